@@ -15,6 +15,7 @@
 # HAVE_INTEL_PCLMUL
 # HAVE_INTEL_SSE4_1
 # HAVE_INTEL_SSE4_2
+# HAVE_INTEL_VPCLMULQDQ
 #
 # HAVE_PPC64LE
 # HAVE_PPC64
@@ -88,6 +89,9 @@ elseif(CMAKE_SYSTEM_PROCESSOR MATCHES "i386|i686|amd64|x86_64|AMD64")
       if(HAVE_INTEL_SSE4_2)
         set(SIMD_COMPILE_FLAGS "${SIMD_COMPILE_FLAGS} -msse4.2")
       endif()
+      # only enabled per function and picked at runtime, so it is not
+      # added to SIMD_COMPILE_FLAGS
+      CHECK_C_COMPILER_FLAG(-mvpclmulqdq HAVE_INTEL_VPCLMULQDQ)
     endif(CMAKE_SYSTEM_PROCESSOR MATCHES "amd64|x86_64|AMD64")
   endif(CMAKE_SYSTEM_PROCESSOR MATCHES "i686|amd64|x86_64|AMD64")
 elseif(CMAKE_SYSTEM_PROCESSOR MATCHES "(powerpc|ppc)")
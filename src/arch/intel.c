@@ -23,6 +23,7 @@ int ceph_arch_intel_ssse3 = 0;
 int ceph_arch_intel_sse3 = 0;
 int ceph_arch_intel_sse2 = 0;
 int ceph_arch_intel_aesni = 0;
+int ceph_arch_intel_vpclmul = 0;
 
 #ifdef __x86_64__
 #include <cpuid.h>
@@ -36,6 +37,31 @@ int ceph_arch_intel_aesni = 0;
 #define CPUID_SSE3	(1)
 #define CPUID_SSE2	(1 << 26)
 #define CPUID_AESNI (1 << 25)
+#define CPUID_OSXSAVE	(1 << 27)
+
+/* leaf 7, subleaf 0 */
+#define CPUID7_EBX_AVX512F	(1 << 16)
+#define CPUID7_EBX_AVX512VL	(1u << 31)
+#define CPUID7_ECX_VPCLMULQDQ	(1 << 10)
+
+/* XCR0: the os saves the sse, avx, opmask and zmm registers */
+#define XCR0_AVX512	0xe6
+
+static int ceph_arch_intel_probe_avx512_vpclmul(unsigned int ecx1)
+{
+	unsigned int eax, ebx, ecx, edx;
+	unsigned int xcr0_lo, xcr0_hi;
+
+	if ((ecx1 & CPUID_OSXSAVE) == 0)
+		return 0;
+	__asm__("xgetbv" : "=a"(xcr0_lo), "=d"(xcr0_hi) : "c"(0));
+	if ((xcr0_lo & XCR0_AVX512) != XCR0_AVX512)
+		return 0;
+	if (!__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx))
+		return 0;
+	return (ebx & CPUID7_EBX_AVX512F) && (ebx & CPUID7_EBX_AVX512VL) &&
+		(ecx & CPUID7_ECX_VPCLMULQDQ);
+}
 
 int ceph_arch_intel_probe(void)
 {
@@ -65,6 +91,9 @@ int ceph_arch_intel_probe(void)
   if ((ecx & CPUID_AESNI) != 0) {
           ceph_arch_intel_aesni = 1;
   }
+	if (ceph_arch_intel_pclmul && ceph_arch_intel_probe_avx512_vpclmul(ecx)) {
+		ceph_arch_intel_vpclmul = 1;
+	}
 
 	return 0;
 }
@@ -18,6 +18,7 @@
 #include <unistd.h>
 
 #include "BlockDevice.h"
+#include "emulated/EmulatedDevice.h"
 
 #if defined(HAVE_LIBAIO) || defined(HAVE_POSIXAIO)
 #include "kernel/KernelDevice.h"
@@ -120,6 +121,9 @@ BlockDevice::detect_device_type(const std::string& path)
 BlockDevice::block_device_t
 BlockDevice::device_type_from_name(const std::string& blk_dev_name)
 {
+  if (blk_dev_name == "emulated") {
+    return block_device_t::emulated;
+  }
 #if defined(HAVE_LIBAIO) || defined(HAVE_POSIXAIO)
   if (blk_dev_name == "aio") {
     return block_device_t::aio;
@@ -144,6 +148,8 @@ BlockDevice* BlockDevice::create_with_type(block_device_t device_type,
 {
 
   switch (device_type) {
+  case block_device_t::emulated:
+    return new EmulatedDevice(cct, cb, cbpriv);
 #if defined(HAVE_LIBAIO) || defined(HAVE_POSIXAIO)
   case block_device_t::aio:
     return new KernelDevice(cct, cb, cbpriv, d_cb, d_cbpriv, dev_name);
@@ -158,6 +158,7 @@ private:
   std::atomic_int ioc_reap_count = {0};
   enum class block_device_t {
     unknown,
+    emulated,
 #if defined(HAVE_LIBAIO) || defined(HAVE_POSIXAIO)
     aio,
 #endif
@@ -0,0 +1,522 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cmath>
+#include <cstring>
+#include <thread>
+
+#include "EmulatedDevice.h"
+#include "common/debug.h"
+#include "common/errno.h"
+#include "include/compat.h"
+#include "include/intarith.h"
+#include "include/stringify.h"
+#include "include/types.h"
+
+#define dout_context cct
+#define dout_subsys ceph_subsys_bdev
+#undef dout_prefix
+#define dout_prefix *_dout << "bdev-emul(" << this << " " << path << ") "
+
+using std::map;
+using std::string;
+using ceph::bufferlist;
+using ceph::mono_clock;
+
+/// sparse in-memory device image, allocated on first write
+struct EmulatedDevice::ram_store_t {
+  static constexpr uint64_t CHUNK = 1ull << 16;
+  const uint64_t size;
+  ceph::mutex lock = ceph::make_mutex("EmulatedDevice::ram_store_t::lock");
+  map<uint64_t, std::unique_ptr<char[]>> chunks;
+
+  explicit ram_store_t(uint64_t size) : size(size) {}
+
+  void read(uint64_t off, uint64_t len, char *buf) {
+    std::lock_guard l(lock);
+    while (len > 0) {
+      uint64_t coff = off % CHUNK;
+      uint64_t n = std::min(len, CHUNK - coff);
+      auto p = chunks.find(off / CHUNK);
+      if (p == chunks.end()) {
+	memset(buf, 0, n);
+      } else {
+	memcpy(buf, p->second.get() + coff, n);
+      }
+      off += n;
+      buf += n;
+      len -= n;
+    }
+  }
+  void write(uint64_t off, const char *buf, uint64_t len) {
+    std::lock_guard l(lock);
+    while (len > 0) {
+      uint64_t coff = off % CHUNK;
+      uint64_t n = std::min(len, CHUNK - coff);
+      auto& chunk = chunks[off / CHUNK];
+      if (!chunk) {
+	chunk.reset(new char[CHUNK]());
+      }
+      memcpy(chunk.get() + coff, buf, n);
+      off += n;
+      buf += n;
+      len -= n;
+    }
+  }
+};
+
+ceph::mutex EmulatedDevice::ram_stores_lock =
+  ceph::make_mutex("EmulatedDevice::ram_stores_lock");
+map<string, std::shared_ptr<EmulatedDevice::ram_store_t>>
+  EmulatedDevice::ram_stores;
+
+EmulatedDevice::EmulatedDevice(CephContext *cct, aio_callback_t cb,
+			       void *cbpriv)
+  : BlockDevice(cct, cb, cbpriv),
+    completion_thread(this)
+{
+}
+
+EmulatedDevice::~EmulatedDevice()
+{
+  ceph_assert(fd < 0);
+}
+
+int EmulatedDevice::_lock()
+{
+  if (!lock_exclusive) {
+    return 0;
+  }
+  if (::flock(fd, LOCK_EX | LOCK_NB) < 0) {
+    int r = -errno;
+    derr << __func__ << " flock failed on " << path << ": "
+	 << cpp_strerror(r) << dendl;
+    return r;
+  }
+  return 0;
+}
+
+int EmulatedDevice::open(const string& p)
+{
+  path = p;
+  dout(1) << __func__ << " path " << path << dendl;
+
+  fd = ::open(path.c_str(), O_RDWR | O_CLOEXEC);
+  if (fd < 0) {
+    int r = -errno;
+    derr << __func__ << " open got: " << cpp_strerror(r) << dendl;
+    return r;
+  }
+  int r = _lock();
+  if (r < 0) {
+    VOID_TEMP_FAILURE_RETRY(::close(fd));
+    fd = -1;
+    return r;
+  }
+  // works for block devices and regular files alike
+  off_t end = ::lseek(fd, 0, SEEK_END);
+  if (end < 0) {
+    r = -errno;
+    derr << __func__ << " lseek got: " << cpp_strerror(r) << dendl;
+    VOID_TEMP_FAILURE_RETRY(::close(fd));
+    fd = -1;
+    return r;
+  }
+  block_size = cct->_conf->bdev_block_size;
+  size = p2align<uint64_t>(end, block_size);
+  optimal_io_size = 0;
+  support_discard = false;
+  rotational = cct->_conf.get_val<bool>("bdev_emulated_rotational");
+
+  if (cct->_conf.get_val<string>("bdev_emulated_backend") == "ram") {
+    std::lock_guard l(ram_stores_lock);
+    auto& store = ram_stores[path];
+    if (!store || store->size != size) {
+      store = std::make_shared<ram_store_t>(size);
+    }
+    ram = store;
+  }
+
+  auto us = [this](const char *name) {
+    return duration(std::chrono::microseconds(
+      cct->_conf.get_val<uint64_t>(name)));
+  };
+  auto secs = [this](const char *name) {
+    return std::chrono::duration_cast<duration>(
+      std::chrono::duration<double>(cct->_conf.get_val<double>(name)));
+  };
+  read_latency = us("bdev_emulated_read_latency_us");
+  write_latency = us("bdev_emulated_write_latency_us");
+  flush_latency = us("bdev_emulated_flush_latency_us");
+  seek_latency = us("bdev_emulated_seek_latency_us");
+  bandwidth = cct->_conf.get_val<Option::size_t>("bdev_emulated_bandwidth");
+  queue_depth = cct->_conf.get_val<uint64_t>("bdev_emulated_queue_depth");
+  stall_interval = secs("bdev_emulated_stall_interval");
+  stall_duration = secs("bdev_emulated_stall_duration");
+  sigma = cct->_conf.get_val<double>("bdev_emulated_latency_sigma");
+  auto d = cct->_conf.get_val<string>("bdev_emulated_latency_distribution");
+  if (d == "uniform") {
+    dist = dist_t::UNIFORM;
+  } else if (d == "exponential") {
+    dist = dist_t::EXPONENTIAL;
+  } else if (d == "lognormal") {
+    dist = dist_t::LOGNORMAL;
+  } else {
+    dist = dist_t::FIXED;
+  }
+
+  rng.seed(cct->_conf.get_val<uint64_t>("bdev_emulated_seed"));
+  opened = mono_clock::now();
+  bw_busy_until = opened;
+  last_end = 0;
+  slots = {};
+  stop = false;
+  completion_thread.create("bdev_emul");
+
+  dout(1) << __func__ << " size " << size
+	  << " (0x" << std::hex << size << std::dec << ", "
+	  << byte_u_t(size) << ")"
+	  << " block_size " << block_size
+	  << " backend " << (ram ? "ram" : "file")
+	  << " distribution " << d
+	  << " read " << read_latency
+	  << " write " << write_latency
+	  << " bandwidth " << bandwidth
+	  << " queue_depth " << queue_depth
+	  << dendl;
+  return 0;
+}
+
+void EmulatedDevice::close()
+{
+  dout(1) << __func__ << dendl;
+  {
+    std::lock_guard l(lock);
+    stop = true;
+    cond.notify_all();
+  }
+  completion_thread.join();
+  ceph_assert(pending.empty());
+  ram.reset();
+  VOID_TEMP_FAILURE_RETRY(::close(fd));
+  fd = -1;
+  path.clear();
+}
+
+int EmulatedDevice::collect_metadata(const string& prefix,
+				     map<string,string> *pm) const
+{
+  (*pm)[prefix + "support_discard"] = stringify((int)(bool)support_discard);
+  (*pm)[prefix + "rotational"] = stringify((int)(bool)rotational);
+  (*pm)[prefix + "size"] = stringify(get_size());
+  (*pm)[prefix + "block_size"] = stringify(get_block_size());
+  (*pm)[prefix + "driver"] = "EmulatedDevice";
+  (*pm)[prefix + "type"] = rotational ? "hdd" : "ssd";
+  (*pm)[prefix + "emulated_backend"] = ram ? "ram" : "file";
+  (*pm)[prefix + "path"] = path;
+  return 0;
+}
+
+EmulatedDevice::duration EmulatedDevice::_draw_latency(duration mean)
+{
+  if (mean == duration::zero()) {
+    return mean;
+  }
+  double m = std::chrono::duration<double>(mean).count();
+  double v = m;
+  switch (dist) {
+  case dist_t::FIXED:
+    break;
+  case dist_t::UNIFORM:
+    v = std::uniform_real_distribution<double>(0, 2 * m)(rng);
+    break;
+  case dist_t::EXPONENTIAL:
+    v = std::exponential_distribution<double>(1 / m)(rng);
+    break;
+  case dist_t::LOGNORMAL:
+    // parametrized so that the mean stays m whatever the spread
+    v = std::lognormal_distribution<double>(
+      std::log(m) - sigma * sigma / 2, sigma)(rng);
+    break;
+  }
+  return std::chrono::duration_cast<duration>(std::chrono::duration<double>(v));
+}
+
+// Returns when an io issued now completes.  Called with lock held.
+EmulatedDevice::time_point EmulatedDevice::_schedule(
+  bool write, uint64_t off, uint64_t len)
+{
+  time_point start = mono_clock::now();
+  if (queue_depth) {
+    if (slots.size() >= queue_depth) {
+      // wait for the earliest io in service to leave
+      start = std::max(start, slots.top());
+      slots.pop();
+    }
+  }
+  if (stall_interval > duration::zero() &&
+      stall_duration > duration::zero()) {
+    // the last stall_duration of each stall_interval is a stall
+    auto phase = (start - opened) % stall_interval;
+    if (phase >= stall_interval - stall_duration) {
+      start += stall_interval - phase;
+    }
+  }
+  duration latency = _draw_latency(write ? write_latency : read_latency);
+  if (off != last_end) {
+    latency += seek_latency;
+  }
+  last_end = off + len;
+  time_point done;
+  if (bandwidth) {
+    auto xfer = std::chrono::duration_cast<duration>(
+      std::chrono::duration<double>((double)len / bandwidth));
+    bw_busy_until = std::max(start, bw_busy_until) + xfer;
+    done = bw_busy_until + latency;
+  } else {
+    done = start + latency;
+  }
+  if (queue_depth) {
+    slots.push(done);
+  }
+  dout(30) << __func__ << (write ? " write" : " read")
+	   << " 0x" << std::hex << off << "~" << len << std::dec
+	   << " in " << (done - mono_clock::now()) << dendl;
+  return done;
+}
+
+void EmulatedDevice::_wait_until(time_point t)
+{
+  auto now = mono_clock::now();
+  if (t > now) {
+    std::this_thread::sleep_for(t - now);
+  }
+}
+
+int EmulatedDevice::_do_read(uint64_t off, uint64_t len, char *buf)
+{
+  if (ram) {
+    ram->read(off, len, buf);
+    return 0;
+  }
+  while (len > 0) {
+    ssize_t r = ::pread(fd, buf, len, off);
+    if (r < 0) {
+      if (errno == EINTR) {
+	continue;
+      }
+      r = -errno;
+      derr << __func__ << " 0x" << std::hex << off << "~" << len << std::dec
+	   << " error: " << cpp_strerror(r) << dendl;
+      return r;
+    }
+    if (r == 0) {
+      // sparse tail of the file
+      memset(buf, 0, len);
+      break;
+    }
+    off += r;
+    buf += r;
+    len -= r;
+  }
+  return 0;
+}
+
+int EmulatedDevice::_do_write(uint64_t off, const bufferlist& bl)
+{
+  if (ram) {
+    for (auto& p : bl.buffers()) {
+      ram->write(off, p.c_str(), p.length());
+      off += p.length();
+    }
+    return 0;
+  }
+  int r = bl.write_fd(fd, off);
+  if (r < 0) {
+    derr << __func__ << " 0x" << std::hex << off << "~" << bl.length()
+	 << std::dec << " error: " << cpp_strerror(r) << dendl;
+  }
+  return r;
+}
+
+void EmulatedDevice::_completion_thread()
+{
+  dout(10) << __func__ << " start" << dendl;
+  std::unique_lock l(lock);
+  // drain everything in flight before stopping
+  while (!stop || !running.empty()) {
+    if (running.empty()) {
+      cond.wait(l);
+      continue;
+    }
+    auto now = mono_clock::now();
+    if (running.top().done > now) {
+      cond.wait_for(l, running.top().done - now);
+      continue;
+    }
+    IOContext *ioc = running.top().ioc;
+    running.pop();
+    l.unlock();
+    // NOTE: once num_running and we either call the callback or
+    // call aio_wake we cannot touch ioc as the caller may free it.
+    if (ioc->priv) {
+      if (--ioc->num_running == 0) {
+	aio_callback(aio_callback_priv, ioc->priv);
+      }
+    } else {
+      ioc->try_aio_wake();
+    }
+    l.lock();
+  }
+  dout(10) << __func__ << " end" << dendl;
+}
+
+void EmulatedDevice::aio_submit(IOContext *ioc)
+{
+  dout(20) << __func__ << " ioc " << ioc
+	   << " pending " << ioc->num_pending.load()
+	   << " running " << ioc->num_running.load()
+	   << dendl;
+  if (ioc->num_pending.load() == 0) {
+    return;
+  }
+  std::lock_guard l(lock);
+  auto p = pending.find(ioc);
+  ceph_assert(p != pending.end());
+  int n = p->second.size();
+  ioc->num_pending -= n;
+  ioc->num_running += n;
+  for (auto& io : p->second) {
+    io.done = _schedule(io.write, io.offset, io.length);
+    running.push(io);
+  }
+  pending.erase(p);
+  cond.notify_all();
+}
+
+int EmulatedDevice::read(uint64_t off, uint64_t len, bufferlist *pbl,
+			 IOContext *ioc,
+			 bool buffered)
+{
+  dout(5) << __func__ << " 0x" << std::hex << off << "~" << len << std::dec
+	  << dendl;
+  ceph_assert(is_valid_io(off, len));
+  auto p = ceph::buffer::create_small_page_aligned(len);
+  int r = _do_read(off, len, p.c_str());
+  if (r < 0) {
+    return r;
+  }
+  time_point done;
+  {
+    std::lock_guard l(lock);
+    done = _schedule(false, off, len);
+  }
+  _wait_until(done);
+  pbl->push_back(std::move(p));
+  return 0;
+}
+
+int EmulatedDevice::aio_read(uint64_t off, uint64_t len, bufferlist *pbl,
+			     IOContext *ioc)
+{
+  dout(5) << __func__ << " 0x" << std::hex << off << "~" << len << std::dec
+	  << dendl;
+  ceph_assert(is_valid_io(off, len));
+  auto p = ceph::buffer::create_small_page_aligned(len);
+  int r = _do_read(off, len, p.c_str());
+  if (r < 0) {
+    return r;
+  }
+  pbl->push_back(std::move(p));
+  std::lock_guard l(lock);
+  pending[ioc].push_back(emul_io_t{time_point(), ioc, off, len, false});
+  ++ioc->num_pending;
+  return 0;
+}
+
+int EmulatedDevice::read_random(uint64_t off, uint64_t len, char *buf,
+				bool buffered)
+{
+  dout(5) << __func__ << " 0x" << std::hex << off << "~" << len << std::dec
+	  << dendl;
+  ceph_assert(len > 0);
+  ceph_assert(off < size);
+  ceph_assert(off + len <= size);
+  int r = _do_read(off, len, buf);
+  if (r < 0) {
+    return r;
+  }
+  time_point done;
+  {
+    std::lock_guard l(lock);
+    done = _schedule(false, off, len);
+  }
+  _wait_until(done);
+  return 0;
+}
+
+int EmulatedDevice::write(uint64_t off, bufferlist& bl, bool buffered,
+			  int write_hint)
+{
+  uint64_t len = bl.length();
+  dout(5) << __func__ << " 0x" << std::hex << off << "~" << len << std::dec
+	  << dendl;
+  ceph_assert(is_valid_io(off, len));
+  int r = _do_write(off, bl);
+  if (r < 0) {
+    return r;
+  }
+  time_point done;
+  {
+    std::lock_guard l(lock);
+    done = _schedule(true, off, len);
+  }
+  _wait_until(done);
+  return 0;
+}
+
+int EmulatedDevice::aio_write(uint64_t off, bufferlist& bl, IOContext *ioc,
+			      bool buffered, int write_hint)
+{
+  uint64_t len = bl.length();
+  dout(5) << __func__ << " 0x" << std::hex << off << "~" << len << std::dec
+	  << dendl;
+  ceph_assert(is_valid_io(off, len));
+  int r = _do_write(off, bl);
+  if (r < 0) {
+    return r;
+  }
+  std::lock_guard l(lock);
+  pending[ioc].push_back(emul_io_t{time_point(), ioc, off, len, true});
+  ++ioc->num_pending;
+  return 0;
+}
+
+int EmulatedDevice::flush()
+{
+  // the backing file is not synced: durability is not what is being
+  // emulated, and a real fdatasync would add the host's own latency
+  if (flush_latency > duration::zero()) {
+    std::this_thread::sleep_for(flush_latency);
+  }
+  return 0;
+}
+
+int EmulatedDevice::invalidate_cache(uint64_t off, uint64_t len)
+{
+  return 0;
+}
@@ -0,0 +1,146 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#ifndef CEPH_BLK_EMULATEDDEVICE_H
+#define CEPH_BLK_EMULATEDDEVICE_H
+
+#include <map>
+#include <memory>
+#include <queue>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "common/Thread.h"
+#include "common/ceph_time.h"
+#include "BlockDevice.h"
+
+/**
+ * EmulatedDevice
+ *
+ * A block device with a synthetic service time model, for reproducing the
+ * behaviour of slow or jittery media (HDD, QLC, tail latency heavy
+ * devices) on any box.  Data lives in a regular file or, with
+ * bdev_emulated_backend=ram, in memory sized after that file.
+ *
+ * Data is transferred when an io is issued; only its completion is
+ * delayed.  The completion time of every io is computed from
+ *  - a per-io latency drawn from a fixed, uniform, exponential or
+ *    lognormal distribution, plus a seek penalty for non-sequential ios,
+ *  - a shared transfer bandwidth cap,
+ *  - a queue depth limit: at most that many ios are in service at once,
+ *  - periodic stalls during which no io is serviced.
+ * The random source is seeded by bdev_emulated_seed, so a given io
+ * sequence always sees the same service times.
+ *
+ * Selected with bdev_type=emulated.
+ */
+class EmulatedDevice : public BlockDevice {
+  typedef ceph::mono_clock::time_point time_point;
+  typedef ceph::mono_clock::duration duration;
+
+  struct emul_io_t {
+    time_point done;
+    IOContext *ioc;
+    uint64_t offset;
+    uint64_t length;
+    bool write;
+    bool operator>(const emul_io_t& o) const {
+      return done > o.done;
+    }
+  };
+
+  /// in-memory backing store, looked up by path so that it survives
+  /// close() and open() within the process, like a file would
+  struct ram_store_t;
+  static ceph::mutex ram_stores_lock;
+  static std::map<std::string, std::shared_ptr<ram_store_t>> ram_stores;
+
+  std::string path;
+  int fd = -1;
+  std::shared_ptr<ram_store_t> ram;
+
+  // service time model, read on open()
+  enum class dist_t { FIXED, UNIFORM, EXPONENTIAL, LOGNORMAL };
+  dist_t dist = dist_t::FIXED;
+  double sigma = 1.0;
+  duration read_latency{0};
+  duration write_latency{0};
+  duration flush_latency{0};
+  duration seek_latency{0};
+  uint64_t bandwidth = 0;       ///< bytes/sec, 0 is unlimited
+  uint64_t queue_depth = 0;     ///< 0 is unlimited
+  duration stall_interval{0};
+  duration stall_duration{0};
+
+  ceph::mutex lock = ceph::make_mutex("EmulatedDevice::lock");
+  ceph::condition_variable cond;
+  std::mt19937_64 rng;
+  time_point opened;
+  time_point bw_busy_until;     ///< end of the last scheduled transfer
+  uint64_t last_end = 0;        ///< end offset of the last io, for seeks
+  /// completion times of the ios in service, at most queue_depth of them
+  std::priority_queue<time_point, std::vector<time_point>,
+		      std::greater<time_point>> slots;
+  std::map<IOContext*, std::vector<emul_io_t>> pending;
+  std::priority_queue<emul_io_t, std::vector<emul_io_t>,
+		      std::greater<emul_io_t>> running;
+  bool stop = false;
+
+  struct CompletionThread : public Thread {
+    EmulatedDevice *bdev;
+    explicit CompletionThread(EmulatedDevice *b) : bdev(b) {}
+    void *entry() override {
+      bdev->_completion_thread();
+      return NULL;
+    }
+  } completion_thread;
+
+  void _completion_thread();
+  duration _draw_latency(duration mean);
+  time_point _schedule(bool write, uint64_t off, uint64_t len);
+  int _do_read(uint64_t off, uint64_t len, char *buf);
+  int _do_write(uint64_t off, const ceph::buffer::list& bl);
+  void _wait_until(time_point t);
+  int _lock();
+
+public:
+  EmulatedDevice(CephContext *cct, aio_callback_t cb, void *cbpriv);
+  ~EmulatedDevice() override;
+
+  void aio_submit(IOContext *ioc) override;
+
+  int collect_metadata(const std::string& prefix,
+		       std::map<std::string,std::string> *pm) const override;
+
+  int read(uint64_t off, uint64_t len, ceph::buffer::list *pbl,
+	   IOContext *ioc,
+	   bool buffered) override;
+  int aio_read(uint64_t off, uint64_t len, ceph::buffer::list *pbl,
+	       IOContext *ioc) override;
+  int read_random(uint64_t off, uint64_t len, char *buf,
+		  bool buffered) override;
+
+  int write(uint64_t off, ceph::buffer::list& bl, bool buffered,
+	    int write_hint = WRITE_LIFE_NOT_SET) override;
+  int aio_write(uint64_t off, ceph::buffer::list& bl,
+		IOContext *ioc,
+		bool buffered,
+		int write_hint = WRITE_LIFE_NOT_SET) override;
+  int flush() override;
+
+  int invalidate_cache(uint64_t off, uint64_t len) override;
+  int open(const std::string& path) override;
+  void close() override;
+};
+
+#endif
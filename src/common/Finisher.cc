@@ -137,3 +137,53 @@ void *Finisher::finisher_thread_entry()
   return 0;
 }
 
+ShardedFinisher::ShardedFinisher(CephContext *cct, unsigned num_shards)
+{
+  ceph_assert(num_shards > 0);
+  for (unsigned i = 0; i < num_shards; i++) {
+    shards.push_back(std::make_unique<Finisher>(cct));
+  }
+}
+
+ShardedFinisher::ShardedFinisher(CephContext *cct, unsigned num_shards,
+				 std::string_view name, std::string_view tn)
+{
+  ceph_assert(num_shards > 0);
+  for (unsigned i = 0; i < num_shards; i++) {
+    shards.push_back(std::make_unique<Finisher>(
+      cct,
+      num_shards == 1 ? std::string(name) : fmt::format("{}-{}", name, i),
+      std::string(tn)));
+  }
+}
+
+void ShardedFinisher::start()
+{
+  for (auto& f : shards) {
+    f->start();
+  }
+}
+
+void ShardedFinisher::stop()
+{
+  for (auto& f : shards) {
+    f->stop();
+  }
+}
+
+void ShardedFinisher::wait_for_empty()
+{
+  for (auto& f : shards) {
+    f->wait_for_empty();
+  }
+}
+
+bool ShardedFinisher::is_empty()
+{
+  for (auto& f : shards) {
+    if (!f->is_empty()) {
+      return false;
+    }
+  }
+  return true;
+}
@@ -17,6 +17,7 @@
 
 #include <atomic>
 #include <list>
+#include <memory>
 #include <mutex>
 #include <string>
 #include <vector>
@@ -132,6 +133,65 @@ class Finisher {
   ~Finisher();
 };
 
+/** @brief Finisher completing Contexts on several worker threads.
+ * Every Context is queued with a key, such as a PG, an image or an object,
+ * and completed by the shard the key maps to.  Contexts queued with the
+ * same key complete in the order they were queued, those of different keys
+ * may complete concurrently and in any order.
+ */
+class ShardedFinisher {
+  std::vector<std::unique_ptr<Finisher>> shards;
+
+public:
+  /// Construct anonymous shards.
+  ShardedFinisher(CephContext *cct, unsigned num_shards);
+
+  /// Construct named shards, which log their queue length.  A single
+  /// shard is named as a Finisher would be, others get their index
+  /// appended to name.
+  ShardedFinisher(CephContext *cct, unsigned num_shards,
+		  std::string_view name, std::string_view tn);
+
+  ShardedFinisher(const ShardedFinisher&) = delete;
+  ShardedFinisher& operator=(const ShardedFinisher&) = delete;
+
+  unsigned get_num_shards() const {
+    return shards.size();
+  }
+
+  /// The shard completing the Contexts queued with key.
+  Finisher& get_shard(uint64_t key) {
+    if (shards.size() == 1) {
+      return *shards.front();
+    }
+    // keys are often aligned pointers or small sequential ids, mix them
+    const uint64_t h = (key * 0x9e3779b97f4a7c15ull) >> 32;
+    return *shards[h % shards.size()];
+  }
+
+  /// Add a context to complete after the ones queued before with key.
+  void queue(uint64_t key, Context *c, int r = 0) {
+    get_shard(key).queue(c, r);
+  }
+
+  template<typename T>
+  auto queue(uint64_t key, T &ls) -> decltype(std::distance(ls.begin(), ls.end()), void()) {
+    get_shard(key).queue(ls);
+  }
+
+  /// Start the worker threads.
+  void start();
+
+  /// Stop the worker threads, see Finisher::stop().
+  void stop();
+
+  /// Blocks until every shard in turn has nothing left to process.
+  /// Contexts queueing to a shard already waited for are not waited for.
+  void wait_for_empty();
+
+  bool is_empty();
+};
+
 /// Context that is completed asynchronously on the supplied finisher.
 class C_OnFinisher : public Context {
   Context *con;
@@ -20,8 +20,6 @@
 #undef dout_prefix
 #define dout_prefix *_dout << "timer(" << this << ")."
 
-using std::pair;
-
 using ceph::operator <<;
 
 template <class Mutex>
@@ -82,30 +80,19 @@ void CommonSafeTimer<Mutex>::timer_thread()
   ldout(cct,10) << "timer_thread starting" << dendl;
   while (!stopping) {
     auto now = clock_t::now();
-
-    while (!schedule.empty()) {
-      auto p = schedule.begin();
-
-      // is the future now?
-      #if defined(_WIN32)
-      if (p->first - now > std::chrono::milliseconds(1)) {
-        // std::condition_variable::wait_for uses SleepConditionVariableSRW
-        // on Windows, which has millisecond precision. Deltas <1ms will
-        // lead to busy loops, which should be avoided. This situation is
-        // quite common since "wait_for" often returns ~1ms earlier than
-        // requested.
-        break;
-      }
-      #else // !_WIN32
-      if (p->first > now) {
-        break;
-      }
-      #endif
-
-      ldout(cct, 20) << "timer_thread going to execute and remove the top of a schedule sized " << schedule.size() << dendl;
-      Context *callback = p->second;
-      events.erase(callback);
-      schedule.erase(p);
+    #if defined(_WIN32)
+    // std::condition_variable::wait_for uses SleepConditionVariableSRW
+    // on Windows, which has millisecond precision. Deltas <1ms will
+    // lead to busy loops, which should be avoided. This situation is
+    // quite common since "wait_for" often returns ~1ms earlier than
+    // requested.
+    now += std::chrono::milliseconds(1);
+    #endif
+
+    // is the future now?
+    while (auto expired = schedule.pop_expired(now)) {
+      Context *callback = *expired;
+      ldout(cct, 20) << "timer_thread going to execute the top of a schedule sized " << schedule.size() << dendl;
       ldout(cct,10) << "timer_thread executing " << callback << dendl;
       
       if (!safe_callbacks) {
@@ -126,7 +113,7 @@ void CommonSafeTimer<Mutex>::timer_thread()
       cond.wait(l);
     } else {
       ldout(cct, 20) << "timer_thread going to sleep with a schedule size " << schedule.size() << dendl;
-      auto when = schedule.begin()->first;
+      auto when = schedule.next_expiry();
       cond.wait_until(l, when);
     }
     ldout(cct,20) << "timer_thread awake" << dendl;
@@ -159,18 +146,15 @@ Context* CommonSafeTimer<Mutex>::add_event_at(CommonSafeTimer<Mutex>::clock_t::t
     delete callback;
     return nullptr;
   }
-  scheduled_map_t::value_type s_val(when, callback);
-  scheduled_map_t::iterator i = schedule.insert(s_val);
-
-  event_lookup_map_t::value_type e_val(callback, i);
-  pair < event_lookup_map_t::iterator, bool > rval(events.insert(e_val));
+  const auto next = schedule.next_expiry();
+  const bool added = schedule.add(when, callback);
 
   /* If you hit this, you tried to insert the same Context* twice. */
-  ceph_assert(rval.second);
+  ceph_assert(added);
 
-  /* If the event we have just inserted comes before everything else, we need to
-   * adjust our timeout. */
-  if (i == schedule.begin())
+  /* If the event we have just inserted comes before the timer thread
+   * would wake up, we need to adjust our timeout. */
+  if (when < next)
     cond.notify_all();
   return callback;
 }
@@ -193,17 +177,15 @@ bool CommonSafeTimer<Mutex>::cancel_event(Context *callback)
 {
   ceph_assert(ceph_mutex_is_locked(lock));
   
-  auto p = events.find(callback);
-  if (p == events.end()) {
+  auto when = schedule.get(callback);
+  if (!when) {
     ldout(cct,10) << "cancel_event " << callback << " not found" << dendl;
     return false;
   }
 
-  ldout(cct,10) << "cancel_event " << p->second->first << " -> " << callback << dendl;
-  delete p->first;
-
-  schedule.erase(p->second);
-  events.erase(p);
+  ldout(cct,10) << "cancel_event " << *when << " -> " << callback << dendl;
+  schedule.remove(callback);
+  delete callback;
   return true;
 }
 
@@ -213,13 +195,10 @@ void CommonSafeTimer<Mutex>::cancel_all_events()
   ldout(cct,10) << "cancel_all_events" << dendl;
   ceph_assert(ceph_mutex_is_locked(lock));
 
-  while (!events.empty()) {
-    auto p = events.begin();
-    ldout(cct,10) << " cancelled " << p->second->first << " -> " << p->first << dendl;
-    delete p->first;
-    schedule.erase(p->second);
-    events.erase(p);
-  }
+  schedule.clear([this](clock_t::time_point when, Context *callback) {
+    ldout(cct,10) << " cancelled " << when << " -> " << callback << dendl;
+    delete callback;
+  });
 }
 
 template <class Mutex>
@@ -229,10 +208,9 @@ void CommonSafeTimer<Mutex>::dump(const char *caller) const
     caller = "";
   ldout(cct,10) << "dump " << caller << dendl;
 
-  for (scheduled_map_t::const_iterator s = schedule.begin();
-       s != schedule.end();
-       ++s)
-    ldout(cct,10) << " " << s->first << "->" << s->second << dendl;
+  schedule.for_each([this](clock_t::time_point when, Context *callback) {
+    ldout(cct,10) << " " << when << "->" << callback << dendl;
+  });
 }
 
 template class CommonSafeTimer<ceph::mutex>;
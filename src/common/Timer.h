@@ -15,11 +15,11 @@
 #ifndef CEPH_TIMER_H
 #define CEPH_TIMER_H
 
-#include <map>
 #include "include/common_fwd.h"
 #include "ceph_time.h"
 #include "ceph_mutex.h"
 #include "fair_mutex.h"
+#include "timer_wheel.h"
 #include <condition_variable>
 
 class Context;
@@ -41,10 +41,8 @@ class CommonSafeTimer
   void _shutdown();
 
   using clock_t = ceph::mono_clock;
-  using scheduled_map_t = std::multimap<clock_t::time_point, Context*>;
-  scheduled_map_t schedule;
-  using event_lookup_map_t = std::map<Context*, scheduled_map_t::iterator>;
-  event_lookup_map_t events;
+  using schedule_t = ceph::timer_wheel<clock_t, Context*>;
+  schedule_t schedule;
   bool stopping;
 
   void dump(const char *caller = 0) const;
@@ -2080,12 +2080,42 @@ __u32 buffer::list::crc32c(__u32 crc) const
   int cache_hits = 0;
   int cache_adjusts = 0;
 
+  // fragments without a cached crc are gathered and computed together,
+  // the first one from the running crc and the others from 0, so that
+  // the implementation can work on several streams at once.  the partial
+  // crcs are then chained in order with ceph_crc32c_combine().
+  constexpr unsigned max_batch = 8;
+  const ptr_node* batch[max_batch];
+  const unsigned char* batch_data[max_batch];
+  unsigned batch_len[max_batch];
+  uint32_t batch_crc[max_batch];
+  unsigned batched = 0;
+  auto flush_batch = [&] {
+    if (!batched) {
+      return;
+    }
+    ceph_crc32c_multi(batch_crc, batch_data, batch_len, batched);
+    for (unsigned i = 0; i < batched; i++) {
+      const ptr_node& node = *batch[i];
+      pair<size_t, size_t> ofs(node.offset(), node.offset() + node.length());
+      if (i == 0) {
+	node._raw->set_crc(ofs, make_pair(crc, batch_crc[0]));
+	crc = batch_crc[0];
+      } else {
+	node._raw->set_crc(ofs, make_pair(0u, batch_crc[i]));
+	crc = ceph_crc32c_combine(crc, batch_crc[i], batch_len[i]);
+      }
+    }
+    batched = 0;
+  };
+
   for (const auto& node : _buffers) {
     if (node.length()) {
       raw* const r = node._raw;
       pair<size_t, size_t> ofs(node.offset(), node.offset() + node.length());
       pair<uint32_t, uint32_t> ccrc;
       if (r->get_crc(ofs, &ccrc)) {
+	flush_batch();
 	if (ccrc.first == crc) {
 	  // got it already
 	  crc = ccrc.second;
@@ -2104,12 +2134,17 @@ __u32 buffer::list::crc32c(__u32 crc) const
 	}
       } else {
 	cache_misses++;
-	uint32_t base = crc;
-	crc = ceph_crc32c(crc, (unsigned char*)node.c_str(), node.length());
-	r->set_crc(ofs, make_pair(base, crc));
+	batch[batched] = &node;
+	batch_data[batched] = (const unsigned char*)node.c_str();
+	batch_len[batched] = node.length();
+	batch_crc[batched] = batched ? 0 : crc;
+	if (++batched == max_batch) {
+	  flush_batch();
+	}
       }
     }
   }
+  flush_batch();
 
   if (buffer_track_crc) {
     if (cache_adjusts)
@@ -9,6 +9,7 @@
 #include "arch/s390x.h"
 #include "common/sctp_crc32.h"
 #include "common/crc32c_intel_fast.h"
+#include "common/crc32c_intel_vpclmul.h"
 #include "common/crc32c_aarch64.h"
 #include "common/crc32c_ppc.h"
 #include "common/crc32c_s390x.h"
@@ -25,6 +26,11 @@ ceph_crc32c_func_t ceph_choose_crc32(void)
   // if the CPU supports it, *and* the fast version is compiled in,
   // use that.
 #if defined(__i386__) || defined(__x86_64__)
+# if defined(HAVE_INTEL_VPCLMULQDQ)
+  if (ceph_arch_intel_sse42 && ceph_arch_intel_vpclmul) {
+    return ceph_crc32c_intel_vpclmul;
+  }
+# endif
   if (ceph_arch_intel_sse42 && ceph_crc32c_intel_fast_exists()) {
     if (ceph_arch_intel_pclmul) {
       return ceph_crc32c_intel_fast_pclmul;
@@ -61,6 +67,37 @@ ceph_crc32c_func_t ceph_choose_crc32(void)
  */
 ceph_crc32c_func_t ceph_crc32c_func = ceph_choose_crc32();
 
+static void ceph_crc32c_multi_generic(uint32_t *crc,
+				      unsigned char const * const *data,
+				      unsigned const *length, unsigned n)
+{
+  for (unsigned i = 0; i < n; i++) {
+    crc[i] = ceph_crc32c(crc[i], data[i], length[i]);
+  }
+}
+
+/*
+ * choose the multi-buffer implementation; the single buffer one above
+ * is used for the streams it does not interleave.
+ */
+ceph_crc32c_multi_func_t ceph_choose_crc32c_multi(void)
+{
+  ceph_arch_probe();
+
+#if defined(__x86_64__) && defined(HAVE_INTEL_VPCLMULQDQ)
+  if (ceph_arch_intel_sse42) {
+    return ceph_crc32c_intel_multi;
+  }
+#elif defined(__aarch64__) && defined(HAVE_ARMV8_CRC)
+  if (ceph_arch_aarch64_crc32) {
+    return ceph_crc32c_aarch64_multi;
+  }
+#endif
+  return ceph_crc32c_multi_generic;
+}
+
+ceph_crc32c_multi_func_t ceph_crc32c_multi_func = ceph_choose_crc32c_multi();
+
 
 /*
  * Look: http://crcutil.googlecode.com/files/crc-doc.1.0.pdf
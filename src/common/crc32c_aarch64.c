@@ -272,3 +272,57 @@ uint32_t ceph_crc32c_aarch64(uint32_t crc, unsigned char const *buffer, unsigned
 	}
 	return crc;
 }
+
+/*
+ * crc32cx is pipelined, so a single stream leaves most of it idle.
+ * Buffers shorter than the 1024 byte blocks ceph_crc32c_aarch64() splits
+ * and merges with PMULL are processed in groups of three instead,
+ * interleaved over their common length.
+ */
+#define MULTI_MAX_LEN	1024
+
+void ceph_crc32c_aarch64_multi(uint32_t *crc, unsigned char const * const *buffer,
+			       unsigned const *len, unsigned n)
+{
+	unsigned idx[3];
+	unsigned pending = 0;
+	unsigned i;
+
+	for (i = 0; i < n; i++) {
+		unsigned char const *p0, *p1, *p2;
+		uint32_t c0, c1, c2;
+		unsigned common, off;
+
+		if (!buffer[i] || len[i] >= MULTI_MAX_LEN) {
+			crc[i] = ceph_crc32c_aarch64(crc[i], buffer[i], len[i]);
+			continue;
+		}
+		idx[pending++] = i;
+		if (pending < 3)
+			continue;
+		pending = 0;
+
+		p0 = buffer[idx[0]];
+		p1 = buffer[idx[1]];
+		p2 = buffer[idx[2]];
+		c0 = crc[idx[0]];
+		c1 = crc[idx[1]];
+		c2 = crc[idx[2]];
+		common = len[idx[0]];
+		if (len[idx[1]] < common)
+			common = len[idx[1]];
+		if (len[idx[2]] < common)
+			common = len[idx[2]];
+		common &= ~7u;
+		for (off = 0; off < common; off += sizeof(uint64_t)) {
+			CRC32CX(c0, *(const uint64_t *)(p0 + off));
+			CRC32CX(c1, *(const uint64_t *)(p1 + off));
+			CRC32CX(c2, *(const uint64_t *)(p2 + off));
+		}
+		crc[idx[0]] = ceph_crc32c_aarch64(c0, p0 + common, len[idx[0]] - common);
+		crc[idx[1]] = ceph_crc32c_aarch64(c1, p1 + common, len[idx[1]] - common);
+		crc[idx[2]] = ceph_crc32c_aarch64(c2, p2 + common, len[idx[2]] - common);
+	}
+	for (i = 0; i < pending; i++)
+		crc[idx[i]] = ceph_crc32c_aarch64(crc[idx[i]], buffer[idx[i]], len[idx[i]]);
+}
@@ -11,6 +11,8 @@ extern "C" {
 #ifdef HAVE_ARMV8_CRC
 
 extern uint32_t ceph_crc32c_aarch64(uint32_t crc, unsigned char const *buffer, unsigned len);
+extern void ceph_crc32c_aarch64_multi(uint32_t *crc, unsigned char const * const *buffer,
+				      unsigned const *len, unsigned n);
 
 #else
 
@@ -19,6 +21,11 @@ static inline uint32_t ceph_crc32c_aarch64(uint32_t crc, unsigned char const *bu
 	return 0;
 }
 
+static inline void ceph_crc32c_aarch64_multi(uint32_t *crc, unsigned char const * const *buffer,
+					     unsigned const *len, unsigned n)
+{
+}
+
 #endif
 
 #ifdef __cplusplus
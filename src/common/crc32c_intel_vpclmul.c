@@ -0,0 +1,203 @@
+#include "acconfig.h"
+#include "common/crc32c_intel_vpclmul.h"
+#include "include/crc32c.h"
+
+#include <immintrin.h>
+#include <string.h>
+
+/*
+ * Carry-less multiplication folding, as described in Intel's "Fast CRC
+ * Computation for Generic Polynomials Using PCLMULQDQ Instruction".
+ *
+ * Each 128 bit lane of the accumulators is moved forward over D bits of
+ * input by multiplying its two halves with x^(D+32) and x^(D-32) mod P,
+ * bit reflected and shifted left by one, and xor-ing the products into
+ * the input found D bits later.  With four 512 bit accumulators D is 2048
+ * bits, i.e. 256 bytes are consumed per iteration.  The folded remainder
+ * is finally reduced with the crc32 instruction.
+ *
+ * As everywhere else in ceph, the crc is neither inverted on the way in
+ * nor on the way out, so the initial value is simply xor-ed into the
+ * first four bytes of the input.
+ */
+
+#define FOLD_K(hi, lo) _mm_set_epi64x(hi, lo)
+
+#define VPCLMUL_TARGET \
+	__attribute__((target("avx512f,avx512vl,vpclmulqdq,pclmul,sse4.2")))
+#define SSE42_TARGET \
+	__attribute__((target("sse4.2")))
+
+/* fold constants, x^(D-32) in the high and x^(D+32) in the low half */
+#define K_2048	FOLD_K(0xb9e02b86, 0xdcb17aa4)
+#define K_512	FOLD_K(0x9e4addf8, 0x740eef02)
+#define K_384	FOLD_K(0x1d82c63da, 0x1c291d04)
+#define K_256	FOLD_K(0xba4fc28e, 0x1384aa63a)
+#define K_128	FOLD_K(0x14cd00bd6, 0xf20c0dfe)
+
+/* below this the interleaved crc32 instruction is faster than folding */
+#define VPCLMUL_MIN_LEN	256
+
+static inline SSE42_TARGET
+uint32_t crc32c_sse42(uint32_t crc, unsigned char const *p, unsigned len)
+{
+	uint64_t c = crc;
+	while (len >= 8) {
+		uint64_t v;
+		memcpy(&v, p, 8);
+		c = _mm_crc32_u64(c, v);
+		p += 8;
+		len -= 8;
+	}
+	crc = (uint32_t)c;
+	while (len--)
+		crc = _mm_crc32_u8(crc, *p++);
+	return crc;
+}
+
+static inline SSE42_TARGET
+uint32_t crc32c_sse42_zeros(uint32_t crc, unsigned len)
+{
+	uint64_t c = crc;
+	while (len >= 8) {
+		c = _mm_crc32_u64(c, 0);
+		len -= 8;
+	}
+	crc = (uint32_t)c;
+	while (len--)
+		crc = _mm_crc32_u8(crc, 0);
+	return crc;
+}
+
+static inline VPCLMUL_TARGET
+__m512i fold512(__m512i x, __m512i k, __m512i next)
+{
+	return _mm512_ternarylogic_epi64(_mm512_clmulepi64_epi128(x, k, 0x00),
+					 _mm512_clmulepi64_epi128(x, k, 0x11),
+					 next, 0x96);
+}
+
+static inline VPCLMUL_TARGET
+__m128i fold128(__m128i x, __m128i k, __m128i next)
+{
+	return _mm_ternarylogic_epi64(_mm_clmulepi64_si128(x, k, 0x00),
+				      _mm_clmulepi64_si128(x, k, 0x11),
+				      next, 0x96);
+}
+
+VPCLMUL_TARGET
+uint32_t ceph_crc32c_intel_vpclmul(uint32_t crc, unsigned char const *buffer, unsigned len)
+{
+	__m512i x, k;
+	__m128i a;
+	uint64_t lo, hi;
+
+	if (!buffer)
+		return crc32c_sse42_zeros(crc, len);
+	if (len < VPCLMUL_MIN_LEN)
+		return crc32c_sse42(crc, buffer, len);
+
+	x = _mm512_xor_si512(_mm512_loadu_si512(buffer),
+			     _mm512_zextsi128_si512(_mm_cvtsi32_si128(crc)));
+	{
+		__m512i x1 = _mm512_loadu_si512(buffer + 64);
+		__m512i x2 = _mm512_loadu_si512(buffer + 128);
+		__m512i x3 = _mm512_loadu_si512(buffer + 192);
+
+		buffer += 256;
+		len -= 256;
+		k = _mm512_broadcast_i32x4(K_2048);
+		while (len >= 256) {
+			x = fold512(x, k, _mm512_loadu_si512(buffer));
+			x1 = fold512(x1, k, _mm512_loadu_si512(buffer + 64));
+			x2 = fold512(x2, k, _mm512_loadu_si512(buffer + 128));
+			x3 = fold512(x3, k, _mm512_loadu_si512(buffer + 192));
+			buffer += 256;
+			len -= 256;
+		}
+		k = _mm512_broadcast_i32x4(K_512);
+		x = fold512(x, k, x1);
+		x = fold512(x, k, x2);
+		x = fold512(x, k, x3);
+	}
+	while (len >= 64) {
+		x = fold512(x, k, _mm512_loadu_si512(buffer));
+		buffer += 64;
+		len -= 64;
+	}
+
+	/* four lanes down to one */
+	a = fold128(_mm512_extracti32x4_epi32(x, 0), K_384,
+		    _mm512_extracti32x4_epi32(x, 3));
+	a = fold128(_mm512_extracti32x4_epi32(x, 1), K_256, a);
+	a = fold128(_mm512_extracti32x4_epi32(x, 2), K_128, a);
+	while (len >= 16) {
+		a = fold128(a, K_128, _mm_loadu_si128((const __m128i *)buffer));
+		buffer += 16;
+		len -= 16;
+	}
+
+	lo = _mm_cvtsi128_si64(a);
+	hi = _mm_extract_epi64(a, 1);
+	crc = (uint32_t)_mm_crc32_u64(_mm_crc32_u64(0, lo), hi);
+	return crc32c_sse42(crc, buffer, len);
+}
+
+/*
+ * The crc32 instruction has a latency of three cycles but can be issued
+ * every cycle, so a single stream only uses a third of it.  Unless they
+ * are long enough for the folding kernel, streams are processed in
+ * groups of three, interleaved over their common length.
+ */
+static inline SSE42_TARGET
+void crc32c_sse42_x3(uint32_t *crc, unsigned char const * const *buffer,
+		     unsigned const *len, unsigned const *idx)
+{
+	unsigned char const *p0 = buffer[idx[0]];
+	unsigned char const *p1 = buffer[idx[1]];
+	unsigned char const *p2 = buffer[idx[2]];
+	uint64_t c0 = crc[idx[0]], c1 = crc[idx[1]], c2 = crc[idx[2]];
+	unsigned common = len[idx[0]];
+	unsigned off;
+
+	if (len[idx[1]] < common)
+		common = len[idx[1]];
+	if (len[idx[2]] < common)
+		common = len[idx[2]];
+	common &= ~7u;
+	for (off = 0; off < common; off += 8) {
+		uint64_t v0, v1, v2;
+		memcpy(&v0, p0 + off, 8);
+		memcpy(&v1, p1 + off, 8);
+		memcpy(&v2, p2 + off, 8);
+		c0 = _mm_crc32_u64(c0, v0);
+		c1 = _mm_crc32_u64(c1, v1);
+		c2 = _mm_crc32_u64(c2, v2);
+	}
+	crc[idx[0]] = crc32c_sse42((uint32_t)c0, p0 + common, len[idx[0]] - common);
+	crc[idx[1]] = crc32c_sse42((uint32_t)c1, p1 + common, len[idx[1]] - common);
+	crc[idx[2]] = crc32c_sse42((uint32_t)c2, p2 + common, len[idx[2]] - common);
+}
+
+SSE42_TARGET
+void ceph_crc32c_intel_multi(uint32_t *crc, unsigned char const * const *buffer,
+			     unsigned const *len, unsigned n)
+{
+	unsigned idx[3];
+	unsigned pending = 0;
+	unsigned i;
+
+	for (i = 0; i < n; i++) {
+		if (!buffer[i] || len[i] >= VPCLMUL_MIN_LEN) {
+			crc[i] = ceph_crc32c(crc[i], buffer[i], len[i]);
+			continue;
+		}
+		idx[pending++] = i;
+		if (pending == 3) {
+			crc32c_sse42_x3(crc, buffer, len, idx);
+			pending = 0;
+		}
+	}
+	for (i = 0; i < pending; i++)
+		crc[idx[i]] = crc32c_sse42(crc[idx[i]], buffer[idx[i]], len[idx[i]]);
+}
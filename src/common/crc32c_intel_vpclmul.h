@@ -0,0 +1,39 @@
+#ifndef CEPH_COMMON_CRC32C_INTEL_VPCLMUL_H
+#define CEPH_COMMON_CRC32C_INTEL_VPCLMUL_H
+
+#include "acconfig.h"
+#include "include/int_types.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#if defined(__x86_64__) && defined(HAVE_INTEL_VPCLMULQDQ)
+
+/* single stream, folds 256 bytes per iteration with AVX-512 VPCLMULQDQ */
+extern uint32_t ceph_crc32c_intel_vpclmul(uint32_t crc, unsigned char const *buffer, unsigned len);
+
+/* independent streams, short ones interleaved three at a time with the
+ * SSE 4.2 crc32 instruction */
+extern void ceph_crc32c_intel_multi(uint32_t *crc, unsigned char const * const *buffer,
+				    unsigned const *len, unsigned n);
+
+#else
+
+static inline uint32_t ceph_crc32c_intel_vpclmul(uint32_t crc, unsigned char const *buffer, unsigned len)
+{
+	return 0;
+}
+
+static inline void ceph_crc32c_intel_multi(uint32_t *crc, unsigned char const * const *buffer,
+					   unsigned const *len, unsigned n)
+{
+}
+
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -153,9 +153,8 @@ struct is_dynamic<dynamic_marker_t<T>> : public std::true_type {};
     }                                           \
   } while (0)
 #else
-#define dout_impl(cct, sub, v)						\
-  do {									\
-  const bool should_gather = [&](const auto cctX, auto sub_, auto v_) {	\
+#define dout_should_gather(cct, sub, v)				\
+  [&](const auto cctX, auto sub_, auto v_) {				\
     /* The check is performed on `sub_` and `v_` to leverage the C++'s 	\
      * guarantee on _discarding_ one of blocks of `if constexpr`, which	\
      * includes also the checks for ill-formed code (`should_gather<>`	\
@@ -175,7 +174,11 @@ struct is_dynamic<dynamic_marker_t<T>> : public std::true_type {};
       return (cctX->_conf->subsys.template should_gather<sub_helper,	\
 							 v_helper>());	\
     }									\
-  }(cct, sub, v);							\
+  }(cct, sub, v)
+
+#define dout_impl(cct, sub, v)						\
+  do {									\
+  const bool should_gather = dout_should_gather(cct, sub, v);		\
 									\
   if (should_gather) {							\
     ceph::logging::MutableEntry _dout_e(v, sub);                        \
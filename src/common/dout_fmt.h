@@ -54,3 +54,40 @@ inline void dout_fmt_use_prefix(std::ostream&) {}
     fmt::print(*_dout, __VA_ARGS__); \
     *_dout << dendl; \
   }
+
+/// \brief dout macros deferring the formatting to the log thread
+///
+/// Where log_ring_size is set, the arguments of these statements are copied
+/// into a ring owned by the calling thread and formatted by the log thread,
+/// see Log::submit_fmt().  The format string must be a literal, anything
+/// else is rejected at compile time.  As the statement is not formatted
+/// through an ostream, dout_prefix does not apply; any context belongs in
+/// the format string.
+#ifdef WITH_CRIMSON
+#define lsubdout_ring(cct, sub, v, ...) \
+  dout_impl(cct, ceph_subsys_##sub, v) \
+  fmt::print(*_dout, __VA_ARGS__); \
+  *_dout << dendl
+
+#define ldout_ring(cct, v, ...) \
+  dout_impl(cct, dout_subsys, v) \
+  fmt::print(*_dout, __VA_ARGS__); \
+  *_dout << dendl
+#else
+#define lsubdout_ring(cct, sub, v, ...) \
+  do { \
+    if (dout_should_gather(cct, ceph_subsys_##sub, v)) { \
+      (cct)->_log->submit_fmt(v, ceph_subsys_##sub, __VA_ARGS__); \
+    } \
+  } while (0)
+
+#define ldout_ring(cct, v, ...) \
+  do { \
+    if (dout_should_gather(cct, dout_subsys, v)) { \
+      (cct)->_log->submit_fmt(v, dout_subsys, __VA_ARGS__); \
+    } \
+  } while (0)
+#endif
+
+#define dout_ring(v, ...) \
+  ldout_ring((dout_context), v, __VA_ARGS__)
@@ -18,8 +18,11 @@
 #include "common/dout.h"
 #include "common/valgrind.h"
 #include "include/common_fwd.h"
+#include "include/intarith.h"
+#include "include/mempool.h"
 #include "include/utime.h"
 
+#include <numeric>
 #include <sstream>
 
 using std::ostringstream;
@@ -158,6 +161,47 @@ void PerfCountersCollectionImpl::with_counters(std::function<void(
 
 // ---------------------------
 
+// as with the mempool shards, assume the largest known cache line size
+static constexpr size_t SHARD_ALIGN = 128;
+// the number of slots filling whole cache lines
+static constexpr size_t SHARD_SLOTS_ALIGN =
+  SHARD_ALIGN / std::gcd(SHARD_ALIGN, sizeof(PerfCounters::perf_counter_value_t));
+
+PerfCounters::shards_t::shards_t(size_t num_counters)
+  : num_shards(mempool::get_num_shards()),
+    stride(p2roundup(num_counters, SHARD_SLOTS_ALIGN))
+{
+  void *p = ::aligned_alloc(SHARD_ALIGN,
+			    num_shards * stride * sizeof(perf_counter_value_t));
+  ceph_assert(p);
+  slots = static_cast<perf_counter_value_t*>(p);
+  for (size_t i = 0; i < num_shards * stride; i++) {
+    new (&slots[i]) perf_counter_value_t;
+  }
+}
+
+PerfCounters::shards_t::~shards_t()
+{
+  static_assert(std::is_trivially_destructible_v<perf_counter_value_t>);
+  ::free(slots);
+}
+
+PerfCounters::perf_counter_value_t&
+PerfCounters::shards_t::local(size_t idx) const
+{
+  return at(mempool::pick_a_shard_int(), idx);
+}
+
+// set a counter to v, taking the increments kept per CPU into account
+static void set_value(PerfCounters::perf_counter_data_any_d& data, uint64_t v)
+{
+  uint64_t sharded = 0;
+  for (size_t i = 0; data.shards && i < data.shards->size(); i++) {
+    sharded += data.shards->at(i, data.shard_idx).u64;
+  }
+  data.u64 = v - sharded;
+}
+
 PerfCounters::~PerfCounters()
 {
 }
@@ -174,12 +218,13 @@ void PerfCounters::inc(int idx, uint64_t amt)
   perf_counter_data_any_d& data(m_data[idx - m_lower_bound - 1]);
   if (!(data.type & PERFCOUNTER_U64))
     return;
+  perf_counter_value_t& v = data.local();
   if (data.type & PERFCOUNTER_LONGRUNAVG) {
-    data.avgcount++;
-    data.u64 += amt;
-    data.avgcount2++;
+    v.avgcount++;
+    v.u64 += amt;
+    v.avgcount2++;
   } else {
-    data.u64 += amt;
+    v.u64 += amt;
   }
 }
 
@@ -195,16 +240,17 @@ void PerfCounters::inc_with_max(int idx, uint64_t amt)
   perf_counter_data_any_d& data(m_data[idx - m_lower_bound - 1]);
   if (!(data.type & PERFCOUNTER_U64))
     return;
+  perf_counter_value_t& v = data.local();
   if (data.type & PERFCOUNTER_LONGRUNAVG) {
-    data.avgcount++;
-    data.u64 += amt;
+    v.avgcount++;
+    v.u64 += amt;
     uint64_t m;
     do {
       m = data.max_u64_inc.load();
     } while(amt > m && !data.max_u64_inc.compare_exchange_weak(m, amt));
-    data.avgcount2++;
+    v.avgcount2++;
   } else {
-    data.u64 += amt;
+    v.u64 += amt;
   }
 }
 
@@ -221,7 +267,7 @@ void PerfCounters::dec(int idx, uint64_t amt)
   ceph_assert(!(data.type & PERFCOUNTER_LONGRUNAVG));
   if (!(data.type & PERFCOUNTER_U64))
     return;
-  data.u64 -= amt;
+  data.local().u64 -= amt;
 }
 
 void PerfCounters::set(int idx, uint64_t amt)
@@ -241,10 +287,10 @@ void PerfCounters::set(int idx, uint64_t amt)
                              "perf counter atomic");
   if (data.type & PERFCOUNTER_LONGRUNAVG) {
     data.avgcount++;
-    data.u64 = amt;
+    set_value(data, amt);
     data.avgcount2++;
   } else {
-    data.u64 = amt;
+    set_value(data, amt);
   }
 }
 
@@ -260,7 +306,7 @@ uint64_t PerfCounters::get(int idx) const
   const perf_counter_data_any_d& data(m_data[idx - m_lower_bound - 1]);
   if (!(data.type & PERFCOUNTER_U64))
     return 0;
-  return data.u64;
+  return data.read_u64();
 }
 
 void PerfCounters::tinc(int idx, utime_t amt)
@@ -275,12 +321,13 @@ void PerfCounters::tinc(int idx, utime_t amt)
   perf_counter_data_any_d& data(m_data[idx - m_lower_bound - 1]);
   if (!(data.type & PERFCOUNTER_TIME))
     return;
+  perf_counter_value_t& v = data.local();
   if (data.type & PERFCOUNTER_LONGRUNAVG) {
-    data.avgcount++;
-    data.u64 += amt.to_nsec();
-    data.avgcount2++;
+    v.avgcount++;
+    v.u64 += amt.to_nsec();
+    v.avgcount2++;
   } else {
-    data.u64 += amt.to_nsec();
+    v.u64 += amt.to_nsec();
   }
 }
 
@@ -296,17 +343,18 @@ void PerfCounters::tinc_with_max(int idx, utime_t amt)
   perf_counter_data_any_d& data(m_data[idx - m_lower_bound - 1]);
   if (!(data.type & PERFCOUNTER_TIME))
     return;
+  perf_counter_value_t& v = data.local();
   if (data.type & PERFCOUNTER_LONGRUNAVG) {
     uint64_t new_m = amt.to_nsec();
-    data.avgcount++;
-    data.u64 += new_m;
+    v.avgcount++;
+    v.u64 += new_m;
     uint64_t m;
     do {
       m = data.max_u64_inc.load();
     } while(new_m > m && !data.max_u64_inc.compare_exchange_weak(m, new_m));
-    data.avgcount2++;
+    v.avgcount2++;
   } else {
-    data.u64 += amt.to_nsec();
+    v.u64 += amt.to_nsec();
   }
 }
 
@@ -322,12 +370,13 @@ void PerfCounters::tinc(int idx, ceph::timespan amt)
   perf_counter_data_any_d& data(m_data[idx - m_lower_bound - 1]);
   if (!(data.type & PERFCOUNTER_TIME))
     return;
+  perf_counter_value_t& v = data.local();
   if (data.type & PERFCOUNTER_LONGRUNAVG) {
-    data.avgcount++;
-    data.u64 += amt.count();
-    data.avgcount2++;
+    v.avgcount++;
+    v.u64 += amt.count();
+    v.avgcount2++;
   } else {
-    data.u64 += amt.count();
+    v.u64 += amt.count();
   }
 }
 
@@ -343,17 +392,18 @@ void PerfCounters::tinc_with_max(int idx, ceph::timespan amt)
   perf_counter_data_any_d& data(m_data[idx - m_lower_bound - 1]);
   if (!(data.type & PERFCOUNTER_TIME))
     return;
+  perf_counter_value_t& v = data.local();
   if (data.type & PERFCOUNTER_LONGRUNAVG) {
     uint64_t new_m = amt.count();
-    data.avgcount++;
-    data.u64 += new_m;
+    v.avgcount++;
+    v.u64 += new_m;
     uint64_t m;
     do {
       m = data.max_u64_inc.load();
     } while(new_m > m && !data.max_u64_inc.compare_exchange_weak(m, new_m));
-    data.avgcount2++;
+    v.avgcount2++;
   } else {
-    data.u64 += amt.count();
+    v.u64 += amt.count();
   }
 }
 
@@ -369,7 +419,7 @@ void PerfCounters::tset(int idx, utime_t amt)
   perf_counter_data_any_d& data(m_data[idx - m_lower_bound - 1]);
   if (!(data.type & PERFCOUNTER_TIME))
     return;
-  data.u64 = amt.to_nsec();
+  set_value(data, amt.to_nsec());
   if (data.type & PERFCOUNTER_LONGRUNAVG)
     ceph_abort();
 }
@@ -386,7 +436,7 @@ void PerfCounters::tset(int idx, ceph::timespan amt)
   perf_counter_data_any_d& data(m_data[idx - m_lower_bound - 1]);
   if (!(data.type & PERFCOUNTER_TIME))
     return;
-  data.u64 = amt.count();
+  set_value(data, amt.count());
   if (data.type & PERFCOUNTER_LONGRUNAVG)
     ceph_abort();
 }
@@ -403,7 +453,7 @@ utime_t PerfCounters::tget(int idx) const
   const perf_counter_data_any_d& data(m_data[idx - m_lower_bound - 1]);
   if (!(data.type & PERFCOUNTER_TIME))
     return utime_t();
-  uint64_t v = data.u64;
+  uint64_t v = data.read_u64();
   return utime_t(v / 1000000000ull, v % 1000000000ull);
 }
 
@@ -593,7 +643,7 @@ void PerfCounters::dump_formatted_generic(Formatter *f, bool schema,
         Formatter::ObjectSection histogram_section{*f, d->name};
         d->histogram->dump_formatted(f);
       } else {
-	uint64_t v = d->u64;
+	uint64_t v = d->read_u64();
 	if (d->type & PERFCOUNTER_U64) {
 	  f->dump_unsigned(d->name, v);
 	} else if (d->type & PERFCOUNTER_TIME) {
@@ -725,6 +775,13 @@ PerfCounters *PerfCountersBuilder::create_perf_counters()
 
   PerfCounters *ret = m_perf_counters;
   m_perf_counters = NULL;
+  if (sharded) {
+    ret->m_shards = std::make_unique<PerfCounters::shards_t>(ret->m_data.size());
+    for (size_t i = 0; i < ret->m_data.size(); i++) {
+      ret->m_data[i].shards = ret->m_shards.get();
+      ret->m_data[i].shard_idx = i;
+    }
+  }
   return ret;
 }
 
@@ -124,6 +124,14 @@ public:
     prio_default = prio_;
   }
 
+  // keep the counters per CPU, and only sum them up when they are read.
+  // This spares the cache line bouncing of counters updated by many
+  // threads at once, at the cost of memory and slower reads.
+  void set_sharded(bool sharded_)
+  {
+    sharded = sharded_;
+  }
+
   PerfCounters* create_perf_counters();
 private:
   PerfCountersBuilder(const PerfCountersBuilder &rhs);
@@ -135,6 +143,7 @@ private:
   PerfCounters *m_perf_counters;
 
   int prio_default = 0;
+  bool sharded = false;
 };
 
 /*
@@ -161,12 +170,67 @@ private:
  * For the time average, it returns the current value and
  * the "avgcount" member when read off. avgcount is incremented when you call
  * tinc. Calling tset on an average is an error and will assert out.
+ *
+ * The counters of a sharded PerfCounters are updated in a slot of the CPU
+ * the caller runs on, and the slots of all CPUs are summed up on reads.
  */
 class PerfCounters
 {
 public:
+  /** The part of a counter updated by inc, dec and tinc */
+  struct perf_counter_value_t {
+    std::atomic<uint64_t> u64 = { 0 };
+    std::atomic<uint64_t> avgcount = { 0 };
+    std::atomic<uint64_t> avgcount2 = { 0 };
+
+    void reset() {
+      u64 = 0;
+      avgcount = 0;
+      avgcount2 = 0;
+    }
+    // read <sum, count> safely by making sure the post- and pre-count
+    // are identical; in other words the whole loop needs to be run
+    // without any intervening calls to inc, set, or tinc.
+    std::pair<uint64_t,uint64_t> read_avg() const {
+      uint64_t sum, count;
+      do {
+	count = avgcount2;
+	sum = u64;
+      } while (avgcount != count);
+      return { sum, count };
+    }
+  };
+
+  /**
+   * Per-CPU slots of the counters of a sharded PerfCounters
+   *
+   * The slots of a shard are packed together and the shards are cache
+   * line aligned, so a CPU only ever writes to lines of its own.
+   */
+  class shards_t {
+  public:
+    shards_t(size_t num_counters);
+    ~shards_t();
+    shards_t(const shards_t&) = delete;
+    shards_t& operator=(const shards_t&) = delete;
+
+    size_t size() const {
+      return num_shards;
+    }
+    perf_counter_value_t& at(size_t shard, size_t idx) const {
+      return slots[shard * stride + idx];
+    }
+    /// the slot of the CPU the caller is running on
+    perf_counter_value_t& local(size_t idx) const;
+
+  private:
+    const size_t num_shards;
+    const size_t stride;
+    perf_counter_value_t *slots;
+  };
+
   /** Represents a PerfCounters data element. */
-  struct perf_counter_data_any_d {
+  struct perf_counter_data_any_d : public perf_counter_value_t {
     perf_counter_data_any_d()
       : name(nullptr),
         description(nullptr),
@@ -180,6 +244,7 @@ public:
         nick(other.nick),
 	 type(other.type),
 	 unit(other.unit) {
+      // the copy is not sharded, it starts out with the sum of the slots
       std::tie(u64, avgcount, max_u64_inc) = other.read_avg_ex();
       avgcount2 = avgcount.load();
 
@@ -194,44 +259,50 @@ public:
     uint8_t prio = 0;
     enum perfcounter_type_d type;
     enum unit_t unit;
-    std::atomic<uint64_t> u64 = { 0 };
     std::atomic<uint64_t> max_u64_inc = { 0 };
-    std::atomic<uint64_t> avgcount = { 0 };
-    std::atomic<uint64_t> avgcount2 = { 0 };
     std::unique_ptr<PerfHistogram<>> histogram;
+    // set if the counter is sharded, along with its index in the shards
+    const shards_t *shards = nullptr;
+    size_t shard_idx = 0;
 
     void reset()
     {
       if (type != PERFCOUNTER_U64) {
-	    u64 = 0;
+	    perf_counter_value_t::reset();
 	    max_u64_inc = 0;
-	    avgcount = 0;
-	    avgcount2 = 0;
+	    for (size_t i = 0; shards && i < shards->size(); i++) {
+	      shards->at(i, shard_idx).reset();
+	    }
       }
       if (histogram) {
         histogram->reset();
       }
     }
 
-    // read <sum, count> safely by making sure the post- and pre-count
-    // are identical; in other words the whole loop needs to be run
-    // without any intervening calls to inc, set, or tinc.
+    /// where inc, dec and tinc go
+    perf_counter_value_t& local() {
+      return shards ? shards->local(shard_idx) : *this;
+    }
+
+    uint64_t read_u64() const {
+      uint64_t v = u64;
+      for (size_t i = 0; shards && i < shards->size(); i++) {
+	v += shards->at(i, shard_idx).u64;
+      }
+      return v;
+    }
     std::pair<uint64_t,uint64_t> read_avg() const {
-      uint64_t sum, count;
-      do {
-	count = avgcount2;
-	sum = u64;
-      } while (avgcount != count);
+      auto [sum, count] = perf_counter_value_t::read_avg();
+      for (size_t i = 0; shards && i < shards->size(); i++) {
+	auto [s, c] = shards->at(i, shard_idx).read_avg();
+	sum += s;
+	count += c;
+      }
       return { sum, count };
     }
     std::tuple<uint64_t,uint64_t, uint64_t> read_avg_ex() const {
-      uint64_t _sum, _count, _max;
-      do {
-	_count = avgcount2;
-	_sum = u64;
-	_max = max_u64_inc;
-      } while (avgcount != _count);
-      return { _sum, _count, _max };
+      auto [sum, count] = read_avg();
+      return { sum, count, max_u64_inc };
     }
   };
 
@@ -326,6 +397,7 @@ private:
 #endif
 
   perf_counter_data_vec_t m_data;
+  std::unique_ptr<shards_t> m_shards;
 
   friend class PerfCountersBuilder;
   friend class PerfCountersCollectionImpl;
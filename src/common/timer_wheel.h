@@ -0,0 +1,375 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#ifndef CEPH_COMMON_TIMER_WHEEL_H
+#define CEPH_COMMON_TIMER_WHEEL_H
+
+#include <array>
+#include <bit>
+#include <chrono>
+#include <cstdint>
+#include <optional>
+#include <unordered_map>
+
+#include <boost/intrusive/list.hpp>
+#include <boost/intrusive/set.hpp>
+
+namespace ceph {
+
+/*
+ * A hierarchical timing wheel
+ *
+ * Time is cut into ticks.  An event goes into one of the NUM_SLOTS slots
+ * of the first level if it expires within the current lap of that level,
+ * else into the first upper level whose current lap it expires in; events
+ * beyond the last level are kept aside.  Adding and removing an event is
+ * O(1), looking up the next slot to process is a scan of a few bitmap
+ * words.  When a lap of a level begins, the matching slot of the level
+ * above is cascaded down.  When a slot of the first level is reached, its
+ * events are moved to a set ordered by expiry.  They are taken from that
+ * set once due, in the order they expire.  Events expiring at the same
+ * time are taken in the order they were added.
+ *
+ * An event is identified by its value, which must be unique.
+ */
+template <typename Clock, typename T>
+class timer_wheel {
+public:
+  using time_point = typename Clock::time_point;
+  using duration = typename Clock::duration;
+
+  static constexpr unsigned SLOT_BITS = 8;
+  static constexpr unsigned NUM_SLOTS = 1 << SLOT_BITS;
+  static constexpr unsigned NUM_LEVELS = 4;
+
+private:
+  static constexpr uint64_t SLOT_MASK = NUM_SLOTS - 1;
+  static constexpr int LEVEL_EXPIRED = -1;
+  static constexpr int LEVEL_OVERFLOW = NUM_LEVELS;
+
+  struct event_t {
+    time_point when;
+    uint64_t seq = 0;
+    T value;
+    int level = LEVEL_EXPIRED;	///< or LEVEL_OVERFLOW
+    unsigned slot = 0;
+    boost::intrusive::list_member_hook<> slot_item;
+    boost::intrusive::set_member_hook<> expired_item;
+  };
+
+  struct expiry_less {
+    bool operator()(const event_t& l, const event_t& r) const {
+      if (l.when != r.when) {
+	return l.when < r.when;
+      }
+      return l.seq < r.seq;
+    }
+  };
+
+  using slot_t = boost::intrusive::list<
+    event_t,
+    boost::intrusive::member_hook<event_t,
+				  boost::intrusive::list_member_hook<>,
+				  &event_t::slot_item>,
+    boost::intrusive::constant_time_size<false>>;
+  using expired_set_t = boost::intrusive::set<
+    event_t,
+    boost::intrusive::member_hook<event_t,
+				  boost::intrusive::set_member_hook<>,
+				  &event_t::expired_item>,
+    boost::intrusive::compare<expiry_less>>;
+
+  struct level_t {
+    std::array<slot_t, NUM_SLOTS> slots;
+    std::array<uint64_t, NUM_SLOTS / 64> bits = {};
+
+    void push(event_t& e) {
+      slots[e.slot].push_back(e);
+      bits[e.slot / 64] |= uint64_t(1) << (e.slot % 64);
+    }
+    void erase(event_t& e) {
+      auto& s = slots[e.slot];
+      s.erase(s.iterator_to(e));
+      if (s.empty()) {
+	bits[e.slot / 64] &= ~(uint64_t(1) << (e.slot % 64));
+      }
+    }
+    void clear(unsigned slot) {
+      slots[slot].clear();
+      bits[slot / 64] &= ~(uint64_t(1) << (slot % 64));
+    }
+    /// the first non-empty slot from the given one, or -1
+    int find(unsigned from) const {
+      for (unsigned w = from / 64; w < bits.size(); w++) {
+	uint64_t b = bits[w];
+	if (w == from / 64) {
+	  b &= ~uint64_t(0) << (from % 64);
+	}
+	if (b) {
+	  return w * 64 + std::countr_zero(b);
+	}
+      }
+      return -1;
+    }
+  };
+
+  // declared first so that the hooks are unlinked before being destroyed
+  std::unordered_map<T, event_t> events;
+
+  const duration tick;
+  const time_point origin;
+  uint64_t cur = 0;	///< the next tick to process
+  uint64_t next_seq = 0;
+
+  std::array<level_t, NUM_LEVELS> levels;
+  slot_t overflow;
+  expired_set_t expired;
+
+  uint64_t tick_of(time_point when) const {
+    if (when <= origin) {
+      return 0;
+    }
+    return (when - origin) / tick;
+  }
+
+  void place(event_t& e) {
+    const uint64_t k = tick_of(e.when);
+    if (k < cur) {
+      e.level = LEVEL_EXPIRED;
+      expired.insert(e);
+      return;
+    }
+    for (unsigned l = 0; l < NUM_LEVELS; l++) {
+      const unsigned lap_shift = (l + 1) * SLOT_BITS;
+      if ((k >> lap_shift) == (cur >> lap_shift)) {
+	e.level = l;
+	e.slot = (k >> (l * SLOT_BITS)) & SLOT_MASK;
+	levels[l].push(e);
+	return;
+      }
+    }
+    e.level = LEVEL_OVERFLOW;
+    overflow.push_back(e);
+  }
+
+  void unlink(event_t& e) {
+    if (e.level == LEVEL_EXPIRED) {
+      expired.erase(expired.iterator_to(e));
+    } else if (e.level == LEVEL_OVERFLOW) {
+      overflow.erase(overflow.iterator_to(e));
+    } else {
+      levels[e.level].erase(e);
+    }
+  }
+
+  /// place again the events of a slot, which may get some back
+  void replace_all(slot_t& from) {
+    slot_t s;
+    s.swap(from);
+    while (!s.empty()) {
+      event_t& e = s.front();
+      s.pop_front();
+      place(e);
+    }
+  }
+
+  /// cascade the upper levels into the lower ones as laps begin at cur
+  void cascade() {
+    // top down, as a slot may fill the slots of the levels below
+    constexpr unsigned top_shift = NUM_LEVELS * SLOT_BITS;
+    if ((cur & ((uint64_t(1) << top_shift) - 1)) == 0) {
+      replace_all(overflow);
+    }
+    for (unsigned l = NUM_LEVELS - 1; l > 0; l--) {
+      const unsigned shift = l * SLOT_BITS;
+      if (cur & ((uint64_t(1) << shift) - 1)) {
+	continue;
+      }
+      const unsigned slot = (cur >> shift) & SLOT_MASK;
+      if (levels[l].bits[slot / 64] & (uint64_t(1) << (slot % 64))) {
+	replace_all(levels[l].slots[slot]);
+	levels[l].clear(slot);
+      }
+    }
+  }
+
+  /// the first tick from cur with events to process, the wheel being
+  /// not empty
+  uint64_t next_tick() const {
+    for (unsigned l = 0; l < NUM_LEVELS; l++) {
+      const unsigned shift = l * SLOT_BITS;
+      const unsigned lap_shift = shift + SLOT_BITS;
+      // the upper slots of the current laps were cascaded already
+      const unsigned from = ((cur >> shift) & SLOT_MASK) + (l ? 1 : 0);
+      if (int s = levels[l].find(from); s >= 0) {
+	return ((cur >> lap_shift) << lap_shift) | (uint64_t(s) << shift);
+      }
+    }
+    constexpr unsigned top_shift = NUM_LEVELS * SLOT_BITS;
+    return ((cur >> top_shift) + 1) << top_shift;
+  }
+
+  bool wheel_empty() const {
+    return events.size() == expired.size();
+  }
+
+  /// process the ticks up to now_tick
+  void advance(uint64_t now_tick) {
+    while (!wheel_empty()) {
+      const uint64_t t = next_tick();
+      if (t > now_tick) {
+	break;
+      }
+      if (t != cur) {
+	cur = t;
+	cascade();
+      }
+      auto& slots = levels[0];
+      const unsigned slot = cur & SLOT_MASK;
+      while (!slots.slots[slot].empty()) {
+	event_t& e = slots.slots[slot].front();
+	slots.slots[slot].pop_front();
+	e.level = LEVEL_EXPIRED;
+	expired.insert(e);
+      }
+      slots.clear(slot);
+      cur++;
+      if ((cur & SLOT_MASK) == 0) {
+	cascade();
+      }
+    }
+    if (cur <= now_tick) {
+      // nothing is due before, keep the wheel close to now so that new
+      // events go into the lower levels
+      cur = now_tick + 1;
+      if ((cur & SLOT_MASK) == 0) {
+	cascade();
+      }
+    }
+  }
+
+public:
+  explicit timer_wheel(duration tick = std::chrono::milliseconds(1),
+		       time_point origin = Clock::now())
+    : tick(tick), origin(origin) {}
+  timer_wheel(const timer_wheel&) = delete;
+  timer_wheel& operator=(const timer_wheel&) = delete;
+
+  ~timer_wheel() {
+    clear([](time_point, T) {});
+  }
+
+  size_t size() const {
+    return events.size();
+  }
+  bool empty() const {
+    return events.empty();
+  }
+
+  /// @return false if the value is scheduled already
+  bool add(time_point when, T value) {
+    auto [i, inserted] = events.try_emplace(value);
+    if (!inserted) {
+      return false;
+    }
+    event_t& e = i->second;
+    e.when = when;
+    e.seq = next_seq++;
+    e.value = value;
+    place(e);
+    return true;
+  }
+
+  /// @return the expiry of the event, if scheduled
+  std::optional<time_point> get(T value) const {
+    auto i = events.find(value);
+    if (i == events.end()) {
+      return std::nullopt;
+    }
+    return i->second.when;
+  }
+
+  /// @return false if the value is not scheduled
+  bool remove(T value) {
+    auto i = events.find(value);
+    if (i == events.end()) {
+      return false;
+    }
+    unlink(i->second);
+    events.erase(i);
+    return true;
+  }
+
+  /// remove and return the first event expiring by now
+  std::optional<T> pop_expired(time_point now) {
+    if (expired.empty() || expired.begin()->when > now) {
+      advance(tick_of(now));
+      if (expired.empty() || expired.begin()->when > now) {
+	return std::nullopt;
+      }
+    }
+    auto i = expired.begin();
+    T value = i->value;
+    expired.erase(i);
+    events.erase(value);
+    return value;
+  }
+
+  /**
+   * when to look for expired events next
+   *
+   * This is the expiry of the first event if known already, else the start
+   * of the next tick with events to process, which may come earlier.
+   *
+   * @return time_point::max() if there are no events
+   */
+  time_point next_expiry() const {
+    if (!expired.empty()) {
+      // anything left in the wheel is in a later tick
+      return expired.begin()->when;
+    }
+    if (events.empty()) {
+      return time_point::max();
+    }
+    return origin + tick * static_cast<typename duration::rep>(next_tick());
+  }
+
+  /// call f(when, value) on every event
+  template <typename F>
+  void for_each(F&& f) const {
+    for (const auto& [value, e] : events) {
+      f(e.when, value);
+    }
+  }
+
+  /// remove all events, then call f(when, value) on each
+  template <typename F>
+  void clear(F&& f) {
+    expired.clear();
+    overflow.clear();
+    for (auto& l : levels) {
+      for (unsigned s = 0; s < NUM_SLOTS; s++) {
+	l.clear(s);
+      }
+    }
+    // f may well add events again
+    auto cleared = std::move(events);
+    events.clear();
+    for (auto& [value, e] : cleared) {
+      f(e.when, value);
+    }
+  }
+};
+
+} // namespace ceph
+
+#endif
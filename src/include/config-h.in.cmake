@@ -256,6 +256,9 @@
 /* nasm can also build the isa-l:avx512 */
 #cmakedefine HAVE_NASM_X64_AVX512
 
+/* the compiler can build avx512 vpclmulqdq code */
+#cmakedefine HAVE_INTEL_VPCLMULQDQ
+
 /* Define if the erasure code isa-l plugin is compiled */
 #cmakedefine WITH_EC_ISA_PLUGIN
 
@@ -1,6 +1,7 @@
 #ifndef CEPH_CRC32C_H
 #define CEPH_CRC32C_H
 
+#include <stddef.h>
 #include <stdint.h>
 
 #ifdef __cplusplus
@@ -50,6 +51,47 @@ static inline uint32_t ceph_crc32c(uint32_t crc, unsigned char const *data, unsi
   return ceph_crc32c_func(crc, data, length);
 }
 
+typedef void (*ceph_crc32c_multi_func_t)(uint32_t *crc, unsigned char const * const *data,
+					 unsigned const *length, unsigned n);
+
+extern ceph_crc32c_multi_func_t ceph_crc32c_multi_func;
+
+extern ceph_crc32c_multi_func_t ceph_choose_crc32c_multi(void);
+
+/**
+ * calculate crc32c of several independent buffers
+ *
+ * Same as crc[i] = ceph_crc32c(crc[i], data[i], length[i]) for each i < n,
+ * but lets the implementation work on several streams at once.  Partial
+ * results can be joined with ceph_crc32c_combine().
+ *
+ * @param crc initial values, replaced with the results
+ * @param data pointers to the data buffers
+ * @param length lengths of the buffers
+ * @param n number of buffers
+ */
+static inline void ceph_crc32c_multi(uint32_t *crc, unsigned char const * const *data,
+				     unsigned const *length, unsigned n)
+{
+  ceph_crc32c_multi_func(crc, data, length, n);
+}
+
+/**
+ * combine the crc32c of two adjacent buffers
+ *
+ * Given crc_a = ceph_crc32c(crc, a, len_a) and
+ * crc_b = ceph_crc32c(0, b, length_b), returns the crc32c of a followed
+ * by b, starting with crc.
+ *
+ * @param crc_a crc of the first buffer
+ * @param crc_b crc of the second buffer, starting with 0
+ * @param length_b length of the second buffer
+ */
+static inline uint32_t ceph_crc32c_combine(uint32_t crc_a, uint32_t crc_b, unsigned length_b)
+{
+  return ceph_crc32c(crc_a, NULL, length_b) ^ crc_b;
+}
+
 #ifdef __cplusplus
 }
 #endif
@@ -52,9 +52,11 @@
 
 DEFINE_MSGR2_FEATURE(0, 1, REVISION_1)   // msgr2.1
 DEFINE_MSGR2_FEATURE(1, 1, COMPRESSION)  // on-wire compression
+DEFINE_MSGR2_FEATURE(2, 1, KTLS)         // secure mode records in kernel TLS
 
 /*
- * Features supported.  Should be everything above.
+ * Features supported.  Should be everything above, except for KTLS which
+ * is offered per connection, when the socket accepts kernel TLS.
  */
 #define CEPH_MSGR2_SUPPORTED_FEATURES \
 	(CEPH_MSGR2_FEATURE_REVISION_1 | \
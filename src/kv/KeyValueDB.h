@@ -10,6 +10,7 @@
 #include <optional>
 #include <string>
 #include <string_view>
+#include <vector>
 #include <boost/scoped_ptr.hpp>
 #include "include/encoding.h"
 #include "common/Formatter.h"
@@ -197,6 +198,27 @@ public:
     return get(prefix, std::string(key, keylen), value);
   }
 
+  /// Retrieve a batch of keys under a single prefix/CF
+  ///
+  /// Implementations may issue the lookups concurrently; the default
+  /// falls back to serial point lookups.  out is resized to match keys
+  /// and (*out)[i] is left empty if keys[i] does not exist.
+  virtual int get_batch(
+    const std::string &prefix,                     ///< [in] Prefix/CF for keys
+    const std::vector<std::string> &keys,          ///< [in] Keys to retrieve
+    std::vector<std::optional<ceph::buffer::list>> *out ///< [out] Values, by index
+    ) {
+    out->clear();
+    out->resize(keys.size());
+    for (size_t i = 0; i < keys.size(); ++i) {
+      ceph::buffer::list bl;
+      if (get(prefix, keys[i], &bl) >= 0) {
+	(*out)[i] = std::move(bl);
+      }
+    }
+    return 0;
+  }
+
   // This superclass is used both by kv iterators *and* by the ObjectMap
   // omap iterator.  The class hierarchies are unfortunately tied together
   // by the legacy DBOjectMap implementation :(.
@@ -359,6 +381,9 @@ protected:
 public:
   typedef uint32_t IteratorOpts;
   static const uint32_t ITERATOR_NOCACHE = 1;
+  /// the iterator is going to walk many consecutive keys (listing, full
+  /// omap reads, log loads); backends may read ahead and prefetch
+  static const uint32_t ITERATOR_SCAN = 2;
 
   struct IteratorBounds {
     std::optional<std::string> lower_bound;
@@ -400,6 +425,21 @@ public:
     return nullptr;
   }
 
+  /// prefixes that have a cache of their own, not shared with the default one
+  virtual std::map<std::string, std::shared_ptr<PriorityCache::PriCache>>
+      get_priority_caches() const {
+    return {};
+  }
+
+  /// count cache lookups from now on, at the cost of an atomic increment each
+  virtual void enable_cache_lookup_stats() {}
+
+  /// cumulative cache lookup hits and misses; empty prefix for the default cache
+  virtual int get_cache_lookup_stats(const std::string& prefix,
+                                     uint64_t* hits, uint64_t* misses) const {
+    return -EOPNOTSUPP;
+  }
+
 
 
   virtual ~KeyValueDB() {}
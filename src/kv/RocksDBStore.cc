@@ -34,6 +34,7 @@
 #include "include/utime.h"
 #include "KeyValueDB.h"
 #include "RocksDBStore.h"
+#include "rocksdb_cache/BinnedClockCache.h"
 
 #include "common/debug.h"
 
@@ -471,6 +472,9 @@ std::shared_ptr<rocksdb::Cache> RocksDBStore::create_block_cache(
   auto shard_bits = cct->_conf->rocksdb_cache_shard_bits;
   if (cache_type == "binned_lru") {
     cache = rocksdb_cache::NewBinnedLRUCache(cct, cache_size, shard_bits, false, cache_prio_high);
+  } else if (cache_type == "binned_clock") {
+    cache = rocksdb_cache::NewBinnedClockCache(cct, cache_size, shard_bits, false, cache_prio_high,
+                                               cct->_conf->rocksdb_block_size);
   } else if (cache_type == "lru") {
     cache = rocksdb::NewLRUCache(cache_size, shard_bits);
   } else if (cache_type == "clock") {
@@ -892,9 +896,11 @@ extern rocksdb::Status rocksdb::StringToMap(const std::string& opts_str,
 // The split is done using RocksDB parser that understands "{" and "}", so it
 // properly extracts compound options.
 // If non-RocksDB option "block_cache" is defined it is extracted to block_cache_opt.
+// If non-RocksDB option "blob_files" is defined it is extracted to blob_files_opt.
 int RocksDBStore::split_column_family_options(const std::string& options,
 					      std::unordered_map<std::string, std::string>* opt_map,
-					      std::string* block_cache_opt)
+					      std::string* block_cache_opt,
+					      std::string* blob_files_opt)
 {
   dout(20) << __func__ << " options=" << options << dendl;
   rocksdb::Status status = rocksdb::StringToMap(options, opt_map);
@@ -910,6 +916,13 @@ int RocksDBStore::split_column_family_options(const std::string& options,
   } else {
     block_cache_opt->clear();
   }
+  // same for "blob_files"
+  if (auto it = opt_map->find("blob_files"); it != opt_map->end()) {
+    *blob_files_opt = it->second;
+    opt_map->erase(it);
+  } else {
+    blob_files_opt->clear();
+  }
   return 0;
 }
 
@@ -918,6 +931,8 @@ int RocksDBStore::split_column_family_options(const std::string& options,
 // Allowed options are exactly the same as allowed for column families in RocksDB.
 // Ceph addition is "block_cache" option that is translated to block_cache and
 // allows to specialize separate block cache for O column family.
+// The other Ceph addition is "blob_files" option that turns on key-value
+// separation into RocksDB blob files for the column family.
 //
 // base_name - name of column without shard suffix: "-"+number
 // options - additional options to apply
@@ -928,8 +943,10 @@ int RocksDBStore::update_column_family_options(const std::string& base_name,
 {
   std::unordered_map<std::string, std::string> options_map;
   std::string block_cache_opt;
+  std::string blob_files_opt;
   rocksdb::Status status;
-  int r = split_column_family_options(more_options, &options_map, &block_cache_opt);
+  int r = split_column_family_options(more_options, &options_map,
+				      &block_cache_opt, &blob_files_opt);
   if (r != 0) {
     dout(5) << __func__ << " failed to parse options; column family=" << base_name
 	    << " options=" << more_options << dendl;
@@ -953,9 +970,122 @@ int RocksDBStore::update_column_family_options(const std::string& base_name,
       return r;
     }
   }
+  if (!blob_files_opt.empty()) {
+    r = apply_blob_files_options(base_name, blob_files_opt, cf_opt);
+    if (r != 0) {
+      return r;
+    }
+  }
   return 0;
 }
 
+// Translates the "blob_files" column family option into RocksDB integrated
+// BlobDB settings.  Values at least min_size long are stored in blob files
+// and only referenced from the SST files, so compactions stop rewriting them.
+//   blob_files=1
+//   blob_files={min_size=4K;file_size=256M;compression=lz4;gc_age_cutoff=0.25}
+// Settings that are not given default to rocksdb_blob_* config values.
+int RocksDBStore::apply_blob_files_options(const std::string& column_name,
+					   const std::string& blob_files_opt,
+					   rocksdb::ColumnFamilyOptions* cf_opt)
+{
+#if (ROCKSDB_MAJOR > 6 || (ROCKSDB_MAJOR == 6 && ROCKSDB_MINOR >= 18))
+  std::unordered_map<std::string, std::string> blob_options_map;
+  if (blob_files_opt == "0" || blob_files_opt == "false") {
+    return 0;
+  }
+  if (blob_files_opt != "1" && blob_files_opt != "true") {
+    rocksdb::Status status = rocksdb::StringToMap(blob_files_opt, &blob_options_map);
+    if (!status.ok()) {
+      dout(5) << __func__ << " invalid blob files options; column=" << column_name
+	      << " options=" << blob_files_opt << dendl;
+      return -EINVAL;
+    }
+  }
+  auto take = [&](const char* name, const std::string& dflt) {
+    std::string v = dflt;
+    if (auto it = blob_options_map.find(name); it != blob_options_map.end()) {
+      v = it->second;
+      blob_options_map.erase(it);
+    }
+    return v;
+  };
+  std::string error;
+  uint64_t min_size = strict_iecstrtoll(
+    take("min_size", stringify(cct->_conf.get_val<Option::size_t>("rocksdb_blob_min_size"))),
+    &error);
+  if (!error.empty()) {
+    dout(5) << __func__ << " invalid min_size; column=" << column_name
+	    << " options=" << blob_files_opt << dendl;
+    return -EINVAL;
+  }
+  uint64_t file_size = strict_iecstrtoll(
+    take("file_size", stringify(cct->_conf.get_val<Option::size_t>("rocksdb_blob_file_size"))),
+    &error);
+  if (!error.empty() || file_size == 0) {
+    dout(5) << __func__ << " invalid file_size; column=" << column_name
+	    << " options=" << blob_files_opt << dendl;
+    return -EINVAL;
+  }
+  static const std::map<std::string, std::string> compressions = {
+    {"none", "kNoCompression"},
+    {"snappy", "kSnappyCompression"},
+    {"zlib", "kZlibCompression"},
+    {"lz4", "kLZ4Compression"},
+    {"zstd", "kZSTD"},
+  };
+  std::string compression = take(
+    "compression", cct->_conf.get_val<std::string>("rocksdb_blob_compression"));
+  auto cit = compressions.find(compression);
+  if (cit == compressions.end()) {
+    dout(5) << __func__ << " unknown compression '" << compression
+	    << "'; column=" << column_name << dendl;
+    return -EINVAL;
+  }
+  double gc_age_cutoff = strict_strtod(
+    take("gc_age_cutoff", stringify(cct->_conf.get_val<double>("rocksdb_blob_gc_age_cutoff"))),
+    &error);
+  if (!error.empty() || gc_age_cutoff < 0 || gc_age_cutoff > 1) {
+    dout(5) << __func__ << " invalid gc_age_cutoff; column=" << column_name
+	    << " options=" << blob_files_opt << dendl;
+    return -EINVAL;
+  }
+  if (!blob_options_map.empty()) {
+    dout(5) << __func__ << " unknown blob files option '"
+	    << blob_options_map.begin()->first << "'; column=" << column_name
+	    << dendl;
+    return -EINVAL;
+  }
+
+  // let rocksdb validate the result
+  std::unordered_map<std::string, std::string> rocksdb_map = {
+    {"enable_blob_files", "true"},
+    {"min_blob_size", stringify(min_size)},
+    {"blob_file_size", stringify(file_size)},
+    {"blob_compression_type", cit->second},
+    {"enable_blob_garbage_collection", gc_age_cutoff > 0 ? "true" : "false"},
+    {"blob_garbage_collection_age_cutoff", stringify(gc_age_cutoff)},
+  };
+  rocksdb::Status status =
+    rocksdb::GetColumnFamilyOptionsFromMap(*cf_opt, rocksdb_map, cf_opt);
+  if (!status.ok()) {
+    dout(5) << __func__ << " failed to apply blob files options; column="
+	    << column_name << " RocksDB error='" << status.getState() << "'" << dendl;
+    return -EINVAL;
+  }
+  dout(10) << __func__ << " column=" << column_name
+	   << " min_size=" << min_size
+	   << " file_size=" << file_size
+	   << " compression=" << compression
+	   << " gc_age_cutoff=" << gc_age_cutoff << dendl;
+  return 0;
+#else
+  dout(5) << __func__ << " blob files need RocksDB 6.18 or later; column="
+	  << column_name << dendl;
+  return -EOPNOTSUPP;
+#endif
+}
+
 int RocksDBStore::apply_block_cache_options(const std::string& column_name,
 					    const std::string& block_cache_opt,
 					    rocksdb::ColumnFamilyOptions* cf_opt)
@@ -1030,6 +1160,57 @@ int RocksDBStore::apply_block_cache_options(const std::string& column_name,
   return 0;
 }
 
+std::map<std::string, std::shared_ptr<PriorityCache::PriCache>>
+RocksDBStore::get_priority_caches() const
+{
+  std::map<std::string, std::shared_ptr<PriorityCache::PriCache>> caches;
+  for (auto& [prefix, opts] : cf_bbt_opts) {
+    if (!opts.block_cache || opts.block_cache == bbt_opts.block_cache) {
+      continue;
+    }
+    auto cache = std::dynamic_pointer_cast<PriorityCache::PriCache>(
+      opts.block_cache);
+    if (cache) {
+      caches[prefix] = cache;
+    }
+  }
+  return caches;
+}
+
+void RocksDBStore::enable_cache_lookup_stats()
+{
+  auto enable = [](const std::shared_ptr<rocksdb::Cache>& cache) {
+    if (auto sharded =
+	  std::dynamic_pointer_cast<rocksdb_cache::ShardedCache>(cache)) {
+      sharded->set_count_lookups(true);
+    }
+  };
+  enable(bbt_opts.block_cache);
+  for (auto& [prefix, opts] : cf_bbt_opts) {
+    enable(opts.block_cache);
+  }
+}
+
+int RocksDBStore::get_cache_lookup_stats(const std::string& prefix,
+					 uint64_t* hits, uint64_t* misses) const
+{
+  std::shared_ptr<rocksdb::Cache> cache = bbt_opts.block_cache;
+  if (!prefix.empty()) {
+    auto it = cf_bbt_opts.find(prefix);
+    if (it == cf_bbt_opts.end()) {
+      return -ENOENT;
+    }
+    cache = it->second.block_cache;
+  }
+  // only our own caches count lookups
+  auto sharded = std::dynamic_pointer_cast<rocksdb_cache::ShardedCache>(cache);
+  if (!sharded) {
+    return -EOPNOTSUPP;
+  }
+  sharded->get_lookup_stats(hits, misses);
+  return 0;
+}
+
 int RocksDBStore::verify_sharding(const rocksdb::Options& opt,
 				  std::vector<rocksdb::ColumnFamilyDescriptor>& existing_cfs,
 				  std::vector<std::pair<size_t, RocksDBStore::ColumnFamily> >& existing_cfs_shard,
@@ -1251,6 +1432,8 @@ int RocksDBStore::do_open(ostream &out,
   
   PerfCountersBuilder plb(cct, "rocksdb", l_rocksdb_first, l_rocksdb_last);
   plb.add_time_avg(l_rocksdb_get_latency, "get_latency", "Get latency", nullptr, PerfCountersBuilder::PRIO_USEFUL);
+  plb.add_time_avg(l_rocksdb_get_batch_latency, "get_batch_latency", "Batched get latency");
+  plb.add_u64_counter(l_rocksdb_get_batch_keys, "get_batch_keys", "Keys retrieved via batched get");
   plb.add_time_avg(l_rocksdb_submit_latency, "submit_latency", "Submit Latency");
   plb.add_time_avg(l_rocksdb_submit_sync_latency, "submit_sync_latency", "Submit Sync Latency");
   plb.add_u64_counter(l_rocksdb_compact, "compact", "Compactions");
@@ -1467,7 +1650,19 @@ void RocksDBStore::get_statistics(Formatter *f)
       split_stats(stat_str, '\n', stats);
       for (auto st :stats) {
         f->dump_string("", st);
-      }  
+      }
+      // column families with value separation also account blob files
+      rocksdb::ColumnFamilyDescriptor cf_desc;
+      if (handle->GetDescriptor(&cf_desc).ok() &&
+	  cf_desc.options.enable_blob_files &&
+	  db->GetProperty(handle, "rocksdb.blob-stats", &stat_str)) {
+	f->dump_string("rocksdb_blob_statistics", handle->GetName());
+	stats.clear();
+	split_stats(stat_str, '\n', stats);
+	for (auto st :stats) {
+	  f->dump_string("", st);
+	}
+      }
     }
     f->close_section();
   }
@@ -1891,40 +2086,56 @@ void RocksDBStore::RocksDBTransactionImpl::merge(
   }
 }
 
+void RocksDBStore::multi_get(
+    const string &prefix,
+    size_t num_keys,
+    const string *keys,
+    vector<rocksdb::PinnableSlice> *values,
+    vector<rocksdb::Status> *statuses)
+{
+  vector<rocksdb::ColumnFamilyHandle*> cfs(num_keys);
+  vector<rocksdb::Slice> slices(num_keys);
+  vector<string> combined;
+  auto shards = cf_handles.find(prefix);
+  if (shards != cf_handles.end()) {
+    for (size_t i = 0; i < num_keys; ++i) {
+      cfs[i] = get_key_cf(shards->second, keys[i].c_str(), keys[i].size());
+      slices[i] = rocksdb::Slice(keys[i]);
+    }
+  } else {
+    // slices point into combined, so it must not reallocate
+    combined.reserve(num_keys);
+    for (size_t i = 0; i < num_keys; ++i) {
+      combined.push_back(combine_strings(prefix, keys[i]));
+      cfs[i] = default_cf;
+      slices[i] = rocksdb::Slice(combined.back());
+    }
+  }
+  values->resize(num_keys);
+  statuses->resize(num_keys);
+  rocksdb::ReadOptions options;
+  // let rocksdb issue the data block reads of one batch concurrently
+  options.async_io = cct->_conf.get_val<bool>("rocksdb_multiget_async_io");
+  db->MultiGet(options, num_keys, cfs.data(), slices.data(),
+	       values->data(), statuses->data());
+  logger->inc(l_rocksdb_get_batch_keys, num_keys);
+}
+
 int RocksDBStore::get(
     const string &prefix,
     const std::set<string> &keys,
     std::map<string, bufferlist> *out)
 {
-  rocksdb::PinnableSlice value;
   utime_t start = ceph_clock_now();
-  if (cf_handles.count(prefix) > 0) {
-    for (auto& key : keys) {
-      auto cf_handle = get_cf_handle(prefix, key);
-      auto status = db->Get(rocksdb::ReadOptions(),
-			    cf_handle,
-			    rocksdb::Slice(key),
-			    &value);
-      if (status.ok()) {
-	(*out)[key].append(value.data(), value.size());
-      } else if (status.IsIOError()) {
-	ceph_abort_msg(status.getState());
-      }
-      value.Reset();
-    }
-  } else {
-    for (auto& key : keys) {
-      string k = combine_strings(prefix, key);
-      auto status = db->Get(rocksdb::ReadOptions(),
-			    default_cf,
-			    rocksdb::Slice(k),
-			    &value);
-      if (status.ok()) {
-	(*out)[key].append(value.data(), value.size());
-      } else if (status.IsIOError()) {
-	ceph_abort_msg(status.getState());
-      }
-      value.Reset();
+  vector<string> kv(keys.begin(), keys.end());
+  vector<rocksdb::PinnableSlice> values;
+  vector<rocksdb::Status> statuses;
+  multi_get(prefix, kv.size(), kv.data(), &values, &statuses);
+  for (size_t i = 0; i < kv.size(); ++i) {
+    if (statuses[i].ok()) {
+      (*out)[kv[i]].append(values[i].data(), values[i].size());
+    } else if (statuses[i].IsIOError()) {
+      ceph_abort_msg(statuses[i].getState());
     }
   }
   utime_t lat = ceph_clock_now() - start;
@@ -1932,6 +2143,33 @@ int RocksDBStore::get(
   return 0;
 }
 
+int RocksDBStore::get_batch(
+    const string &prefix,
+    const vector<string> &keys,
+    vector<std::optional<bufferlist>> *out)
+{
+  out->clear();
+  out->resize(keys.size());
+  if (keys.empty()) {
+    return 0;
+  }
+  utime_t start = ceph_clock_now();
+  vector<rocksdb::PinnableSlice> values;
+  vector<rocksdb::Status> statuses;
+  multi_get(prefix, keys.size(), keys.data(), &values, &statuses);
+  for (size_t i = 0; i < keys.size(); ++i) {
+    if (statuses[i].ok()) {
+      (*out)[i].emplace();
+      (*out)[i]->append(values[i].data(), values[i].size());
+    } else if (statuses[i].IsIOError()) {
+      ceph_abort_msg(statuses[i].getState());
+    }
+  }
+  utime_t lat = ceph_clock_now() - start;
+  logger->tinc(l_rocksdb_get_batch_latency, lat);
+  return 0;
+}
+
 int RocksDBStore::get(
     const string &prefix,
     const string &key,
@@ -2347,12 +2585,14 @@ public:
   explicit CFIteratorImpl(const RocksDBStore* db,
                           const std::string& p,
                           rocksdb::ColumnFamilyHandle* cf,
-                          KeyValueDB::IteratorBounds bounds_)
+                          KeyValueDB::IteratorBounds bounds_,
+                          KeyValueDB::IteratorOpts opts = 0)
     : prefix(p), bounds(std::move(bounds_)),
       iterate_lower_bound(make_slice(bounds.lower_bound)),
       iterate_upper_bound(make_slice(bounds.upper_bound))
       {
       auto options = rocksdb::ReadOptions();
+      db->get_iterator_read_options(opts, &options);
       if (db->cct->_conf->osd_rocksdb_iterator_bounds_enabled) {
         if (bounds.lower_bound) {
           options.iterate_lower_bound = &iterate_lower_bound;
@@ -2939,13 +3179,15 @@ public:
   explicit ShardMergeIteratorImpl(const RocksDBStore* db,
 				  const std::string& prefix,
 				  const std::vector<rocksdb::ColumnFamilyHandle*>& shards,
-                  KeyValueDB::IteratorBounds bounds_)
+                  KeyValueDB::IteratorBounds bounds_,
+                  KeyValueDB::IteratorOpts opts = 0)
     : db(db), keyless(db->comparator), prefix(prefix), bounds(std::move(bounds_)),
       iterate_lower_bound(make_slice(bounds.lower_bound)),
       iterate_upper_bound(make_slice(bounds.upper_bound))
   {
     iters.reserve(shards.size());
     auto options = rocksdb::ReadOptions();
+    db->get_iterator_read_options(opts, &options);
     if (db->cct->_conf->osd_rocksdb_iterator_bounds_enabled) {
       if (bounds.lower_bound) {
         options.iterate_lower_bound = &iterate_lower_bound;
@@ -3136,6 +3378,27 @@ public:
   }
 };
 
+void RocksDBStore::get_iterator_read_options(IteratorOpts opts,
+					     rocksdb::ReadOptions* options) const
+{
+  if (opts & ITERATOR_NOCACHE) {
+    options->fill_cache = false;
+  }
+  if (opts & ITERATOR_SCAN) {
+    // explicit readahead if configured, otherwise let rocksdb grow its
+    // own readahead as long as the scan stays sequential
+    options->readahead_size =
+      cct->_conf.get_val<Option::size_t>("rocksdb_iterator_scan_readahead");
+#if (ROCKSDB_MAJOR >= 7 || (ROCKSDB_MAJOR == 6 && ROCKSDB_MINOR >= 22))
+    options->adaptive_readahead = true;
+#endif
+#if (ROCKSDB_MAJOR > 7 || (ROCKSDB_MAJOR == 7 && ROCKSDB_MINOR >= 2))
+    options->async_io =
+      cct->_conf.get_val<bool>("rocksdb_iterator_scan_async_io");
+#endif
+  }
+}
+
 KeyValueDB::Iterator RocksDBStore::get_iterator(const std::string& prefix, IteratorOpts opts, IteratorBounds bounds)
 {
   auto cf_it = cf_handles.find(prefix);
@@ -3151,22 +3414,36 @@ KeyValueDB::Iterator RocksDBStore::get_iterator(const std::string& prefix, Itera
               this,
               prefix,
               cf,
-              std::move(bounds));
+              std::move(bounds),
+              opts);
     } else {
       return std::make_shared<ShardMergeIteratorImpl>(
         this,
         prefix,
         cf_it->second.handles,
-        std::move(bounds));
+        std::move(bounds),
+        opts);
     }
+  } else if (prefix.empty()) {
+    return KeyValueDB::make_iterator(prefix, get_wholespace_iterator(opts));
   } else {
-    // use wholespace engine if no cfs are configured
-    // or use default cf otherwise as there is no
-    // matching cf for the specified prefix.
-    auto w_it = cf_handles.size() == 0 || prefix.empty() ?
-      get_wholespace_iterator(opts) :
-      get_default_cf_iterator();
-    return KeyValueDB::make_iterator(prefix, w_it);
+    // use default cf if no cfs are configured or there is no matching
+    // cf for the specified prefix.  keys there are prefix\0key, so bound
+    // the iterator to the prefix to keep rocksdb from reading past it.
+    std::string lower_key, upper_key;
+    if (cct->_conf->osd_rocksdb_iterator_bounds_enabled) {
+      lower_key = combine_strings(prefix, bounds.lower_bound.value_or(""));
+      if (bounds.upper_bound) {
+        upper_key = combine_strings(prefix, *bounds.upper_bound);
+      } else {
+        upper_key = prefix;
+        upper_key.push_back(1);
+      }
+    }
+    return KeyValueDB::make_iterator(
+      prefix,
+      std::make_shared<RocksDBWholeSpaceIteratorImpl>(
+        this, default_cf, opts, std::move(lower_key), std::move(upper_key)));
   }
 }
 
@@ -3180,13 +3457,15 @@ RocksDBStore::WholeSpaceIterator RocksDBStore::new_shard_iterator(rocksdb::Colum
 
 KeyValueDB::Iterator RocksDBStore::new_shard_iterator(rocksdb::ColumnFamilyHandle* cf,
 						      const std::string& prefix,
-						      IteratorBounds bounds)
+						      IteratorBounds bounds,
+						      IteratorOpts opts)
 {
   return std::make_shared<CFIteratorImpl>(
     this,
     prefix,
     cf,
-    std::move(bounds));
+    std::move(bounds),
+    opts);
 }
 
 RocksDBStore::WholeSpaceIterator RocksDBStore::get_wholespace_iterator(IteratorOpts opts)
@@ -35,6 +35,8 @@
 enum {
   l_rocksdb_first = 34300,
   l_rocksdb_get_latency,
+  l_rocksdb_get_batch_latency,
+  l_rocksdb_get_batch_keys,
   l_rocksdb_submit_latency,
   l_rocksdb_submit_sync_latency,
   l_rocksdb_compact,
@@ -141,6 +143,11 @@ private:
   rocksdb::ColumnFamilyHandle *check_cf_handle_bounds(const cf_handles_iterator& it, const IteratorBounds& bounds);
 
   int submit_common(rocksdb::WriteOptions& woptions, KeyValueDB::Transaction t);
+  void multi_get(const std::string &prefix,
+		 size_t num_keys,
+		 const std::string *keys,
+		 std::vector<rocksdb::PinnableSlice> *values,
+		 std::vector<rocksdb::Status> *statuses);
   int install_cf_mergeop(const std::string &cf_name, rocksdb::ColumnFamilyOptions *cf_opt);
   int create_db_dir();
   int do_open(std::ostream &out, bool create_if_missing, bool open_readonly,
@@ -170,10 +177,14 @@ private:
   std::shared_ptr<rocksdb::Cache> create_block_cache(const std::string& cache_type, size_t cache_size, double cache_prio_high = 0.0);
   int split_column_family_options(const std::string& opts_str,
 				  std::unordered_map<std::string, std::string>* column_opts_map,
-				  std::string* block_cache_opt);
+				  std::string* block_cache_opt,
+				  std::string* blob_files_opt);
   int apply_block_cache_options(const std::string& column_name,
 				const std::string& block_cache_opt,
 				rocksdb::ColumnFamilyOptions* cf_opt);
+  int apply_blob_files_options(const std::string& column_name,
+			       const std::string& blob_files_opt,
+			       rocksdb::ColumnFamilyOptions* cf_opt);
   int update_column_family_options(const std::string& base_name,
 				   const std::string& more_options,
 				   rocksdb::ColumnFamilyOptions* cf_opt);
@@ -361,20 +372,44 @@ public:
     const char *key,
     size_t keylen,
     ceph::bufferlist *out) override;
+  int get_batch(
+    const std::string &prefix,
+    const std::vector<std::string> &keys,
+    std::vector<std::optional<ceph::bufferlist>> *out) override;
+
 
+  /// translate IteratorOpts hints to rocksdb read options
+  void get_iterator_read_options(IteratorOpts opts,
+				 rocksdb::ReadOptions* options) const;
 
   class RocksDBWholeSpaceIteratorImpl :
     public KeyValueDB::WholeSpaceIteratorImpl {
   protected:
     rocksdb::Iterator *dbiter;
+    const std::string lower_bound_key;
+    const std::string upper_bound_key;
+    const rocksdb::Slice iterate_lower_bound;
+    const rocksdb::Slice iterate_upper_bound;
   public:
+    /// lower_key and upper_key, when not empty, bound the raw keys
     explicit RocksDBWholeSpaceIteratorImpl(const RocksDBStore* db,
                                            rocksdb::ColumnFamilyHandle* cf,
-                                           const KeyValueDB::IteratorOpts opts)
+                                           const KeyValueDB::IteratorOpts opts,
+                                           std::string lower_key = std::string(),
+                                           std::string upper_key = std::string())
+      : lower_bound_key(std::move(lower_key)),
+        upper_bound_key(std::move(upper_key)),
+        iterate_lower_bound(lower_bound_key),
+        iterate_upper_bound(upper_bound_key)
       {
         rocksdb::ReadOptions options = rocksdb::ReadOptions();
-        if (opts & ITERATOR_NOCACHE)
-          options.fill_cache=false;
+        db->get_iterator_read_options(opts, &options);
+        if (!lower_bound_key.empty()) {
+          options.iterate_lower_bound = &iterate_lower_bound;
+        }
+        if (!upper_bound_key.empty()) {
+          options.iterate_upper_bound = &iterate_upper_bound;
+        }
         dbiter = db->db->NewIterator(options, cf);
     }
     ~RocksDBWholeSpaceIteratorImpl() override;
@@ -406,7 +441,8 @@ private:
   /// this iterator spans single cf
   WholeSpaceIterator new_shard_iterator(rocksdb::ColumnFamilyHandle* cf);
   Iterator new_shard_iterator(rocksdb::ColumnFamilyHandle* cf,
-			      const std::string& prefix, IteratorBounds bound);
+			      const std::string& prefix, IteratorBounds bound,
+			      IteratorOpts opts = 0);
 public:
   /// Utility
   static std::string combine_strings(const std::string &prefix, const std::string &value) {
@@ -537,6 +573,12 @@ err:
     return nullptr;
   }
 
+  std::map<std::string, std::shared_ptr<PriorityCache::PriCache>>
+      get_priority_caches() const override;
+  void enable_cache_lookup_stats() override;
+  int get_cache_lookup_stats(const std::string& prefix,
+                             uint64_t* hits, uint64_t* misses) const override;
+
   WholeSpaceIterator get_wholespace_iterator(IteratorOpts opts = 0) override;
 private:
   WholeSpaceIterator get_default_cf_iterator();
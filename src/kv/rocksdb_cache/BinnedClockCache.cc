@@ -0,0 +1,853 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ */
+
+#ifndef __STDC_FORMAT_MACROS
+#define __STDC_FORMAT_MACROS
+#endif
+
+#include "BinnedClockCache.h"
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <string>
+
+#define dout_context cct
+#define dout_subsys ceph_subsys_rocksdb
+#undef dout_prefix
+#define dout_prefix *_dout << "rocksdb: "
+
+namespace rocksdb_cache {
+
+namespace {
+// Used to size the first table when the caller has no better estimate;
+// matches the default rocksdb_block_size.
+constexpr size_t DEFAULT_ENTRY_CHARGE = 4096;
+constexpr int MIN_TABLE_BITS = 4;
+constexpr int MAX_TABLE_BITS = 30;
+
+// A table is grown once it is 3/4 full.
+inline uint32_t max_occupancy(const BinnedClockHandleTable* t) {
+  return t->length - t->length / 4;
+}
+}
+
+using H = BinnedClockHandle;
+
+BinnedClockHandleTable::BinnedClockHandleTable(int bits)
+  : length_bits(bits),
+    length(1u << bits),
+    mask(length - 1),
+    slots(new BinnedClockHandle[length]) {
+}
+
+BinnedClockCacheShard::BinnedClockCacheShard(CephContext *c, size_t capacity,
+                                             bool strict_capacity_limit,
+                                             double high_pri_pool_ratio,
+                                             size_t estimated_entry_charge)
+    : cct(c),
+      estimated_entry_charge_(estimated_entry_charge ?
+                              estimated_entry_charge : DEFAULT_ENTRY_CHARGE),
+      capacity_(0),
+      strict_capacity_limit_(strict_capacity_limit),
+      high_pri_pool_ratio_(high_pri_pool_ratio),
+      high_pri_pool_capacity_(0),
+      num_tables_(0),
+      age_bins_(new std::atomic<int64_t>[MAX_AGE_BINS]),
+      bin_count_(1),
+      usage_(0),
+      high_pri_pool_usage_(0),
+      standalone_usage_(0),
+      bin_epoch_(0),
+      clock_pointer_(0) {
+  for (uint32_t i = 0; i < MAX_AGE_BINS; i++) {
+    age_bins_[i].store(0, std::memory_order_relaxed);
+  }
+  uint64_t entries = std::max<uint64_t>(capacity / estimated_entry_charge_, 1);
+  int bits = MIN_TABLE_BITS;
+  while (bits < MAX_TABLE_BITS &&
+         ((1ull << bits) - (1ull << bits) / 4) < entries) {
+    ++bits;
+  }
+  tables_[0] = std::make_unique<BinnedClockHandleTable>(bits);
+  num_tables_.store(1, std::memory_order_release);
+  SetCapacity(capacity);
+}
+
+BinnedClockCacheShard::~BinnedClockCacheShard() {
+  int n = num_tables_.load(std::memory_order_acquire);
+  for (int i = 0; i < n; i++) {
+    auto t = tables_[i].get();
+    for (uint32_t j = 0; j < t->length; j++) {
+      BinnedClockHandle* h = &t->slots[j];
+      uint64_t meta = h->meta.load(std::memory_order_acquire);
+      uint64_t state = H::GetState(meta);
+      if ((state == H::STATE_VISIBLE || state == H::STATE_INVISIBLE) &&
+          H::GetRefs(meta) == 0) {
+        if (h->deleter) {
+          (*h->deleter)(h->key(), h->value);
+        }
+        delete[] h->key_data;
+      }
+    }
+  }
+}
+
+BinnedClockHandle* BinnedClockCacheShard::Find(BinnedClockHandleTable* t,
+                                               const rocksdb::Slice& key,
+                                               uint32_t hash,
+                                               const BinnedClockHandle* skip) {
+  uint32_t pos = t->ProbeStart(hash);
+  const uint32_t step = t->ProbeStep(hash);
+  for (uint32_t i = 0; i < t->length; i++) {
+    BinnedClockHandle* h = &t->slots[pos];
+    uint64_t meta = h->meta.load(std::memory_order_acquire);
+    if (H::GetState(meta) == H::STATE_VISIBLE && h != skip) {
+      // take the reference first so that the key can't change under us
+      meta = h->meta.fetch_add(1, std::memory_order_acq_rel);
+      if (H::GetState(meta) == H::STATE_VISIBLE &&
+          h->hash == hash && h->key() == key) {
+        return h;
+      }
+      Unref(h, false);
+    }
+    if (h->displacements.load(std::memory_order_relaxed) == 0) {
+      break;
+    }
+    pos = (pos + step) & t->mask;
+  }
+  return nullptr;
+}
+
+BinnedClockHandle* BinnedClockCacheShard::Claim(BinnedClockHandleTable* t,
+                                                uint32_t hash,
+                                                uint32_t max_probes) {
+  uint32_t pos = t->ProbeStart(hash);
+  const uint32_t step = t->ProbeStep(hash);
+  max_probes = std::min(max_probes, t->length);
+  for (uint32_t i = 0; i < max_probes; i++) {
+    BinnedClockHandle* h = &t->slots[pos];
+    uint64_t expected = H::STATE_EMPTY;
+    if (h->meta.load(std::memory_order_relaxed) == H::STATE_EMPTY &&
+        h->meta.compare_exchange_strong(expected, H::STATE_CONSTRUCTION,
+                                        std::memory_order_acq_rel)) {
+      t->occupancy.fetch_add(1, std::memory_order_relaxed);
+      return h;
+    }
+    h->displacements.fetch_add(1, std::memory_order_relaxed);
+    pos = (pos + step) & t->mask;
+  }
+  Rollback(t, hash, nullptr, max_probes);
+  return nullptr;
+}
+
+void BinnedClockCacheShard::Rollback(BinnedClockHandleTable* t, uint32_t hash,
+                                     const BinnedClockHandle* end,
+                                     uint32_t count) {
+  uint32_t pos = t->ProbeStart(hash);
+  const uint32_t step = t->ProbeStep(hash);
+  for (uint32_t i = 0; i < count; i++) {
+    BinnedClockHandle* h = &t->slots[pos];
+    if (h == end) {
+      break;
+    }
+    h->displacements.fetch_sub(1, std::memory_order_relaxed);
+    pos = (pos + step) & t->mask;
+  }
+}
+
+bool BinnedClockCacheShard::Grow(int num_tables) {
+  std::lock_guard<std::mutex> l(grow_mutex_);
+  int n = num_tables_.load(std::memory_order_relaxed);
+  if (n != num_tables) {
+    return true;
+  }
+  int bits = tables_[n - 1]->length_bits + 1;
+  // entries smaller than estimated; grow only while the capacity would
+  // actually hold more of them, otherwise eviction makes room.
+  if (n == MAX_TABLES || bits > MAX_TABLE_BITS ||
+      usage_.load(std::memory_order_relaxed) >=
+        capacity_.load(std::memory_order_relaxed)) {
+    return false;
+  }
+  tables_[n] = std::make_unique<BinnedClockHandleTable>(bits);
+  num_tables_.store(n + 1, std::memory_order_release);
+  ldout(cct, 10) << __func__ << " added table " << n << " with "
+                 << tables_[n]->length << " slots" << dendl;
+  return true;
+}
+
+bool BinnedClockCacheShard::Unref(BinnedClockHandle* h, bool erase_if_last) {
+  uint64_t old = h->meta.fetch_sub(1, std::memory_order_acq_rel);
+  ceph_assert(H::GetRefs(old) > 0);
+  if (H::GetRefs(old) != 1) {
+    return false;
+  }
+  if (old & H::STANDALONE) {
+    usage_.fetch_sub(h->charge, std::memory_order_relaxed);
+    standalone_usage_.fetch_sub(h->charge, std::memory_order_relaxed);
+    if (h->deleter) {
+      (*h->deleter)(h->key(), h->value);
+    }
+    delete[] h->key_data;
+    delete h;
+    return true;
+  }
+  uint64_t state = H::GetState(old);
+  if (state == H::STATE_INVISIBLE ||
+      (state == H::STATE_VISIBLE && erase_if_last)) {
+    // may fail if somebody took a (transient) reference meanwhile; the
+    // last one to drop its reference retries
+    uint64_t expected = old - 1;
+    if (h->meta.compare_exchange_strong(expected, H::STATE_CONSTRUCTION,
+                                        std::memory_order_acq_rel)) {
+      FreeEntry(h);
+      return true;
+    }
+  }
+  return false;
+}
+
+void BinnedClockCacheShard::FreeEntry(BinnedClockHandle* h) {
+  BinnedClockHandleTable* t = nullptr;
+  int n = num_tables_.load(std::memory_order_acquire);
+  for (int i = 0; i < n; i++) {
+    if (tables_[i]->Contains(h)) {
+      t = tables_[i].get();
+      break;
+    }
+  }
+  ceph_assert(t);
+
+  usage_.fetch_sub(h->charge, std::memory_order_relaxed);
+  if (h->high_pri) {
+    high_pri_pool_usage_.fetch_sub(h->charge, std::memory_order_relaxed);
+  } else {
+    AddToBin(h->age_epoch.load(std::memory_order_relaxed),
+             -static_cast<int64_t>(h->charge));
+  }
+  if (h->deleter) {
+    (*h->deleter)(h->key(), h->value);
+  }
+  delete[] h->key_data;
+  h->key_data = nullptr;
+  h->value = nullptr;
+  h->deleter = nullptr;
+  Rollback(t, h->hash, h, t->length);
+  t->occupancy.fetch_sub(1, std::memory_order_relaxed);
+  // keep the transient references of concurrent lookups intact
+  h->meta.fetch_and(~(H::STATE_MASK | H::COUNTDOWN_MASK),
+                    std::memory_order_release);
+}
+
+uint64_t BinnedClockCacheShard::GetCountdown(bool high_pri, bool hit) const {
+  if (high_pri &&
+      high_pri_pool_usage_.load(std::memory_order_relaxed) <=
+        high_pri_pool_capacity_.load(std::memory_order_relaxed)) {
+    return 3;
+  }
+  return hit ? 2 : 1;
+}
+
+void BinnedClockCacheShard::Touch(BinnedClockHandle* h) {
+  // avoid writing to the slot unless the countdown actually goes up
+  uint64_t want = GetCountdown(h->high_pri, true) << H::COUNTDOWN_SHIFT;
+  uint64_t meta = h->meta.load(std::memory_order_relaxed);
+  if ((meta & H::COUNTDOWN_MASK) < want) {
+    h->meta.compare_exchange_weak(meta, (meta & ~H::COUNTDOWN_MASK) | want,
+                                  std::memory_order_relaxed);
+  }
+  if (!h->high_pri) {
+    uint32_t epoch = bin_epoch_.load(std::memory_order_relaxed);
+    uint32_t old = h->age_epoch.load(std::memory_order_relaxed);
+    if (old != epoch &&
+        h->age_epoch.compare_exchange_strong(old, epoch,
+                                             std::memory_order_relaxed)) {
+      AddToBin(old, -static_cast<int64_t>(h->charge));
+      AddToBin(epoch, h->charge);
+    }
+  }
+}
+
+BinnedClockHandle* BinnedClockCacheShard::GetSlot(uint64_t pos) {
+  int n = num_tables_.load(std::memory_order_acquire);
+  for (int i = 0; i < n; i++) {
+    auto t = tables_[i].get();
+    if (pos < t->length) {
+      return &t->slots[pos];
+    }
+    pos -= t->length;
+  }
+  ceph_abort_msg("slot out of range");
+}
+
+uint64_t BinnedClockCacheShard::GetTotalSlots() const {
+  uint64_t total = 0;
+  int n = num_tables_.load(std::memory_order_acquire);
+  for (int i = 0; i < n; i++) {
+    total += tables_[i]->length;
+  }
+  return total;
+}
+
+void BinnedClockCacheShard::Evict(size_t charge) {
+  const uint64_t total = GetTotalSlots();
+  // an entry may need one visit per countdown step before it goes
+  const uint64_t max_scan = total * 4;
+  uint64_t scanned = 0;
+  while (usage_.load(std::memory_order_relaxed) + charge >
+           capacity_.load(std::memory_order_relaxed) &&
+         scanned < max_scan) {
+    uint64_t pos = clock_pointer_.fetch_add(CLOCK_STEP,
+                                            std::memory_order_relaxed);
+    for (uint32_t i = 0; i < CLOCK_STEP; i++) {
+      BinnedClockHandle* h = GetSlot((pos + i) % total);
+      uint64_t meta = h->meta.load(std::memory_order_relaxed);
+      if (H::GetState(meta) != H::STATE_VISIBLE || H::GetRefs(meta) != 0) {
+        continue;
+      }
+      if (meta & H::COUNTDOWN_MASK) {
+        h->meta.compare_exchange_strong(meta,
+                                        meta - (1ull << H::COUNTDOWN_SHIFT),
+                                        std::memory_order_relaxed);
+      } else if (h->meta.compare_exchange_strong(meta, H::STATE_CONSTRUCTION,
+                                                 std::memory_order_acq_rel)) {
+        FreeEntry(h);
+      }
+    }
+    scanned += CLOCK_STEP;
+  }
+}
+
+void BinnedClockCacheShard::EraseUnRefEntries() {
+  int n = num_tables_.load(std::memory_order_acquire);
+  for (int i = 0; i < n; i++) {
+    auto t = tables_[i].get();
+    for (uint32_t j = 0; j < t->length; j++) {
+      BinnedClockHandle* h = &t->slots[j];
+      uint64_t meta = h->meta.load(std::memory_order_relaxed);
+      if (H::GetState(meta) == H::STATE_VISIBLE && H::GetRefs(meta) == 0 &&
+          h->meta.compare_exchange_strong(meta, H::STATE_CONSTRUCTION,
+                                          std::memory_order_acq_rel)) {
+        FreeEntry(h);
+      }
+    }
+  }
+}
+
+void BinnedClockCacheShard::ApplyToAllCacheEntries(
+  const std::function<void(const rocksdb::Slice& key,
+                           void* value,
+                           size_t charge,
+                           DeleterFn)>& callback,
+  bool thread_safe)
+{
+  // the entries are pinned while the callback runs, so this is always
+  // thread safe
+  int n = num_tables_.load(std::memory_order_acquire);
+  for (int i = 0; i < n; i++) {
+    auto t = tables_[i].get();
+    for (uint32_t j = 0; j < t->length; j++) {
+      BinnedClockHandle* h = &t->slots[j];
+      if (H::GetState(h->meta.load(std::memory_order_acquire)) !=
+          H::STATE_VISIBLE) {
+        continue;
+      }
+      uint64_t meta = h->meta.fetch_add(1, std::memory_order_acq_rel);
+      if (H::GetState(meta) == H::STATE_VISIBLE) {
+        callback(h->key(), h->value, h->charge, h->deleter);
+      }
+      Unref(h, false);
+    }
+  }
+}
+
+size_t BinnedClockCacheShard::TEST_GetOccupancy() const {
+  size_t occupancy = 0;
+  int n = num_tables_.load(std::memory_order_acquire);
+  for (int i = 0; i < n; i++) {
+    occupancy += tables_[i]->occupancy.load(std::memory_order_relaxed);
+  }
+  return occupancy;
+}
+
+int BinnedClockCacheShard::TEST_GetNumTables() const {
+  return num_tables_.load(std::memory_order_acquire);
+}
+
+double BinnedClockCacheShard::GetHighPriPoolRatio() const {
+  return high_pri_pool_ratio_.load(std::memory_order_relaxed);
+}
+
+size_t BinnedClockCacheShard::GetHighPriPoolUsage() const {
+  return high_pri_pool_usage_.load(std::memory_order_relaxed);
+}
+
+void BinnedClockCacheShard::AddToBin(uint32_t epoch, int64_t delta) {
+  uint32_t cur = bin_epoch_.load(std::memory_order_relaxed);
+  // charges of epochs that left the window are not tracked any more
+  if (cur - epoch < bin_count_.load(std::memory_order_relaxed)) {
+    age_bins_[epoch % MAX_AGE_BINS].fetch_add(delta,
+                                              std::memory_order_relaxed);
+  }
+}
+
+uint64_t BinnedClockCacheShard::sum_bins(uint32_t start, uint32_t end) const {
+  uint32_t epoch = bin_epoch_.load(std::memory_order_acquire);
+  end = std::min(end, bin_count_.load(std::memory_order_relaxed));
+  uint64_t bytes = 0;
+  for (auto i = start; i < end; i++) {
+    // racing updates may briefly leave a bin negative
+    int64_t b = age_bins_[(epoch - i) % MAX_AGE_BINS].load(
+      std::memory_order_relaxed);
+    if (b > 0) {
+      bytes += b;
+    }
+  }
+  return bytes;
+}
+
+void BinnedClockCacheShard::SetCapacity(size_t capacity) {
+  capacity_.store(capacity, std::memory_order_relaxed);
+  high_pri_pool_capacity_.store(
+    capacity * high_pri_pool_ratio_.load(std::memory_order_relaxed),
+    std::memory_order_relaxed);
+  Evict(0);
+}
+
+void BinnedClockCacheShard::SetStrictCapacityLimit(bool strict_capacity_limit) {
+  strict_capacity_limit_.store(strict_capacity_limit,
+                               std::memory_order_relaxed);
+}
+
+void BinnedClockCacheShard::SetHighPriPoolRatio(double high_pri_pool_ratio) {
+  high_pri_pool_ratio_.store(high_pri_pool_ratio, std::memory_order_relaxed);
+  high_pri_pool_capacity_.store(
+    capacity_.load(std::memory_order_relaxed) * high_pri_pool_ratio,
+    std::memory_order_relaxed);
+}
+
+rocksdb::Cache::Handle* BinnedClockCacheShard::Lookup(const rocksdb::Slice& key, uint32_t hash) {
+  int n = num_tables_.load(std::memory_order_acquire);
+  for (int i = n - 1; i >= 0; i--) {
+    BinnedClockHandle* h = Find(tables_[i].get(), key, hash);
+    if (h != nullptr) {
+      Touch(h);
+      return reinterpret_cast<rocksdb::Cache::Handle*>(h);
+    }
+  }
+  return nullptr;
+}
+
+bool BinnedClockCacheShard::Ref(rocksdb::Cache::Handle* handle) {
+  BinnedClockHandle* h = reinterpret_cast<BinnedClockHandle*>(handle);
+  // To create another reference - entry must be already externally referenced
+  uint64_t old = h->meta.fetch_add(1, std::memory_order_relaxed);
+  ceph_assert(H::GetRefs(old) > 0);
+  return true;
+}
+
+bool BinnedClockCacheShard::Release(rocksdb::Cache::Handle* handle, bool force_erase) {
+  if (handle == nullptr) {
+    return false;
+  }
+  BinnedClockHandle* h = reinterpret_cast<BinnedClockHandle*>(handle);
+  // the cache is full; take this opportunity and remove the item
+  bool erase = force_erase ||
+    usage_.load(std::memory_order_relaxed) >
+      capacity_.load(std::memory_order_relaxed);
+  return Unref(h, erase);
+}
+
+rocksdb::Status BinnedClockCacheShard::Insert(const rocksdb::Slice& key, uint32_t hash, void* value,
+                             size_t charge,
+                             DeleterFn deleter,
+                             rocksdb::Cache::Handle** handle, rocksdb::Cache::Priority priority) {
+  if (usage_.load(std::memory_order_relaxed) + charge >
+      capacity_.load(std::memory_order_relaxed)) {
+    Evict(charge);
+    if (usage_.load(std::memory_order_relaxed) + charge >
+          capacity_.load(std::memory_order_relaxed) &&
+        (strict_capacity_limit_.load(std::memory_order_relaxed) ||
+         handle == nullptr)) {
+      if (handle == nullptr) {
+        // Don't insert the entry but still return ok, as if the entry inserted
+        // into cache and get evicted immediately.
+        if (deleter) {
+          (*deleter)(key, value);
+        }
+        return rocksdb::Status::OK();
+      }
+      *handle = nullptr;
+      return rocksdb::Status::Incomplete("Insert failed due to clock cache being full.");
+    }
+  }
+
+  BinnedClockHandle* h = nullptr;
+  for (;;) {
+    int n = num_tables_.load(std::memory_order_acquire);
+    BinnedClockHandleTable* t = tables_[n - 1].get();
+    if (t->occupancy.load(std::memory_order_relaxed) < max_occupancy(t)) {
+      h = Claim(t, hash, t->length);
+    }
+    if (h != nullptr || !Grow(n)) {
+      break;
+    }
+  }
+  if (h == nullptr) {
+    // out of tables; squeeze the entry into whatever room is left
+    int n = num_tables_.load(std::memory_order_acquire);
+    for (int i = n - 1; i >= 0 && h == nullptr; i--) {
+      h = Claim(tables_[i].get(), hash, tables_[i]->length);
+    }
+  }
+  bool standalone = false;
+  if (h == nullptr) {
+    if (handle == nullptr) {
+      if (deleter) {
+        (*deleter)(key, value);
+      }
+      return rocksdb::Status::OK();
+    }
+    // the caller needs the value; hand out an entry living outside of the
+    // tables which goes away with its last reference
+    h = new BinnedClockHandle();
+    standalone = true;
+  }
+
+  const bool high_pri = priority == rocksdb::Cache::Priority::HIGH;
+  h->hash = hash;
+  h->high_pri = high_pri && !standalone;
+  h->value = value;
+  h->deleter = deleter;
+  h->charge = charge;
+  h->key_length = key.size();
+  h->key_data = new char[h->key_length];
+  std::copy_n(key.data(), h->key_length, h->key_data);
+  usage_.fetch_add(charge, std::memory_order_relaxed);
+
+  if (standalone) {
+    standalone_usage_.fetch_add(charge, std::memory_order_relaxed);
+    h->meta.store(H::STANDALONE | H::STATE_VISIBLE | 1,
+                  std::memory_order_release);
+    *handle = reinterpret_cast<rocksdb::Cache::Handle*>(h);
+    return rocksdb::Status::OK();
+  }
+
+  if (high_pri) {
+    high_pri_pool_usage_.fetch_add(charge, std::memory_order_relaxed);
+  } else {
+    uint32_t epoch = bin_epoch_.load(std::memory_order_relaxed);
+    h->age_epoch.store(epoch, std::memory_order_relaxed);
+    AddToBin(epoch, charge);
+  }
+  // CONSTRUCTION -> VISIBLE, preserving any transient references
+  h->meta.fetch_add((H::STATE_VISIBLE - H::STATE_CONSTRUCTION) +
+                    (GetCountdown(high_pri, false) << H::COUNTDOWN_SHIFT) +
+                    (handle != nullptr ? 1 : 0),
+                    std::memory_order_acq_rel);
+
+  // replace older entries with the same key
+  int n = num_tables_.load(std::memory_order_acquire);
+  for (int i = 0; i < n; i++) {
+    BinnedClockHandle* old;
+    while ((old = Find(tables_[i].get(), key, hash, h)) != nullptr) {
+      old->meta.fetch_or(H::STATE_INVISIBLE, std::memory_order_acq_rel);
+      Unref(old, false);
+    }
+  }
+
+  if (handle != nullptr) {
+    *handle = reinterpret_cast<rocksdb::Cache::Handle*>(h);
+  }
+  return rocksdb::Status::OK();
+}
+
+void BinnedClockCacheShard::Erase(const rocksdb::Slice& key, uint32_t hash) {
+  int n = num_tables_.load(std::memory_order_acquire);
+  for (int i = 0; i < n; i++) {
+    BinnedClockHandle* h;
+    while ((h = Find(tables_[i].get(), key, hash)) != nullptr) {
+      // VISIBLE -> INVISIBLE; freed once the last reference is dropped
+      h->meta.fetch_or(H::STATE_INVISIBLE, std::memory_order_acq_rel);
+      Unref(h, false);
+    }
+  }
+}
+
+size_t BinnedClockCacheShard::GetUsage() const {
+  return usage_.load(std::memory_order_relaxed);
+}
+
+size_t BinnedClockCacheShard::GetPinnedUsage() const {
+  // pin each referenced entry while reading its charge
+  auto self = const_cast<BinnedClockCacheShard*>(this);
+  size_t pinned = standalone_usage_.load(std::memory_order_relaxed);
+  int n = num_tables_.load(std::memory_order_acquire);
+  for (int i = 0; i < n; i++) {
+    auto t = tables_[i].get();
+    for (uint32_t j = 0; j < t->length; j++) {
+      BinnedClockHandle* h = &t->slots[j];
+      uint64_t meta = h->meta.load(std::memory_order_relaxed);
+      if (H::GetRefs(meta) == 0 ||
+          H::GetState(meta) < H::STATE_VISIBLE) {
+        continue;
+      }
+      meta = h->meta.fetch_add(1, std::memory_order_acq_rel);
+      if (H::GetRefs(meta) > 0 && H::GetState(meta) >= H::STATE_VISIBLE) {
+        pinned += h->charge;
+      }
+      self->Unref(h, false);
+    }
+  }
+  return pinned;
+}
+
+void BinnedClockCacheShard::shift_bins() {
+  uint32_t epoch = bin_epoch_.load(std::memory_order_relaxed) + 1;
+  age_bins_[epoch % MAX_AGE_BINS].store(0, std::memory_order_relaxed);
+  bin_epoch_.store(epoch, std::memory_order_release);
+}
+
+uint32_t BinnedClockCacheShard::get_bin_count() const {
+  return bin_count_.load(std::memory_order_relaxed);
+}
+
+void BinnedClockCacheShard::set_bin_count(uint32_t count) {
+  if (count > MAX_AGE_BINS) {
+    ldout(cct, 5) << __func__ << " clamping bin count " << count
+                  << " to " << MAX_AGE_BINS << dendl;
+    count = MAX_AGE_BINS;
+  }
+  bin_count_.store(count, std::memory_order_relaxed);
+}
+
+std::string BinnedClockCacheShard::GetPrintableOptions() const {
+  const int kBufferSize = 200;
+  char buffer[kBufferSize];
+  snprintf(buffer, kBufferSize,
+           "    high_pri_pool_ratio: %.3lf\n"
+           "    table_slots: %" PRIu64 "\n",
+           GetHighPriPoolRatio(), GetTotalSlots());
+  return std::string(buffer);
+}
+
+DeleterFn BinnedClockCacheShard::GetDeleter(rocksdb::Cache::Handle* h) const
+{
+  auto* handle = reinterpret_cast<BinnedClockHandle*>(h);
+  return handle->deleter;
+}
+
+BinnedClockCache::BinnedClockCache(CephContext *c,
+                                   size_t capacity,
+                                   int num_shard_bits,
+                                   bool strict_capacity_limit,
+                                   double high_pri_pool_ratio,
+                                   size_t estimated_entry_charge)
+    : ShardedCache(capacity, num_shard_bits, strict_capacity_limit), cct(c) {
+  num_shards_ = 1 << num_shard_bits;
+  int rc = posix_memalign((void**) &shards_,
+                          CACHE_LINE_SIZE,
+                          sizeof(BinnedClockCacheShard) * num_shards_);
+  if (rc != 0) {
+    throw std::bad_alloc();
+  }
+  size_t per_shard = (capacity + (num_shards_ - 1)) / num_shards_;
+  for (int i = 0; i < num_shards_; i++) {
+    new (&shards_[i])
+        BinnedClockCacheShard(c, per_shard, strict_capacity_limit,
+                              high_pri_pool_ratio, estimated_entry_charge);
+  }
+}
+
+BinnedClockCache::~BinnedClockCache() {
+  for (int i = 0; i < num_shards_; i++) {
+    shards_[i].~BinnedClockCacheShard();
+  }
+  aligned_free(shards_);
+}
+
+CacheShard* BinnedClockCache::GetShard(int shard) {
+  return reinterpret_cast<CacheShard*>(&shards_[shard]);
+}
+
+const CacheShard* BinnedClockCache::GetShard(int shard) const {
+  return reinterpret_cast<CacheShard*>(&shards_[shard]);
+}
+
+void* BinnedClockCache::Value(Handle* handle) {
+  return reinterpret_cast<const BinnedClockHandle*>(handle)->value;
+}
+
+size_t BinnedClockCache::GetCharge(Handle* handle) const {
+  return reinterpret_cast<const BinnedClockHandle*>(handle)->charge;
+}
+
+uint32_t BinnedClockCache::GetHash(Handle* handle) const {
+  return reinterpret_cast<const BinnedClockHandle*>(handle)->hash;
+}
+
+void BinnedClockCache::DisownData() {
+// Do not drop data if compile with ASAN to suppress leak warning.
+#ifndef __SANITIZE_ADDRESS__
+  shards_ = nullptr;
+#endif  // !__SANITIZE_ADDRESS__
+}
+
+#if (ROCKSDB_MAJOR >= 7 || (ROCKSDB_MAJOR == 6 && ROCKSDB_MINOR >= 22))
+DeleterFn BinnedClockCache::GetDeleter(Handle* handle) const
+{
+  return reinterpret_cast<const BinnedClockHandle*>(handle)->deleter;
+}
+#endif
+
+size_t BinnedClockCache::TEST_GetOccupancy() const {
+  size_t occupancy = 0;
+  for (int i = 0; i < num_shards_; i++) {
+    occupancy += shards_[i].TEST_GetOccupancy();
+  }
+  return occupancy;
+}
+
+void BinnedClockCache::SetHighPriPoolRatio(double high_pri_pool_ratio) {
+  for (int i = 0; i < num_shards_; i++) {
+    shards_[i].SetHighPriPoolRatio(high_pri_pool_ratio);
+  }
+}
+
+double BinnedClockCache::GetHighPriPoolRatio() const {
+  double result = 0.0;
+  if (num_shards_ > 0) {
+    result = shards_[0].GetHighPriPoolRatio();
+  }
+  return result;
+}
+
+size_t BinnedClockCache::GetHighPriPoolUsage() const {
+  size_t usage = 0;
+  for (int s = 0; s < num_shards_; s++) {
+    usage += shards_[s].GetHighPriPoolUsage();
+  }
+  return usage;
+}
+
+// PriCache
+
+int64_t BinnedClockCache::request_cache_bytes(PriorityCache::Priority pri, uint64_t total_cache) const
+{
+  int64_t assigned = get_cache_bytes(pri);
+  int64_t request = 0;
+
+  switch(pri) {
+  // PRI0 is for rocksdb's high priority items (indexes/filters)
+  case PriorityCache::Priority::PRI0:
+    {
+      // Because we want the high pri cache to grow independently of the low
+      // pri cache, request a chunky allocation independent of the other
+      // priorities.
+      request = PriorityCache::get_chunk(GetHighPriPoolUsage(), total_cache);
+      break;
+    }
+  case PriorityCache::Priority::LAST:
+    {
+      auto max = get_bin_count();
+      request = GetUsage();
+      request -= GetHighPriPoolUsage();
+      request -= sum_bins(0, max);
+      break;
+    }
+  default:
+    {
+      ceph_assert(pri > 0 && pri < PriorityCache::Priority::LAST);
+      auto prev_pri = static_cast<PriorityCache::Priority>(pri - 1);
+      uint64_t start = get_bins(prev_pri);
+      uint64_t end = get_bins(pri);
+      request = sum_bins(start, end);
+      break;
+    }
+  }
+  request = (request > assigned) ? request - assigned : 0;
+  ldout(cct, 10) << __func__ << " Priority: " << static_cast<uint32_t>(pri)
+                 << " Request: " << request << dendl;
+  return request;
+}
+
+int64_t BinnedClockCache::commit_cache_size(uint64_t total_bytes)
+{
+  size_t old_bytes = GetCapacity();
+  int64_t new_bytes = PriorityCache::get_chunk(
+      get_cache_bytes(), total_bytes);
+  ldout(cct, 10) << __func__ << " old: " << old_bytes
+                 << " new: " << new_bytes << dendl;
+  SetCapacity((size_t) new_bytes);
+
+  double ratio = 0;
+  if (new_bytes > 0) {
+    int64_t pri0_bytes = get_cache_bytes(PriorityCache::Priority::PRI0);
+    ratio = (double) pri0_bytes / new_bytes;
+  }
+  ldout(cct, 5) << __func__ << " High Pri Pool Ratio set to " << ratio << dendl;
+  SetHighPriPoolRatio(ratio);
+  return new_bytes;
+}
+
+void BinnedClockCache::shift_bins() {
+  for (int s = 0; s < num_shards_; s++) {
+    shards_[s].shift_bins();
+  }
+}
+
+uint64_t BinnedClockCache::sum_bins(uint32_t start, uint32_t end) const {
+  uint64_t bytes = 0;
+  for (int s = 0; s < num_shards_; s++) {
+    bytes += shards_[s].sum_bins(start, end);
+  }
+  return bytes;
+}
+
+uint32_t BinnedClockCache::get_bin_count() const {
+  uint32_t result = 0;
+  if (num_shards_ > 0) {
+    result = shards_[0].get_bin_count();
+  }
+  return result;
+}
+
+void BinnedClockCache::set_bin_count(uint32_t count) {
+  for (int s = 0; s < num_shards_; s++) {
+    shards_[s].set_bin_count(count);
+  }
+}
+
+std::shared_ptr<rocksdb::Cache> NewBinnedClockCache(
+    CephContext *c,
+    size_t capacity,
+    int num_shard_bits,
+    bool strict_capacity_limit,
+    double high_pri_pool_ratio,
+    size_t estimated_entry_charge) {
+  if (num_shard_bits >= 20) {
+    return nullptr;  // the cache cannot be sharded into too many fine pieces
+  }
+  if (high_pri_pool_ratio < 0.0 || high_pri_pool_ratio > 1.0) {
+    // invalid high_pri_pool_ratio
+    return nullptr;
+  }
+  if (num_shard_bits < 0) {
+    num_shard_bits = GetDefaultCacheShardBits(capacity);
+  }
+  return std::make_shared<BinnedClockCache>(
+      c, capacity, num_shard_bits, strict_capacity_limit, high_pri_pool_ratio,
+      estimated_entry_charge);
+}
+
+}  // namespace rocksdb_cache
@@ -0,0 +1,357 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ */
+
+#ifndef ROCKSDB_BINNED_CLOCK_CACHE
+#define ROCKSDB_BINNED_CLOCK_CACHE
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+
+#include "ShardedCache.h"
+#include "common/dout.h"
+#include "include/ceph_assert.h"
+#include "common/ceph_context.h"
+
+namespace rocksdb_cache {
+
+// Clock cache implementation
+//
+// A lock-free alternative to BinnedLRUCache with the same PriorityCache
+// semantics (high-pri pool, age bins).  Lookup, Ref and Release never take
+// a lock: every entry is a slot of an open addressed hash table and all of
+// its bookkeeping is packed into a single atomic meta word, so a cache hit
+// costs one atomic read-modify-write on the slot itself instead of a trip
+// through the shard mutex.
+//
+// Eviction follows the CLOCK algorithm: each visible entry carries a small
+// countdown which is refreshed on every hit and decremented by the sweep;
+// unreferenced entries whose countdown reached zero are reclaimed.  High
+// priority entries (indexes/filters) start with a larger countdown as long
+// as the high-pri pool is not exceeded.
+//
+// A slot is in one of these states:
+// 1. EMPTY: free for insertion.
+// 2. CONSTRUCTION: exclusively owned by the thread inserting or freeing it.
+// 3. VISIBLE: in the cache; can be looked up.  Evictable when refs == 0.
+// 4. INVISIBLE: erased or replaced but still referenced; freed by the
+//    last Release.
+//
+// Lookups speculatively take a reference on any visible slot they probe
+// and only then check the key, dropping the reference again on mismatch.
+// Such transient references can be seen on slots in any state, which is
+// why ownership changes are done with compare-and-swap on the whole meta
+// word and state changes never overwrite the reference count.
+//
+// The tables of a shard are never resized.  When the newest table gets
+// too crowded for the capacity a new table of twice the size is added;
+// lookups probe the tables newest first.
+
+std::shared_ptr<rocksdb::Cache> NewBinnedClockCache(
+    CephContext *c,
+    size_t capacity,
+    int num_shard_bits = -1,
+    bool strict_capacity_limit = false,
+    double high_pri_pool_ratio = 0.0,
+    size_t estimated_entry_charge = 0);
+
+struct BinnedClockHandle {
+  // meta word layout:
+  //   bits  0..29 reference count
+  //   bits 30..31 clock countdown
+  //   bits 61..62 state
+  //   bit      63 standalone entry, not reachable through any table
+  static constexpr uint64_t REFS_MASK = (1ull << 30) - 1;
+  static constexpr int COUNTDOWN_SHIFT = 30;
+  static constexpr uint64_t COUNTDOWN_MASK = 3ull << COUNTDOWN_SHIFT;
+  static constexpr int STATE_SHIFT = 61;
+  static constexpr uint64_t STATE_MASK = 3ull << STATE_SHIFT;
+  static constexpr uint64_t STATE_EMPTY = 0;
+  static constexpr uint64_t STATE_CONSTRUCTION = 1ull << STATE_SHIFT;
+  static constexpr uint64_t STATE_VISIBLE = 2ull << STATE_SHIFT;
+  static constexpr uint64_t STATE_INVISIBLE = 3ull << STATE_SHIFT;
+  static constexpr uint64_t STANDALONE = 1ull << 63;
+
+  std::atomic<uint64_t> meta{0};
+  // Number of entries whose probe sequence passed over this slot; a lookup
+  // can stop at the first non-matching slot nobody was displaced from.
+  std::atomic<uint32_t> displacements{0};
+  // Age bin epoch the charge of a low priority entry is accounted in.
+  std::atomic<uint32_t> age_epoch{0};
+  uint32_t hash = 0;
+  bool high_pri = false;
+  void* value = nullptr;
+  DeleterFn deleter = nullptr;
+  size_t charge = 0;
+  size_t key_length = 0;
+  char* key_data = nullptr;
+
+  rocksdb::Slice key() const {
+    return rocksdb::Slice(key_data, key_length);
+  }
+
+  static uint64_t GetRefs(uint64_t meta) {
+    return meta & REFS_MASK;
+  }
+  static uint64_t GetState(uint64_t meta) {
+    return meta & STATE_MASK;
+  }
+  static uint64_t GetCountdown(uint64_t meta) {
+    return (meta & COUNTDOWN_MASK) >> COUNTDOWN_SHIFT;
+  }
+};
+
+// A fixed size, open addressed table of handles using double hashing.
+struct BinnedClockHandleTable {
+  explicit BinnedClockHandleTable(int length_bits);
+
+  uint32_t ProbeStart(uint32_t hash) const {
+    return hash & mask;
+  }
+  uint32_t ProbeStep(uint32_t hash) const {
+    // odd, hence co-prime with the power of two length
+    return (((hash * 0x9e3779b1u) >> 7) | 1) & mask;
+  }
+  bool Contains(const BinnedClockHandle* h) const {
+    return h >= slots.get() && h < slots.get() + length;
+  }
+
+  const int length_bits;
+  const uint32_t length;
+  const uint32_t mask;
+  std::unique_ptr<BinnedClockHandle[]> slots;
+  std::atomic<uint32_t> occupancy{0};
+};
+
+// A single shard of sharded cache.
+class alignas(CACHE_LINE_SIZE) BinnedClockCacheShard : public CacheShard {
+ public:
+  BinnedClockCacheShard(CephContext *c, size_t capacity,
+                        bool strict_capacity_limit,
+                        double high_pri_pool_ratio,
+                        size_t estimated_entry_charge);
+  virtual ~BinnedClockCacheShard();
+
+  // If current usage is more than new capacity, the function will attempt
+  // to free the needed space
+  virtual void SetCapacity(size_t capacity) override;
+
+  // Set the flag to reject insertion if cache if full.
+  virtual void SetStrictCapacityLimit(bool strict_capacity_limit) override;
+
+  // Set percentage of capacity reserved for high-pri cache entries.
+  void SetHighPriPoolRatio(double high_pri_pool_ratio);
+
+  // Like Cache methods, but with an extra "hash" parameter.
+  virtual rocksdb::Status Insert(const rocksdb::Slice& key, uint32_t hash, void* value,
+                        size_t charge,
+                        DeleterFn deleter,
+                        rocksdb::Cache::Handle** handle,
+                        rocksdb::Cache::Priority priority) override;
+  virtual rocksdb::Cache::Handle* Lookup(const rocksdb::Slice& key, uint32_t hash) override;
+  virtual bool Ref(rocksdb::Cache::Handle* handle) override;
+  virtual bool Release(rocksdb::Cache::Handle* handle,
+                       bool force_erase = false) override;
+  virtual void Erase(const rocksdb::Slice& key, uint32_t hash) override;
+
+  virtual size_t GetUsage() const override;
+  // Walks the tables; not meant for hot paths.
+  virtual size_t GetPinnedUsage() const override;
+
+  virtual void ApplyToAllCacheEntries(
+    const std::function<void(const rocksdb::Slice& key,
+                             void* value,
+                             size_t charge,
+                             DeleterFn)>& callback,
+    bool thread_safe) override;
+
+  virtual void EraseUnRefEntries() override;
+
+  virtual std::string GetPrintableOptions() const override;
+
+  virtual DeleterFn GetDeleter(rocksdb::Cache::Handle* handle) const override;
+
+  //  Retrieves number of slots in use, for unit test purpose only
+  size_t TEST_GetOccupancy() const;
+
+  //  Retrieves number of tables, for unit test purpose only
+  int TEST_GetNumTables() const;
+
+  //  Retrieves high pri pool ratio
+  double GetHighPriPoolRatio() const;
+
+  // Retrieves high pri pool usage
+  size_t GetHighPriPoolUsage() const;
+
+  // Rotate the bins
+  void shift_bins();
+
+  // Get the bin count
+  uint32_t get_bin_count() const;
+
+  // Set the bin count
+  void set_bin_count(uint32_t count);
+
+  // Get the byte counts for a range of age bins
+  uint64_t sum_bins(uint32_t start, uint32_t end) const;
+
+ private:
+  static constexpr int MAX_TABLES = 8;
+  static constexpr uint32_t MAX_AGE_BINS = 1024;
+  // Slots probed per step of the clock sweep.
+  static constexpr uint32_t CLOCK_STEP = 16;
+
+  // Probe table t for key and return the matching visible entry with a
+  // reference taken, skipping entry skip.
+  BinnedClockHandle* Find(BinnedClockHandleTable* t,
+                          const rocksdb::Slice& key, uint32_t hash,
+                          const BinnedClockHandle* skip = nullptr);
+
+  // Reserve an empty slot of t for an entry with the given hash; the slot
+  // is returned in CONSTRUCTION state.
+  BinnedClockHandle* Claim(BinnedClockHandleTable* t, uint32_t hash,
+                           uint32_t max_probes);
+
+  // Undo the displacements recorded along the probe sequence of hash,
+  // stopping at slot end (or after count slots if end is nullptr).
+  void Rollback(BinnedClockHandleTable* t, uint32_t hash,
+                const BinnedClockHandle* end, uint32_t count);
+
+  // Add a new, larger table unless another thread already did so since
+  // the caller saw num_tables.  Returns false if no table was added.
+  bool Grow(int num_tables);
+
+  // Drop a reference.  The entry is freed if that was the last reference
+  // and the entry was erased, or if erase_if_last is set.  Returns true if
+  // the entry was freed.
+  bool Unref(BinnedClockHandle* h, bool erase_if_last);
+
+  // Refresh the clock countdown and age bin of an entry that was hit.
+  void Touch(BinnedClockHandle* h);
+
+  // Sweep the clock until usage_ + charge fits the capacity or every
+  // entry had its chance.
+  void Evict(size_t charge);
+
+  // Release the contents of an entry in CONSTRUCTION state, owned by the
+  // caller, and return its slot to EMPTY.
+  void FreeEntry(BinnedClockHandle* h);
+
+  BinnedClockHandle* GetSlot(uint64_t pos);
+  uint64_t GetTotalSlots() const;
+
+  // Countdown given to a new entry, or to an entry that was just hit.
+  uint64_t GetCountdown(bool high_pri, bool hit) const;
+
+  void AddToBin(uint32_t epoch, int64_t delta);
+
+  CephContext *cct;
+
+  const size_t estimated_entry_charge_;
+
+  // Initialized before use.
+  std::atomic<size_t> capacity_;
+
+  // Whether to reject insertion if cache reaches its full capacity.
+  std::atomic<bool> strict_capacity_limit_;
+
+  // Ratio of capacity reserved for high priority cache entries.
+  std::atomic<double> high_pri_pool_ratio_;
+
+  // High-pri pool size, equals to capacity * high_pri_pool_ratio.
+  std::atomic<size_t> high_pri_pool_capacity_;
+
+  // grow_mutex_ only serializes adding tables.
+  std::mutex grow_mutex_;
+  std::unique_ptr<BinnedClockHandleTable> tables_[MAX_TABLES];
+  std::atomic<int> num_tables_;
+
+  // Byte counters for age binning, indexed by epoch % MAX_AGE_BINS
+  std::unique_ptr<std::atomic<int64_t>[]> age_bins_;
+  std::atomic<uint32_t> bin_count_;
+
+  // ------------^^^^^^^^^^^^^-----------
+  // Not frequently modified data members
+  // ------------------------------------
+  //
+  // Frequently modified data members are kept on their own cache lines
+  // so that they don't share the same cache line with the read mostly
+  // ones above.
+  //
+  // ------------------------------------
+  // Frequently modified data members
+  // ------------vvvvvvvvvvvvv-----------
+
+  // Memory size for entries residing in the cache
+  alignas(CACHE_LINE_SIZE) std::atomic<size_t> usage_;
+
+  // Memory size for entries in high-pri pool.
+  std::atomic<size_t> high_pri_pool_usage_;
+
+  // Memory size for entries that did not fit in any table
+  std::atomic<size_t> standalone_usage_;
+
+  std::atomic<uint32_t> bin_epoch_;
+
+  alignas(CACHE_LINE_SIZE) std::atomic<uint64_t> clock_pointer_;
+};
+
+class BinnedClockCache : public ShardedCache {
+ public:
+  BinnedClockCache(CephContext *c, size_t capacity, int num_shard_bits,
+      bool strict_capacity_limit, double high_pri_pool_ratio,
+      size_t estimated_entry_charge);
+  virtual ~BinnedClockCache();
+  virtual const char* Name() const override { return "BinnedClockCache"; }
+  virtual CacheShard* GetShard(int shard) override;
+  virtual const CacheShard* GetShard(int shard) const override;
+  virtual void* Value(Handle* handle) override;
+  virtual size_t GetCharge(Handle* handle) const override;
+  virtual uint32_t GetHash(Handle* handle) const override;
+  virtual void DisownData() override;
+#if (ROCKSDB_MAJOR >= 7 || (ROCKSDB_MAJOR == 6 && ROCKSDB_MINOR >= 22))
+  virtual DeleterFn GetDeleter(Handle* handle) const override;
+#endif
+  //  Retrieves number of slots in use, for unit test purpose only
+  size_t TEST_GetOccupancy() const;
+  // Sets the high pri pool ratio
+  void SetHighPriPoolRatio(double high_pri_pool_ratio);
+  //  Retrieves high pri pool ratio
+  double GetHighPriPoolRatio() const;
+  // Retrieves high pri pool usage
+  size_t GetHighPriPoolUsage() const;
+
+  // PriorityCache
+  virtual int64_t request_cache_bytes(
+      PriorityCache::Priority pri, uint64_t total_cache) const;
+  virtual int64_t commit_cache_size(uint64_t total_cache);
+  virtual int64_t get_committed_size() const {
+    return GetCapacity();
+  }
+  virtual void shift_bins();
+  uint64_t sum_bins(uint32_t start, uint32_t end) const;
+  uint32_t get_bin_count() const;
+  void set_bin_count(uint32_t count);
+
+  virtual std::string get_cache_name() const {
+    return "RocksDB Binned Clock Cache";
+  }
+
+ private:
+  CephContext *cct;
+  BinnedClockCacheShard* shards_;
+  int num_shards_ = 0;
+};
+
+}  // namespace rocksdb_cache
+
+#endif // ROCKSDB_BINNED_CLOCK_CACHE
@@ -53,7 +53,27 @@ rocksdb::Status ShardedCache::Insert(const rocksdb::Slice& key, void* value, siz
 
 rocksdb::Cache::Handle* ShardedCache::Lookup(const rocksdb::Slice& key, rocksdb::Statistics* /*stats*/) {
   uint32_t hash = HashSlice(key);
-  return GetShard(Shard(hash))->Lookup(key, hash);
+  CacheShard* shard = GetShard(Shard(hash));
+  rocksdb::Cache::Handle* handle = shard->Lookup(key, hash);
+  if (count_lookups.load(std::memory_order_relaxed)) {
+    if (handle) {
+      shard->lookup_hits.fetch_add(1, std::memory_order_relaxed);
+    } else {
+      shard->lookup_misses.fetch_add(1, std::memory_order_relaxed);
+    }
+  }
+  return handle;
+}
+
+void ShardedCache::get_lookup_stats(uint64_t* hits, uint64_t* misses) const {
+  *hits = 0;
+  *misses = 0;
+  int num_shards = 1 << num_shard_bits_;
+  for (int s = 0; s < num_shards; s++) {
+    const CacheShard* shard = GetShard(s);
+    *hits += shard->lookup_hits.load(std::memory_order_relaxed);
+    *misses += shard->lookup_misses.load(std::memory_order_relaxed);
+  }
 }
 
 bool ShardedCache::Ref(rocksdb::Cache::Handle* handle) {
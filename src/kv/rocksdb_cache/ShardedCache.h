@@ -55,6 +55,11 @@ class CacheShard {
   virtual void EraseUnRefEntries() = 0;
   virtual std::string GetPrintableOptions() const { return ""; }
   virtual DeleterFn GetDeleter(rocksdb::Cache::Handle* handle) const = 0;
+
+  // Lookup outcomes, only counted if enabled on the cache: even split over
+  // the shards, the increments contend between readers of one shard
+  std::atomic<uint64_t> lookup_hits = {0};
+  std::atomic<uint64_t> lookup_misses = {0};
 };
 
 // Generic cache interface which shards cache by hash of keys. 2^num_shard_bits
@@ -106,6 +111,12 @@ class ShardedCache : public rocksdb::Cache, public PriorityCache::PriCache {
   virtual uint32_t GetHash(Handle* handle) const = 0;
 
   int GetNumShardBits() const { return num_shard_bits_; }
+  /// count lookup hits and misses from now on, off by default
+  void set_count_lookups(bool count) {
+    count_lookups.store(count, std::memory_order_relaxed);
+  }
+  /// cumulative lookup hits and misses over all shards while counted
+  void get_lookup_stats(uint64_t* hits, uint64_t* misses) const;
 
   virtual uint32_t get_bin_count() const = 0;
   virtual void set_bin_count(uint32_t count) = 0;
@@ -186,6 +197,7 @@ class ShardedCache : public rocksdb::Cache, public PriorityCache::PriCache {
   uint64_t bins[PriorityCache::Priority::LAST+1] = {0};
   int64_t cache_bytes[PriorityCache::Priority::LAST+1] = {0};
   double cache_ratio = 0;
+  std::atomic<bool> count_lookups = {false};
 
   int num_shard_bits_;
   mutable std::mutex capacity_mutex_;
@@ -113,9 +113,9 @@ struct C_aio_linger_Complete : public Context {
 
   void finish(int r) override {
     if (cancel || r < 0)
-      boost::asio::defer(c->io->client->finish_strand,
-			 CB_aio_linger_cancel(c->io->objecter,
-					      linger_op));
+      c->io->client->queue_aio_callback(c->io,
+					CB_aio_linger_cancel(c->io->objecter,
+							     linger_op));
 
     c->lock.lock();
     c->rval = r;
@@ -124,7 +124,7 @@ struct C_aio_linger_Complete : public Context {
 
     if (c->callback_complete ||
 	c->callback_safe) {
-      boost::asio::defer(c->io->client->finish_strand, CB_AioComplete(c));
+      c->io->client->queue_aio_callback(c->io, CB_AioComplete(c));
     }
     c->put_unlock();
   }
@@ -204,7 +204,7 @@ struct C_aio_selfmanaged_snap_op_Complete : public Context {
     c->cond.notify_all();
 
     if (c->callback_complete || c->callback_safe) {
-      boost::asio::defer(client->finish_strand, librados::CB_AioComplete(c));
+      client->queue_aio_callback(c->io, librados::CB_AioComplete(c));
     }
     c->put_unlock();
   }
@@ -317,7 +317,7 @@ void librados::IoCtxImpl::complete_aio_write(AioCompletionImpl *c)
     ldout(client->cct, 20) << " waking waiters on seq " << waiters->first << dendl;
     for (std::list<AioCompletionImpl*>::iterator it = waiters->second.begin();
 	 it != waiters->second.end(); ++it) {
-      boost::asio::defer(client->finish_strand, CB_AioCompleteAndSafe(*it));
+      client->queue_aio_callback(this, CB_AioCompleteAndSafe(*it));
       (*it)->put();
     }
     aio_write_waiters.erase(waiters++);
@@ -337,7 +337,7 @@ void librados::IoCtxImpl::flush_aio_writes_async(AioCompletionImpl *c)
   if (aio_write_list.empty()) {
     ldout(client->cct, 20) << "flush_aio_writes_async no writes. (tid "
 			   << seq << ")" << dendl;
-    boost::asio::defer(client->finish_strand, CB_AioCompleteAndSafe(c));
+    client->queue_aio_callback(this, CB_AioCompleteAndSafe(c));
   } else {
     ldout(client->cct, 20) << "flush_aio_writes_async " << aio_write_list.size()
 			   << " writes in flight; waiting on tid " << seq << dendl;
@@ -1946,7 +1946,7 @@ void librados::IoCtxImpl::C_aio_stat_Ack::finish(int r)
   }
 
   if (c->callback_complete) {
-    boost::asio::defer(c->io->client->finish_strand, CB_AioComplete(c));
+    c->io->client->queue_aio_callback(c->io, CB_AioComplete(c));
   }
 
   c->put_unlock();
@@ -1974,7 +1974,7 @@ void librados::IoCtxImpl::C_aio_stat2_Ack::finish(int r)
   }
 
   if (c->callback_complete) {
-    boost::asio::defer(c->io->client->finish_strand, CB_AioComplete(c));
+    c->io->client->queue_aio_callback(c->io, CB_AioComplete(c));
   }
 
   c->put_unlock();
@@ -2010,7 +2010,7 @@ void librados::IoCtxImpl::C_aio_Complete::finish(int r)
 
   if (c->callback_complete ||
       c->callback_safe) {
-    boost::asio::defer(c->io->client->finish_strand, CB_AioComplete(c));
+    c->io->client->queue_aio_callback(c->io, CB_AioComplete(c));
   }
 
   if (c->aio_write_seq) {
@@ -2090,10 +2090,10 @@ void librados::IoCtxImpl::application_enable_async(const std::string& app_name,
   // preserved until Luminous is configured as minimim version.
   if (!client->get_required_monitor_features().contains_all(
         ceph::features::mon::FEATURE_LUMINOUS)) {
-    boost::asio::defer(client->finish_strand,
-		       [cb = CB_PoolAsync_Safe(c)]() mutable {
-			 cb(-EOPNOTSUPP);
-		       });
+    client->queue_aio_callback(this,
+			       [cb = CB_PoolAsync_Safe(c)]() mutable {
+				 cb(-EOPNOTSUPP);
+			       });
     return;
   }
 
@@ -239,6 +239,12 @@ int librados::RadosClient::connect()
   common_init_finish(cct);
 
   poolctx.start(cct->_conf.get_val<std::uint64_t>("librados_thread_count"));
+  if (auto shards = cct->_conf.get_val<std::uint64_t>("librados_finisher_shards");
+      shards > 0) {
+    finishers = std::make_unique<ShardedFinisher>(
+      cct, shards, "librados_finisher", "fn_rados");
+    finishers->start();
+  }
 
   // get monmap
   err = monclient.build_initial_monmap();
@@ -334,6 +340,10 @@ int librados::RadosClient::connect()
       delete messenger;
       messenger = NULL;
     }
+    if (finishers) {
+      finishers->stop();
+      finishers.reset();
+    }
   }
 
   return err;
@@ -370,6 +380,12 @@ void librados::RadosClient::shutdown()
     messenger->shutdown();
     messenger->wait();
   }
+  if (finishers) {
+    // callbacks of completed ops still run, as they do on the strand
+    finishers->wait_for_empty();
+    finishers->stop();
+    finishers.reset();
+  }
   poolctx.stop();
   ldout(cct, 1) << "shutdown" << dendl;
 }
@@ -412,7 +428,7 @@ struct CB_aio_watch_flush_Complete {
 
     if (c->callback_complete ||
 	c->callback_safe) {
-      boost::asio::defer(client->finish_strand, librados::CB_AioComplete(c));
+      client->queue_aio_callback(c->io, librados::CB_AioComplete(c));
     }
     c->put_unlock();
   }
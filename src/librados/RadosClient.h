@@ -21,12 +21,14 @@
 #include "msg/Dispatcher.h"
 
 #include "common/async/context_pool.h"
+#include "common/Finisher.h"
 #include "common/config_fwd.h"
 #include "common/Cond.h"
 #include "common/ceph_mutex.h"
 #include "common/ceph_time.h"
 #include "common/config_obs.h"
 #include "include/common_fwd.h"
+#include "include/Context.h"
 #include "include/rados/librados.h"
 #include "include/rados/librados.hpp"
 #include "mon/MonClient.h"
@@ -95,10 +97,27 @@ private:
 
   int wait_for_osdmap();
 
+  // completes aio callbacks instead of finish_strand if
+  // librados_finisher_shards is set
+  std::unique_ptr<ShardedFinisher> finishers;
+
 public:
   boost::asio::strand<boost::asio::io_context::executor_type>
       finish_strand{poolctx.get_executor()};
 
+  /// Complete an aio callback after the ones queued before for io.
+  template <typename CB>
+  void queue_aio_callback(const IoCtxImpl *io, CB&& cb) {
+    if (finishers) {
+      finishers->queue(reinterpret_cast<uintptr_t>(io),
+		       new LambdaContext([cb = std::forward<CB>(cb)](int) mutable {
+			 cb();
+		       }));
+    } else {
+      boost::asio::defer(finish_strand, std::forward<CB>(cb));
+    }
+  }
+
   explicit RadosClient(CephContext *cct);
   ~RadosClient() override;
   int ping_monitor(std::string mon_id, std::string *result);
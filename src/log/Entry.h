@@ -35,6 +35,14 @@ public:
   {
     ceph_pthread_getname(m_thread_name.data(), m_thread_name.size());
   }
+  Entry(time stamp, pthread_t thread, const thread_name_t& thread_name,
+	short pr, short sub) :
+    m_stamp(stamp),
+    m_thread(thread),
+    m_prio(pr),
+    m_subsys(sub),
+    m_thread_name(thread_name)
+  {}
   Entry(const Entry &) = default;
   Entry& operator=(const Entry &) = default;
   Entry(Entry &&e) = default;
@@ -98,6 +106,10 @@ public:
     str.assign(strv.begin(), strv.end());
     return *this;
   }
+  ConcreteEntry(time stamp, pthread_t thread, const thread_name_t& thread_name,
+		short pr, short sub, std::string_view strv)
+    : Entry(stamp, thread, thread_name, pr, sub),
+      str(strv.begin(), strv.end()) {}
   ConcreteEntry(ConcreteEntry&& e) noexcept : Entry(e), str(std::move(e.str)) {}
   ConcreteEntry& operator=(ConcreteEntry&& e) {
     Entry::operator=(e);
@@ -26,6 +26,7 @@
 #include <syslog.h>
 
 #include <algorithm>
+#include <bit>
 #include <iostream>
 #include <set>
 
@@ -40,6 +41,26 @@ namespace logging {
 
 static OnExitManager exit_callbacks;
 
+/// ring records do not wake up the log thread until half the ring is used
+static constexpr auto RING_FLUSH_INTERVAL = std::chrono::milliseconds(100);
+
+static std::atomic<uint64_t> next_log_id{1};
+
+namespace {
+/// the ring the calling thread logs into, and the log it belongs to
+struct ring_holder_t {
+  uint64_t log_id = 0;
+  std::shared_ptr<ThreadRing> ring;
+
+  ~ring_holder_t() {
+    if (ring) {
+      ring->orphan();
+    }
+  }
+};
+thread_local ring_holder_t ring_holder;
+}
+
 static void log_on_exit(void *p)
 {
   Log *l = *(Log **)p;
@@ -51,7 +72,8 @@ static void log_on_exit(void *p)
 Log::Log(const SubsystemMap *s)
   : m_indirect_this(nullptr),
     m_subs(s),
-    m_recent(DEFAULT_MAX_RECENT)
+    m_recent(DEFAULT_MAX_RECENT),
+    m_id(next_log_id++)
 {
   m_log_buf.reserve(MAX_LOG_BUF);
   _configure_stderr();
@@ -139,6 +161,12 @@ void Log::set_max_recent(std::size_t n)
   m_recent.set_capacity(n);
 }
 
+void Log::set_ring_size(std::size_t n)
+{
+  // rings already handed out keep their size
+  m_ring_size = n ? std::bit_ceil(n) : 0;
+}
+
 void Log::set_log_file(std::string_view fn)
 {
   std::scoped_lock lock(m_flush_mutex);
@@ -268,6 +296,55 @@ void Log::submit_entry(Entry&& e)
   m_queue_mutex_holder = 0;
 }
 
+ThreadRing *Log::_get_ring(std::size_t size)
+{
+  auto& holder = ring_holder;
+  if (holder.log_id != m_id || !holder.ring) {
+    if (holder.ring) {
+      holder.ring->orphan();
+    }
+    holder.ring = std::make_shared<ThreadRing>(size);
+    holder.log_id = m_id;
+    std::scoped_lock lock(m_rings_mutex);
+    m_rings.push_back(holder.ring);
+    m_has_rings = true;
+  }
+  return holder.ring.get();
+}
+
+void Log::_drain_rings(EntryVector& t)
+{
+  if (!m_has_rings) {
+    return;
+  }
+  const std::size_t queued = t.size();
+  std::string str;
+  std::scoped_lock lock(m_rings_mutex);
+  for (auto i = m_rings.begin(); i != m_rings.end(); ) {
+    auto& ring = *i;
+    // nothing is appended to an orphaned ring, so it can go once drained
+    const bool orphaned = ring->is_orphaned();
+    ring->consume([&](const ring_record_t& r, const char *args) {
+      str.clear();
+      r.format(std::string_view(r.fmt, r.fmt_len), args, str);
+      t.emplace_back(r.get_stamp(), ring->get_thread(),
+		     ring->get_thread_name(), r.prio, r.subsys, str);
+    });
+    if (orphaned) {
+      i = m_rings.erase(i);
+    } else {
+      ++i;
+    }
+  }
+  if (t.size() > queued) {
+    // merge the records of each thread with the entries submitted so far
+    std::stable_sort(t.begin(), t.end(),
+		     [](const ConcreteEntry& a, const ConcreteEntry& b) {
+		       return a.m_stamp < b.m_stamp;
+		     });
+  }
+}
+
 void Log::flush()
 {
   std::scoped_lock lock1(m_flush_mutex);
@@ -282,6 +359,7 @@ void Log::flush()
     m_queue_mutex_holder = 0;
   }
 
+  _drain_rings(m_flush);
   _flush(m_flush, false);
   m_flush_mutex_holder = 0;
 }
@@ -511,6 +589,7 @@ void Log::dump_recent()
     m_queue_mutex_holder = 0;
   }
 
+  _drain_rings(m_flush);
   _flush(m_flush, false);
 
   _log_message("--- begin dump of recent events ---", true);
@@ -545,6 +624,7 @@ void Log::dump_recent()
 
   _log_message(fmt::format("  max_recent {:9}", m_recent.capacity()), true);
   _log_message(fmt::format("  max_new    {:9}", m_max_new), true);
+  _log_message(fmt::format("  ring_size  {:9}", m_ring_size.load()), true);
   _log_message(fmt::format("  log_file {}", m_log_file), true);
 
   _log_message("--- end dump of recent events ---", true);
@@ -593,6 +673,18 @@ void *Log::entry()
         continue;
       }
 
+      if (m_has_rings) {
+        m_cond_flusher.wait_for(lock, RING_FLUSH_INTERVAL);
+        if (!m_stop) {
+          m_queue_mutex_holder = 0;
+          lock.unlock();
+          flush();
+          lock.lock();
+          m_queue_mutex_holder = pthread_self();
+        }
+        continue;
+      }
+
       m_cond_flusher.wait(lock);
     }
     m_queue_mutex_holder = 0;
@@ -6,6 +6,7 @@
 
 #include <boost/circular_buffer.hpp>
 
+#include <atomic>
 #include <condition_variable>
 #include <map>
 #include <memory>
@@ -19,6 +20,9 @@
 #include "common/likely.h"
 
 #include "log/Entry.h"
+#include "log/Ring.h"
+
+#include <fmt/ostream.h>
 
 #include <unistd.h>
 
@@ -44,6 +48,7 @@ public:
   void set_coarse_timestamps(bool coarse);
   void set_max_new(std::size_t n);
   void set_max_recent(std::size_t n);
+  void set_ring_size(std::size_t n);
   void set_log_file(std::string_view fn);
   void reopen_log_file();
   void chown_log_file(uid_t uid, gid_t gid);
@@ -71,6 +76,27 @@ public:
 
   void submit_entry(Entry&& e);
 
+  /**
+   * submit a log statement to be formatted by the log thread
+   *
+   * If a ring size is set, the arguments are appended to a ring owned by
+   * the calling thread and formatted when the log thread drains it, see
+   * ThreadRing.  Arguments other than numbers and strings are formatted
+   * with "{}" right away, so the format string is checked against
+   * the types they are stored as.  If the ring is disabled or full, the
+   * statement is formatted here and submitted as an entry.
+   *
+   * @param fmt the format string, a string literal
+   */
+  template <typename... Args>
+  void submit_fmt(short prio, short subsys,
+		  ring_format_string<ring_detail::stored_t<Args>...> fmt,
+		  const Args&... args) {
+    fmt::string_view f = fmt.str;
+    _submit_fmt(prio, subsys, std::string_view(f.data(), f.size()),
+		ring_detail::prepare(args)...);
+  }
+
   void start();
   void stop();
 
@@ -140,6 +166,12 @@ private:
 
   std::size_t m_max_new = DEFAULT_MAX_NEW;
 
+  const uint64_t m_id;  ///< tells the rings of this log from other logs'
+  std::atomic<std::size_t> m_ring_size = 0;
+  std::atomic<bool> m_has_rings = false;
+  std::mutex m_rings_mutex;
+  std::vector<std::shared_ptr<ThreadRing>> m_rings;
+
   bool m_inject_segv = false;
 
   void *entry() override;
@@ -150,6 +182,27 @@ private:
   void _configure_stderr();
   void _log_stderr(std::string_view strv);
 
+  ThreadRing *_get_ring(std::size_t size);
+  void _drain_rings(EntryVector& t);
+
+  template <typename... Prepared>
+  void _submit_fmt(short prio, short subsys, std::string_view fmt,
+		   const Prepared&... args) {
+    if (std::size_t size = m_ring_size.load(std::memory_order_relaxed); size) {
+      ThreadRing *ring = _get_ring(size);
+      if (std::size_t used = ring->push(prio, subsys, fmt, args...); used) {
+	if (used > ring->get_capacity() / 2) {
+	  m_cond_flusher.notify_one();
+	}
+	return;
+      }
+    }
+    MutableEntry e(prio, subsys);
+    fmt::vprint(e.get_ostream(), fmt::string_view(fmt.data(), fmt.size()),
+		fmt::make_format_args(args...));
+    submit_entry(std::move(e));
+  }
+
 
 
 };
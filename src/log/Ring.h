@@ -0,0 +1,269 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+
+#ifndef __CEPH_LOG_RING_H
+#define __CEPH_LOG_RING_H
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <iterator>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <type_traits>
+
+#include <fmt/format.h>
+
+#include "include/intarith.h"
+#include "log/Entry.h"
+
+namespace ceph {
+namespace logging {
+
+/*
+ * Binary log records
+ *
+ * A record keeps the format string of the log statement along with its
+ * arguments in binary form.  Arithmetic values and untyped pointers are
+ * copied as is, strings are copied with their length.  Any other argument
+ * is formatted on the spot, as it could not be safely formatted later on.
+ * The record is turned into text by the log thread, with the formatter
+ * instantiated for the types of the arguments as stored.
+ */
+namespace ring_detail {
+
+template <typename T>
+concept raw_arg = std::is_arithmetic_v<T> ||
+  std::is_same_v<T, void*> || std::is_same_v<T, const void*>;
+
+template <typename T>
+concept string_arg = !raw_arg<T> && std::is_convertible_v<T, std::string_view>;
+
+/// the type an argument is stored and formatted as
+template <typename T>
+struct stored {
+  using type = std::string_view;
+};
+template <raw_arg T>
+struct stored<T> {
+  using type = T;
+};
+template <typename T>
+using stored_t = typename stored<std::remove_cvref_t<T>>::type;
+
+/// the argument as it is copied into the record
+template <typename T>
+auto prepare(const T& v) {
+  if constexpr (raw_arg<T> || string_arg<T>) {
+    return static_cast<stored_t<T>>(v);
+  } else {
+    return fmt::format("{}", v);
+  }
+}
+
+template <typename T>
+size_t encoded_size(const T& v) {
+  if constexpr (raw_arg<T>) {
+    return sizeof(T);
+  } else {
+    return sizeof(uint32_t) + std::string_view(v).size();
+  }
+}
+
+template <typename T>
+char *encode(char *p, const T& v) {
+  if constexpr (raw_arg<T>) {
+    memcpy(p, &v, sizeof(T));
+    return p + sizeof(T);
+  } else {
+    std::string_view sv(v);
+    uint32_t len = sv.size();
+    memcpy(p, &len, sizeof(len));
+    memcpy(p + sizeof(len), sv.data(), len);
+    return p + sizeof(len) + len;
+  }
+}
+
+template <typename T>
+T decode(const char *&p) {
+  if constexpr (raw_arg<T>) {
+    T v;
+    memcpy(&v, p, sizeof(T));
+    p += sizeof(T);
+    return v;
+  } else {
+    uint32_t len;
+    memcpy(&len, p, sizeof(len));
+    std::string_view sv(p + sizeof(len), len);
+    p += sizeof(len) + len;
+    return sv;
+  }
+}
+
+template <typename... Stored>
+void format(std::string_view fmt, const char *args, std::string& out) {
+  // braced initializers are evaluated in order
+  std::tuple<Stored...> values{decode<Stored>(args)...};
+  std::apply([&](auto&... v) {
+    fmt::vformat_to(std::back_inserter(out), fmt, fmt::make_format_args(v...));
+  }, values);
+}
+
+} // namespace ring_detail
+
+/**
+ * format string of a record
+ *
+ * A record only keeps a pointer to its format string, so the string has to
+ * outlive the log.  It can only be built from a string literal, at compile
+ * time: a string built at runtime, or wrapped in fmt::runtime(), does not
+ * compile.  The arguments are checked against the format like with
+ * fmt::format_string.
+ */
+template <typename... Args>
+struct ring_format_string {
+  fmt::format_string<Args...> str;
+
+  template <size_t N>
+  consteval ring_format_string(const char (&s)[N]) : str(s) {}
+};
+
+using ring_formatter_t = void (*)(std::string_view fmt, const char *args,
+				  std::string& out);
+
+struct ring_record_t {
+  uint32_t size;		///< of the record, arguments included
+  uint32_t padding;		///< if set, skip to the start of the ring
+  uint64_t stamp;		///< log_time, which is not default constructible
+  bool coarse;
+  short prio;
+  short subsys;
+  const char *fmt;
+  size_t fmt_len;
+  ring_formatter_t format;
+
+  log_time get_stamp() const {
+    return log_time(log_clock::duration(_logclock::taggedrep(stamp, coarse)));
+  }
+};
+
+/*
+ * A single producer, single consumer ring of log records
+ *
+ * Every thread logging through submit_fmt() owns one, so appending a
+ * record takes neither a lock nor a shared atomic read-modify-write:
+ * the thread advances the head, the log thread the tail.  Records are
+ * contiguous; one that would wrap around is preceded by a padding record
+ * covering the end of the buffer.
+ */
+class ThreadRing {
+public:
+  ThreadRing(size_t capacity)
+    : capacity(capacity),
+      buf(new char[capacity]),
+      thread(pthread_self())
+  {
+    ceph_pthread_getname(thread_name.data(), thread_name.size());
+  }
+
+  size_t get_capacity() const {
+    return capacity;
+  }
+
+  /**
+   * append a record, from the owning thread
+   *
+   * @return the bytes in use once appended, 0 if the record did not fit
+   */
+  template <typename... Args>
+  size_t push(short prio, short subsys, std::string_view fmt,
+	      const Args&... args) {
+    using namespace ring_detail;
+    const size_t len = p2roundup<size_t>(
+      sizeof(ring_record_t) + (encoded_size(args) + ... + 0), ALIGN);
+    const uint64_t h = head.load(std::memory_order_relaxed);
+    const size_t pos = h & (capacity - 1);
+    const size_t pad = capacity - pos < len ? capacity - pos : 0;
+    if (h + pad + len - cached_tail > capacity) {
+      cached_tail = tail.load(std::memory_order_acquire);
+      if (h + pad + len - cached_tail > capacity) {
+	return 0;
+      }
+    }
+    if (pad) {
+      ring_record_t r{};
+      r.size = pad;
+      r.padding = 1;
+      memcpy(buf.get() + pos, &r, sizeof(uint32_t) * 2);
+    }
+    char *p = buf.get() + ((h + pad) & (capacity - 1));
+    auto stamp = Entry::clock().now().time_since_epoch().count();
+    ring_record_t r{};
+    r.size = len;
+    r.stamp = stamp.count;
+    r.coarse = stamp.coarse;
+    r.prio = prio;
+    r.subsys = subsys;
+    r.fmt = fmt.data();
+    r.fmt_len = fmt.size();
+    r.format = &ring_detail::format<stored_t<Args>...>;
+    memcpy(p, &r, sizeof(r));
+    p += sizeof(r);
+    ((p = encode(p, args)), ...);
+    head.store(h + pad + len, std::memory_order_release);
+    return h + pad + len - cached_tail;
+  }
+
+  /// call f(record, arguments) on the appended records, from the log thread
+  template <typename F>
+  void consume(F&& f) {
+    const uint64_t h = head.load(std::memory_order_acquire);
+    uint64_t t = tail.load(std::memory_order_relaxed);
+    while (t != h) {
+      const char *p = buf.get() + (t & (capacity - 1));
+      ring_record_t r;
+      memcpy(&r, p, sizeof(uint32_t) * 2);
+      if (!r.padding) {
+	memcpy(&r, p, sizeof(r));
+	f(r, p + sizeof(r));
+      }
+      t += r.size;
+    }
+    tail.store(t, std::memory_order_release);
+  }
+
+  /// the owning thread exited, the ring goes once drained
+  void orphan() {
+    orphaned = true;
+  }
+  bool is_orphaned() const {
+    return orphaned;
+  }
+
+  pthread_t get_thread() const {
+    return thread;
+  }
+  const Entry::thread_name_t& get_thread_name() const {
+    return thread_name;
+  }
+
+private:
+  static constexpr size_t ALIGN = alignof(ring_record_t);
+
+  const size_t capacity;	///< a power of two
+  std::unique_ptr<char[]> buf;
+  const pthread_t thread;
+  Entry::thread_name_t thread_name{};
+  std::atomic<bool> orphaned = false;
+
+  uint64_t cached_tail = 0;	///< owned by the producer
+  alignas(64) std::atomic<uint64_t> head = 0;
+  alignas(64) std::atomic<uint64_t> tail = 0;
+};
+
+}
+}
+
+#endif
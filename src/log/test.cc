@@ -14,6 +14,10 @@
 
 #include <limits.h>
 
+#include <set>
+
+#include <fmt/ranges.h>
+
 using namespace std;
 using namespace ceph::logging;
 
@@ -490,6 +494,70 @@ TEST(Log, GarbleRecovery)
   ASSERT_GT(file_status.st_size, 2000);
 }
 
+class CaptureLog : public Log {
+public:
+  using Log::Log;
+  std::vector<std::string> lines;
+protected:
+  void _flush(EntryVector& q, bool crash) override {
+    for (auto& e : q) {
+      lines.emplace_back(e.strv());
+    }
+    Log::_flush(q, crash);
+  }
+};
+
+// records keep a pointer to their format string, which has to be a literal
+static_assert(!std::is_convertible_v<decltype(fmt::runtime(std::string())),
+				     ring_format_string<int>>);
+static_assert(!std::is_convertible_v<std::string, ring_format_string<int>>);
+static_assert(!std::is_convertible_v<const char*, ring_format_string<int>>);
+
+TEST(Log, Ring)
+{
+  SubsystemMap subs;
+  subs.set_log_level(1, 20);
+  subs.set_gather_level(1, 20);
+  CaptureLog log(&subs);
+  log.set_ring_size(4000);
+
+  const std::string s = "str";
+  log.submit_fmt(1, 1, "{} {:x} {} {} {}", 42, 255u, 1.5, s,
+		 std::vector<int>{1, 2, 3});
+  log.submit_fmt(1, 1, "{}", "literal");
+  log.flush();
+  ASSERT_EQ(2u, log.lines.size());
+  EXPECT_EQ("42 ff 1.5 str [1, 2, 3]", log.lines[0]);
+  EXPECT_EQ("literal", log.lines[1]);
+
+  // more than the ring holds, the rest is formatted on submission
+  log.lines.clear();
+  constexpr unsigned n = 1000;
+  for (unsigned i = 0; i < n; i++) {
+    log.submit_fmt(1, 1, "entry {}", i);
+  }
+  log.flush();
+  ASSERT_EQ(n, log.lines.size());
+  std::set<std::string> seen(log.lines.begin(), log.lines.end());
+  EXPECT_EQ(n, seen.size());
+  EXPECT_EQ(1u, seen.count("entry 0"));
+  EXPECT_EQ(1u, seen.count("entry 999"));
+
+  // records wrap around the end of the ring
+  log.lines.clear();
+  for (unsigned i = 0; i < n; i++) {
+    log.submit_fmt(1, 1, "{} {}", std::string(i % 100, 'x'), i);
+    if (i % 10 == 9) {
+      log.flush();
+    }
+  }
+  ASSERT_EQ(n, log.lines.size());
+  for (unsigned i = 0; i < n; i++) {
+    EXPECT_EQ(fmt::format("{} {}", std::string(i % 100, 'x'), i),
+	      log.lines[i]);
+  }
+}
+
 int main(int argc, char **argv)
 {
   auto args = argv_to_vec(argc, argv);
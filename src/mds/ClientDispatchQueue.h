@@ -0,0 +1,129 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#ifndef CEPH_MDS_CLIENTDISPATCHQUEUE_H
+#define CEPH_MDS_CLIENTDISPATCHQUEUE_H
+
+#include <array>
+#include <atomic>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include "include/ceph_assert.h"
+#include "common/ceph_mutex.h"
+
+/*
+ * FIFOs of items by key, served in turns
+ *
+ * Items of a key are taken in the order they were pushed.  A take goes
+ * through the keys with items queued, one item per key and turn, so that a
+ * key with many items does not hold back the others.  The keys are spread
+ * over separately locked shards, so that pushing from many threads rarely
+ * contends.  Taking is meant for a single thread.
+ */
+template <typename Key, typename T, unsigned NumShards = 16>
+class ClientDispatchQueue {
+  struct shard_t {
+    ceph::mutex lock = ceph::make_mutex("ClientDispatchQueue::shard_t::lock");
+    std::deque<Key> ready;  // keys with queued items, in turn order
+    std::unordered_map<Key, std::deque<T>> queues;
+  };
+
+  std::array<shard_t, NumShards> shards;
+  unsigned next_shard = 0;
+  std::atomic<uint64_t> pending = {0};
+
+  shard_t& get_shard(const Key& k) {
+    return shards[std::hash<Key>{}(k) % NumShards];
+  }
+
+public:
+  /// @return true if nothing was queued before
+  bool push(const Key& k, T item) {
+    auto &shard = get_shard(k);
+    std::lock_guard l(shard.lock);
+    // counted before it can be taken, so that pending never goes negative
+    bool was_empty = pending++ == 0;
+    auto &q = shard.queues[k];
+    if (q.empty()) {
+      shard.ready.push_back(k);
+    }
+    q.push_back(std::move(item));
+    return was_empty;
+  }
+
+  /// append up to max items to out, one per key and turn
+  void take(std::vector<T> &out, unsigned max) {
+    unsigned taken = 0;
+    // keep going round while some key has more, and there is room
+    for (unsigned empty_shards = 0;
+	 empty_shards < NumShards && taken < max; ) {
+      auto &shard = shards[next_shard];
+      next_shard = (next_shard + 1) % NumShards;
+      std::lock_guard l(shard.lock);
+      if (shard.ready.empty()) {
+	empty_shards++;
+	continue;
+      }
+      empty_shards = 0;
+      // the keys with more queued go to the back of their shard
+      for (auto n = shard.ready.size(); n > 0 && taken < max; --n) {
+	auto k = std::move(shard.ready.front());
+	shard.ready.pop_front();
+	auto q = shard.queues.find(k);
+	ceph_assert(q != shard.queues.end());
+	out.push_back(std::move(q->second.front()));
+	q->second.pop_front();
+	taken++;
+	if (q->second.empty()) {
+	  shard.queues.erase(q);
+	} else {
+	  shard.ready.push_back(std::move(k));
+	}
+      }
+    }
+    pending -= taken;
+  }
+
+  /// remove all items, calling f(item) on each
+  template <typename F>
+  void clear(F &&f) {
+    for (auto &shard : shards) {
+      std::unordered_map<Key, std::deque<T>> queues;
+      {
+	std::lock_guard l(shard.lock);
+	for (auto &[k, q] : shard.queues) {
+	  pending -= q.size();
+	}
+	shard.ready.clear();
+	queues.swap(shard.queues);
+      }
+      for (auto &[k, q] : queues) {
+	for (auto &item : q) {
+	  f(item);
+	}
+      }
+    }
+  }
+
+  uint64_t size() const {
+    return pending;
+  }
+  bool empty() const {
+    return pending == 0;
+  }
+};
+
+#endif
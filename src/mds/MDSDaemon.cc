@@ -91,6 +91,8 @@ MDSDaemon::MDSDaemon(std::string_view n, Messenger *m, MonClient *mc,
   ioctx(ioctx),
   mgrc(m->cct, m, &mc->monmap),
   log_client(m->cct, messenger, &mc->monmap, LogClient::NO_FLAGS),
+  client_dispatch_thread(this),
+  fast_dispatch(m->cct->_conf.get_val<bool>("mds_fast_dispatch")),
   starttime(mono_clock::now())
 {
   orig_argc = 0;
@@ -117,6 +119,11 @@ MDSDaemon::MDSDaemon(std::string_view n, Messenger *m, MonClient *mc,
 }
 
 MDSDaemon::~MDSDaemon() {
+  client_dispatch_thread.stop();
+  if (client_dispatch_thread.is_started()) {
+    client_dispatch_thread.join();
+  }
+
   std::lock_guard lock(mds_lock);
 
   delete mds_rank;
@@ -606,6 +613,10 @@ int MDSDaemon::init()
   dout(10) << sizeof(Capability) << "\tCapability" << dendl;
   dout(10) << sizeof(xlist<void*>::item) << "\txlist<>::item" << dendl;
 
+  if (fast_dispatch) {
+    client_dispatch_thread.create("mds_client_disp");
+  }
+
   // Ensure beacons are processed ahead of most other dispatchers.
   messenger->add_dispatcher_head(&beacon, Dispatcher::PRIORITY_HIGH);
   // order last as MDSDaemon::ms_dispatch2 first acquires the mds_lock
@@ -923,6 +934,10 @@ void MDSDaemon::suicide()
 
   clean_up_admin_socket();
 
+  // drops the queued client messages, joined by the destructor as it may
+  // be waiting for the mds_lock now
+  client_dispatch_thread.stop();
+
   // Notify the Monitors (MDSMonitor) that we're dying, so that it doesn't have
   // to wait for us to go laggy. Only do this if we're actually in the MDSMap,
   // because otherwise the MDSMonitor will drop our message.
@@ -1049,6 +1064,104 @@ Dispatcher::dispatch_result_t MDSDaemon::ms_dispatch2(const ref_t<Message> &m)
   }
 }
 
+bool MDSDaemon::ms_can_fast_dispatch2(const cref_t<Message> &m) const
+{
+  if (!fast_dispatch || !m->get_source().is_client()) {
+    return false;
+  }
+  // everything a client sends for its session, so that they stay in order
+  switch (m->get_type()) {
+  case CEPH_MSG_CLIENT_SESSION:
+  case CEPH_MSG_CLIENT_RECONNECT:
+  case CEPH_MSG_CLIENT_RECLAIM:
+  case CEPH_MSG_CLIENT_REQUEST:
+  case CEPH_MSG_CLIENT_CAPS:
+  case CEPH_MSG_CLIENT_CAPRELEASE:
+  case CEPH_MSG_CLIENT_LEASE:
+    return true;
+  default:
+    return false;
+  }
+}
+
+void MDSDaemon::ms_fast_dispatch2(const ref_t<Message> &m)
+{
+  client_dispatch_thread.enqueue(m);
+}
+
+void MDSDaemon::handle_client_message(const ref_t<Message> &m)
+{
+  ceph_assert(ceph_mutex_is_locked_by_me(mds_lock));
+  if (beacon.get_want_state() == CEPH_MDS_STATE_DNE) {
+    dout(10) << " stopping, discarding " << *m << dendl;
+    return;
+  }
+  if (!mds_rank || !mds_rank->ms_dispatch(m)) {
+    dout(1) << __func__ << " unhandled " << *m << dendl;
+  }
+}
+
+void MDSDaemon::ClientDispatchThread::enqueue(const ref_t<Message> &m)
+{
+  // released once handled rather than when this returns
+  uint64_t throttle_size = m->get_dispatch_throttle_size();
+  m->set_dispatch_throttle_size(0);
+  auto con = m->get_connection();
+  if (queue.push(con.get(), {m, throttle_size})) {
+    std::lock_guard l(wait_lock);
+    wait_cond.notify_one();
+  }
+}
+
+void *MDSDaemon::ClientDispatchThread::entry()
+{
+  const unsigned max = g_conf().get_val<uint64_t>("mds_fast_dispatch_batch");
+  std::vector<queued_t> batch;
+  batch.reserve(max);
+  while (true) {
+    {
+      std::unique_lock l(wait_lock);
+      wait_cond.wait(l, [this] { return stopping || !queue.empty(); });
+      if (stopping) {
+	break;
+      }
+    }
+
+    queue.take(batch, max);
+    uint64_t throttle_size = 0;
+    {
+      std::lock_guard l(mds->mds_lock);
+      for (auto &q : batch) {
+	if (mds->stopping) {
+	  break;
+	}
+	mds->handle_client_message(q.m);
+      }
+    }
+    for (auto &q : batch) {
+      throttle_size += q.throttle_size;
+    }
+    // the last references may free the messages, not under the mds_lock
+    batch.clear();
+    mds->messenger->dispatch_throttle_release(throttle_size);
+  }
+  return nullptr;
+}
+
+void MDSDaemon::ClientDispatchThread::stop()
+{
+  {
+    std::lock_guard l(wait_lock);
+    stopping = true;
+    wait_cond.notify_one();
+  }
+  uint64_t throttle_size = 0;
+  queue.clear([&throttle_size](queued_t &q) {
+    throttle_size += q.throttle_size;
+  });
+  mds->messenger->dispatch_throttle_release(throttle_size);
+}
+
 /*
  * high priority messages we always process
  */
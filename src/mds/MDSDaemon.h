@@ -16,12 +16,16 @@
 #define CEPH_MDS_H
 
 #include <string_view>
+#include <vector>
 
 #include "common/admin_finisher.h" // for asok_finisher
 #include "common/LogClient.h"
+#include "common/ceph_mutex.h"
 #include "common/fair_mutex.h"
+#include "common/Thread.h"
 #include "common/Timer.h"
 #include "mgr/MgrClient.h"
+#include "mds/ClientDispatchQueue.h"
 #include "msg/Dispatcher.h"
 
 #include "Beacon.h"
@@ -119,6 +123,7 @@ class MDSDaemon : public Dispatcher {
   void tick();
 
   bool handle_core_message(const cref_t<Message> &m);
+  void handle_client_message(const ref_t<Message> &m);
   
   void handle_command(const cref_t<MCommand> &m);
   void handle_mds_map(const cref_t<MMDSMap> &m);
@@ -150,8 +155,55 @@ class MDSDaemon : public Dispatcher {
   void ms_handle_remote_reset(Connection *con) override;
   bool ms_handle_refused(Connection *con) override;
 
+  bool ms_can_fast_dispatch_any() const override {
+    return fast_dispatch;
+  }
+  bool ms_can_fast_dispatch2(const cref_t<Message> &m) const override;
+  void ms_fast_dispatch2(const ref_t<Message> &m) override;
+
   bool parse_caps(const AuthCapsInfo&, MDSAuthCaps&);
 
+  /*
+   * With mds_fast_dispatch the messenger hands the session messages of
+   * clients to this thread instead of the DispatchQueue.  They wait in a
+   * queue per connection, and the queues are sharded so that messenger
+   * workers rarely contend.  The thread takes the queued connections in
+   * turn, one message each, and handles up to mds_fast_dispatch_batch
+   * messages per acquisition of the mds_lock.
+   *
+   * Queued messages keep their share of ms_dispatch_throttle_bytes until
+   * handled, so that the messenger stops reading from clients while the
+   * thread is behind, as it would with the DispatchQueue.
+   *
+   * Messages of a client connection are handled in the order they were
+   * received, whichever of the fast dispatched types they are.  There is
+   * no order between connections, and none between these messages and
+   * the ones still going through the DispatchQueue (commands, other
+   * daemons, connection resets).
+   */
+  class ClientDispatchThread : public Thread {
+  public:
+    explicit ClientDispatchThread(MDSDaemon *mds_) : mds(mds_) {}
+    void *entry() override;
+    void enqueue(const ref_t<Message> &m);
+    void stop();
+
+  private:
+    struct queued_t {
+      ref_t<Message> m;
+      uint64_t throttle_size;  // of the dispatch throttle
+    };
+
+    MDSDaemon *mds;
+    // a connection stays alive while it has queued messages
+    ClientDispatchQueue<Connection*, queued_t> queue;
+    ceph::mutex wait_lock =
+      ceph::make_mutex("MDSDaemon::ClientDispatchThread::wait_lock");
+    ceph::condition_variable wait_cond;
+    bool stopping = false;
+  } client_dispatch_thread;
+  const bool fast_dispatch;
+
   mono_time starttime = mono_clock::zero();
 };
 
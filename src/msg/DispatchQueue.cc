@@ -71,7 +71,12 @@ bool DispatchQueue::can_fast_dispatch(const cref_t<Message> &m) const
 void DispatchQueue::fast_dispatch(const ref_t<Message>& m)
 {
   uint64_t msize = pre_dispatch(m);
+  // the dispatcher may take the throttle over, see
+  // Messenger::dispatch_throttle_release()
+  m->set_dispatch_throttle_size(msize);
   msgr->ms_fast_dispatch(m);
+  msize = m->get_dispatch_throttle_size();
+  m->set_dispatch_throttle_size(0);
   post_dispatch(m, msize);
 }
 
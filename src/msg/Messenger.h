@@ -307,6 +307,19 @@ public:
    */
   virtual double get_dispatch_queue_max_age(utime_t now) const = 0;
 
+  /**
+   * Give back the dispatch throttle of a fast dispatched Message.
+   *
+   * A fast dispatcher which queues Messages may keep them counted against
+   * ms_dispatch_throttle_bytes until it handled them, so that the
+   * Messenger stops reading when the dispatcher falls behind.  It takes
+   * the throttle over by clearing the dispatch_throttle_size of the
+   * Message in ms_fast_dispatch2(), and releases it here once done.
+   *
+   * @param msize The amount of memory to release.
+   */
+  virtual void dispatch_throttle_release(uint64_t msize) {}
+
   /**
    * @} // Accessors
    */
@@ -130,6 +130,8 @@ AsyncConnection::AsyncConnection(CephContext *cct, AsyncMessenger *m, DispatchQu
     last_active(ceph::coarse_mono_clock::now()),
     connect_timeout_us(cct->_conf->ms_connection_ready_timeout*1000*1000),
     inactive_timeout_us(cct->_conf->ms_connection_idle_timeout*1000*1000),
+    migrate_idle_time(ceph::make_timespan(
+      cct->_conf.get_val<double>("ms_async_migrate_idle_time"))),
     msgr2(m2), state_offset(0),
     worker(w), center(&w->center),read_buffer(nullptr)
 {
@@ -241,7 +243,7 @@ ssize_t AsyncConnection::read_until(unsigned len, char *p)
 
   recv_end = recv_start = 0;
   /* nothing left in the prefetch buffer */
-  if (left > (uint64_t)recv_max_prefetch) {
+  if (left > (uint64_t)recv_max_prefetch || !recv_prefetch) {
     /* this was a large read, we don't prefetch for these */
     do {
       r = read_bulk(p+state_offset, left);
@@ -382,11 +384,23 @@ bool AsyncConnection::inject_network_congestion() const {
 
 void AsyncConnection::process() {
   std::lock_guard<std::mutex> l(lock);
+  if (!center->in_thread()) {
+    // queued before the connection moved to another worker
+    center->dispatch_event_external(read_handler);
+    return;
+  }
+  auto idle_since = last_active;
   last_active = ceph::coarse_mono_clock::now();
   recv_start_time = ceph::mono_clock::now();
 
   ldout(async_msgr->cct, 20) << __func__ << dendl;
 
+  if (state == STATE_CONNECTION_ESTABLISHED &&
+      last_active - idle_since >= migrate_idle_time &&
+      maybe_migrate()) {
+    return;
+  }
+
   switch (state) {
     case STATE_NONE: {
       ldout(async_msgr->cct, 20) << __func__ << " enter none state" << dendl;
@@ -491,6 +505,9 @@ void AsyncConnection::process() {
     }
   }
 
+  // completions on the socket error queue make it poll readable, pick
+  // them up even if the protocol does not read now
+  cs.reap_completions();
   protocol->read_event();
 
   logger->tinc(l_msgr_running_recv_time,
@@ -587,9 +604,8 @@ int AsyncConnection::send_message(Message *m)
   }
 
   // we don't want to consider local message here, it's too lightweight which
-  // may disturb users
-  logger->inc(l_msgr_send_messages);
-
+  // may disturb users.  the protocol counts it under write_lock, as logger
+  // changes when the connection migrates to another worker
   protocol->send_message(m);
   return 0;
 }
@@ -622,6 +638,7 @@ void AsyncConnection::fault()
     delay_state->flush();
 
   recv_start = recv_end = 0;
+  recv_prefetch = true;
   state_offset = 0;
   outgoing_bl.clear();
 }
@@ -640,6 +657,55 @@ void AsyncConnection::_stop() {
   center->dispatch_event_external(EventCallbackRef(new C_clean_handler(this)));
 }
 
+// Hand an established connection that has been idle over to a less busy
+// worker.  The socket stays open, only its events move to the event center
+// of the new worker.  Called from process() on the owner thread with lock
+// held, see the comment on center.
+bool AsyncConnection::maybe_migrate()
+{
+  ceph_assert(center->in_thread());
+  std::lock_guard<std::mutex> wl(write_lock);
+  if (open_write || delay_state || !register_time_events.empty() ||
+      !protocol->can_migrate()) {
+    return false;
+  }
+  Worker *new_worker = async_msgr->get_stack()->get_migration_target(worker);
+  if (!new_worker) {
+    return false;
+  }
+  ldout(async_msgr->cct, 5) << __func__ << " worker " << worker->id
+                            << " load " << worker->load.load() << " -> worker "
+                            << new_worker->id << " load " << new_worker->load.load()
+                            << dendl;
+
+  center->delete_file_event(cs.fd(), EVENT_READABLE | EVENT_WRITABLE);
+  if (last_tick_id) {
+    center->delete_time_event(last_tick_id);
+    last_tick_id = 0;
+  }
+  logger->dec(l_msgr_active_connections);
+  worker->release_worker();
+  worker = new_worker;
+  center = &new_worker->center;
+  logger = new_worker->get_perf_counter();
+  labeled_logger = new_worker->get_labeled_perf_counter();
+  logger->inc(l_msgr_active_connections);
+
+  center->submit_to(
+      center->get_id(), [this, conn = AsyncConnectionRef(this)] {
+    std::lock_guard<std::mutex> l(lock);
+    if (state != STATE_CONNECTION_ESTABLISHED) {
+      // stopped in between, cleanup() runs after us
+      return;
+    }
+    center->create_file_event(cs.fd(), EVENT_READABLE, read_handler);
+    last_tick_id = center->create_time_event(inactive_timeout_us, tick_handler);
+  }, true);
+  // the data that woke us up is still in the socket
+  center->dispatch_event_external(read_handler);
+  return true;
+}
+
 bool AsyncConnection::is_queued() const {
   return outgoing_bl.length();
 }
@@ -734,11 +800,23 @@ void AsyncConnection::mark_down()
 void AsyncConnection::handle_write()
 {
   ldout(async_msgr->cct, 10) << __func__ << dendl;
+  write_lock.lock();
+  if (!center->in_thread()) {
+    // queued before the connection moved to another worker
+    center->dispatch_event_external(write_handler);
+    write_lock.unlock();
+    return;
+  }
+  write_lock.unlock();
   protocol->write_event();
 }
 
 void AsyncConnection::handle_write_callback() {
   std::lock_guard<std::mutex> l(lock);
+  if (!center->in_thread()) {
+    center->dispatch_event_external(write_callback_handler);
+    return;
+  }
   last_active = ceph::coarse_mono_clock::now();
   recv_start_time = ceph::mono_clock::now();
   write_lock.lock();
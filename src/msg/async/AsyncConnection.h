@@ -201,6 +201,9 @@ private:
   uint32_t recv_max_prefetch;
   uint32_t recv_start;
   uint32_t recv_end;
+  // read no further than asked, e.g. while the socket is about to switch to
+  // kernel TLS and the following bytes must stay in the kernel
+  bool recv_prefetch = true;
   std::set<uint64_t> register_time_events; // need to delete it if stop
   ceph::coarse_mono_clock::time_point last_connect_started;
   ceph::coarse_mono_clock::time_point last_active;
@@ -208,6 +211,7 @@ private:
   uint64_t last_tick_id = 0;
   const uint64_t connect_timeout_us;
   const uint64_t inactive_timeout_us;
+  const ceph::coarse_mono_clock::duration migrate_idle_time;
 
   // Tis section are temp variables used by state transition
 
@@ -217,9 +221,15 @@ private:
   entity_addr_t target_addr;  ///< which of the peer_addrs we're connecting to (as clienet) or should reconnect to (as peer)
 
   entity_addr_t _infer_target_addr(const entity_addrvec_t& av);
+  bool maybe_migrate();
 
   // used only by "read_until"
   uint64_t state_offset;
+  // worker, center and the loggers change on the owner thread with both
+  // lock and write_lock held, when the connection migrates or takes over
+  // the socket of a replacing one; other threads read them under either
+  // lock, and events they queued to a center the connection left are
+  // passed on to the current one by the handlers
   Worker *worker;
   EventCenter *center;
 
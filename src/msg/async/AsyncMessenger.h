@@ -124,6 +124,10 @@ public:
   double get_dispatch_queue_max_age(utime_t now) const override {
     return dispatch_queue.get_max_age(now);
   }
+
+  void dispatch_throttle_release(uint64_t msize) override {
+    dispatch_queue.dispatch_throttle_release(msize);
+  }
   /** @} Accessors */
 
   /**
@@ -22,6 +22,9 @@
 #ifdef HAVE_DPDK
 #include "dpdk/EventDPDK.h"
 #endif
+#ifdef HAVE_LIBURING
+#include "uring/EventUring.h"
+#endif
 
 #ifdef HAVE_EPOLL
 #include "EventEpoll.h"
@@ -120,6 +123,10 @@ int EventCenter::init(int nevent, unsigned center_id, const std::string &type)
   if (type == "dpdk") {
 #ifdef HAVE_DPDK
     driver = new DPDKDriver(cct);
+#endif
+  } else if (type == "uring") {
+#ifdef HAVE_LIBURING
+    driver = new UringDriver(cct);
 #endif
   } else {
 #ifdef HAVE_EPOLL
@@ -19,8 +19,12 @@
 #include <netinet/in.h>
 #include <arpa/inet.h>
 #include <errno.h>
+#ifdef __linux__
+#include <linux/errqueue.h>
+#endif
 
 #include <algorithm>
+#include <deque>
 
 #include "PosixStack.h"
 
@@ -37,16 +41,136 @@
 #undef dout_prefix
 #define dout_prefix *_dout << "PosixStack "
 
+#if defined(MSG_ZEROCOPY) && defined(SO_EE_ORIGIN_ZEROCOPY)
+#define HAVE_MSG_ZEROCOPY
+#endif
+
+#ifdef HAVE_MSG_ZEROCOPY
+// MSG_ZEROCOPY sends of a socket.  The kernel numbers every successful
+// zerocopy sendmsg() call and reports ranges of completed calls on the
+// socket error queue; until then the sent buffers must stay untouched, so
+// we keep references to them.
+struct PosixZeroCopy {
+  CephContext *cct;
+  int fd;
+  uint64_t min_size = 0;         ///< 0 if zerocopy is off
+  uint64_t next_id = 0;          ///< id of the next zerocopy sendmsg()
+  uint64_t outstanding = 0;      ///< calls not completed yet
+  struct pinned_t {
+    uint64_t first_id, last_id;
+    uint64_t outstanding;
+    ceph::buffer::list bl;
+  };
+  std::deque<pinned_t> pinned;
+
+  PosixZeroCopy(CephContext *c, int f) : cct(c), fd(f) {}
+
+  // ids are 32 bits on the wire, extend them relative to next_id
+  uint64_t unwrap(uint32_t id) const {
+    return next_id - (uint32_t)((uint32_t)next_id - id);
+  }
+
+  void pin(ceph::buffer::list&& bl, unsigned sends) {
+    pinned.push_back({next_id, next_id + sends - 1, sends, std::move(bl)});
+    next_id += sends;
+    outstanding += sends;
+  }
+
+  void complete(uint64_t lo, uint64_t hi) {
+    outstanding -= std::min(outstanding, hi - lo + 1);
+    for (auto p = pinned.begin(); p != pinned.end() && p->first_id <= hi; ) {
+      if (p->last_id >= lo) {
+	p->outstanding -= std::min(p->last_id, hi) - std::max(p->first_id, lo) + 1;
+      }
+      if (p->outstanding == 0) {
+	p = pinned.erase(p);
+      } else {
+	++p;
+      }
+    }
+  }
+
+  void reap() {
+    while (outstanding) {
+      char control[128];
+      struct msghdr msg;
+      // FIPS zeroization audit: this memset is not security related.
+      memset(&msg, 0, sizeof(msg));
+      msg.msg_control = control;
+      msg.msg_controllen = sizeof(control);
+      if (::recvmsg(fd, &msg, MSG_ERRQUEUE) < 0) {
+	return;  // EAGAIN, nothing completed
+      }
+      for (auto cm = CMSG_FIRSTHDR(&msg); cm; cm = CMSG_NXTHDR(&msg, cm)) {
+	if (!(cm->cmsg_level == SOL_IP && cm->cmsg_type == IP_RECVERR) &&
+	    !(cm->cmsg_level == SOL_IPV6 && cm->cmsg_type == IPV6_RECVERR)) {
+	  continue;
+	}
+	auto serr = reinterpret_cast<struct sock_extended_err*>(CMSG_DATA(cm));
+	if (serr->ee_errno != 0 || serr->ee_origin != SO_EE_ORIGIN_ZEROCOPY) {
+	  continue;
+	}
+	complete(unwrap(serr->ee_info), unwrap(serr->ee_data));
+	if (min_size && (serr->ee_code & SO_EE_CODE_ZEROCOPY_COPIED)) {
+	  // the device could not send from our pages (e.g. loopback), so
+	  // zerocopy only adds the notification overhead
+	  ldout(cct, 10) << __func__ << " fd " << fd
+			 << " kernel copied zerocopy sends, disabling zerocopy"
+			 << dendl;
+	  min_size = 0;
+	}
+      }
+    }
+  }
+};
+
+// A socket closed while zerocopy sends are outstanding.  Its sending side
+// is shut down, so the queued data still goes out followed by a FIN, and
+// the worker keeps the fd and the pinned buffers until the completions are
+// reported on the error queue.  These wake the event center as EPOLLERR.
+struct PosixWorker::Lingering : public EventCallback {
+  PosixWorker *worker;
+  PosixZeroCopy zc;
+
+  Lingering(PosixWorker *w, PosixZeroCopy&& z) : worker(w), zc(std::move(z)) {}
+  void do_request(uint64_t fd) override {
+    zc.reap();
+    if (!zc.outstanding) {
+      worker->release_lingering(zc.fd);  // deletes this
+    }
+  }
+};
+#else
+struct PosixWorker::Lingering {};
+#endif
+
 class PosixConnectedSocketImpl final : public ConnectedSocketImpl {
   ceph::NetHandler &handler;
+  PosixWorker *worker;
   int _fd;
   entity_addr_t sa;
   bool connected;
+#ifdef HAVE_MSG_ZEROCOPY
+  PosixZeroCopy zc;
+#endif
 
  public:
-  explicit PosixConnectedSocketImpl(ceph::NetHandler &h, const entity_addr_t &sa,
-				    int f, bool connected)
-      : handler(h), _fd(f), sa(sa), connected(connected) {}
+  explicit PosixConnectedSocketImpl(ceph::NetHandler &h, PosixWorker *w,
+				    const entity_addr_t &sa, int f,
+				    bool connected)
+      : handler(h), worker(w), _fd(f), sa(sa), connected(connected)
+#ifdef HAVE_MSG_ZEROCOPY
+      , zc(w->cct, f)
+#endif
+  {
+#ifdef HAVE_MSG_ZEROCOPY
+    if (zc.cct->_conf.get_val<bool>("ms_tcp_zerocopy") &&
+	handler.set_zerocopy(_fd) == 0) {
+      zc.min_size = std::max<uint64_t>(
+	1, zc.cct->_conf.get_val<Option::size_t>("ms_tcp_zerocopy_min_size"));
+    }
+#endif
+  }
 
   int is_connected() override {
     if (connected)
@@ -64,6 +188,9 @@ class PosixConnectedSocketImpl final : public ConnectedSocketImpl {
   }
 
   ssize_t read(char *buf, size_t len) override {
+    #ifdef HAVE_MSG_ZEROCOPY
+    zc.reap();
+    #endif
     #ifdef _WIN32
     ssize_t r = ::recv(_fd, buf, len, 0);
     #else
@@ -76,14 +203,24 @@ class PosixConnectedSocketImpl final : public ConnectedSocketImpl {
 
   // return the sent length
   // < 0 means error occurred
+  // zc_sends counts the successful calls if the data is sent with
+  // MSG_ZEROCOPY, NULL means copy
   #ifndef _WIN32
-  static ssize_t do_sendmsg(int fd, struct msghdr &msg, unsigned len, bool more)
+  static ssize_t do_sendmsg(int fd, struct msghdr &msg, unsigned len, bool more,
+			    unsigned *zc_sends = nullptr)
   {
     size_t sent = 0;
+    int flags = MSG_NOSIGNAL | (more ? MSG_MORE : 0);
+    #ifdef HAVE_MSG_ZEROCOPY
+    if (zc_sends)
+      flags |= MSG_ZEROCOPY;
+    #endif
     while (1) {
       MSGR_SIGPIPE_STOPPER;
       ssize_t r;
-      r = ::sendmsg(fd, &msg, MSG_NOSIGNAL | (more ? MSG_MORE : 0));
+      r = ::sendmsg(fd, &msg, flags);
+      if (r >= 0 && zc_sends)
+        ++*zc_sends;
       if (r < 0) {
         int err = ceph_sock_errno();
         if (err == EINTR) {
@@ -114,6 +251,13 @@ class PosixConnectedSocketImpl final : public ConnectedSocketImpl {
   }
 
   ssize_t send(ceph::buffer::list &bl, bool more) override {
+    unsigned zc_sends = 0;
+    unsigned *zc_count = nullptr;
+    #ifdef HAVE_MSG_ZEROCOPY
+    zc.reap();
+    if (zc.min_size && bl.length() >= zc.min_size)
+      zc_count = &zc_sends;
+    #endif
     size_t sent_bytes = 0;
     auto pb = std::cbegin(bl.buffers());
     uint64_t left_pbrs = bl.get_num_buffers();
@@ -133,9 +277,15 @@ class PosixConnectedSocketImpl final : public ConnectedSocketImpl {
 	msglen += pb->length();
 	++pb;
       }
-      ssize_t r = do_sendmsg(_fd, msg, msglen, left_pbrs || more);
-      if (r < 0)
+      ssize_t r = do_sendmsg(_fd, msg, msglen, left_pbrs || more, zc_count);
+      if (r < 0) {
+        #ifdef HAVE_MSG_ZEROCOPY
+        // the socket is failing, just keep the ids in step
+        if (zc_sends)
+          zc.pin({}, zc_sends);
+        #endif
         return r;
+      }
 
       // "r" is the remaining length
       sent_bytes += r;
@@ -150,8 +300,13 @@ class PosixConnectedSocketImpl final : public ConnectedSocketImpl {
         bl.splice(sent_bytes, bl.length()-sent_bytes, &swapped);
         bl.swap(swapped);
       } else {
-        bl.clear();
+        swapped.swap(bl);
       }
+      #ifdef HAVE_MSG_ZEROCOPY
+      // swapped holds the sent data now, the kernel still refers to it
+      if (zc_sends)
+        zc.pin(std::move(swapped), zc_sends);
+      #endif
     }
 
     return static_cast<ssize_t>(sent_bytes);
@@ -204,6 +359,17 @@ class PosixConnectedSocketImpl final : public ConnectedSocketImpl {
     ::shutdown(_fd, SHUT_RDWR);
   }
   void close() override {
+    #ifdef HAVE_MSG_ZEROCOPY
+    zc.reap();
+    if (zc.outstanding) {
+      // the kernel may still send from our pages, they are handed back
+      // once it reported so
+      ::shutdown(_fd, SHUT_WR);
+      worker->linger(std::make_unique<PosixWorker::Lingering>(
+	worker, std::move(zc)));
+      return;
+    }
+    #endif
     compat_closesocket(_fd);
   }
   void set_priority(int sd, int prio, int domain) override {
@@ -212,6 +378,23 @@ class PosixConnectedSocketImpl final : public ConnectedSocketImpl {
   int fd() const override {
     return _fd;
   }
+  void reap_completions() override {
+    #ifdef HAVE_MSG_ZEROCOPY
+    zc.reap();
+    #endif
+  }
+  int enable_ktls() override {
+    return handler.enable_ktls(_fd);
+  }
+  int set_ktls_key(bool tx, const unsigned char *key,
+		   const unsigned char *iv) override {
+    #ifdef HAVE_MSG_ZEROCOPY
+    // kernel TLS rejects MSG_ZEROCOPY sends
+    if (tx)
+      zc.min_size = 0;
+    #endif
+    return handler.set_ktls_key(_fd, tx, key, iv);
+  }
   friend class PosixServerSocketImpl;
   friend class PosixNetworkStack;
 };
@@ -262,15 +445,73 @@ int PosixServerSocketImpl::accept(ConnectedSocket *sock, const SocketOptions &op
   out->set_sockaddr((sockaddr*)&ss);
   handler.set_priority(sd, opt.priority, out->get_family());
 
-  std::unique_ptr<PosixConnectedSocketImpl> csi(new PosixConnectedSocketImpl(handler, *out, sd, true));
+  std::unique_ptr<PosixConnectedSocketImpl> csi(new PosixConnectedSocketImpl(
+      handler, static_cast<PosixWorker*>(w), *out, sd, true));
   *sock = ConnectedSocket(std::move(csi));
   return 0;
 }
 
+PosixWorker::PosixWorker(CephContext *c, unsigned i)
+  : Worker(c, i), net(c)
+{
+}
+
+PosixWorker::~PosixWorker()
+{
+  for (auto& [fd, l] : lingering) {
+    compat_closesocket(fd);
+  }
+}
+
 void PosixWorker::initialize()
 {
 }
 
+void PosixWorker::destroy()
+{
+  // the stack is going away, nothing is sent from the buffers any more
+  while (!lingering.empty()) {
+    release_lingering(lingering.begin()->first);
+  }
+}
+
+void PosixWorker::linger(std::unique_ptr<Lingering> l)
+{
+#ifdef HAVE_MSG_ZEROCOPY
+  center.submit_to(center.get_id(), [this, l = std::move(l)]() mutable {
+    int fd = l->zc.fd;
+    // bound the wait for a peer which does not take the data any more,
+    // giving up on the connection drops its queue and completes the sends
+    unsigned timeout_ms = cct->_conf->ms_connection_idle_timeout * 1000;
+    ::setsockopt(fd, IPPROTO_TCP, TCP_USER_TIMEOUT, &timeout_ms,
+		 sizeof(timeout_ms));
+    ldout(cct, 10) << __func__ << " fd " << fd << " waits for "
+		   << l->zc.outstanding << " zerocopy sends" << dendl;
+    auto [p, inserted] = lingering.emplace(fd, std::move(l));
+    ceph_assert(inserted);
+    center.create_file_event(fd, EVENT_READABLE, p->second.get());
+    // completions reported before the event was created
+    p->second->do_request(fd);
+  }, true);
+#endif
+}
+
+void PosixWorker::release_lingering(int fd)
+{
+  auto p = lingering.find(fd);
+  ceph_assert(p != lingering.end());
+#ifdef HAVE_MSG_ZEROCOPY
+  if (p->second->zc.outstanding) {
+    ldout(cct, 1) << __func__ << " fd " << fd << " "
+		  << p->second->zc.outstanding
+		  << " zerocopy sends did not complete" << dendl;
+  }
+#endif
+  center.delete_file_event(fd, EVENT_READABLE);
+  compat_closesocket(fd);
+  lingering.erase(p);
+}
+
 int PosixWorker::listen(entity_addr_t &sa,
 			unsigned addr_slot,
 			const SocketOptions &opt,
@@ -331,7 +572,7 @@ int PosixWorker::connect(const entity_addr_t &addr, const SocketOptions &opts, C
 
   net.set_priority(sd, opts.priority, addr.get_family());
   *socket = ConnectedSocket(
-      std::unique_ptr<PosixConnectedSocketImpl>(new PosixConnectedSocketImpl(net, addr, sd, !opts.nonblock)));
+      std::unique_ptr<PosixConnectedSocketImpl>(new PosixConnectedSocketImpl(net, this, addr, sd, !opts.nonblock)));
   return 0;
 }
 
@@ -17,6 +17,8 @@
 #ifndef CEPH_MSG_ASYNC_POSIXSTACK_H
 #define CEPH_MSG_ASYNC_POSIXSTACK_H
 
+#include <map>
+#include <memory>
 #include <thread>
 
 #include "msg/msg_types.h"
@@ -26,10 +28,21 @@
 
 class PosixWorker : public Worker {
   ceph::NetHandler net;
+ public:
+  /// a closed socket whose send buffers the kernel still refers to
+  struct Lingering;
+ private:
+  /// by fd, owner thread only
+  std::map<int, std::unique_ptr<Lingering>> lingering;
+
   void initialize() override;
+  void destroy() override;
  public:
-  PosixWorker(CephContext *c, unsigned i)
-      : Worker(c, i), net(c) {}
+  PosixWorker(CephContext *c, unsigned i);
+  ~PosixWorker() override;
+  /// keeps a closed socket until its sends completed, then closes its fd
+  void linger(std::unique_ptr<Lingering> l);
+  void release_lingering(int fd);
   int listen(entity_addr_t &sa,
 	     unsigned addr_slot,
 	     const SocketOptions &opt,
@@ -54,6 +67,7 @@ class PosixNetworkStack : public NetworkStack {
     ceph_assert(threads.size() > i && threads[i].joinable());
     threads[i].join();
   }
+  bool support_connection_migration() const override { return true; }
 };
 
 #endif //CEPH_MSG_ASYNC_POSIXSTACK_H
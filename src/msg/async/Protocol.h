@@ -131,6 +131,9 @@ public:
   virtual void read_event() = 0;
   virtual void write_event() = 0;
   virtual bool is_queued() = 0;
+  // true -> no timers or pending transitions tie the connection to the
+  // event center of its worker; called with the write_lock held
+  virtual bool can_migrate() { return false; }
 
   virtual void dump(Formatter *f) = 0;
 
@@ -240,6 +240,7 @@ void ProtocolV1::send_message(Message *m) {
   } else {
     m->queue_start = ceph::mono_clock::now();
     m->trace.event("async enqueueing message");
+    connection->logger->inc(l_msgr_send_messages);
     out_q[m->get_priority()].emplace_back(out_q_entry_t{
       std::move(bl), m, is_prepared});
     ldout(cct, 15) << __func__ << " inline write is denied, reschedule m=" << m
@@ -2418,6 +2419,8 @@ CtPtr ProtocolV1::replace(const AsyncConnectionRef& existing,
             if (exproto->state == NONE) {
               existing->shutdown_socket();
               existing->cs = std::move(cs);
+              // send_message() reads them under write_lock only
+              std::lock_guard<std::mutex> wl(existing->write_lock);
               existing->worker->references--;
               new_worker->references++;
               existing->logger = new_worker->get_perf_counter();
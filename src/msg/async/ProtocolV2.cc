@@ -39,6 +39,11 @@ using namespace ceph::msgr::v2;
 using CtPtr = Ct<ProtocolV2> *;
 using CtRef = Ct<ProtocolV2> &;
 
+// set when the kernel took TCP_ULP "tls" but refused our keys; until then
+// new connections stay with the stream handlers, rather than each of them
+// failing once the same way
+static std::atomic<ceph::mono_time> ktls_refused_until{ceph::mono_time::min()};
+
 void ProtocolV2::run_continuation(CtPtr pcontinuation) {
   if (pcontinuation) {
     run_continuation(*pcontinuation);
@@ -102,7 +107,10 @@ ProtocolV2::ProtocolV2(AsyncConnection *connection)
       rx_frame_asm(&session_stream_handlers, false, cct->_conf->ms_crc_data,
                    &session_compression_handlers),
       next_tag(static_cast<Tag>(0)),
-      keepalive(false) {
+      keepalive(false),
+      tx_batch_bytes(cct->_conf.get_val<Option::size_t>("ms_frame_batch_bytes")),
+      tx_batch_time(std::chrono::microseconds(
+        cct->_conf.get_val<uint64_t>("ms_frame_batch_usec"))) {
 }
 
 ProtocolV2::~ProtocolV2() {
@@ -240,6 +248,8 @@ void ProtocolV2::reset_security() {
   session_stream_handlers.tx.reset(nullptr);
   pre_auth.rxbuf.clear();
   pre_auth.txbuf.clear();
+  ktls.pending = false;
+  ktls.active = false;
 }
 
 // it's expected the `write_lock` is held while calling this method.
@@ -459,6 +469,7 @@ void ProtocolV2::send_message(Message *m) {
                   << " type=" << m->get_type() << " " << *m << dendl;
     m->queue_start = ceph::mono_clock::now();
     m->trace.event("async enqueueing message");
+    connection->logger->inc(l_msgr_send_messages);
     out_queue[m->get_priority()].emplace_back(
       out_queue_entry_t{is_prepared, m});
     ldout(cct, 15) << __func__ << " inline write is denied, reschedule m=" << m
@@ -551,6 +562,7 @@ ssize_t ProtocolV2::write_message(Message *m, bool more) {
     m->put();
     return -EILSEQ;
   }
+  note_tx_frame();
 
   ldout(cct, 2) << __func__ << " sending message m=" << m
                 << " seq=" << m->get_seq() << " " << *m << dendl;
@@ -560,17 +572,16 @@ ssize_t ProtocolV2::write_message(Message *m, bool more) {
                  << " src=" << entity_name_t(messenger->get_myname())
                  << " off=" << header2.data_off
                  << dendl;
-  ssize_t total_send_size = connection->outgoing_bl.length();
-  ssize_t rc = connection->_try_send(more);
-  if (rc < 0) {
+  ssize_t rc = 0;
+  if (more && tx_batch_open()) {
+    // the next message goes into the same write
+    ldout(cct, 20) << __func__ << " batched " << tx_batch.frames
+                   << " frames, " << connection->outgoing_bl.length()
+                   << " bytes" << dendl;
+  } else if (rc = flush_frames(more); rc < 0) {
     ldout(cct, 1) << __func__ << " error sending " << m << ", "
                   << cpp_strerror(rc) << dendl;
   } else {
-    const auto sent_bytes = total_send_size - connection->outgoing_bl.length();
-    connection->logger->inc(l_msgr_send_bytes, sent_bytes);
-    if (session_stream_handlers.tx) {
-      connection->logger->inc(l_msgr_send_encrypted_bytes, sent_bytes);
-    }
     ldout(cct, 10) << __func__ << " sending " << m
                    << (rc ? " continuely." : " done.") << dendl;
   }
@@ -586,6 +597,30 @@ ssize_t ProtocolV2::write_message(Message *m, bool more) {
   return rc;
 }
 
+bool ProtocolV2::tx_batch_open() const {
+  // only called with more messages queued, so a lone message is never held
+  // back; a deep queue fills the batch up to the size or time budget
+  return connection->outgoing_bl.length() < tx_batch_bytes &&
+    ceph::mono_clock::now() - tx_batch.start < tx_batch_time;
+}
+
+ssize_t ProtocolV2::flush_frames(bool more) {
+  if (tx_batch.frames) {
+    connection->logger->inc(l_msgr_send_frames_per_write, tx_batch.frames);
+    tx_batch.frames = 0;
+  }
+  ssize_t total_send_size = connection->outgoing_bl.length();
+  ssize_t rc = connection->_try_send(more);
+  if (rc >= 0) {
+    const auto sent_bytes = total_send_size - connection->outgoing_bl.length();
+    connection->logger->inc(l_msgr_send_bytes, sent_bytes);
+    if (session_stream_handlers.tx) {
+      connection->logger->inc(l_msgr_send_encrypted_bytes, sent_bytes);
+    }
+  }
+  return rc;
+}
+
 template <class F>
 bool ProtocolV2::append_frame(F& frame) {
   ceph::bufferlist bl;
@@ -654,13 +689,15 @@ void ProtocolV2::write_event() {
         connection->lock.unlock();
         return;
       }
+      note_tx_frame();
       keepalive = false;
     }
 
     auto start = ceph::mono_clock::now();
     bool more;
     do {
-      if (connection->is_queued()) {
+      // leftovers of an earlier write go out first, a batch keeps growing
+      if (connection->is_queued() && !tx_batch.frames) {
 	if (r = connection->_try_send(); r!= 0) {
 	  // either fails to send or not all queued buffer is sent
 	  break;
@@ -715,14 +752,15 @@ void ProtocolV2::write_event() {
                        << " messages" << dendl;
         auto ack_frame = AckFrame::Encode(in_seq);
         if (append_frame(ack_frame)) {
+          note_tx_frame();
           ack_left -= left;
           left = ack_left;
-          r = connection->_try_send(left);
+          r = flush_frames(left);
         } else {
           r = -EILSEQ;
         }
       } else if (is_queued()) {
-        r = connection->_try_send();
+        r = flush_frames();
       }
     }
     connection->write_lock.unlock();
@@ -731,6 +769,7 @@ void ProtocolV2::write_event() {
                              ceph::mono_clock::now() - start);
     if (r < 0) {
       ldout(cct, 1) << __func__ << " send msg failed" << dendl;
+      tx_batch.frames = 0;
       connection->lock.lock();
       fault();
       connection->lock.unlock();
@@ -767,6 +806,11 @@ bool ProtocolV2::is_queued() {
   return !out_queue.empty() || connection->is_queued();
 }
 
+bool ProtocolV2::can_migrate() {
+  // the throttle states wait on time events, the others on the handshake
+  return state == READY && !is_queued();
+}
+
 void ProtocolV2::dump(Formatter *f) {
   f->open_object_section("v2");
   f->dump_string("state", get_state_name(state));
@@ -778,14 +822,19 @@ void ProtocolV2::dump(Formatter *f) {
   f->dump_unsigned("peer_global_seq", peer_global_seq);
 
   f->open_object_section("crypto");
-  f->dump_string(
-      "rx", session_stream_handlers.rx
-                ? session_stream_handlers.rx->cipher_name()
-                : "PLAIN");
-  f->dump_string(
-      "tx", session_stream_handlers.tx
-                ? session_stream_handlers.tx->cipher_name()
-                : "PLAIN");
+  if (ktls.active) {
+    f->dump_string("rx", "kTLS AES-128-GCM");
+    f->dump_string("tx", "kTLS AES-128-GCM");
+  } else {
+    f->dump_string(
+        "rx", session_stream_handlers.rx
+                  ? session_stream_handlers.rx->cipher_name()
+                  : "PLAIN");
+    f->dump_string(
+        "tx", session_stream_handlers.tx
+                  ? session_stream_handlers.tx->cipher_name()
+                  : "PLAIN");
+  }
   f->close_section();  // crypto
 
   f->open_object_section("compression");
@@ -883,9 +932,17 @@ CtPtr ProtocolV2::_banner_exchange(CtRef callback) {
   ldout(cct, 20) << __func__ << dendl;
   bannerExchangeCallback = &callback;
 
+  uint64_t supported_features = CEPH_MSGR2_SUPPORTED_FEATURES;
+  ktls.offered = cct->_conf.get_val<bool>("ms_ktls") &&
+    ceph::mono_clock::now() >= ktls_refused_until.load() &&
+    connection->cs.enable_ktls() == 0;
+  if (ktls.offered) {
+    supported_features |= CEPH_MSGR2_FEATURE_KTLS;
+  }
+
   ceph::bufferlist banner_payload;
   using ceph::encode;
-  encode((uint64_t)CEPH_MSGR2_SUPPORTED_FEATURES, banner_payload, 0);
+  encode(supported_features, banner_payload, 0);
   encode((uint64_t)CEPH_MSGR2_REQUIRED_FEATURES, banner_payload, 0);
 
   ceph::bufferlist bl;
@@ -1227,8 +1284,15 @@ CtPtr ProtocolV2::read_frame_segment() {
   rx_buffer_t rx_buffer;
   uint16_t align = rx_frame_asm.get_segment_align(seg_idx);
   try {
-    rx_buffer = ceph::buffer::ptr_node::create(ceph::buffer::create_aligned(
-        onwire_len, align));
+    ceph::unique_leakable_ptr<ceph::buffer::raw> raw;
+    if (auto pool = connection->worker->rx_buffer_pool.get(); pool) {
+      raw = pool->get(onwire_len, align, connection->logger);
+    }
+    if (!raw) {
+      raw = ceph::buffer::create_aligned(onwire_len, align);
+    }
+    rx_buffer = ceph::buffer::ptr_node::create(std::move(raw));
+    rx_buffer->set_length(onwire_len);
   } catch (const ceph::buffer::bad_alloc&) {
     // Catching because of potential issues with satisfying alignment.
     ldout(cct, 1) << __func__ << " can't allocate aligned rx_buffer"
@@ -1883,6 +1947,7 @@ CtPtr ProtocolV2::handle_auth_done(ceph::bufferlist &payload)
   bool is_rev1 = HAVE_MSGR2_FEATURE(peer_supported_features, REVISION_1);
   session_stream_handlers = ceph::crypto::onwire::rxtx_t::create_handler_pair(
       cct, *auth_meta, /*new_nonce_format=*/is_rev1, /*crossed=*/false);
+  prepare_ktls();
 
   state = AUTH_CONNECTING_SIGN;
 
@@ -2206,7 +2271,7 @@ CtPtr ProtocolV2::handle_compression_done(ceph::bufferlist &payload) {
     comp_meta.con_mode = Compressor::COMP_NONE;
   }
   session_compression_handlers = ceph::compression::onwire::rxtx_t::create_handler_pair(
-    cct, comp_meta, messenger->comp_registry.get_min_compression_size(connection->get_peer_type()));
+    cct, comp_meta, messenger->comp_registry.get_tx_policy(connection->get_peer_type()));
 
   return start_session_connect();
 }
@@ -2323,6 +2388,7 @@ CtPtr ProtocolV2::finish_auth()
   bool is_rev1 = HAVE_MSGR2_FEATURE(peer_supported_features, REVISION_1);
   session_stream_handlers = ceph::crypto::onwire::rxtx_t::create_handler_pair(
       cct, *auth_meta, /*new_nonce_format=*/is_rev1, /*crossed=*/true);
+  prepare_ktls();
 
   const auto sig = auth_meta->session_key.empty() ? sha256_digest_t() :
     auth_meta->session_key.hmac_sha256(cct, pre_auth.rxbuf);
@@ -2375,6 +2441,10 @@ CtPtr ProtocolV2::handle_auth_signature(ceph::bufferlist &payload)
     pre_auth.txbuf.clear();
   }
 
+  if (ktls.pending && !install_ktls()) {
+    return _fault();
+  }
+
   if (state == AUTH_ACCEPTING_SIGN) {
     // this happened on server side
     return finish_server_auth();
@@ -2386,6 +2456,54 @@ CtPtr ProtocolV2::handle_auth_signature(ceph::bufferlist &payload)
   }
 }
 
+void ProtocolV2::prepare_ktls()
+{
+  ktls.pending = ktls.offered && auth_meta->is_mode_secure() &&
+    HAVE_MSGR2_FEATURE(peer_supported_features, KTLS);
+  if (ktls.pending) {
+    // both sides switch right after the peer's auth signature, the bytes
+    // behind it must stay in the socket for the kernel to decrypt
+    connection->recv_prefetch = false;
+  }
+}
+
+bool ProtocolV2::install_ktls()
+{
+  ktls.pending = false;
+  connection->recv_prefetch = true;
+  // our signature went out before we started reading the peer's one
+  if (connection->recv_end != connection->recv_start ||
+      connection->outgoing_bl.length()) {
+    lderr(cct) << __func__ << " not at a frame boundary" << dendl;
+    return false;
+  }
+
+  auto keys = ceph::crypto::onwire::ktls_keys_t::create(
+    *auth_meta, /*crossed=*/state == AUTH_ACCEPTING_SIGN);
+  int r = connection->cs.set_ktls_key(true, keys.tx.key.data(),
+				      keys.tx.iv.data());
+  if (r == 0) {
+    r = connection->cs.set_ktls_key(false, keys.rx.key.data(),
+				    keys.rx.iv.data());
+  }
+  ::TOPNSPC::crypto::zeroize_for_security(&keys, sizeof(keys));
+  if (r < 0) {
+    // the peer has switched already, this connection can only start over
+    auto backoff = cct->_conf.get_val<std::chrono::seconds>("ms_ktls_backoff");
+    lderr(cct) << __func__ << " kernel TLS refused the keys: "
+	       << cpp_strerror(r) << ", not offering it for " << backoff
+	       << dendl;
+    ktls_refused_until = ceph::mono_clock::now() + backoff;
+    return false;
+  }
+
+  session_stream_handlers.rx.reset(nullptr);
+  session_stream_handlers.tx.reset(nullptr);
+  ktls.active = true;
+  ldout(cct, 10) << __func__ << " frames are protected by kernel TLS" << dendl;
+  return true;
+}
+
 CtPtr ProtocolV2::handle_client_ident(ceph::bufferlist &payload)
 {
   ldout(cct, 20) << __func__
@@ -2822,7 +2940,8 @@ CtPtr ProtocolV2::reuse_connection(const AsyncConnectionRef& existing,
         tx_is_rev1=tx_frame_asm.get_is_rev1(),
         rx_is_rev1=rx_frame_asm.get_is_rev1(),
         temp_stream_handlers=std::move(temp_stream_handlers),
-        temp_compression_handlers=std::move(temp_compression_handlers)
+        temp_compression_handlers=std::move(temp_compression_handlers),
+        temp_ktls=ktls
       ](ConnectedSocket &cs) mutable {
         // we need to delete time event in original thread
         {
@@ -2838,6 +2957,8 @@ CtPtr ProtocolV2::reuse_connection(const AsyncConnectionRef& existing,
           existing->open_write = false;
           exproto->session_stream_handlers = std::move(temp_stream_handlers);
           exproto->session_compression_handlers = std::move(temp_compression_handlers);
+          // kernel TLS state lives in the socket handed over with cs
+          exproto->ktls = temp_ktls;
           if (!reconnecting) {
             exproto->tx_frame_asm.set_is_rev1(tx_is_rev1);
             exproto->rx_frame_asm.set_is_rev1(rx_is_rev1);
@@ -2846,6 +2967,8 @@ CtPtr ProtocolV2::reuse_connection(const AsyncConnectionRef& existing,
           if (exproto->state == NONE) {
             existing->shutdown_socket();
             existing->cs = std::move(cs);
+            // send_message() reads them under write_lock only
+            std::lock_guard<std::mutex> wl(existing->write_lock);
             existing->worker->references--;
             new_worker->references++;
             existing->logger = new_worker->get_perf_counter();
@@ -3068,7 +3191,7 @@ CtPtr ProtocolV2::finish_compression() {
   // allow reusing finish_compression().
   
   session_compression_handlers = ceph::compression::onwire::rxtx_t::create_handler_pair(
-    cct, comp_meta, messenger->comp_registry.get_min_compression_size(connection->get_peer_type()));
+    cct, comp_meta, messenger->comp_registry.get_tx_policy(connection->get_peer_type()));
 
   state = SESSION_ACCEPTING;
   return CONTINUE(read_frame);
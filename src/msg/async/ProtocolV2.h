@@ -125,9 +125,25 @@ private:
     bool enabled {true};
   } pre_auth;
 
+  // kernel TLS takes the secure mode record layer over from the stream
+  // handlers once both auth signatures are through
+  struct {
+    bool offered {false};  // our socket accepts kernel TLS
+    bool pending {false};  // negotiated, keys not installed yet
+    bool active {false};
+  } ktls;
+
   bool keepalive;
   bool write_in_progress = false;
 
+  // frames appended by write_event() that are not handed to the socket yet
+  struct {
+    unsigned frames {0};
+    ceph::mono_time start;
+  } tx_batch;
+  uint64_t tx_batch_bytes;
+  ceph::timespan tx_batch_time;
+
   CompConnectionMeta comp_meta;
   std::ostream& _conn_prefix(std::ostream *_dout);
   void run_continuation(Ct<ProtocolV2> *pcontinuation);
@@ -157,6 +173,13 @@ private:
   void prepare_send_message(uint64_t features, Message *m);
   out_queue_entry_t _get_next_outgoing();
   ssize_t write_message(Message *m, bool more);
+  void note_tx_frame() {
+    if (tx_batch.frames++ == 0) {
+      tx_batch.start = ceph::mono_clock::now();
+    }
+  }
+  bool tx_batch_open() const;
+  ssize_t flush_frames(bool more = false);
   void handle_message_ack(uint64_t seq);
   void reset_compression();
 
@@ -223,6 +246,7 @@ public:
   virtual void read_event() override;
   virtual void write_event() override;
   virtual bool is_queued() override;
+  virtual bool can_migrate() override;
 
   virtual void dump(Formatter *f) override;
 
@@ -242,6 +266,8 @@ private:
   Ct<ProtocolV2> *handle_auth_reply_more(ceph::bufferlist &payload);
   Ct<ProtocolV2> *handle_auth_done(ceph::bufferlist &payload);
   Ct<ProtocolV2> *handle_auth_signature(ceph::bufferlist &payload);
+  void prepare_ktls();
+  bool install_ktls();
   Ct<ProtocolV2> *start_session_connect();
   Ct<ProtocolV2> *send_client_ident();
   Ct<ProtocolV2> *send_reconnect();
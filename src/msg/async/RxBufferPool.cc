@@ -0,0 +1,146 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#include <sys/mman.h>
+
+#include "RxBufferPool.h"
+#include "Stack.h"
+#include "include/buffer_raw.h"
+#include "include/compat.h"
+#include "include/page.h"
+
+class RxBufferPool::raw_pooled : public ceph::buffer::raw {
+  std::shared_ptr<RxBufferPool> pool;
+  unsigned cls;
+public:
+  raw_pooled(char *p, unsigned cls, std::shared_ptr<RxBufferPool> pool)
+    : raw(p, RxBufferPool::class_size(cls)), pool(std::move(pool)), cls(cls) {}
+  ~raw_pooled() override {
+    pool->put(cls, data);
+  }
+};
+
+RxBufferPool::~RxBufferPool()
+{
+  for (unsigned cls = 0; cls < NUM_CLASSES; cls++) {
+    for (char *p : classes[cls].free) {
+      free_chunk(cls, p);
+    }
+  }
+}
+
+unsigned RxBufferPool::class_align(unsigned cls) const
+{
+  if (is_huge(cls)) {
+    return HUGE_PAGE_SIZE;
+  }
+  // the largest power of two dividing the class size
+  const size_t size = class_size(cls);
+  return std::min<size_t>(size & -size, CEPH_PAGE_SIZE);
+}
+
+char *RxBufferPool::alloc_chunk(unsigned cls)
+{
+  const size_t size = class_size(cls);
+  if (is_huge(cls)) {
+    // over-map by a huge page and trim, so that the chunk can be backed
+    // by huge pages from its first byte
+    char *m = (char *)::mmap(nullptr, size + HUGE_PAGE_SIZE,
+			     PROT_READ | PROT_WRITE,
+			     MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (m == MAP_FAILED) {
+      return nullptr;
+    }
+    char *p = (char *)p2roundup((uintptr_t)m, (uintptr_t)HUGE_PAGE_SIZE);
+    if (p > m) {
+      ::munmap(m, p - m);
+    }
+    if (m + HUGE_PAGE_SIZE > p) {
+      ::munmap(p + size, m + HUGE_PAGE_SIZE - p);
+    }
+#ifdef MADV_HUGEPAGE
+    ::madvise(p, size, MADV_HUGEPAGE);
+#endif
+    return p;
+  }
+  void *p = nullptr;
+  if (::posix_memalign(&p, std::max<size_t>(class_align(cls), sizeof(void *)),
+		       size)) {
+    return nullptr;
+  }
+  return (char *)p;
+}
+
+void RxBufferPool::free_chunk(unsigned cls, char *p)
+{
+  if (is_huge(cls)) {
+    ::munmap(p, class_size(cls));
+  } else {
+    aligned_free(p);
+  }
+}
+
+void RxBufferPool::put(unsigned cls, char *p)
+{
+  const size_t size = class_size(cls);
+  // reserve the bytes before caching the chunk: the class locks do not
+  // serialize puts to different classes
+  size_t cached = cached_bytes.load(std::memory_order_relaxed);
+  do {
+    if (cached + size > max_bytes) {
+      free_chunk(cls, p);
+      return;
+    }
+  } while (!cached_bytes.compare_exchange_weak(cached, cached + size));
+  std::lock_guard l{classes[cls].lock};
+  classes[cls].free.push_back(p);
+}
+
+ceph::unique_leakable_ptr<ceph::buffer::raw>
+RxBufferPool::get(unsigned len, unsigned align, PerfCounters *logger)
+{
+  if (len == 0 || len > class_size(NUM_CLASSES - 1)) {
+    logger->inc(l_msgr_rx_pool_miss);
+    return nullptr;
+  }
+  const unsigned cls = size_to_class(len);
+  if (align > class_align(cls)) {
+    logger->inc(l_msgr_rx_pool_miss);
+    return nullptr;
+  }
+
+  char *p = nullptr;
+  {
+    std::lock_guard l{classes[cls].lock};
+    if (!classes[cls].free.empty()) {
+      p = classes[cls].free.back();
+      classes[cls].free.pop_back();
+      cached_bytes -= class_size(cls);
+    }
+  }
+  if (p) {
+    logger->inc(l_msgr_rx_pool_hit);
+  } else {
+    p = alloc_chunk(cls);
+    if (!p) {
+      logger->inc(l_msgr_rx_pool_miss);
+      return nullptr;
+    }
+    logger->inc(l_msgr_rx_pool_miss);
+    if (is_huge(cls)) {
+      logger->inc(l_msgr_rx_pool_hugepage_allocs);
+    }
+  }
+  logger->set(l_msgr_rx_pool_cached_bytes, cached_bytes);
+  return ceph::unique_leakable_ptr<ceph::buffer::raw>(
+    new raw_pooled(p, cls, shared_from_this()));
+}
@@ -0,0 +1,110 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#ifndef CEPH_MSG_ASYNC_RXBUFFERPOOL_H
+#define CEPH_MSG_ASYNC_RXBUFFERPOOL_H
+
+#include <array>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "include/buffer.h"
+#include "include/common_fwd.h"
+#include "include/intarith.h"
+
+/*
+ * RxBufferPool recycles the buffers frame segments are received into.
+ *
+ * Every worker owns one.  Segments are served from size classes spaced a
+ * quarter of a power of two apart, so that rounding a segment up wastes
+ * less than 25% of its buffer, and a buffer goes back to the free list of
+ * its class when the last reference to it is dropped, on whichever thread
+ * that happens.
+ * Classes of ms_rx_buffer_pool_hugepage_min bytes and more are mapped 2MB
+ * aligned and advised to be backed by transparent huge pages.  The free
+ * lists hold at most ms_rx_buffer_pool_size bytes in total, buffers put
+ * back beyond that are released.
+ */
+class RxBufferPool : public std::enable_shared_from_this<RxBufferPool> {
+public:
+  static constexpr unsigned MIN_SHIFT = 9;	// 512 bytes
+  static constexpr unsigned MAX_SHIFT = 22;	// 4 MB
+  static constexpr unsigned CLASS_STEPS = 4;	// classes per power of two
+  static constexpr unsigned NUM_CLASSES =
+    (MAX_SHIFT - MIN_SHIFT) * CLASS_STEPS + 1;
+  static constexpr size_t HUGE_PAGE_SIZE = 2 << 20;
+
+private:
+  class raw_pooled;
+
+  struct size_class_t {
+    std::mutex lock;
+    std::vector<char*> free;
+  };
+  std::array<size_class_t, NUM_CLASSES> classes;
+
+  const size_t max_bytes;
+  const size_t hugepage_min;
+  std::atomic<size_t> cached_bytes{0};
+
+  static size_t class_size(unsigned cls) {
+    const unsigned shift = MIN_SHIFT + cls / CLASS_STEPS;
+    return size_t(CLASS_STEPS + cls % CLASS_STEPS) << (shift - 2);
+  }
+  static unsigned size_to_class(unsigned len) {
+    if (len <= class_size(0)) {
+      return 0;
+    }
+    // 2^shift <= len - 1 < 2^(shift + 1), and the class above len - 1 is
+    // the next quarter step of 2^shift
+    const unsigned shift = cbits(len - 1) - 1;
+    const unsigned step = (len - 1) >> (shift - 2);
+    return (shift - MIN_SHIFT) * CLASS_STEPS + step - (CLASS_STEPS - 1);
+  }
+  bool is_huge(unsigned cls) const {
+    return hugepage_min && class_size(cls) >= hugepage_min &&
+      class_size(cls) >= HUGE_PAGE_SIZE;
+  }
+  unsigned class_align(unsigned cls) const;
+  char *alloc_chunk(unsigned cls);
+  void free_chunk(unsigned cls, char *p);
+  void put(unsigned cls, char *p);
+
+public:
+  RxBufferPool(size_t max_bytes, size_t hugepage_min)
+    : max_bytes(max_bytes), hugepage_min(hugepage_min) {}
+  ~RxBufferPool();
+
+  RxBufferPool(const RxBufferPool&) = delete;
+  RxBufferPool& operator=(const RxBufferPool&) = delete;
+
+  /**
+   * get a buffer for a received segment
+   *
+   * @param len length of the segment
+   * @param align required alignment
+   * @param logger worker perf counters to account the hit or miss in
+   * @return a buffer of at least len bytes, or nullptr if the segment is
+   *         too large or too strictly aligned to be pooled
+   */
+  ceph::unique_leakable_ptr<ceph::buffer::raw> get(unsigned len,
+						   unsigned align,
+						   PerfCounters *logger);
+
+  size_t get_cached_bytes() const {
+    return cached_bytes;
+  }
+};
+
+#endif
@@ -25,6 +25,9 @@
 #ifdef HAVE_DPDK
 #include "dpdk/DPDKStack.h"
 #endif
+#ifdef HAVE_LIBURING
+#include "uring/UringStack.h"
+#endif
 
 #include "common/dout.h"
 #include "include/ceph_assert.h"
@@ -33,15 +36,22 @@
 #undef dout_prefix
 #define dout_prefix *_dout << "stack "
 
+// period over which the busy time of a worker is sampled for its load
+static constexpr auto WorkerLoadInterval = std::chrono::seconds(1);
+
 std::function<void ()> NetworkStack::add_thread(Worker* w)
 {
   return [this, w]() {
       rename_thread(w->id);
-      const unsigned EventMaxWaitUs = 30000000;
+      // wake up idle workers once per sample so that their load decays
+      const unsigned EventMaxWaitUs = placement_by_load ?
+        std::chrono::microseconds(WorkerLoadInterval).count() : 30000000;
       w->center.set_owner();
       ldout(cct, 10) << __func__ << " starting" << dendl;
       w->initialize();
       w->init_done();
+      ceph::timespan busy = ceph::timespan::zero();
+      auto load_stamp = ceph::mono_clock::now();
       while (!w->done) {
         ldout(cct, 30) << __func__ << " calling event process" << dendl;
 
@@ -53,6 +63,15 @@ std::function<void ()> NetworkStack::add_thread(Worker* w)
           // TODO do something?
         }
         w->perf_logger->tinc(l_msgr_running_total_time, dur);
+
+        busy += dur;
+        auto now = ceph::mono_clock::now();
+        if (now - load_stamp >= WorkerLoadInterval) {
+          w->update_load(busy, now - load_stamp);
+          ldout(cct, 30) << __func__ << " load " << w->load.load() << dendl;
+          busy = ceph::timespan::zero();
+          load_stamp = now;
+        }
       }
       w->reset();
       w->destroy();
@@ -74,6 +93,10 @@ std::shared_ptr<NetworkStack> NetworkStack::create(CephContext *c,
   else if (t == "dpdk")
     stack.reset(new DPDKStack(c));
 #endif
+#ifdef HAVE_LIBURING
+  else if (t == "uring")
+    stack.reset(new UringNetworkStack(c));
+#endif
 
   if (stack == nullptr) {
     lderr(c) << __func__ << " ms_async_transport_type " << t <<
@@ -104,7 +127,9 @@ std::shared_ptr<NetworkStack> NetworkStack::create(CephContext *c,
 }
 
 NetworkStack::NetworkStack(CephContext *c)
-  : cct(c)
+  : placement_by_load(
+      c->_conf.get_val<std::string>("ms_async_worker_placement") == "load"),
+    cct(c)
 {}
 
 void NetworkStack::start()
@@ -134,16 +159,23 @@ Worker* NetworkStack::get_worker()
 
    // start with some reasonably large number
   unsigned min_load = std::numeric_limits<int>::max();
+  unsigned min_busy = std::numeric_limits<int>::max();
   Worker* current_best = nullptr;
 
   pool_spin.lock();
   // find worker with least references
   // tempting case is returning on references == 0, but in reality
   // this will happen so rarely that there's no need for special case.
+  // With placement by load the least busy workers come first, compared
+  // in steps of 10% so that the references still spread a burst of new
+  // connections between the workers of similar load.
   for (Worker* worker : workers) {
+    unsigned worker_busy = placement_by_load ? worker->load / 100 : 0;
     unsigned worker_load = worker->references.load();
-    if (worker_load < min_load) {
+    if (worker_busy < min_busy ||
+        (worker_busy == min_busy && worker_load < min_load)) {
       current_best = worker;
+      min_busy = worker_busy;
       min_load = worker_load;
     }
   }
@@ -154,6 +186,39 @@ Worker* NetworkStack::get_worker()
   return current_best;
 }
 
+Worker* NetworkStack::get_migration_target(Worker *from)
+{
+  // minimum load difference, in 1/1000, to move an idle connection
+  unsigned migrate_load_gap =
+    cct->_conf.get_val<uint64_t>("ms_async_migrate_load_gap") * 10;
+  if (!migrate_load_gap || !support_connection_migration()) {
+    return nullptr;
+  }
+  // move a single connection per sample, the loads have to catch up
+  // before the next one is worth moving
+  auto now = ceph::mono_clock::now();
+  if (now - from->last_migration < WorkerLoadInterval) {
+    return nullptr;
+  }
+
+  Worker* target = nullptr;
+  unsigned from_load = from->load;
+  pool_spin.lock();
+  for (Worker* worker : workers) {
+    unsigned worker_load = worker->load;
+    if (worker != from && worker_load + migrate_load_gap <= from_load) {
+      target = worker;
+      from_load = worker_load + migrate_load_gap;
+    }
+  }
+  pool_spin.unlock();
+  if (target) {
+    from->last_migration = now;
+    ++target->references;
+  }
+  return target;
+}
+
 void NetworkStack::stop()
 {
   std::lock_guard lk(pool_spin);
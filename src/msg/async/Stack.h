@@ -21,6 +21,7 @@
 #include "common/perf_counters_key.h"
 #include "include/spinlock.h"
 #include "msg/async/Event.h"
+#include "msg/async/RxBufferPool.h"
 #include "msg/msg_types.h"
 
 #ifdef WITH_CRIMSON
@@ -46,6 +47,17 @@ class ConnectedSocketImpl {
   virtual void close() = 0;
   virtual int fd() const = 0;
   virtual void set_priority(int sd, int prio, int domain) = 0;
+  /// release send buffers the stack no longer needs, see send()
+  virtual void reap_completions() {}
+  /// prepare the socket for kernel TLS, see set_ktls_key()
+  virtual int enable_ktls() {
+    return -EOPNOTSUPP;
+  }
+  /// from here on, data of one direction goes through kernel TLS records
+  virtual int set_ktls_key(bool tx, const unsigned char *key,
+			   const unsigned char *iv) {
+    return -EOPNOTSUPP;
+  }
 };
 
 class ConnectedSocket;
@@ -141,6 +153,27 @@ class ConnectedSocket {
     _csi->set_priority(sd, prio, domain);
   }
 
+  /// Handles send completions reported through socket readiness.
+  ///
+  /// A stack may keep references to sent buffers until the transmission
+  /// completes (e.g. MSG_ZEROCOPY); this releases the completed ones.
+  void reap_completions() {
+    _csi->reap_completions();
+  }
+
+  /// Attaches kernel TLS to the socket.
+  ///
+  /// Until keys are installed with set_ktls_key() the socket carries
+  /// plain data. Returns -EOPNOTSUPP if the stack or kernel lacks support.
+  int enable_ktls() {
+    return _csi->enable_ktls();
+  }
+
+  /// Installs the AES-128-GCM key and iv of the tx or rx direction.
+  int set_ktls_key(bool tx, const unsigned char *key, const unsigned char *iv) {
+    return _csi->set_ktls_key(tx, key, iv);
+  }
+
   explicit operator bool() const {
     return _csi.get();
   }
@@ -224,6 +257,13 @@ enum {
   l_msgr_recv_encrypted_bytes,
   l_msgr_send_encrypted_bytes,
 
+  l_msgr_send_frames_per_write,
+
+  l_msgr_rx_pool_hit,
+  l_msgr_rx_pool_miss,
+  l_msgr_rx_pool_cached_bytes,
+  l_msgr_rx_pool_hugepage_allocs,
+
   l_msgr_last,
 };
 
@@ -250,6 +290,13 @@ class Worker {
   unsigned id;
 
   std::atomic_uint references;
+  /// share of the recent wall time the thread spent handling events, in
+  /// 1/1000, see NetworkStack::add_thread()
+  std::atomic_uint load{0};
+  /// when a connection was last moved off this worker, owner thread only
+  ceph::mono_time last_migration;
+  /// buffers for received frame segments, null if disabled
+  std::shared_ptr<RxBufferPool> rx_buffer_pool;
   EventCenter center;
 
   Worker(const Worker&) = delete;
@@ -263,6 +310,9 @@ class Worker {
 
     // initialize perf_logger
     PerfCountersBuilder plb(cct, name, l_msgr_first, l_msgr_last);
+    // messages are queued from the threads sending them, while the worker
+    // updates the byte counters of all of its connections
+    plb.set_sharded(cct->_conf.get_val<bool>("perf_counters_sharded"));
 
     plb.add_u64_counter(l_msgr_recv_messages, "msgr_recv_messages", "Network received messages");
     plb.add_u64_counter(l_msgr_send_messages, "msgr_send_messages", "Network sent messages");
@@ -282,6 +332,13 @@ class Worker {
     plb.add_u64_counter(l_msgr_recv_encrypted_bytes, "msgr_recv_encrypted_bytes", "Network received encrypted bytes", NULL, 0, unit_t(UNIT_BYTES));
     plb.add_u64_counter(l_msgr_send_encrypted_bytes, "msgr_send_encrypted_bytes", "Network sent encrypted bytes", NULL, 0, unit_t(UNIT_BYTES));
 
+    plb.add_u64_avg(l_msgr_send_frames_per_write, "msgr_send_frames_per_write", "Frames coalesced into one socket write");
+
+    plb.add_u64_counter(l_msgr_rx_pool_hit, "msgr_rx_pool_hit", "Received segments served from the buffer pool");
+    plb.add_u64_counter(l_msgr_rx_pool_miss, "msgr_rx_pool_miss", "Received segments that needed a new buffer");
+    plb.add_u64(l_msgr_rx_pool_cached_bytes, "msgr_rx_pool_cached_bytes", "Free bytes held by the receive buffer pool", NULL, 0, unit_t(UNIT_BYTES));
+    plb.add_u64_counter(l_msgr_rx_pool_hugepage_allocs, "msgr_rx_pool_hugepage_allocs", "Receive buffers mapped for huge pages");
+
     perf_logger = plb.create_perf_counters();
     cct->get_perfcounters_collection()->add(perf_logger);
 
@@ -303,6 +360,14 @@ class Worker {
 
     perf_labeled_logger = plb_labeled.create_perf_counters();
     cct->get_perfcounters_collection()->add(perf_labeled_logger);
+
+    uint64_t pool_size =
+      cct->_conf.get_val<Option::size_t>("ms_rx_buffer_pool_size");
+    if (pool_size) {
+      rx_buffer_pool = std::make_shared<RxBufferPool>(
+	pool_size,
+	cct->_conf.get_val<Option::size_t>("ms_rx_buffer_pool_hugepage_min"));
+    }
   }
   virtual ~Worker() {
     if (perf_logger) {
@@ -328,6 +393,10 @@ class Worker {
     int oldref = references.fetch_sub(1);
     ceph_assert(oldref > 0);
   }
+  void update_load(ceph::timespan busy, ceph::timespan elapsed) {
+    unsigned sample = std::min<uint64_t>(1000, busy * 1000 / elapsed);
+    load = (load * 3 + sample) / 4;
+  }
   void init_done() {
     init_lock.lock();
     init = true;
@@ -356,6 +425,10 @@ class NetworkStack {
   ceph::spinlock pool_spin;
   bool started = false;
 
+  // place new connections by the measured load of the workers rather than
+  // by their connection count alone
+  bool placement_by_load;
+
   std::function<void ()> add_thread(Worker* w);
 
   virtual Worker* create_worker(CephContext *c, unsigned i) = 0;
@@ -390,6 +463,9 @@ class NetworkStack {
   // need to let each thread do binding port.
   virtual bool support_local_listen_table() const { return false; }
   virtual bool nonblock_connect_need_writable_event() const { return true; }
+  // whether a connected socket can be served by another worker's event
+  // center, which is only true if the socket is just a kernel fd
+  virtual bool support_connection_migration() const { return false; }
 
   void start();
   void stop();
@@ -397,6 +473,9 @@ class NetworkStack {
   Worker *get_worker(unsigned worker_id) {
     return workers[worker_id];
   }
+  /// a worker that is sufficiently less loaded than @p from to take one of
+  /// its idle connections over, with a reference taken, or nullptr
+  Worker *get_migration_target(Worker *from);
   void drain();
   unsigned get_num_worker() const {
     return workers.size();
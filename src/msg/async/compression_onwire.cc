@@ -12,7 +12,7 @@ namespace ceph::compression::onwire {
 rxtx_t rxtx_t::create_handler_pair(
     CephContext* ctx,
     const CompConnectionMeta& comp_meta,
-    std::uint64_t compress_min_size)
+    TxPolicy tx_policy)
 {
   if (comp_meta.is_compress()) {
      CompressorRef compressor = Compressor::create(ctx, comp_meta.get_method());
@@ -20,12 +20,31 @@ rxtx_t rxtx_t::create_handler_pair(
       return {std::make_unique<RxHandler>(ctx, compressor),
 	      std::make_unique<TxHandler>(ctx, compressor,
 					  comp_meta.get_mode(),
-					  compress_min_size)};
+					  std::move(tx_policy))};
     }
   }
   return {};
 }
 
+void TxHandler::reset_handler(int num_segments, uint64_t size,
+			      std::uint16_t msg_type)
+{
+  m_init_onwire_size = size;
+  m_compress_potential = size;
+  m_onwire_size = 0;
+  m_msg_type = msg_type;
+  m_min_size = m_policy.get_min_size(msg_type);
+  if (size < m_min_size || !m_policy.min_ratio) {
+    return;
+  }
+  // a frame that would be compressed but its type compresses poorly
+  if (auto p = m_type_stats.find(msg_type);
+      p != m_type_stats.end() && p->second.skip > 0) {
+    p->second.skip--;
+    m_min_size = TxPolicy::NEVER;
+  }
+}
+
 std::optional<ceph::bufferlist> TxHandler::compress(const ceph::bufferlist &input)
 {
   if (m_init_onwire_size < m_min_size) {
@@ -81,6 +100,20 @@ std::optional<ceph::bufferlist> RxHandler::decompress(const ceph::bufferlist &in
 void TxHandler::done()
 {
   ldout(m_cct, 25) << __func__ << " compression ratio=" << get_ratio() << dendl;
+  if (!m_policy.min_ratio || !get_final_size()) {
+    return;
+  }
+  auto& stats = m_type_stats[m_msg_type];
+  stats.ratio = stats.ratio ? (stats.ratio * 7 + get_ratio()) / 8 : get_ratio();
+  if (stats.ratio < m_policy.min_ratio) {
+    ldout(m_cct, 10) << __func__ << " message type " << m_msg_type
+		     << " compresses with ratio " << stats.ratio
+		     << ", sending the next " << m_policy.backoff_frames
+		     << " uncompressed" << dendl;
+    // start over with the frame probed after the back off
+    stats.ratio = 0;
+    stats.skip = m_policy.backoff_frames;
+  }
 }
 
 std::string_view RxHandler::compressor_name() const {
@@ -5,6 +5,8 @@
 #define CEPH_COMPRESSION_ONWIRE_H
 
 #include <cstdint>
+#include <limits>
+#include <map>
 #include <optional>
 
 #include "compressor/Compressor.h"
@@ -16,6 +18,33 @@ namespace ceph::compression::onwire {
   using Compressor = TOPNSPC::Compressor;
   using CompressorRef = TOPNSPC::CompressorRef;
 
+  /**
+   * What the sending side of a session compresses
+   *
+   * A copy is taken from the CompressorRegistry when compression is
+   * negotiated, so that deciding upon a frame does not take any lock.
+   */
+  struct TxPolicy {
+    static constexpr std::uint64_t NEVER =
+      std::numeric_limits<std::uint64_t>::max();
+
+    /// frames smaller than this are sent uncompressed
+    std::uint64_t min_size = 0;
+    /// message types with their own min_size, NEVER to not compress them
+    std::map<std::uint16_t, std::uint64_t> type_min_size;
+    /// a message type compressing worse than this on average is sent
+    /// uncompressed for the next backoff_frames frames of that type
+    double min_ratio = 0;
+    unsigned backoff_frames = 0;
+
+    std::uint64_t get_min_size(std::uint16_t msg_type) const {
+      if (auto p = type_min_size.find(msg_type); p != type_min_size.end()) {
+	return p->second;
+      }
+      return min_size;
+    }
+  };
+
   class Handler {
   public:
     Handler(CephContext* const cct, CompressorRef compressor)
@@ -47,18 +76,23 @@ namespace ceph::compression::onwire {
 
   class TxHandler final : private Handler {
   public:
-    TxHandler(CephContext* const cct, CompressorRef compressor, int mode, std::uint64_t min_size)
+    TxHandler(CephContext* const cct, CompressorRef compressor, int mode,
+	      TxPolicy policy)
       : Handler(cct, compressor),
-	m_min_size(min_size),
+	m_policy(std::move(policy)),
 	m_mode(static_cast<Compressor::CompressionMode>(mode))
     {}
     ~TxHandler() {}
 
-    void reset_handler(int num_segments, uint64_t size) {
-      m_init_onwire_size = size;
-      m_compress_potential = size;
-      m_onwire_size = 0;
-    }
+    /**
+     * Prepares for compressing the segments of a frame
+     *
+     * @param num_segments number of segments in the frame
+     * @param size logical length of the frame
+     * @param msg_type type of the message carried, 0 for control frames
+     */
+    void reset_handler(int num_segments, uint64_t size,
+		       std::uint16_t msg_type = 0);
 
     void done();
 
@@ -87,8 +121,17 @@ namespace ceph::compression::onwire {
     std::string_view compressor_name() const;
 
   private:
-    uint64_t m_min_size; 
+    struct type_stats_t {
+      double ratio = 0;		///< moving average, 0 when not sampled yet
+      unsigned skip = 0;	///< frames left to send uncompressed
+    };
+
+    const TxPolicy m_policy;
     Compressor::CompressionMode m_mode;
+    std::map<std::uint16_t, type_stats_t> m_type_stats;
+
+    std::uint16_t m_msg_type = 0;
+    uint64_t m_min_size = 0;
 
     uint64_t m_init_onwire_size;
     uint64_t m_onwire_size;
@@ -102,7 +145,7 @@ namespace ceph::compression::onwire {
     static rxtx_t create_handler_pair(
       CephContext* ctx,
       const CompConnectionMeta& comp_meta,
-      std::uint64_t compress_min_size);
+      TxPolicy tx_policy);
   };
 }
 
@@ -5,10 +5,12 @@
 #include "common/debug.h"
 #include "common/ceph_crypto.h"
 #include "include/buffer.h"
+#include "include/intarith.h"
 #include "include/types.h"
 
 #include <openssl/evp.h>
 
+#include <algorithm>
 #include <array>
 #include <numeric> // for std::accumulate()
 
@@ -20,6 +22,9 @@ static constexpr const std::size_t AESGCM_KEY_LEN{16};
 static constexpr const std::size_t AESGCM_IV_LEN{12};
 static constexpr const std::size_t AESGCM_TAG_LEN{16};
 static constexpr const std::size_t AESGCM_BLOCK_LEN{16};
+// plaintext buffers shorter than this are gathered before encrypting
+static constexpr const std::size_t AESGCM_GATHER_LEN{1024};
+static constexpr const std::size_t AESGCM_TX_CHUNK_LEN{64 << 10};
 
 struct nonce_t {
   ceph_le32 fixed;
@@ -40,12 +45,21 @@ using key_t = std::array<std::uint8_t, AESGCM_KEY_LEN>;
 class AES128GCM_OnWireTxHandler : public ceph::crypto::onwire::TxHandler {
   CephContext* const cct;
   std::unique_ptr<EVP_CIPHER_CTX, decltype(&::EVP_CIPHER_CTX_free)> ectx;
-  ceph::bufferlist buffer;
+  // frames are carved out of a preallocated chunk, so a run of small
+  // messages doesn't pay for an allocation each
+  ceph::bufferptr chunk;
+  unsigned chunk_off = 0;
+  ceph::bufferptr out;            // the frame being encrypted
+  unsigned out_len = 0;           // ciphertext bytes in out
+  unsigned pending = 0;           // plaintext gathered after them
   nonce_t nonce, initial_nonce;
   bool used_initial_nonce;
   bool new_nonce_format;  // 64-bit counter?
   static_assert(sizeof(nonce) == AESGCM_IV_LEN);
 
+  void encrypt(unsigned char* dst, const unsigned char* src, unsigned len);
+  void encrypt_pending();
+
 public:
   AES128GCM_OnWireTxHandler(CephContext* const cct,
 			    const key_t& key,
@@ -94,13 +108,28 @@ void AES128GCM_OnWireTxHandler::reset_tx_handler(const uint32_t* first,
     used_initial_nonce = true;
   }
 
+  // only the IV changes, the key schedule set up by the constructor
+  // stays in the context
   if(1 != EVP_EncryptInit_ex(ectx.get(), nullptr, nullptr, nullptr,
       reinterpret_cast<const unsigned char*>(&nonce))) {
     throw std::runtime_error("EVP_EncryptInit_ex failed");
   }
 
-  ceph_assert(buffer.get_append_buffer_unused_tail_length() == 0);
-  buffer.reserve(std::accumulate(first, last, AESGCM_TAG_LEN));
+  const unsigned need = std::accumulate(first, last, AESGCM_TAG_LEN);
+  if (need > AESGCM_TX_CHUNK_LEN / 4) {
+    out = ceph::buffer::create(need);
+  } else {
+    if (!chunk.have_raw() || chunk.length() - chunk_off < need) {
+      chunk = ceph::buffer::create(AESGCM_TX_CHUNK_LEN);
+      chunk_off = 0;
+    }
+    out = ceph::bufferptr(chunk, chunk_off, need);
+    // keep the frames block aligned
+    chunk_off = std::min<unsigned>(
+      p2roundup<unsigned>(chunk_off + need, AESGCM_BLOCK_LEN), chunk.length());
+  }
+  out_len = 0;
+  pending = 0;
 
   if (!new_nonce_format) {
     // msgr2.0: 32-bit counter followed by 64-bit fixed field,
@@ -111,42 +140,67 @@ void AES128GCM_OnWireTxHandler::reset_tx_handler(const uint32_t* first,
   }
 }
 
+void AES128GCM_OnWireTxHandler::encrypt(unsigned char* dst,
+					const unsigned char* src,
+					unsigned len)
+{
+  int update_len = 0;
+  if(1 != EVP_EncryptUpdate(ectx.get(), dst, &update_len, src, len)) {
+    throw std::runtime_error("EVP_EncryptUpdate failed");
+  }
+  ceph_assert_always(update_len >= 0);
+  ceph_assert(static_cast<unsigned>(update_len) == len);
+  out_len += len;
+}
+
+void AES128GCM_OnWireTxHandler::encrypt_pending()
+{
+  if (pending) {
+    auto p = reinterpret_cast<unsigned char*>(out.c_str()) + out_len;
+    unsigned len = pending;
+    pending = 0;
+    encrypt(p, p, len);
+  }
+}
+
 void AES128GCM_OnWireTxHandler::authenticated_encrypt_update(
   const ceph::bufferlist& plaintext)
 {
-  ceph_assert(buffer.get_append_buffer_unused_tail_length() >=
-              plaintext.length());
-  auto filler = buffer.append_hole(plaintext.length());
+  ceph_assert(out_len + pending + plaintext.length() + AESGCM_TAG_LEN <=
+	      out.length());
 
   for (const auto& plainbuf : plaintext.buffers()) {
-    int update_len = 0;
-
-    if(1 != EVP_EncryptUpdate(ectx.get(),
-	reinterpret_cast<unsigned char*>(filler.c_str()),
-	&update_len,
-	reinterpret_cast<const unsigned char*>(plainbuf.c_str()),
-	plainbuf.length())) {
-      throw std::runtime_error("EVP_EncryptUpdate failed");
+    if (plainbuf.length() < AESGCM_GATHER_LEN) {
+      // small buffers (headers, encoded fronts, the preamble and epilogue)
+      // are gathered in place and encrypted together: an EVP call per
+      // buffer costs more than the copy, and feeding GCM ragged lengths
+      // pushes it off its block-at-a-time path
+      memcpy(out.c_str() + out_len + pending, plainbuf.c_str(),
+	     plainbuf.length());
+      pending += plainbuf.length();
+    } else {
+      encrypt_pending();
+      encrypt(reinterpret_cast<unsigned char*>(out.c_str()) + out_len,
+	      reinterpret_cast<const unsigned char*>(plainbuf.c_str()),
+	      plainbuf.length());
     }
-    ceph_assert_always(update_len >= 0);
-    ceph_assert(static_cast<unsigned>(update_len) == plainbuf.length());
-    filler.advance(update_len);
   }
 
   ldout(cct, 15) << __func__
 		 << " plaintext.length()=" << plaintext.length()
-		 << " buffer.length()=" << buffer.length()
+		 << " out_len=" << out_len
+		 << " pending=" << pending
 		 << dendl;
 }
 
 ceph::bufferlist AES128GCM_OnWireTxHandler::authenticated_encrypt_final()
 {
+  encrypt_pending();
+  ceph_assert(out_len + AESGCM_BLOCK_LEN == out.length());
+  auto filler = out.c_str() + out_len;
   int final_len = 0;
-  ceph_assert(buffer.get_append_buffer_unused_tail_length() ==
-              AESGCM_BLOCK_LEN);
-  auto filler = buffer.append_hole(AESGCM_BLOCK_LEN);
   if(1 != EVP_EncryptFinal_ex(ectx.get(),
-	reinterpret_cast<unsigned char*>(filler.c_str()),
+	reinterpret_cast<unsigned char*>(filler),
 	&final_len)) {
     throw std::runtime_error("EVP_EncryptFinal_ex failed");
   }
@@ -155,15 +209,17 @@ ceph::bufferlist AES128GCM_OnWireTxHandler::authenticated_encrypt_final()
   static_assert(AESGCM_BLOCK_LEN == AESGCM_TAG_LEN);
   if(1 != EVP_CIPHER_CTX_ctrl(ectx.get(),
 	EVP_CTRL_GCM_GET_TAG, AESGCM_TAG_LEN,
-	filler.c_str())) {
+	filler)) {
     throw std::runtime_error("EVP_CIPHER_CTX_ctrl failed");
   }
 
   ldout(cct, 15) << __func__
-		 << " buffer.length()=" << buffer.length()
+		 << " out.length()=" << out.length()
 		 << " final_len=" << final_len
 		 << dendl;
-  return std::move(buffer);
+  ceph::bufferlist bl;
+  bl.push_back(std::move(out));
+  return bl;
 }
 
 // RX PART
@@ -316,4 +372,37 @@ ceph::crypto::onwire::rxtx_t ceph::crypto::onwire::rxtx_t::create_handler_pair(
   }
 }
 
+static void derive_ktls_key(const std::string& secret, const char* label,
+			    ktls_key_t* out)
+{
+  unsigned char digest[CEPH_CRYPTO_HMACSHA256_DIGESTSIZE];
+  static_assert(sizeof(out->key) + sizeof(out->iv) <= sizeof(digest));
+  ceph::crypto::HMACSHA256 hmac(
+    reinterpret_cast<const unsigned char*>(secret.data()), secret.size());
+  hmac.Update(reinterpret_cast<const unsigned char*>(label), strlen(label));
+  hmac.Final(digest);
+  ::memcpy(out->key.data(), digest, sizeof(out->key));
+  ::memcpy(out->iv.data(), digest + sizeof(out->key), sizeof(out->iv));
+  ::TOPNSPC::crypto::zeroize_for_security(digest, sizeof(digest));
+}
+
+ceph::crypto::onwire::ktls_keys_t ceph::crypto::onwire::ktls_keys_t::create(
+  const AuthConnectionMeta& auth_meta,
+  bool crossed)
+{
+  ceph_assert_always(auth_meta.is_mode_secure());
+  ceph_assert_always(auth_meta.connection_secret.length() >= \
+    sizeof(key_t) + 2 * sizeof(nonce_t));
+
+  // each direction is keyed after the side sending with it
+  ktls_keys_t keys;
+  derive_ktls_key(auth_meta.connection_secret,
+		  crossed ? "msgr2 ktls client" : "msgr2 ktls server",
+		  &keys.rx);
+  derive_ktls_key(auth_meta.connection_secret,
+		  crossed ? "msgr2 ktls server" : "msgr2 ktls client",
+		  &keys.tx);
+  return keys;
+}
+
 } // namespace ceph::crypto::onwire
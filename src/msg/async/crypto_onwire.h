@@ -16,6 +16,7 @@
 #ifndef CEPH_CRYPTO_ONWIRE_H
 #define CEPH_CRYPTO_ONWIRE_H
 
+#include <array>
 #include <cstdint>
 #include <memory>
 #include <stdexcept>
@@ -130,6 +131,24 @@ struct rxtx_t {
     bool crossed);
 };
 
+// Key material for handing the secure mode record layer over to kernel TLS
+// (TLS 1.3, AES-128-GCM). The keys are derived from the connection secret
+// apart from those of the rx/tx handlers, so the nonces the handlers used
+// before the switch never repeat under the same key.
+struct ktls_key_t {
+  std::array<std::uint8_t, 16> key;
+  std::array<std::uint8_t, 12> iv;  // 4 bytes of salt, then the 8 byte iv
+};
+
+struct ktls_keys_t {
+  ktls_key_t rx;
+  ktls_key_t tx;
+
+  static ktls_keys_t create(
+    const class AuthConnectionMeta& auth_meta,
+    bool crossed);
+};
+
 } // namespace ceph::crypto::onwire
 
 #endif // CEPH_CRYPTO_ONWIRE_H
@@ -241,7 +241,7 @@ bufferlist FrameAssembler::assemble_frame(Tag tag, bufferlist segment_bls[],
   }
 
   if (m_compression->tx) {   
-    asm_compress(segment_bls);
+    asm_compress(tag, segment_bls);
   }
 
   preamble_block_t preamble;
@@ -499,10 +499,20 @@ std::ostream& operator<<(std::ostream& os, const FrameAssembler& frame_asm) {
   return os;
 }
 
-void FrameAssembler::asm_compress(bufferlist segment_bls[]) {
+void FrameAssembler::asm_compress(Tag tag, bufferlist segment_bls[]) {
   std::array<bufferlist, MAX_NUM_SEGMENTS> compressed;
 
-  m_compression->tx->reset_handler(m_descs.size(), get_frame_logical_len());
+  // the compression policy depends on the type of the message carried
+  uint16_t msg_type = 0;
+  if (tag == Tag::MESSAGE &&
+      segment_bls[0].length() >= sizeof(ceph_msg_header2)) {
+    ceph_msg_header2 header2;
+    segment_bls[0].cbegin().copy(sizeof(header2),
+                                 reinterpret_cast<char*>(&header2));
+    msg_type = header2.type;
+  }
+  m_compression->tx->reset_handler(m_descs.size(), get_frame_logical_len(),
+                                   msg_type);
 
   bool abort = false;
   for (size_t i = 0; (i < m_descs.size()) && !abort; i++) {
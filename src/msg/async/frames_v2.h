@@ -342,7 +342,7 @@ private:
     return m_flags & FRAME_EARLY_DATA_COMPRESSED; 
   }
 
-  void asm_compress(bufferlist segment_bls[]);
+  void asm_compress(Tag tag, bufferlist segment_bls[]);
 
   bufferlist asm_crc_rev0(const preamble_block_t& preamble,
                           bufferlist segment_bls[]) const;
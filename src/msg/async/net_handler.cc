@@ -20,8 +20,21 @@
 #include <netinet/ip.h>
 #include <netinet/tcp.h>
 #include <arpa/inet.h>
+#if defined(__linux__) && __has_include(<linux/tls.h>)
+#include <linux/tls.h>
+#ifdef TLS_1_3_VERSION
+#define HAVE_KTLS
+#ifndef SOL_TLS
+#define SOL_TLS 282
+#endif
+#ifndef TCP_ULP
+#define TCP_ULP 31
+#endif
+#endif
+#endif
 
 #include "net_handler.h"
+#include "common/ceph_crypto.h"
 #include "common/debug.h"
 #include "common/errno.h"
 #include "include/compat.h"
@@ -126,6 +139,67 @@ int NetHandler::set_socket_options(int sd, bool nodelay, int size)
   return -r;
 }
 
+int NetHandler::set_zerocopy(int sd)
+{
+#ifdef SO_ZEROCOPY
+  int flag = 1;
+  int r = ::setsockopt(sd, SOL_SOCKET, SO_ZEROCOPY, (SOCKOPT_VAL_TYPE)&flag, sizeof(flag));
+  if (r < 0) {
+    r = ceph_sock_errno();
+    ldout(cct, 1) << "couldn't set SO_ZEROCOPY: " << cpp_strerror(r) << dendl;
+    return -r;
+  }
+  return 0;
+#else
+  return -EOPNOTSUPP;
+#endif
+}
+
+int NetHandler::enable_ktls(int sd)
+{
+#ifdef HAVE_KTLS
+  int r = ::setsockopt(sd, SOL_TCP, TCP_ULP, "tls", sizeof("tls"));
+  if (r < 0) {
+    r = ceph_sock_errno();
+    if (r == EEXIST) {
+      return 0;
+    }
+    ldout(cct, 1) << "couldn't attach kernel tls: " << cpp_strerror(r) << dendl;
+    return -r;
+  }
+  return 0;
+#else
+  return -EOPNOTSUPP;
+#endif
+}
+
+int NetHandler::set_ktls_key(int sd, bool tx, const unsigned char *key,
+			     const unsigned char *iv)
+{
+#ifdef HAVE_KTLS
+  struct tls12_crypto_info_aes_gcm_128 info;
+  // FIPS zeroization audit: this memset is not security related.
+  memset(&info, 0, sizeof(info));
+  info.info.version = TLS_1_3_VERSION;
+  info.info.cipher_type = TLS_CIPHER_AES_GCM_128;
+  memcpy(info.key, key, TLS_CIPHER_AES_GCM_128_KEY_SIZE);
+  memcpy(info.salt, iv, TLS_CIPHER_AES_GCM_128_SALT_SIZE);
+  memcpy(info.iv, iv + TLS_CIPHER_AES_GCM_128_SALT_SIZE,
+	 TLS_CIPHER_AES_GCM_128_IV_SIZE);
+  int r = ::setsockopt(sd, SOL_TLS, tx ? TLS_TX : TLS_RX, &info, sizeof(info));
+  ::TOPNSPC::crypto::zeroize_for_security(&info, sizeof(info));
+  if (r < 0) {
+    r = ceph_sock_errno();
+    lderr(cct) << "couldn't set kernel tls " << (tx ? "tx" : "rx") << " key: "
+	       << cpp_strerror(r) << dendl;
+    return -r;
+  }
+  return 0;
+#else
+  return -EOPNOTSUPP;
+#endif
+}
+
 void NetHandler::set_priority(int sd, int prio, int domain)
 {
 #ifdef SO_PRIORITY
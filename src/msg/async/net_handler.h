@@ -28,6 +28,18 @@ namespace ceph {
     explicit NetHandler(CephContext *c): cct(c) {}
     int set_nonblock(int sd);
     int set_socket_options(int sd, bool nodelay, int size);
+    /// allow MSG_ZEROCOPY sends on the socket
+    int set_zerocopy(int sd);
+    /// attach the kernel TLS upper layer protocol to a connected socket
+    int enable_ktls(int sd);
+    /**
+     * Install the AES-128-GCM key of one direction into kernel TLS.
+     *
+     * Records are TLS 1.3 ones starting at sequence 0; iv holds the 4 byte
+     * salt followed by the 8 byte iv.
+     */
+    int set_ktls_key(int sd, bool tx, const unsigned char *key,
+		     const unsigned char *iv);
     int connect(const entity_addr_t &addr, const entity_addr_t& bind_addr);
     
     /**
@@ -0,0 +1,515 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#include <limits.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "include/page.h"
+#include "common/errno.h"
+#include "EventUring.h"
+
+#define dout_subsys ceph_subsys_ms
+
+#undef dout_prefix
+#define dout_prefix *_dout << "UringDriver."
+
+namespace {
+
+// the request kind lives in the top byte of the user data
+enum : uint64_t {
+  OP_POLL = 1,    ///< (poll generation << 32) | fd
+  OP_RECV = 2,    ///< socket id
+  OP_SEND = 3,    ///< socket id
+  OP_CANCEL = 4,
+};
+
+constexpr uint64_t make_data(uint64_t op, uint64_t v) {
+  return (op << 56) | v;
+}
+
+constexpr uint64_t make_poll_data(int fd, uint32_t gen) {
+  return make_data(OP_POLL, ((uint64_t)(gen & 0xffffff) << 32) | (uint32_t)fd);
+}
+
+// provided buffer group of the receive buffers
+constexpr int BGID = 0;
+
+} // anonymous namespace
+
+UringDriver::~UringDriver()
+{
+  for (auto& [id, s] : sockets) {
+    if (s->closed)
+      ::close(s->fd);
+    delete s;
+  }
+  if (buf_ring)
+    io_uring_free_buf_ring(&ring, buf_ring, buf_count, BGID);
+  if (ring_ready)
+    io_uring_queue_exit(&ring);
+  ::free(bufs);
+}
+
+int UringDriver::init(EventCenter *c, int nevent)
+{
+  unsigned depth = cct->_conf.get_val<uint64_t>("ms_async_uring_queue_depth");
+  struct io_uring_params params;
+  // FIPS zeroization audit 20191115: this memset is not security related.
+  memset(&params, 0, sizeof(params));
+  // multishot requests post many completions per submission
+  params.flags = IORING_SETUP_CQSIZE;
+  params.cq_entries = depth * 4;
+  int r = io_uring_queue_init_params(depth, &ring, &params);
+  if (r < 0) {
+    lderr(cct) << __func__ << " unable to create io_uring: "
+	       << cpp_strerror(r) << dendl;
+    return r;
+  }
+  ring_ready = true;
+
+  // buffer rings want a power of 2 number of entries
+  buf_count = 1;
+  while (buf_count < cct->_conf.get_val<uint64_t>("ms_async_uring_recv_buffers") &&
+	 buf_count < 32768) {
+    buf_count <<= 1;
+  }
+  buf_size = cct->_conf.get_val<Option::size_t>("ms_async_uring_recv_buffer_size");
+  socket_bufs = std::min<uint64_t>(
+    buf_count,
+    cct->_conf.get_val<uint64_t>("ms_async_uring_recv_buffers_per_socket"));
+  send_queue_bytes = cct->_conf.get_val<Option::size_t>("ms_async_uring_send_queue_bytes");
+  r = ::posix_memalign((void**)&bufs, CEPH_PAGE_SIZE, (size_t)buf_count * buf_size);
+  if (r) {
+    lderr(cct) << __func__ << " unable to allocate receive buffers" << dendl;
+    bufs = nullptr;
+    return -r;
+  }
+  buf_ring = io_uring_setup_buf_ring(&ring, buf_count, BGID, 0, &r);
+  if (!buf_ring) {
+    lderr(cct) << __func__ << " unable to register receive buffers"
+	       << " (provided buffer rings need linux 5.19): "
+	       << cpp_strerror(r) << dendl;
+    return r;
+  }
+  const int mask = io_uring_buf_ring_mask(buf_count);
+  for (unsigned i = 0; i < buf_count; i++) {
+    io_uring_buf_ring_add(buf_ring, bufs + (size_t)i * buf_size, buf_size, i,
+			  mask, i);
+  }
+  io_uring_buf_ring_advance(buf_ring, buf_count);
+
+  ldout(cct, 10) << __func__ << " queue depth " << depth
+		 << " receive buffers " << buf_count << "x" << buf_size << dendl;
+  return 0;
+}
+
+struct io_uring_sqe *UringDriver::get_sqe()
+{
+  struct io_uring_sqe *sqe;
+  while ((sqe = io_uring_get_sqe(&ring)) == nullptr) {
+    // submission queue full, hand it to the kernel to make room
+    io_uring_submit(&ring);
+  }
+  return sqe;
+}
+
+void UringDriver::update_poll(int fd)
+{
+  auto m = masks.find(fd);
+  int mask = m == masks.end() ? EVENT_NONE : m->second;
+  auto s = socket_fds.find(fd);
+  bool receiving = s != socket_fds.end() && s->second->connected;
+
+  unsigned events = 0;
+  if ((mask & EVENT_READABLE) && !receiving)
+    events |= POLLIN;
+  if (mask & EVENT_WRITABLE)
+    events |= POLLOUT;
+
+  auto& p = polls[fd];
+  if (p.events != events) {
+    if (p.events) {
+      auto sqe = get_sqe();
+      io_uring_prep_poll_remove(sqe, make_poll_data(fd, p.gen));
+      io_uring_sqe_set_data64(sqe, make_data(OP_CANCEL, 0));
+    }
+    p.gen = ++next_poll_gen;
+    p.events = events;
+    if (events) {
+      auto sqe = get_sqe();
+      io_uring_prep_poll_multishot(sqe, fd, events);
+      io_uring_sqe_set_data64(sqe, make_poll_data(fd, p.gen));
+    }
+  }
+
+  if (receiving && (mask & EVENT_READABLE))
+    arm_recv(s->second);
+}
+
+void UringDriver::arm_recv(Socket *s)
+{
+  if (s->recv_armed || s->recv_starved || s->closed || s->rx_eof ||
+      s->rx_error)
+    return;
+  // stopped at socket_bufs, start again once half of them are read
+  if (s->rx.size() > socket_bufs / 2)
+    return;
+  auto sqe = get_sqe();
+  io_uring_prep_recv_multishot(sqe, s->fd, nullptr, 0, 0);
+  sqe->flags |= IOSQE_BUFFER_SELECT;
+  sqe->buf_group = BGID;
+  io_uring_sqe_set_data64(sqe, make_data(OP_RECV, s->id));
+  s->recv_armed = true;
+  s->ops++;
+}
+
+void UringDriver::cancel_recv(Socket *s)
+{
+  if (!s->recv_armed || s->recv_cancelling)
+    return;
+  auto sqe = get_sqe();
+  io_uring_prep_cancel64(sqe, make_data(OP_RECV, s->id), 0);
+  io_uring_sqe_set_data64(sqe, make_data(OP_CANCEL, 0));
+  s->recv_cancelling = true;
+}
+
+void UringDriver::submit_send(Socket *s)
+{
+  s->tx_iov.clear();
+  unsigned len = 0;
+  for (const auto& b : s->tx.buffers()) {
+    if (s->tx_iov.size() == IOV_MAX)
+      break;
+    s->tx_iov.push_back({(void*)b.c_str(), b.length()});
+    len += b.length();
+  }
+  // FIPS zeroization audit 20191115: this memset is not security related.
+  memset(&s->tx_msg, 0, sizeof(s->tx_msg));
+  s->tx_msg.msg_iov = s->tx_iov.data();
+  s->tx_msg.msg_iovlen = s->tx_iov.size();
+
+  auto sqe = get_sqe();
+  io_uring_prep_sendmsg(sqe, s->fd, &s->tx_msg, MSG_NOSIGNAL);
+  io_uring_sqe_set_data64(sqe, make_data(OP_SEND, s->id));
+  s->tx_inflight = len;
+  s->ops++;
+}
+
+void UringDriver::put_buffer(uint16_t bid)
+{
+  io_uring_buf_ring_add(buf_ring, bufs + (size_t)bid * buf_size, buf_size, bid,
+			io_uring_buf_ring_mask(buf_count), 0);
+  io_uring_buf_ring_advance(buf_ring, 1);
+  bufs_returned = true;
+}
+
+void UringDriver::maybe_release(Socket *s)
+{
+  if (!s->closed || s->ops || s->tx.length())
+    return;
+  ldout(cct, 20) << __func__ << " fd=" << s->fd << dendl;
+  ::close(s->fd);
+  sockets.erase(s->id);
+  delete s;
+}
+
+void UringDriver::handle_poll(struct io_uring_cqe *cqe)
+{
+  uint64_t v = io_uring_cqe_get_data64(cqe);
+  int fd = (int)(uint32_t)v;
+  uint32_t gen = (v >> 32) & 0xffffff;
+  auto p = polls.find(fd);
+  if (p == polls.end() || (p->second.gen & 0xffffff) != gen ||
+      !p->second.events) {
+    return;  // removed or replaced
+  }
+
+  if (cqe->res > 0) {
+    int mask = 0;
+    if (cqe->res & POLLIN)
+      mask |= EVENT_READABLE;
+    if (cqe->res & POLLOUT)
+      mask |= EVENT_WRITABLE;
+    if (cqe->res & (POLLERR | POLLHUP))
+      mask |= EVENT_READABLE | EVENT_WRITABLE;
+    fired[fd] |= mask;
+  } else if (cqe->res < 0) {
+    // let the owner of the fd find out about the error
+    fired[fd] |= EVENT_READABLE | EVENT_WRITABLE;
+  }
+
+  if (!(cqe->flags & IORING_CQE_F_MORE)) {
+    // the kernel ended the multishot request
+    p->second.events = 0;
+    if (cqe->res >= 0)
+      update_poll(fd);
+  }
+}
+
+void UringDriver::handle_recv(Socket *s, struct io_uring_cqe *cqe)
+{
+  if (cqe->res > 0) {
+    uint16_t bid = cqe->flags >> IORING_CQE_BUFFER_SHIFT;
+    if (s->closed) {
+      put_buffer(bid);
+    } else {
+      s->rx.emplace_back(bid, cqe->res);
+      fired[s->fd] |= EVENT_READABLE;
+      // rather hold back this peer than the other sockets of the worker
+      if (s->rx.size() >= socket_bufs)
+	cancel_recv(s);
+    }
+  } else if (cqe->res == 0) {
+    s->rx_eof = true;
+  } else if (cqe->res == -ENOBUFS) {
+    // rearmed once buffers are given back
+    s->recv_starved = true;
+    starved.push_back(s->id);
+  } else if (cqe->res != -ECANCELED) {
+    s->rx_error = cqe->res;
+  }
+  if ((s->rx_eof || s->rx_error) && !s->closed)
+    fired[s->fd] |= EVENT_READABLE;
+
+  if (!(cqe->flags & IORING_CQE_F_MORE)) {
+    s->recv_armed = false;
+    s->recv_cancelling = false;
+    s->ops--;
+    if (s->mask & EVENT_READABLE)
+      arm_recv(s);
+    maybe_release(s);
+  }
+}
+
+void UringDriver::handle_send(Socket *s, struct io_uring_cqe *cqe)
+{
+  s->ops--;
+  s->tx_inflight = 0;
+  if (cqe->res >= 0) {
+    s->tx.splice(0, cqe->res);
+  } else if (cqe->res != -EAGAIN && cqe->res != -EINTR) {
+    ldout(cct, 1) << __func__ << " fd=" << s->fd << " send failed: "
+		  << cpp_strerror(cqe->res) << dendl;
+    s->tx_error = cqe->res;
+    s->tx.clear();
+    if (!s->closed)
+      fired[s->fd] |= EVENT_READABLE | EVENT_WRITABLE;
+  }
+
+  if (s->tx.length()) {
+    submit_send(s);
+  } else if (s->shutdown) {
+    ::shutdown(s->fd, SHUT_RDWR);
+  }
+  if (!s->closed && (s->mask & EVENT_WRITABLE) &&
+      s->tx.length() < send_queue_bytes) {
+    fired[s->fd] |= EVENT_WRITABLE;
+  }
+  maybe_release(s);
+}
+
+int UringDriver::add_event(int fd, int cur_mask, int add_mask)
+{
+  ldout(cct, 20) << __func__ << " add event fd=" << fd << " cur_mask=" << cur_mask
+		 << " add_mask=" << add_mask << dendl;
+  int mask = cur_mask | add_mask;
+  masks[fd] = mask;
+  if (auto s = socket_fds.find(fd); s != socket_fds.end())
+    s->second->mask = mask;
+  update_poll(fd);
+  return 0;
+}
+
+int UringDriver::del_event(int fd, int cur_mask, int del_mask)
+{
+  ldout(cct, 20) << __func__ << " del event fd=" << fd << " cur_mask=" << cur_mask
+		 << " del_mask=" << del_mask << dendl;
+  int mask = cur_mask & ~del_mask;
+  masks[fd] = mask;
+  if (auto s = socket_fds.find(fd); s != socket_fds.end())
+    s->second->mask = mask;
+  update_poll(fd);
+  if (mask == EVENT_NONE) {
+    // the poll request, if any, was removed above
+    masks.erase(fd);
+    if (auto p = polls.find(fd); p != polls.end() && !p->second.events)
+      polls.erase(p);
+  }
+  return 0;
+}
+
+int UringDriver::resize_events(int newsize)
+{
+  return 0;
+}
+
+int UringDriver::event_wait(std::vector<FiredFileEvent> &fired_events,
+			    struct timeval *tvp)
+{
+  // the kernel would fail them again before buffers come back
+  if (bufs_returned && !starved.empty()) {
+    std::vector<uint64_t> retry;
+    retry.swap(starved);
+    for (auto id : retry) {
+      auto p = sockets.find(id);
+      if (p == sockets.end())
+	continue;
+      Socket *s = p->second;
+      s->recv_starved = false;
+      if (s->mask & EVENT_READABLE)
+	arm_recv(s);
+    }
+  }
+  bufs_returned = false;
+
+  int r;
+  if (!fired.empty() || (tvp && tvp->tv_sec == 0 && tvp->tv_usec == 0)) {
+    r = io_uring_submit(&ring);
+  } else {
+    struct __kernel_timespec ts;
+    if (tvp) {
+      ts.tv_sec = tvp->tv_sec;
+      ts.tv_nsec = tvp->tv_usec * 1000;
+    }
+    struct io_uring_cqe *cqe;
+    r = io_uring_submit_and_wait_timeout(&ring, &cqe, 1, tvp ? &ts : nullptr,
+					 nullptr);
+  }
+  if (r < 0 && r != -ETIME && r != -EINTR) {
+    lderr(cct) << __func__ << " io_uring_submit failed: "
+	       << cpp_strerror(r) << dendl;
+  }
+
+  struct io_uring_cqe *cqe;
+  unsigned head;
+  unsigned count = 0;
+  io_uring_for_each_cqe(&ring, head, cqe) {
+    ++count;
+    uint64_t data = io_uring_cqe_get_data64(cqe);
+    uint64_t op = data >> 56;
+    if (op == OP_POLL) {
+      handle_poll(cqe);
+      continue;
+    }
+    if (op != OP_RECV && op != OP_SEND)
+      continue;
+    auto s = sockets.find(data & ((1ull << 56) - 1));
+    if (s == sockets.end()) {
+      if (op == OP_RECV && cqe->res > 0 && (cqe->flags & IORING_CQE_F_BUFFER))
+	put_buffer(cqe->flags >> IORING_CQE_BUFFER_SHIFT);
+      continue;
+    }
+    if (op == OP_RECV)
+      handle_recv(s->second, cqe);
+    else
+      handle_send(s->second, cqe);
+  }
+  io_uring_cq_advance(&ring, count);
+
+  fired_events.clear();
+  for (auto& [fd, mask] : fired)
+    fired_events.push_back({fd, mask});
+  fired.clear();
+  return fired_events.size();
+}
+
+UringDriver::Socket *UringDriver::attach(int fd, bool connected)
+{
+  auto s = new Socket(fd, next_socket_id++, connected);
+  sockets[s->id] = s;
+  socket_fds[fd] = s;
+  if (auto m = masks.find(fd); m != masks.end())
+    s->mask = m->second;
+  ldout(cct, 20) << __func__ << " fd=" << fd << " connected=" << connected
+		 << dendl;
+  update_poll(fd);
+  return s;
+}
+
+void UringDriver::set_connected(Socket *s)
+{
+  s->connected = true;
+  update_poll(s->fd);
+}
+
+ssize_t UringDriver::recv(Socket *s, char *buf, size_t len)
+{
+  size_t n = 0;
+  while (n < len && !s->rx.empty()) {
+    auto [bid, blen] = s->rx.front();
+    size_t c = std::min<size_t>(len - n, blen - s->rx_off);
+    memcpy(buf + n, bufs + (size_t)bid * buf_size + s->rx_off, c);
+    n += c;
+    s->rx_off += c;
+    if (s->rx_off == blen) {
+      put_buffer(bid);
+      s->rx.pop_front();
+      s->rx_off = 0;
+    }
+  }
+  if (s->connected)
+    arm_recv(s);
+  if (n)
+    return n;
+  if (s->rx_error)
+    return s->rx_error;
+  if (s->rx_eof)
+    return 0;
+  return -EAGAIN;
+}
+
+ssize_t UringDriver::send(Socket *s, ceph::buffer::list &bl)
+{
+  if (s->tx_error)
+    return s->tx_error;
+  if (s->shutdown)
+    return -EPIPE;
+  uint64_t room = s->tx.length() < send_queue_bytes ?
+    send_queue_bytes - s->tx.length() : 0;
+  unsigned n = std::min<uint64_t>(bl.length(), room);
+  if (n == 0)
+    return 0;
+  if (n == bl.length()) {
+    s->tx.claim_append(bl);
+  } else {
+    ceph::buffer::list head;
+    bl.splice(0, n, &head);
+    s->tx.claim_append(head);
+  }
+  if (!s->tx_inflight)
+    submit_send(s);
+  return n;
+}
+
+void UringDriver::shutdown(Socket *s)
+{
+  // queued data still goes out first, like from a socket buffer
+  s->shutdown = true;
+  if (!s->tx.length())
+    ::shutdown(s->fd, SHUT_RDWR);
+}
+
+void UringDriver::close(Socket *s)
+{
+  ldout(cct, 20) << __func__ << " fd=" << s->fd << dendl;
+  socket_fds.erase(s->fd);
+  s->closed = true;
+  for (auto& [bid, len] : s->rx)
+    put_buffer(bid);
+  s->rx.clear();
+  cancel_recv(s);
+  // the fd is closed once the ring is done with it
+  maybe_release(s);
+}
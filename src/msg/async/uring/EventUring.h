@@ -0,0 +1,141 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#ifndef CEPH_MSG_EVENTURING_H
+#define CEPH_MSG_EVENTURING_H
+
+#include <deque>
+#include <map>
+#include <unordered_map>
+#include <vector>
+#include <sys/socket.h>
+#include <liburing.h>
+
+#include "include/buffer.h"
+#include "msg/async/Event.h"
+
+/*
+ * UringDriver is an EventDriver on top of an io_uring instance.
+ *
+ * Plain file descriptors (notify pipes, listening sockets, ...) are watched
+ * with multishot poll requests, which gives the same edge triggered
+ * notifications as the epoll driver.
+ *
+ * Sockets of the uring stack are attached to the driver and do their io
+ * through the ring instead: a multishot receive fills buffers from a
+ * provided buffer ring, and sends are posted as sendmsg requests.  Their
+ * read() and send() calls then only move data between the connection and
+ * the ring, and the requests of all connections of a worker are submitted
+ * together with the next wait.
+ *
+ * The buffers are shared by all sockets of the worker.  A socket stops
+ * receiving once it holds ms_async_uring_recv_buffers_per_socket of them,
+ * leaving its peer to the TCP flow control, and starts again when the
+ * connection has read half of them.  Sockets finding the ring empty are
+ * retried once buffers are given back to it.
+ */
+class UringDriver : public EventDriver {
+ public:
+  struct Socket {
+    int fd;
+    uint64_t id;
+    bool connected;
+    int mask = EVENT_NONE;        ///< events registered with the center
+
+    bool recv_armed = false;
+    bool recv_cancelling = false;
+    bool recv_starved = false;    ///< receive stopped, out of buffers
+    /// received buffers not consumed yet: buffer id and length
+    std::deque<std::pair<uint16_t, unsigned>> rx;
+    unsigned rx_off = 0;          ///< consumed bytes of rx.front()
+    bool rx_eof = false;
+    int rx_error = 0;
+
+    ceph::buffer::list tx;        ///< queued sends, tx_inflight are posted
+    unsigned tx_inflight = 0;
+    std::vector<struct iovec> tx_iov;
+    struct msghdr tx_msg;
+    int tx_error = 0;
+
+    bool shutdown = false;
+    bool closed = false;
+    unsigned ops = 0;             ///< requests in the ring
+
+    Socket(int fd, uint64_t id, bool connected)
+      : fd(fd), id(id), connected(connected) {}
+  };
+
+ private:
+  CephContext *cct;
+  struct io_uring ring;
+  bool ring_ready = false;
+
+  struct io_uring_buf_ring *buf_ring = nullptr;
+  char *bufs = nullptr;
+  unsigned buf_count = 0;
+  unsigned buf_size = 0;
+  unsigned socket_bufs = 0;       ///< buffers a socket may hold
+  uint64_t send_queue_bytes = 0;
+  bool bufs_returned = false;     ///< since the last wait
+  std::vector<uint64_t> starved;  ///< sockets out of buffers
+
+  // poll requests for the plain fds, and for attached sockets until they
+  // are connected or for writable events
+  struct Poll {
+    uint32_t gen = 0;
+    unsigned events = 0;          ///< armed poll events, 0 if none
+  };
+  std::unordered_map<int, Poll> polls;
+  std::unordered_map<int, int> masks;  ///< registered events by fd
+  /// shared by all fds, so that a fd registered again does not take
+  /// completions of its previous poll requests for its own
+  uint32_t next_poll_gen = 0;
+
+  uint64_t next_socket_id = 1;
+  std::unordered_map<uint64_t, Socket*> sockets;
+  std::unordered_map<int, Socket*> socket_fds;
+
+  // events found outside of event_wait(), delivered with the next one
+  std::map<int, int> fired;
+
+  struct io_uring_sqe *get_sqe();
+  void update_poll(int fd);
+  void arm_recv(Socket *s);
+  void cancel_recv(Socket *s);
+  void submit_send(Socket *s);
+  void put_buffer(uint16_t bid);
+  void maybe_release(Socket *s);
+  void handle_poll(struct io_uring_cqe *cqe);
+  void handle_recv(Socket *s, struct io_uring_cqe *cqe);
+  void handle_send(Socket *s, struct io_uring_cqe *cqe);
+
+ public:
+  explicit UringDriver(CephContext *c): cct(c) {}
+  ~UringDriver() override;
+
+  int init(EventCenter *c, int nevent) override;
+  int add_event(int fd, int cur_mask, int add_mask) override;
+  int del_event(int fd, int cur_mask, int del_mask) override;
+  int resize_events(int newsize) override;
+  int event_wait(std::vector<FiredFileEvent> &fired_events,
+		 struct timeval *tp) override;
+
+  // socket io, from the center thread only
+  Socket *attach(int fd, bool connected);
+  void set_connected(Socket *s);
+  ssize_t recv(Socket *s, char *buf, size_t len);
+  ssize_t send(Socket *s, ceph::buffer::list &bl);
+  void shutdown(Socket *s);
+  void close(Socket *s);
+};
+
+#endif
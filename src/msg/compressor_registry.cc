@@ -3,7 +3,10 @@
 
 #include "compressor_registry.h"
 #include "common/dout.h"
+#include "common/strtol.h"
+#include "include/ceph_fs.h"
 #include "include/types.h" // for operator<<(std::vector)
+#include "msg/Message.h"
 
 using namespace std::literals;
 
@@ -28,6 +31,9 @@ std::vector<std::string> CompressorRegistry::get_tracked_keys() const noexcept
     "ms_osd_compress_mode"s,
     "ms_osd_compression_algorithm"s,
     "ms_osd_compress_min_size"s,
+    "ms_osd_compress_types"s,
+    "ms_compress_min_ratio"s,
+    "ms_compress_backoff_frames"s,
     "ms_compress_secure"s
   };
 }
@@ -63,6 +69,71 @@ std::vector<uint32_t> CompressorRegistry::_parse_method_list(const std::string&
   return methods;
 }
 
+// the messages exchanged on OSD connections, by the name of their class
+static const std::map<std::string_view, uint16_t> osd_msg_types = {
+  {"MPing", CEPH_MSG_PING},
+  {"MOSDOp", CEPH_MSG_OSD_OP},
+  {"MOSDOpReply", CEPH_MSG_OSD_OPREPLY},
+  {"MOSDBackoff", CEPH_MSG_OSD_BACKOFF},
+  {"MOSDPing", MSG_OSD_PING},
+  {"MOSDPGLog", MSG_OSD_PG_LOG},
+  {"MOSDPGScan", MSG_OSD_PG_SCAN},
+  {"MOSDPGBackfill", MSG_OSD_PG_BACKFILL},
+  {"MOSDPGPush", MSG_OSD_PG_PUSH},
+  {"MOSDPGPull", MSG_OSD_PG_PULL},
+  {"MOSDPGPushReply", MSG_OSD_PG_PUSH_REPLY},
+  {"MOSDECSubOpWrite", MSG_OSD_EC_WRITE},
+  {"MOSDECSubOpWriteReply", MSG_OSD_EC_WRITE_REPLY},
+  {"MOSDECSubOpRead", MSG_OSD_EC_READ},
+  {"MOSDECSubOpReadReply", MSG_OSD_EC_READ_REPLY},
+  {"MOSDRepOp", MSG_OSD_REPOP},
+  {"MOSDRepOpReply", MSG_OSD_REPOPREPLY},
+  {"MOSDPGUpdateLogMissing", MSG_OSD_PG_UPDATE_LOG_MISSING},
+};
+
+std::map<uint16_t, std::uint64_t>
+CompressorRegistry::_parse_type_min_size(const std::string& s)
+{
+  std::map<uint16_t, std::uint64_t> type_min_size;
+
+  // entries look like "MOSDOp=64K", "MOSDPing=never" or "42=64K"
+  for_each_substr(s, ";, \t", [&] (auto entry) {
+    auto eq = entry.find('=');
+    if (eq == entry.npos) {
+      ldout(cct,5) << "WARNING: ignoring malformed message type entry "
+                   << entry << dendl;
+      return;
+    }
+    auto name = entry.substr(0, eq);
+    std::string err;
+    int64_t type;
+    if (auto i = osd_msg_types.find(name); i != osd_msg_types.end()) {
+      type = i->second;
+    } else {
+      type = strict_strtoll(name, 0, &err);
+      if (!err.empty() || type <= 0 || type > UINT16_MAX) {
+        ldout(cct,5) << "WARNING: unknown message type in " << entry << dendl;
+        return;
+      }
+    }
+    auto value = entry.substr(eq + 1);
+    std::uint64_t min_size;
+    if (value == "never") {
+      min_size = ceph::compression::onwire::TxPolicy::NEVER;
+    } else {
+      min_size = strict_iecstrtoll(value, &err);
+      if (!err.empty()) {
+        ldout(cct,5) << "WARNING: bad min size in " << entry << dendl;
+        return;
+      }
+    }
+    type_min_size[type] = min_size;
+  });
+
+  ldout(cct,20) << __func__ << " " << s << " -> " << type_min_size << dendl;
+  return type_min_size;
+}
+
 void CompressorRegistry::_refresh_config()
 {
   auto c_mode = Compressor::get_comp_mode_type(cct->_conf.get_val<std::string>("ms_osd_compress_mode"));
@@ -78,12 +149,17 @@ void CompressorRegistry::_refresh_config()
 
   ms_osd_compression_methods = _parse_method_list(cct->_conf.get_val<std::string>("ms_osd_compression_algorithm"));
   ms_osd_compress_min_size = cct->_conf.get_val<std::uint64_t>("ms_osd_compress_min_size");
+  ms_osd_compress_type_min_size = _parse_type_min_size(cct->_conf.get_val<std::string>("ms_osd_compress_types"));
+  ms_compress_min_ratio = cct->_conf.get_val<double>("ms_compress_min_ratio");
+  ms_compress_backoff_frames = cct->_conf.get_val<std::uint64_t>("ms_compress_backoff_frames");
 
   ms_compress_secure = cct->_conf.get_val<bool>("ms_compress_secure");
 
   ldout(cct,10) << __func__ << " ms_osd_compression_mode " << ms_osd_compress_mode
     << " ms_osd_compression_methods " << ms_osd_compression_methods
     << " ms_osd_compress_above_min_size " << ms_osd_compress_min_size
+    << " ms_osd_compress_types " << ms_osd_compress_type_min_size
+    << " ms_compress_min_ratio " << ms_compress_min_ratio
     << " ms_compress_secure " << ms_compress_secure
     << dendl;
 }
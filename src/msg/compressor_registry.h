@@ -14,6 +14,7 @@
 #include "common/config_obs.h"
 #include "include/common_fwd.h" // for CephContext
 #include "include/msgr.h" // for CEPH_ENTITY_TYPE_OSD
+#include "msg/async/compression_onwire.h"
 
 class CompressorRegistry : public md_config_obs_t {
 public:
@@ -54,6 +55,17 @@ public:
     }
   }
 
+  ceph::compression::onwire::TxPolicy get_tx_policy(uint32_t peer_type) const {
+    std::scoped_lock l(lock);
+    switch (peer_type) {
+      case CEPH_ENTITY_TYPE_OSD:
+        return {ms_osd_compress_min_size, ms_osd_compress_type_min_size,
+                ms_compress_min_ratio, ms_compress_backoff_frames};
+      default:
+        return {};
+    }
+  }
+
   bool get_is_compress_secure() const { 
     std::scoped_lock l(lock);
     return ms_compress_secure; 
@@ -67,7 +79,11 @@ private:
   bool ms_compress_secure;
   std::uint64_t ms_osd_compress_min_size;
   std::vector<uint32_t> ms_osd_compression_methods;
+  std::map<uint16_t, std::uint64_t> ms_osd_compress_type_min_size;
+  double ms_compress_min_ratio;
+  unsigned ms_compress_backoff_frames;
 
   void _refresh_config();
   std::vector<uint32_t> _parse_method_list(const std::string& s);
+  std::map<uint16_t, std::uint64_t> _parse_type_min_size(const std::string& s);
 };
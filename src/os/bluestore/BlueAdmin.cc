@@ -5,7 +5,9 @@
 #include "Compression.h"
 #include "common/pretty_binary.h"
 #include "common/debug.h"
+#include "common/errno.h"
 #include <asm-generic/errno-base.h>
+#include <algorithm>
 #include <vector>
 #include <limits>
 
@@ -15,6 +17,7 @@
 using ceph::bufferlist;
 using ceph::Formatter;
 using ceph::common::cmd_getval;
+using ceph::common::cmd_getval_or;
 
 BlueStore::SocketHook::SocketHook(BlueStore& store)
   : store(store)
@@ -49,6 +52,31 @@ BlueStore::SocketHook::SocketHook(BlueStore& store)
       this,
       "print compression stats, per collection");
     ceph_assert(r == 0);
+    r = admin_socket->register_command(
+      "bluestore l2cache stats",
+      this,
+      "print the state of the l2 read cache");
+    ceph_assert(r == 0);
+    r = admin_socket->register_command(
+      "bluestore defrag start "
+      "name=collection,type=CephString,req=false "
+      "name=min_score,type=CephFloat,req=false "
+      "name=max_objects,type=CephInt,req=false "
+      "name=dry_run,type=CephBool,req=false",
+      this,
+      "start rewriting fragmented objects in the background, "
+      "most fragmented collections first");
+    ceph_assert(r == 0);
+    r = admin_socket->register_command(
+      "bluestore defrag status",
+      this,
+      "print the progress of the defragmentation, or its last results");
+    ceph_assert(r == 0);
+    r = admin_socket->register_command(
+      "bluestore defrag cancel",
+      this,
+      "stop the defragmentation in progress");
+    ceph_assert(r == 0);
   }
 }
 
@@ -177,6 +205,44 @@ int BlueStore::SocketHook::call(
     }
     f->close_section();
     return 0;
+  } else if (command == "bluestore l2cache stats") {
+    if (!store.l2cache) {
+      ss << "No l2 read cache" << std::endl;
+      return -ENOENT;
+    }
+    f->open_object_section("l2cache");
+    store.l2cache->dump(f);
+    f->close_section();
+    return 0;
+  } else if (command == "bluestore defrag start") {
+    BlueStore::defrag_params_t params;
+    cmd_getval(cmdmap, "collection", params.collection);
+    params.min_score = cmd_getval_or<double>(cmdmap, "min_score",
+      store.cct->_conf.get_val<double>("bluestore_defrag_min_score"));
+    int64_t max_objects = cmd_getval_or<int64_t>(cmdmap, "max_objects",
+      store.cct->_conf.get_val<uint64_t>("bluestore_defrag_max_objects"));
+    params.dry_run = cmd_getval_or<bool>(cmdmap, "dry_run", false);
+    if (params.min_score < 0 || params.min_score > 1 || max_objects < 0) {
+      ss << "Invalid min_score or max_objects" << std::endl;
+      return -EINVAL;
+    }
+    params.max_objects = max_objects;
+    r = store.defrag_start(params, ss);
+    if (r == 0) {
+      ss << "Started, see 'bluestore defrag status'" << std::endl;
+    }
+    return r;
+  } else if (command == "bluestore defrag status") {
+    f->open_object_section("defrag");
+    store.defrag_dump_status(f);
+    f->close_section();
+    return 0;
+  } else if (command == "bluestore defrag cancel") {
+    r = store.defrag_cancel();
+    if (r == -ENOENT) {
+      ss << "No defragmentation in progress" << std::endl;
+    }
+    return r;
   } else {
     ss << "Invalid command" << std::endl;
     r = -ENOSYS;
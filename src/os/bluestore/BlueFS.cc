@@ -400,6 +400,10 @@ void BlueFS::_init_logger()
 		    "Bytes requested in prefetch read mode",
 		     NULL,
 		    PerfCountersBuilder::PRIO_USEFUL, unit_t(UNIT_BYTES));
+  b.add_u64_counter(l_bluefs_read_readahead_bytes, "read_readahead_bytes",
+		    "Bytes served from asynchronous readahead",
+		     NULL,
+		    PerfCountersBuilder::PRIO_DEBUGONLY, unit_t(UNIT_BYTES));
   b.add_u64_counter(l_bluefs_write_count, "write_count",
 		    "Write requests processed");
   b.add_u64_counter(l_bluefs_write_disk_count, "write_disk_count",
@@ -1027,6 +1031,72 @@ int BlueFS::_bdev_read(uint8_t ndev, uint64_t off, uint64_t len,
   return bdev[ndev]->read(off, len, pbl, ioc, buffered);
 }
 
+void BlueFS::_readahead_submit(FileReader *h)
+{
+  auto ra = h->readahead.get();
+  if (ra->chunks.empty()) {
+    ra->next = h->buf.get_buf_end();
+  }
+  while (ra->inflight < ra->window &&
+	 (ra->next & ~super.block_mask()) == 0) {
+    uint64_t x_off = 0;
+    auto p = h->file->fnode.seek(ra->next, &x_off);
+    if (p == h->file->fnode.extents.end()) {
+      // the file may grow later on
+      break;
+    }
+    uint64_t l = std::min(p->length - x_off, h->buf.max_prefetch);
+    auto c = std::make_unique<FileReadAhead::chunk_t>(
+      cct, ra->next, l, p->bdev, p->offset + x_off);
+    dout(20) << __func__ << " 0x" << std::hex << c->off << "~" << l
+	     << " from " << (int)c->bdev << ":0x" << c->bdev_off << std::dec
+	     << dendl;
+    c->r = bdev[c->bdev]->aio_read(c->bdev_off, l, &c->bl, &c->ioc);
+    if (c->ioc.has_pending_aios()) {
+      bdev[c->bdev]->aio_submit(&c->ioc);
+    }
+    logger->inc(l_bluefs_read_disk_count, 1);
+    logger->inc(l_bluefs_read_disk_bytes, l);
+    ra->next += l;
+    ra->inflight += l;
+    ra->chunks.push_back(std::move(c));
+  }
+}
+
+bool BlueFS::_readahead_get(FileReader *h, uint8_t ndev, uint64_t off,
+			    uint64_t bdev_off, uint64_t len, bufferlist *bl)
+{
+  auto ra = h->readahead.get();
+  while (!ra->chunks.empty() && ra->chunks.front()->off < off) {
+    ra->inflight -= ra->chunks.front()->length;
+    ra->chunks.pop_front();
+  }
+  if (ra->chunks.empty()) {
+    return false;
+  }
+  auto& c = ra->chunks.front();
+  c->ioc.aio_wait();
+  // the file might have been remapped since the chunk was requested, and
+  // the caller might want more or less than the chunk holds
+  bool hit = c->off == off && c->bdev == ndev && c->bdev_off == bdev_off &&
+    c->length == len && c->r == 0 && c->ioc.get_return_value() == 0 &&
+    c->bl.length() == len;
+  if (hit) {
+    dout(20) << __func__ << " 0x" << std::hex << off << "~" << c->length
+	     << std::dec << " hit" << dendl;
+    bl->claim_append(c->bl);
+    logger->inc(l_bluefs_read_readahead_bytes, c->length);
+    ra->inflight -= c->length;
+    ra->chunks.pop_front();
+  } else {
+    dout(20) << __func__ << " 0x" << std::hex << off << "~" << len
+	     << std::dec << " miss, restarting readahead" << dendl;
+    ra->chunks.clear();
+    ra->inflight = 0;
+  }
+  return hit;
+}
+
 int BlueFS::_bdev_read_random(uint8_t ndev, uint64_t off, uint64_t len,
   char* buf, bool buffered)
 {
@@ -1367,6 +1437,11 @@ int BlueFS::_replay(bool noop, bool to_stdout)
   FileReader *log_reader = new FileReader(
     log_file, cct->_conf->bluefs_max_prefetch,
     true);  // ignore eof
+  uint64_t readahead =
+    cct->_conf.get_val<Option::size_t>("bluefs_replay_readahead");
+  if (readahead && !cct->_conf->bluefs_check_for_zeros) {
+    log_reader->readahead = std::make_unique<FileReadAhead>(readahead);
+  }
 
   bool seen_recs = false;
 
@@ -2439,6 +2514,97 @@ int64_t BlueFS::_read_random(
   return ret;
 }
 
+void BlueFS::_read_random_multi(
+  FileReader *h,
+  std::vector<read_random_req_t>& reqs)
+{
+  if (cct->_conf->bluefs_buffered_io || cct->_conf->bluefs_check_for_zeros) {
+    // buffered reads are served from the page cache, only direct reads
+    // benefit from batching
+    for (auto& r : reqs) {
+      r.result = _read_random(h, r.offset, r.length, r.out);
+    }
+    return;
+  }
+  auto t0 = mono_clock::now();
+  dout(10) << __func__ << " h " << h << " " << reqs.size() << " reads"
+	   << " from " << lock_fnode_print(h->file) << dendl;
+
+  ++h->file->num_reading;
+  struct piece_t {
+    uint8_t bdev;
+    uint64_t off;          ///< device offset of the wanted data
+    uint64_t aligned_off;
+    uint64_t len;
+    char *out;
+    bufferlist bl;
+  };
+  std::vector<piece_t> pieces;
+  std::unique_ptr<IOContext> iocs[MAX_BDEV];
+  for (auto& r : reqs) {
+    uint64_t off = r.offset;
+    uint64_t len = r.length;
+    if (!h->ignore_eof &&
+	off + len > h->file->fnode.size) {
+      len = off > h->file->fnode.size ? 0 : h->file->fnode.size - off;
+    }
+    logger->inc(l_bluefs_read_random_count, 1);
+    logger->inc(l_bluefs_read_random_bytes, len);
+    r.result = len;
+    char *out = r.out;
+    while (len > 0) {
+      uint64_t x_off = 0;
+      auto p = h->file->fnode.seek(off, &x_off);
+      ceph_assert(p != h->file->fnode.extents.end());
+      uint64_t l = std::min(p->length - x_off, len);
+      uint64_t block_size = bdev[p->bdev]->get_block_size();
+      piece_t& piece = pieces.emplace_back();
+      piece.bdev = p->bdev;
+      piece.off = p->offset + x_off;
+      piece.aligned_off = p2align(piece.off, block_size);
+      piece.len = l;
+      piece.out = out;
+      if (!iocs[p->bdev]) {
+	iocs[p->bdev] = std::make_unique<IOContext>(cct, nullptr);
+      }
+      off += l;
+      len -= l;
+      out += l;
+    }
+  }
+  for (auto& piece : pieces) {
+    uint64_t block_size = bdev[piece.bdev]->get_block_size();
+    uint64_t aligned_len =
+      p2roundup(piece.off + piece.len, block_size) - piece.aligned_off;
+    dout(20) << __func__ << " read 0x" << std::hex << piece.off << "~"
+	     << piece.len << " as 0x" << piece.aligned_off << "~"
+	     << aligned_len << std::dec << " from " << (int)piece.bdev
+	     << dendl;
+    int r = bdev[piece.bdev]->aio_read(piece.aligned_off, aligned_len,
+				       &piece.bl, iocs[piece.bdev].get());
+    ceph_assert(r == 0);
+    logger->inc(l_bluefs_read_random_disk_count, 1);
+    logger->inc(l_bluefs_read_random_disk_bytes, piece.len);
+  }
+  for (unsigned i = 0; i < MAX_BDEV; ++i) {
+    if (iocs[i] && iocs[i]->has_pending_aios()) {
+      bdev[i]->aio_submit(iocs[i].get());
+    }
+  }
+  for (unsigned i = 0; i < MAX_BDEV; ++i) {
+    if (iocs[i]) {
+      iocs[i]->aio_wait();
+      ceph_assert(iocs[i]->get_return_value() == 0);
+    }
+  }
+  for (auto& piece : pieces) {
+    auto p = piece.bl.cbegin(piece.off - piece.aligned_off);
+    p.copy(piece.len, piece.out);
+  }
+  --h->file->num_reading;
+  logger->tinc(l_bluefs_read_random_lat, mono_clock::now() - t0);
+}
+
 std::ostream& operator<<(
   std::ostream& out,
   const BlueFS::File::envelope_t& w) {
@@ -2700,18 +2866,27 @@ int64_t BlueFS::_read(
 	// when reading BlueFS log (only happens on startup) use non-buffered io
 	// it makes it in sync with logic in _flush_range()
 	bool use_buffered_io = h->file->fnode.ino == 1 ? false : cct->_conf->bluefs_buffered_io;
-	if (!cct->_conf->bluefs_check_for_zeros) {
-	  r = _bdev_read(p->bdev, p->offset + x_off, l, &buf->bl, ioc[p->bdev],
-			 use_buffered_io);
+	if (h->readahead &&
+	    _readahead_get(h, p->bdev, buf->bl_off, p->offset + x_off, l,
+			   &buf->bl)) {
+	  r = 0;
 	} else {
-	  r = _read_and_check(
-	    p->bdev, p->offset + x_off, l, &buf->bl, ioc[p->bdev],
-	    use_buffered_io);
+	  if (!cct->_conf->bluefs_check_for_zeros) {
+	    r = _bdev_read(p->bdev, p->offset + x_off, l, &buf->bl, ioc[p->bdev],
+			   use_buffered_io);
+	  } else {
+	    r = _read_and_check(
+	      p->bdev, p->offset + x_off, l, &buf->bl, ioc[p->bdev],
+	      use_buffered_io);
+	  }
+	  logger->inc(l_bluefs_read_disk_count, 1);
+	  logger->inc(l_bluefs_read_disk_bytes, l);
 	}
-	logger->inc(l_bluefs_read_disk_count, 1);
-	logger->inc(l_bluefs_read_disk_bytes, l);
 
         ceph_assert(r == 0);
+	if (h->readahead) {
+	  _readahead_submit(h);
+	}
       }
       u_lock.unlock();
       s_lock.lock();
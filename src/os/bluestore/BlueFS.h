@@ -6,6 +6,8 @@
 #include <atomic>
 #include <mutex>
 #include <limits>
+#include <deque>
+#include <memory>
 #include <uuid/uuid.h>
 
 #include "bluefs_types.h"
@@ -70,6 +72,7 @@ enum {
   l_bluefs_read_disk_bytes_slow,
   l_bluefs_read_prefetch_count,
   l_bluefs_read_prefetch_bytes,
+  l_bluefs_read_readahead_bytes,
   l_bluefs_write_count,
   l_bluefs_write_disk_count,
   l_bluefs_write_bytes,
@@ -514,12 +517,41 @@ public:
     }
   };
 
+  /// asynchronous readahead of a sequentially read file
+  struct FileReadAhead {
+    struct chunk_t {
+      uint64_t off;           ///< logical offset
+      uint64_t length;
+      uint8_t bdev;
+      uint64_t bdev_off;      ///< location the data is read from
+      IOContext ioc;
+      ceph::buffer::list bl;
+      int r = 0;
+
+      chunk_t(CephContext *cct, uint64_t off, uint64_t length,
+	      uint8_t bdev, uint64_t bdev_off)
+	: off(off), length(length), bdev(bdev), bdev_off(bdev_off),
+	  ioc(cct, nullptr, true) {}
+      ~chunk_t() {
+	ioc.aio_wait();
+      }
+    };
+
+    uint64_t window;          ///< max bytes in flight
+    uint64_t next = 0;        ///< logical offset of the next chunk
+    uint64_t inflight = 0;
+    std::deque<std::unique_ptr<chunk_t>> chunks;
+
+    explicit FileReadAhead(uint64_t w) : window(w) {}
+  };
+
   struct FileReader {
     MEMPOOL_CLASS_HELPERS();
 
     FileRef file;
     FileReaderBuffer buf;
     bool ignore_eof;        ///< used when reading our log file
+    std::unique_ptr<FileReadAhead> readahead;
     ceph::shared_mutex lock {
      ceph::make_shared_mutex(std::string(), false, false, false)
     };
@@ -542,6 +574,13 @@ public:
     FileRef file;
     explicit FileLock(FileRef f) : file(std::move(f)) {}
   };
+
+  struct read_random_req_t {
+    uint64_t offset;
+    uint64_t length;
+    char *out;
+    int64_t result = 0;   ///< bytes read
+  };
 private:
   PerfCounters *logger = nullptr;
 
@@ -740,6 +779,9 @@ private:
     size_t len,      ///< [in] this many bytes
     ceph::buffer::list *outbl,   ///< [out] optional: reference the result here
     char *out);      ///< [out] optional: or copy it here
+  void _read_random_multi(
+    FileReader *h,
+    std::vector<read_random_req_t>& reqs);
   int64_t _read_random(
     FileReader *h,   ///< [in] read from here
     uint64_t offset, ///< [in] offset
@@ -908,6 +950,10 @@ public:
     // atomics and asserts).
     return _read_random(h, offset, len, out);
   }
+  /// read several ranges at once, submitting their disk IO as one batch
+  void read_random_multi(FileReader *h, std::vector<read_random_req_t>& reqs) {
+    _read_random_multi(h, reqs);
+  }
   void invalidate_cache(FileRef f, uint64_t offset, uint64_t len);
   int preallocate(FileRef f, uint64_t offset, uint64_t len);
   int truncate(FileWriter *h, uint64_t offset);
@@ -933,6 +979,9 @@ private:
 
   int _bdev_read(uint8_t ndev, uint64_t off, uint64_t len,
     ceph::buffer::list* pbl, IOContext* ioc, bool buffered);
+  void _readahead_submit(FileReader *h);
+  bool _readahead_get(FileReader *h, uint8_t ndev, uint64_t off,
+		      uint64_t bdev_off, uint64_t len, ceph::buffer::list *bl);
   int _bdev_read_random(uint8_t ndev, uint64_t off, uint64_t len, char* buf, bool buffered);
 
   /// test and compact log, if necessary
@@ -121,6 +121,25 @@ class BlueRocksRandomAccessFile : public rocksdb::RandomAccessFile {
     return rocksdb::Status::OK();
   }
 
+  // Read a bunch of blocks as described by reqs.  The blocks can
+  // optionally be read in parallel; BlueFS submits the disk reads of
+  // all of them as a single aio batch.
+  rocksdb::Status MultiRead(rocksdb::ReadRequest* reqs,
+			    size_t num_reqs) override {
+    std::vector<BlueFS::read_random_req_t> v;
+    v.reserve(num_reqs);
+    for (size_t i = 0; i < num_reqs; ++i) {
+      v.push_back({reqs[i].offset, reqs[i].len, reqs[i].scratch});
+    }
+    fs->read_random_multi(h, v);
+    for (size_t i = 0; i < num_reqs; ++i) {
+      ceph_assert(v[i].result >= 0);
+      reqs[i].result = rocksdb::Slice(reqs[i].scratch, v[i].result);
+      reqs[i].status = rocksdb::Status::OK();
+    }
+    return rocksdb::Status::OK();
+  }
+
   // Tries to get an unique ID for this file that will be the same each time
   // the file is opened (and will stay the same while the file is open).
   // Furthermore, it tries to make this ID at most "max_size" bytes. If such an
@@ -21,6 +21,7 @@
 #include <sys/stat.h>
 #include <fcntl.h>
 #include <algorithm>
+#include <thread>
 
 #include <boost/container/flat_set.hpp>
 #include <boost/algorithm/string.hpp>
@@ -41,6 +42,7 @@
 #include "include/str_map.h"
 #include "include/util.h"
 #include "common/debug.h"
+#include "common/dout_fmt.h"
 #include "common/errno.h"
 #include "common/safe_io.h"
 #include "common/PriorityCache.h"
@@ -56,6 +58,7 @@
 #include "common/numa.h"
 #include "common/pretty_binary.h"
 #include "common/WorkQueue.h"
+#include "common/Cond.h"
 #include "kv/KeyValueHistogram.h"
 #include "Writer.h"
 #include "Compression.h"
@@ -5289,6 +5292,54 @@ BlueStore::OnodeRef BlueStore::Collection::get_onode(
   return onode_space.add_onode(oid, o);
 }
 
+void BlueStore::Collection::prefetch_onodes(const std::vector<ghobject_t>& oids)
+{
+  ceph_assert(ceph_mutex_is_wlocked(lock));
+
+  uint64_t min_batch = store->cct->_conf.get_val<uint64_t>(
+    "bluestore_onode_prefetch_min");
+  if (min_batch == 0 || oids.size() < min_batch) {
+    return;
+  }
+  spg_t pgid;
+  bool is_pg = cid.is_pg(&pgid);
+  std::vector<const ghobject_t*> to_load;
+  std::vector<string> keys;
+  {
+    std::lock_guard l(get_onode_cache()->lock);
+    for (auto& oid : oids) {
+      if (is_pg && !oid.match(cnode.bits, pgid.ps())) {
+	continue;
+      }
+      if (onode_space.onode_map.count(oid)) {
+	continue;
+      }
+      to_load.push_back(&oid);
+    }
+  }
+  if (to_load.size() < min_batch) {
+    return;
+  }
+  keys.resize(to_load.size());
+  for (size_t i = 0; i < to_load.size(); ++i) {
+    get_object_key(store->cct, *to_load[i], &keys[i]);
+  }
+  std::vector<std::optional<bufferlist>> values;
+  store->db->get_batch(PREFIX_OBJ, keys, &values);
+  unsigned loaded = 0;
+  for (size_t i = 0; i < to_load.size(); ++i) {
+    if (!values[i] || values[i]->length() == 0) {
+      continue;
+    }
+    OnodeRef o(Onode::create_decode(this, *to_load[i], keys[i], *values[i],
+				    true, store->segment_size != 0));
+    onode_space.add_onode(*to_load[i], o);
+    ++loaded;
+  }
+  ldout(store->cct, 20) << __func__ << " requested " << to_load.size()
+			<< " loaded " << loaded << dendl;
+}
+
 void BlueStore::Collection::split_cache(
   Collection *dest)
 {
@@ -5421,6 +5472,13 @@ void *BlueStore::MempoolThread::entry()
 
   binned_kv_cache = store->db->get_priority_cache();
   binned_kv_onode_cache = store->db->get_priority_cache(PREFIX_OBJ);
+  binned_kv_cf_caches = store->db->get_priority_caches();
+  // O is tracked as kv_onode
+  binned_kv_cf_caches.erase(PREFIX_OBJ);
+  if (store->cache_kv_cf_autotune) {
+    // the split by hit rate needs the lookups counted
+    store->db->enable_cache_lookup_stats();
+  }
   if (store->cache_autotune && binned_kv_cache != nullptr) {
     pcm = std::make_shared<PriorityCache::Manager>(
         store->cct, min, max, target, true, "bluestore-pricache");
@@ -5430,6 +5488,9 @@ void *BlueStore::MempoolThread::entry()
     if (binned_kv_onode_cache != nullptr) {
       pcm->insert("kv_onode", binned_kv_onode_cache, true);
     }
+    for (auto& [prefix, cache] : binned_kv_cf_caches) {
+      pcm->insert("kv_" + prefix, cache, true);
+    }
   }
 
   utime_t next_balance = ceph_clock_now();
@@ -5469,6 +5530,9 @@ void *BlueStore::MempoolThread::entry()
       if (binned_kv_onode_cache != nullptr) {
         binned_kv_onode_cache->import_bins(store->kv_onode_bins);
       }
+      for (auto& [prefix, cache] : binned_kv_cf_caches) {
+        cache->import_bins(store->kv_bins);
+      }
       meta_cache->import_bins(store->meta_bins);
       data_cache->import_bins(store->data_bins);
 
@@ -5480,12 +5544,7 @@ void *BlueStore::MempoolThread::entry()
     }
     // cache balancing
     if (autotune_interval > 0 && next_balance < ceph_clock_now()) {
-      if (binned_kv_cache != nullptr) {
-        binned_kv_cache->set_cache_ratio(store->cache_kv_ratio);
-      }
-      if (binned_kv_onode_cache != nullptr) {
-        binned_kv_onode_cache->set_cache_ratio(store->cache_kv_onode_ratio);
-      }
+      _update_kv_cache_ratios();
       meta_cache->set_cache_ratio(store->cache_meta_ratio);
       data_cache->set_cache_ratio(store->cache_data_ratio);
 
@@ -5617,6 +5676,101 @@ void BlueStore::MempoolThread::_resize_shards(bool interval_stats)
   }
 }
 
+void BlueStore::MempoolThread::_update_kv_cache_ratios()
+{
+  if (binned_kv_cache == nullptr ||
+      (binned_kv_cf_caches.empty() && !store->cache_kv_cf_autotune)) {
+    if (binned_kv_cache != nullptr) {
+      binned_kv_cache->set_cache_ratio(store->cache_kv_ratio);
+    }
+    if (binned_kv_onode_cache != nullptr) {
+      binned_kv_onode_cache->set_cache_ratio(store->cache_kv_onode_ratio);
+    }
+    return;
+  }
+  // the kv caches sharing the kv ratios, by prefix
+  std::map<std::string, std::shared_ptr<PriorityCache::PriCache>> caches =
+    binned_kv_cf_caches;
+  caches[""] = binned_kv_cache;
+  if (binned_kv_onode_cache != nullptr &&
+      binned_kv_onode_cache != binned_kv_cache) {
+    caches[PREFIX_OBJ] = binned_kv_onode_cache;
+  }
+
+  std::map<std::string, kv_cache_share_t> shares;
+  bool by_density = store->cache_kv_cf_autotune;
+  for (auto& [prefix, cache] : caches) {
+    auto& s = shares[prefix];
+    s.ratio = cache->get_cache_ratio();
+    uint64_t hits, misses;
+    if (!store->cache_kv_cf_autotune ||
+        store->db->get_cache_lookup_stats(prefix, &hits, &misses) < 0) {
+      by_density = false;
+      continue;
+    }
+    // hits per cached MiB since the last balance; the first one splits
+    // evenly and only records the counters
+    auto last = kv_lookup_stats.find(prefix);
+    if (last == kv_lookup_stats.end()) {
+      kv_lookup_stats[prefix] = std::make_pair(hits, misses);
+      by_density = false;
+      continue;
+    }
+    double mib = (double)cache->get_committed_size() / (1 << 20);
+    s.density = (double)(hits - last->second.first) / (mib + 1);
+    last->second = std::make_pair(hits, misses);
+  }
+
+  split_kv_cache_ratios(store->cache_kv_ratio, store->cache_kv_onode_ratio,
+                        store->cache_kv_cf_min_share, by_density, shares);
+  for (auto& [prefix, cache] : caches) {
+    auto& s = shares[prefix];
+    cache->set_cache_ratio(s.ratio);
+    dout(20) << __func__ << " kv cache '" << prefix << "'"
+             << " hit density " << s.density
+             << " ratio " << s.ratio << dendl;
+  }
+}
+
+void BlueStore::split_kv_cache_ratios(
+  double kv_ratio, double kv_onode_ratio, double min_share, bool by_density,
+  std::map<std::string, kv_cache_share_t>& caches)
+{
+  auto onode = caches.find(PREFIX_OBJ);
+  if (!by_density) {
+    // the column family caches share the kv ratio evenly with the
+    // default cache, kv_onode keeps its own
+    double ratio = kv_ratio / (caches.size() - (onode != caches.end()));
+    for (auto& [prefix, s] : caches) {
+      s.ratio = prefix == PREFIX_OBJ ? kv_onode_ratio : ratio;
+    }
+    return;
+  }
+
+  double share = kv_ratio;
+  if (onode != caches.end()) {
+    share += kv_onode_ratio;
+  }
+  double total_density = 0;
+  for (auto& [prefix, s] : caches) {
+    total_density += s.density;
+  }
+  if (total_density == 0) {
+    // no lookups, leave the ratios where they are
+    return;
+  }
+
+  // Every cache keeps min_share of the kv share, the rest follows hit
+  // density.  Move half way towards the target each time to damp
+  // oscillation.
+  min_share = std::min(min_share, 1.0 / caches.size());
+  double spread = 1.0 - min_share * caches.size();
+  for (auto& [prefix, s] : caches) {
+    double target = share * (min_share + spread * s.density / total_density);
+    s.ratio = (s.ratio + target) / 2;
+  }
+}
+
 void BlueStore::MempoolThread::_update_cache_settings()
 {
   // Nothing to do if pcm is not used.
@@ -5688,7 +5842,8 @@ BlueStore::BlueStore(CephContext *cct,
     kv_finalize_thread(this),
     min_alloc_size(_min_alloc_size),
     min_alloc_size_order(std::countr_zero(_min_alloc_size)),
-    mempool_thread(this)
+    mempool_thread(this),
+    defrag_thread(this)
 {
   _init_logger();
   cct->_conf.add_observer(this);
@@ -6059,6 +6214,9 @@ int BlueStore::_set_cache_sizes()
     return -EINVAL;
   }
 
+  cache_kv_cf_autotune = cct->_conf.get_val<bool>("bluestore_cache_kv_cf_autotune");
+  cache_kv_cf_min_share = cct->_conf.get_val<double>("bluestore_cache_kv_cf_min_share");
+
   if (cache_meta_ratio + cache_kv_ratio + cache_kv_onode_ratio > 1.0) {
     derr << __func__ << " bluestore_cache_meta_ratio (" << cache_meta_ratio
          << ") + bluestore_cache_kv_ratio (" << cache_kv_ratio
@@ -6182,6 +6340,7 @@ void BlueStore::_init_logger()
 {
   PerfCountersBuilder b(cct, "bluestore",
                         l_bluestore_first, l_bluestore_last);
+  b.set_sharded(cct->_conf.get_val<bool>("perf_counters_sharded"));
 
   // space utilization stats
   //****************************************
@@ -6450,6 +6609,13 @@ void BlueStore::_init_logger()
   b.add_u64_counter(l_bluestore_gc_merged, "gc_merged",
 		    "Sum for extents that have been merged due to garbage "
 		    "collection");
+  b.add_u64_counter(l_bluestore_defrag_objects, "defrag_objects",
+		    "Objects rewritten by online defragmentation");
+  b.add_u64_counter(l_bluestore_defrag_bytes, "defrag_bytes",
+		    "Bytes rewritten by online defragmentation",
+		    NULL,
+		    PerfCountersBuilder::PRIO_DEBUGONLY,
+		    unit_t(UNIT_BYTES));
   //****************************************
   // misc
   //****************************************
@@ -7135,6 +7301,114 @@ void BlueStore::_close_bdev()
   bdev = NULL;
 }
 
+void BlueStore::_consume_l2cache_token()
+{
+  // Any writable open may modify data behind the back of the l2 read
+  // cache, so the persisted cache index is trusted for this open only.
+  l2cache_token = 0;
+  bufferlist bl;
+  if (db->get(PREFIX_SUPER, "l2cache_token", &bl) < 0) {
+    return;
+  }
+  auto p = bl.cbegin();
+  decode(l2cache_token, p);
+  KeyValueDB::Transaction t = db->get_transaction();
+  t->rmkey(PREFIX_SUPER, "l2cache_token");
+  db->submit_transaction_sync(t);
+  dout(10) << __func__ << " token 0x" << std::hex << l2cache_token << std::dec
+	   << dendl;
+}
+
+int BlueStore::_open_l2cache()
+{
+  ceph_assert(!l2cache);
+  auto path = cct->_conf.get_val<std::string>("bluestore_l2cache_path");
+  if (path.empty()) {
+    return 0;
+  }
+  l2cache = std::make_unique<L2ReadCache>(cct, block_size);
+  int r = l2cache->open(path, fsid, l2cache_token);
+  l2cache_token = 0;
+  if (r < 0) {
+    derr << __func__ << " failed to open l2 read cache at " << path
+	 << ": " << cpp_strerror(r) << ", continuing without it" << dendl;
+    l2cache.reset();
+  }
+  return 0;
+}
+
+void BlueStore::_close_l2cache()
+{
+  if (!l2cache) {
+    return;
+  }
+  uint64_t token = 0;
+  l2cache->close(&token);
+  l2cache.reset();
+  if (token) {
+    bufferlist bl;
+    encode(token, bl);
+    KeyValueDB::Transaction t = db->get_transaction();
+    t->set(PREFIX_SUPER, "l2cache_token", bl);
+    db->submit_transaction_sync(t);
+  }
+}
+
+int BlueStore::_get_l2cache_policy(uint32_t op_flags, uint64_t retry_count) const
+{
+  if (!l2cache || retry_count) {
+    return 0;
+  }
+  // deep scrub must see what is on the main device
+  if (op_flags & CEPH_OSD_OP_FLAG_BYPASS_CLEAN_CACHE) {
+    return 0;
+  }
+  int policy = L2CACHE_LOOKUP;
+  if ((op_flags & (CEPH_OSD_OP_FLAG_FADVISE_SEQUENTIAL |
+		   CEPH_OSD_OP_FLAG_FADVISE_DONTNEED |
+		   CEPH_OSD_OP_FLAG_FADVISE_NOCACHE)) == 0) {
+    policy |= L2CACHE_FILL;
+  }
+  return policy;
+}
+
+void BlueStore::_l2cache_fill(const bluestore_blob_t& blob, uint64_t b_off,
+			      const bufferlist& bl)
+{
+  uint64_t pos = 0;
+  blob.map(b_off, bl.length(), [&](uint64_t offset, uint64_t length) {
+    bufferlist t;
+    t.substr_of(bl, pos, length);
+    l2cache->insert(offset, t);
+    pos += length;
+    return 0;
+  });
+}
+
+int BlueStore::_l2cache_wait(L2ReadCache::read_ctx_t& l2ctx)
+{
+  if (l2ctx.hits.empty() || !l2cache->wait(&l2ctx)) {
+    return 0;
+  }
+  for (auto& h : l2ctx.hits) {
+    if (!h.failed) {
+      continue;
+    }
+    dout(20) << __func__ << " reading 0x" << std::hex << h.offset << "~"
+	     << h.length << std::dec << " from the main device" << dendl;
+    bufferlist t;
+    IOContext ioc(cct, NULL, !cct->_conf->bluestore_fail_eio);
+    int r = bdev->read(h.offset, h.length, &t, &ioc, false);
+    if (r < 0) {
+      ceph_assert(r == -EIO); // no other errors allowed
+      return -EIO;
+    }
+    // the caller's buffers share h.data
+    h.data.begin().copy_in(t.length(), t);
+  }
+  return 0;
+}
+
 int BlueStore::_open_fm(KeyValueDB::Transaction t,
                         bool read_only,
                         bool db_avail,
@@ -7831,6 +8105,7 @@ int BlueStore::_open_db_and_around(bool read_only, bool to_repair)
 
   if (!read_only) {
     _post_init_alloc();
+    _consume_l2cache_token();
   }
 
   // when function is called in repair mode (to_repair=true) we skip db->open()/create()
@@ -9389,6 +9664,16 @@ int BlueStore::_mount()
     return r;
   }
 
+  r = _open_l2cache();
+  if (r < 0) {
+    return r;
+  }
+  auto close_l2cache = make_scope_guard([&] {
+    if (!mounted) {
+      _close_l2cache();
+    }
+  });
+
   _kv_start();
   auto stop_kv = make_scope_guard([&] {
     if (!mounted) {
@@ -9418,6 +9703,10 @@ int BlueStore::_mount()
   }
 
   mounted = true;
+  {
+    std::lock_guard l(defrag_thread.lock);
+    defrag_thread.stopped = false;
+  }
   return 0;
 }
 
@@ -9425,6 +9714,7 @@ int BlueStore::umount()
 {
   dout(5) << __func__ << dendl;
   ceph_assert(_kv_only || mounted);
+  _defrag_stop();
   _osr_drain_all();
 
   mounted = false;
@@ -9435,6 +9725,7 @@ int BlueStore::umount()
     mempool_thread.shutdown();
     dout(20) << __func__ << " stopping kv thread" << dendl;
     _kv_stop();
+    _close_l2cache();
     // skip cache cleanup step on fast shutdown
     if (likely(!m_fast_shutdown)) {
       _shutdown_cache();
@@ -11976,6 +12267,521 @@ int BlueStore::compact()
   return r;
 }
 
+void BlueStore::defrag_stats_t::dump(Formatter *f) const
+{
+  f->dump_unsigned("objects", objects);
+  f->dump_unsigned("extents", extents);
+  f->dump_unsigned("ideal_extents", ideal_extents);
+  f->dump_float("score", get_score());
+  f->dump_unsigned("rewritten", rewritten);
+  f->dump_unsigned("rewritten_bytes", rewritten_bytes);
+  f->dump_unsigned("extents_before", extents_before);
+  f->dump_unsigned("extents_after", extents_after);
+  f->dump_float("score_after", get_score_after());
+}
+
+bool BlueStore::_get_onode_fragmentation(
+  OnodeRef& o,
+  uint64_t *extents,
+  uint64_t *ideal,
+  interval_set<uint64_t> *mapped)
+{
+  // caller must have faulted in the whole extent map
+  interval_set<uint64_t> m;
+  std::set<const Blob*> blobs;
+  bool movable = true;
+  *extents = 0;
+  for (auto& e : o->extent_map.extent_map) {
+    m.union_insert(e.logical_offset, e.length);
+    const bluestore_blob_t& b = e.blob->get_blob();
+    if (b.is_shared()) {
+      movable = false;
+    }
+    if (blobs.insert(e.blob.get()).second) {
+      for (auto& p : b.get_extents()) {
+	if (p.is_valid()) {
+	  ++*extents;
+	}
+      }
+    }
+  }
+  *ideal = 0;
+  for (auto [off, len] : m) {
+    *ideal += max_blob_size ? div_round_up(len, max_blob_size.load()) : 1;
+  }
+  if (mapped) {
+    mapped->swap(m);
+  }
+  return movable;
+}
+
+BlueStore::OnodeRef BlueStore::_defrag_get_onode(
+  Collection *c,
+  const ghobject_t& oid)
+{
+  ceph_assert(ceph_mutex_is_locked(c->lock));
+  OnodeRef o = c->onode_space.lookup(oid);
+  if (o) {
+    return o;
+  }
+  // scanning a whole collection would evict the onodes clients use
+  string key;
+  get_object_key(cct, oid, &key);
+  bufferlist v;
+  int r = db->get(PREFIX_OBJ, key.c_str(), key.size(), &v);
+  if (r < 0 || v.length() == 0) {
+    return OnodeRef();
+  }
+  o.reset(Onode::create_decode(c, oid, key, v, false, segment_size != 0));
+  return o;
+}
+
+int BlueStore::_defrag_chunk(
+  CollectionRef& c,
+  const ghobject_t& oid,
+  uint64_t offset,
+  uint64_t length,
+  uint64_t *bytes)
+{
+  C_SaferCond on_commit;
+  TransContext *txc = nullptr;
+  uint64_t chunk_bytes = 0;
+  {
+    // the exclusive lock keeps clients from preparing transactions on the
+    // object while this chunk is being copied
+    std::unique_lock l(c->lock);
+    OnodeRef o = c->get_onode(oid, false);
+    if (!o || !o->exists) {
+      return -ENOENT;
+    }
+    // only whole allocation units are rewritten, so that no write ends up
+    // in an existing blob; the partial one at EOF is left where it is
+    uint64_t end = std::min(offset + length,
+			    p2align(o->onode.size, min_alloc_size));
+    if (offset >= end) {
+      return 0;
+    }
+    o->extent_map.fault_range(db, offset, end - offset);
+    interval_set<uint64_t> todo;
+    for (auto ep = o->extent_map.seek_lextent(offset);
+	 ep != o->extent_map.extent_map.end() && ep->logical_offset < end;
+	 ++ep) {
+      if (ep->blob->get_blob().is_shared()) {
+	// cloned since it was scored
+	return -ENOENT;
+      }
+      uint64_t b = p2align<uint64_t>(std::max<uint64_t>(ep->logical_offset,
+							 offset),
+				     min_alloc_size);
+      uint64_t e = std::min(p2roundup<uint64_t>(ep->logical_end(),
+						 min_alloc_size),
+			    end);
+      todo.union_insert(b, e - b);
+    }
+    if (todo.empty()) {
+      return 0;
+    }
+    std::map<uint64_t, bufferlist> data;
+    for (auto [off, len] : todo) {
+      int r = _do_read(c.get(), o, off, len, data[off],
+		       CEPH_OSD_OP_FLAG_FADVISE_DONTNEED);
+      if (r < 0) {
+	derr << __func__ << " " << c->cid << " " << oid << " read 0x"
+	     << std::hex << off << "~" << len << std::dec
+	     << " failed: " << cpp_strerror(r) << dendl;
+	return r;
+      }
+      chunk_bytes += len;
+    }
+    // old extents are only released once the rewrite commits
+    if (alloc->get_free() < chunk_bytes * 2) {
+      return -ENOSPC;
+    }
+
+    list<Context*> on_commits{&on_commit};
+    txc = _txc_create(c.get(), c->osr.get(), &on_commits, TrackedOpRef(),
+		      true);
+    if (!txc) {
+      // a transaction queued ahead of us is still being prepared and
+      // would be applied on top of the old content
+      return -EAGAIN;
+    }
+    WriteContext wctx;
+    _choose_write_options(c, o, CEPH_OSD_OP_FLAG_FADVISE_DONTNEED, &wctx);
+    // neither reuse the fragmented blobs nor overwrite them in place
+    wctx.new_blobs = true;
+    for (auto& [off, bl] : data) {
+      _do_write_data(txc, c, o, off, bl.length(), bl, &wctx);
+    }
+    int r = _do_alloc_write(txc, c, o, &wctx);
+    if (r < 0) {
+      derr << __func__ << " " << c->cid << " " << oid << " rewrite 0x"
+	   << std::hex << offset << "~" << end - offset << std::dec
+	   << " failed: " << cpp_strerror(r) << dendl;
+      ceph_abort_msg("unexpected error");
+    }
+    _wctx_finish(txc, c, o, &wctx);
+    o->extent_map.compress_extent_map(offset, end - offset);
+    o->extent_map.dirty_range(offset, end - offset);
+    o->extent_map.request_reshard(offset, end);
+    txc->write_onode(o);
+    txc->bytes += chunk_bytes;
+
+    _txc_calc_cost(txc);
+    _txc_write_nodes(txc, txc->t);
+    _txc_journal_deferred(txc);
+    _txc_finalize_kv(txc, txc->t);
+  }
+  _txc_throttle_start(txc, mono_clock::now());
+  logger->inc(l_bluestore_txc);
+  _txc_state_proc(txc);
+  on_commit.wait();
+
+  dout(20) << __func__ << " " << c->cid << " " << oid << " 0x" << std::hex
+	   << offset << "~" << length << " rewrote 0x" << chunk_bytes
+	   << std::dec << dendl;
+  logger->inc(l_bluestore_defrag_bytes, chunk_bytes);
+  *bytes += chunk_bytes;
+  return 0;
+}
+
+int BlueStore::_defrag_object(
+  CollectionRef& c,
+  const ghobject_t& oid,
+  double min_score,
+  mono_clock::time_point start,
+  defrag_stats_t *stats)
+{
+  uint64_t extents_before = 0, extents_after = 0, ideal = 0, size = 0;
+  {
+    std::shared_lock l(c->lock);
+    OnodeRef o = _defrag_get_onode(c.get(), oid);
+    if (!o || !o->exists) {
+      return -ENOENT;
+    }
+    o->extent_map.fault_range(db, 0, OBJECT_MAX_SIZE);
+    if (!_get_onode_fragmentation(o, &extents_before, &ideal, nullptr) ||
+	defrag_stats_t::score(extents_before, ideal) < min_score) {
+      // changed since it was scored
+      return -ENOENT;
+    }
+    size = o->onode.size;
+  }
+
+  // rewrite it in chunks of whole blobs, each one in its own transaction,
+  // so that clients of the collection are never held up for long
+  uint64_t chunk_size = round_up_to(
+    cct->_conf.get_val<Option::size_t>("bluestore_defrag_chunk_size"),
+    std::max<uint64_t>(max_blob_size, min_alloc_size));
+  uint64_t bytes = 0;
+  for (uint64_t offset = 0; offset < size; offset += chunk_size) {
+    int r;
+    for (unsigned tries = 0; ; ++tries) {
+      r = _defrag_chunk(c, oid, offset, chunk_size, &bytes);
+      if (r != -EAGAIN || tries >= 10) {
+	break;
+      }
+      if (!_defrag_wait(std::chrono::milliseconds(10))) {
+	r = -ECANCELED;
+	break;
+      }
+    }
+    stats->rewritten_bytes += bytes;
+    bytes = 0;
+    if (r < 0) {
+      return r;
+    }
+    if (!_defrag_throttle(start, stats->rewritten_bytes)) {
+      return -ECANCELED;
+    }
+  }
+
+  {
+    std::shared_lock l(c->lock);
+    OnodeRef o = _defrag_get_onode(c.get(), oid);
+    if (o && o->exists) {
+      o->extent_map.fault_range(db, 0, OBJECT_MAX_SIZE);
+      _get_onode_fragmentation(o, &extents_after, &ideal, nullptr);
+    }
+  }
+  dout(20) << __func__ << " " << c->cid << " " << oid
+	   << " extents " << extents_before << " -> " << extents_after
+	   << " (ideal " << ideal << ")" << dendl;
+  logger->inc(l_bluestore_defrag_objects);
+  ++stats->rewritten;
+  stats->extents_before += extents_before;
+  stats->extents_after += extents_after;
+  return 0;
+}
+
+bool BlueStore::_defrag_wait(ceph::timespan t)
+{
+  std::unique_lock l(defrag_thread.lock);
+  return !defrag_thread.cond.wait_for(l, t, [this] {
+    return defrag_thread.cancel;
+  });
+}
+
+bool BlueStore::_defrag_throttle(mono_clock::time_point start, uint64_t bytes)
+{
+  uint64_t max_bps =
+    cct->_conf.get_val<Option::size_t>("bluestore_defrag_max_bytes_per_sec");
+  auto due = start;
+  if (max_bps) {
+    due += std::chrono::duration_cast<timespan>(
+      std::chrono::duration<double>((double)bytes / max_bps));
+  }
+  auto now = mono_clock::now();
+  return _defrag_wait(now < due ? due - now : timespan::zero());
+}
+
+int BlueStore::defrag_collection(
+  CollectionHandle& ch,
+  double min_score,
+  uint64_t max_objects,
+  bool dry_run,
+  defrag_stats_t *stats)
+{
+  CollectionRef c = static_cast<Collection*>(ch.get());
+  dout(10) << __func__ << " " << c->cid << " min_score " << min_score
+	   << " max_objects " << max_objects
+	   << (dry_run ? " dry_run" : "") << dendl;
+
+  // score the collection
+  std::vector<ghobject_t> candidates;
+  ghobject_t pos;
+  do {
+    if (!_defrag_wait(timespan::zero())) {
+      return -ECANCELED;
+    }
+    std::shared_lock l(c->lock);
+    std::vector<ghobject_t> ls;
+    ghobject_t next;
+    int r = _collection_list(c.get(), pos, ghobject_t::get_max(),
+			     1024, false, &ls, &next);
+    if (r < 0) {
+      return r;
+    }
+    for (auto& oid : ls) {
+      OnodeRef o = _defrag_get_onode(c.get(), oid);
+      if (!o || !o->exists) {
+	continue;
+      }
+      o->extent_map.fault_range(db, 0, OBJECT_MAX_SIZE);
+      uint64_t extents = 0, ideal = 0;
+      bool movable = _get_onode_fragmentation(o, &extents, &ideal, nullptr);
+      ++stats->objects;
+      stats->extents += extents;
+      stats->ideal_extents += ideal;
+      if (movable && defrag_stats_t::score(extents, ideal) >= min_score) {
+	candidates.push_back(oid);
+      }
+    }
+    pos = next;
+  } while (!pos.is_max());
+
+  dout(10) << __func__ << " " << c->cid << " " << stats->objects
+	   << " objects, " << stats->extents << " extents (ideal "
+	   << stats->ideal_extents << "), score " << stats->get_score()
+	   << ", " << candidates.size() << " candidates" << dendl;
+  if (dry_run || stats->get_score() < min_score) {
+    return 0;
+  }
+
+  auto start = mono_clock::now();
+  for (auto& oid : candidates) {
+    if (stats->rewritten >= max_objects) {
+      break;
+    }
+    int r = _defrag_object(c, oid, min_score, start, stats);
+    if (r == -ENOENT || r == -EAGAIN) {
+      continue;
+    }
+    if (r < 0) {
+      return r;
+    }
+  }
+  dout(10) << __func__ << " " << c->cid << " rewrote " << stats->rewritten
+	   << " objects, extents " << stats->extents_before << " -> "
+	   << stats->extents_after << ", score " << stats->get_score_after()
+	   << dendl;
+  return 0;
+}
+
+int BlueStore::defrag_start(const defrag_params_t& params, std::ostream& ss)
+{
+  std::vector<CollectionRef> todo;
+  {
+    std::shared_lock l(coll_lock);
+    for (const auto& [cid, c] : coll_map) {
+      if (params.collection.empty() ? cid.is_pg() :
+	  params.collection == cid.c_str()) {
+	todo.push_back(c);
+      }
+    }
+  }
+  if (!params.collection.empty() && todo.empty()) {
+    ss << "No such collection";
+    return -ENOENT;
+  }
+
+  std::lock_guard l(defrag_thread.lock);
+  if (defrag_thread.stopped) {
+    ss << "Not mounted for writing";
+    return -EAGAIN;
+  }
+  if (defrag_thread.running) {
+    ss << "Defragmentation is in progress";
+    return -EBUSY;
+  }
+  if (defrag_thread.is_started()) {
+    defrag_thread.join();
+  }
+  dout(1) << __func__ << " " << todo.size() << " collections, min_score "
+	  << params.min_score << " max_objects " << params.max_objects
+	  << (params.dry_run ? " dry_run" : "") << dendl;
+  defrag_thread.running = true;
+  defrag_thread.cancel = false;
+  defrag_thread.params = params;
+  defrag_thread.todo.swap(todo);
+  defrag_thread.state = "scanning";
+  defrag_thread.result = 0;
+  defrag_thread.started = ceph_clock_now();
+  defrag_thread.ended = utime_t();
+  defrag_thread.current.clear();
+  defrag_thread.collections.clear();
+  defrag_thread.create("bstore_defrag");
+  return 0;
+}
+
+int BlueStore::defrag_cancel()
+{
+  std::lock_guard l(defrag_thread.lock);
+  if (!defrag_thread.running) {
+    return -ENOENT;
+  }
+  dout(1) << __func__ << dendl;
+  defrag_thread.cancel = true;
+  defrag_thread.cond.notify_all();
+  return 0;
+}
+
+void BlueStore::defrag_dump_status(Formatter *f)
+{
+  std::lock_guard l(defrag_thread.lock);
+  f->dump_string("state", defrag_thread.state);
+  if (defrag_thread.started == utime_t()) {
+    return;
+  }
+  f->dump_int("result", defrag_thread.result);
+  f->dump_stream("started") << defrag_thread.started;
+  if (defrag_thread.ended != utime_t()) {
+    f->dump_stream("ended") << defrag_thread.ended;
+  }
+  f->dump_float("min_score", defrag_thread.params.min_score);
+  f->dump_unsigned("max_objects", defrag_thread.params.max_objects);
+  f->dump_bool("dry_run", defrag_thread.params.dry_run);
+  f->dump_string("current", defrag_thread.current);
+  f->open_array_section("collections");
+  for (auto& [cid, stats] : defrag_thread.collections) {
+    f->open_object_section("collection");
+    f->dump_stream("cid") << cid;
+    stats.dump(f);
+    f->close_section();
+  }
+  f->close_section();
+}
+
+void BlueStore::_defrag_thread()
+{
+  std::unique_lock l(defrag_thread.lock);
+  auto params = defrag_thread.params;
+  std::vector<CollectionRef> todo;
+  todo.swap(defrag_thread.todo);
+  l.unlock();
+
+  // score every collection first, then work on the worst ones
+  int r = 0;
+  std::vector<std::pair<CollectionRef, defrag_stats_t>> scored;
+  for (auto& c : todo) {
+    l.lock();
+    defrag_thread.current = stringify(c->cid);
+    l.unlock();
+    ObjectStore::CollectionHandle ch = c;
+    defrag_stats_t stats;
+    r = defrag_collection(ch, params.min_score, 0, true, &stats);
+    if (r == -ENOENT) {
+      r = 0;
+      continue;
+    }
+    if (r < 0) {
+      break;
+    }
+    scored.emplace_back(c, stats);
+  }
+  std::sort(scored.begin(), scored.end(), [](auto& a, auto& b) {
+    return a.second.get_score() > b.second.get_score();
+  });
+  l.lock();
+  for (auto& [c, stats] : scored) {
+    defrag_thread.collections.emplace_back(c->cid, stats);
+  }
+  if (r == 0 && !params.dry_run) {
+    defrag_thread.state = "rewriting";
+  }
+  l.unlock();
+
+  uint64_t left = params.max_objects;
+  for (size_t i = 0; r == 0 && !params.dry_run && i < scored.size(); ++i) {
+    auto& [c, stats] = scored[i];
+    if (left == 0 || stats.get_score() < params.min_score) {
+      break;
+    }
+    l.lock();
+    defrag_thread.current = stringify(c->cid);
+    l.unlock();
+    ObjectStore::CollectionHandle ch = c;
+    stats = defrag_stats_t();
+    r = defrag_collection(ch, params.min_score, left, false, &stats);
+    left -= std::min(left, stats.rewritten);
+    l.lock();
+    defrag_thread.collections[i].second = stats;
+    l.unlock();
+  }
+
+  l.lock();
+  if (r == -ECANCELED) {
+    defrag_thread.state = "cancelled";
+  } else if (r < 0) {
+    derr << __func__ << " " << defrag_thread.current << " failed: "
+	 << cpp_strerror(r) << dendl;
+    defrag_thread.state = "failed";
+  } else {
+    defrag_thread.state = "done";
+  }
+  dout(1) << __func__ << " " << defrag_thread.state << dendl;
+  defrag_thread.result = r;
+  defrag_thread.ended = ceph_clock_now();
+  defrag_thread.current.clear();
+  defrag_thread.running = false;
+  defrag_thread.cancel = false;
+  // from here on the lock is not taken again, so it can be joined under it
+  defrag_thread.cond.notify_all();
+}
+
+void BlueStore::_defrag_stop()
+{
+  std::unique_lock l(defrag_thread.lock);
+  defrag_thread.stopped = true;
+  defrag_thread.cancel = true;
+  defrag_thread.cond.notify_all();
+  defrag_thread.cond.wait(l, [this] { return !defrag_thread.running; });
+  if (defrag_thread.is_started()) {
+    defrag_thread.join();
+  }
+  defrag_thread.cancel = false;
+}
+
 void BlueStore::collect_metadata(map<string,string> *pm)
 {
   dout(10) << __func__ << dendl;
@@ -12655,7 +13461,8 @@ void BlueStore::_read_cache(
 int BlueStore::_prepare_read_ioc(
   blobs2read_t& blobs2read,
   vector<bufferlist>* compressed_blob_bls,
-  IOContext* ioc)
+  IOContext* ioc,
+  L2ReadCache::read_ctx_t* l2ctx)
 {
   for (auto& p : blobs2read) {
     const BlobRef& bptr = p.first;
@@ -12673,6 +13480,9 @@ int BlueStore::_prepare_read_ioc(
       auto r = bptr->get_blob().map(
         0, bptr->get_blob().get_ondisk_length(),
         [&](uint64_t offset, uint64_t length) {
+          if (l2ctx && l2cache->read(offset, length, &bl, l2ctx)) {
+            return 0;
+          }
           int r = bdev->aio_read(offset, length, &bl, ioc);
           if (r < 0)
             return r;
@@ -12700,6 +13510,9 @@ int BlueStore::_prepare_read_ioc(
         auto r = bptr->get_blob().map(
           req.r_off, req.r_len,
           [&](uint64_t offset, uint64_t length) {
+            if (l2ctx && l2cache->read(offset, length, &req.bl, l2ctx)) {
+              return 0;
+            }
             int r = bdev->aio_read(offset, length, &req.bl, ioc);
             if (r < 0)
               return r;
@@ -12730,7 +13543,8 @@ int BlueStore::_generate_read_result_bl(
   blobs2read_t& blobs2read,
   bool buffered,
   bool* csum_error,
-  bufferlist& bl)
+  bufferlist& bl,
+  int l2cache_policy)
 {
  // enumerate and decompress desired blobs
   auto p = compressed_blob_bls.begin();
@@ -12750,6 +13564,9 @@ int BlueStore::_generate_read_result_bl(
         *csum_error = true;
         return -EIO;
       }
+      if (l2cache_policy & L2CACHE_FILL) {
+        _l2cache_fill(bptr->get_blob(), 0, compressed_bl);
+      }
       bufferlist raw_bl;
       auto r = _decompress(compressed_bl, &raw_bl);
       if (r < 0)
@@ -12772,6 +13589,9 @@ int BlueStore::_generate_read_result_bl(
           *csum_error = true;
           return -EIO;
         }
+        if (l2cache_policy & L2CACHE_FILL) {
+          _l2cache_fill(bptr->get_blob(), req.r_off, req.bl);
+        }
 
         // prune and keep result
         for (const auto& r : req.regs) {
@@ -12886,22 +13706,37 @@ int BlueStore::_do_read(
                              // The error isn't that much...
   vector<bufferlist> compressed_blob_bls;
   IOContext ioc(cct, NULL, !cct->_conf->bluestore_fail_eio);
-  r = _prepare_read_ioc(blobs2read, &compressed_blob_bls, &ioc);
+  int l2cache_policy = _get_l2cache_policy(op_flags, retry_count);
+  L2ReadCache::read_ctx_t l2ctx(cct);
+  r = _prepare_read_ioc(blobs2read, &compressed_blob_bls, &ioc,
+			(l2cache_policy & L2CACHE_LOOKUP) ? &l2ctx : nullptr);
   // we always issue aio for reading, so errors other than EIO are not allowed
   if (r < 0)
     return r;
 
   int64_t num_ios = blobs2read.size();
-  if (ioc.has_pending_aios()) {
+  bool submitted = ioc.has_pending_aios();
+  if (submitted) {
     num_ios = ioc.get_num_ios();
     bdev->aio_submit(&ioc);
+  }
+  // l2 cache hits are read in parallel
+  if (!l2ctx.hits.empty()) {
+    l2cache->submit(&l2ctx);
+  }
+  if (submitted) {
     dout(20) << __func__ << " waiting for aio" << dendl;
     ioc.aio_wait();
     r = ioc.get_return_value();
-    if (r < 0) {
-      ceph_assert(r == -EIO); // no other errors allowed
-      return -EIO;
-    }
+  }
+  // even on error, as they are reading into our buffers
+  int l2r = _l2cache_wait(l2ctx);
+  if (r < 0) {
+    ceph_assert(r == -EIO); // no other errors allowed
+    return -EIO;
+  }
+  if (l2r < 0) {
+    return l2r;
   }
   log_latency_fn(__func__,
     l_bluestore_read_wait_aio_lat,
@@ -12915,7 +13750,7 @@ int BlueStore::_do_read(
   r = _generate_read_result_bl(o, offset, length, ready_regions,
                               compressed_blob_bls, blobs2read,
                               buffered && !ioc.skip_cache(),
-                              &csum_error, bl);
+                              &csum_error, bl, l2cache_policy);
   if (csum_error) {
     // Handles spurious read errors caused by a kernel bug.
     // We sometimes get all-zero pages as a result of the read under
@@ -13256,6 +14091,8 @@ int BlueStore::_do_readv(
   _dump_onode<30>(cct, *o);
 
   IOContext ioc(cct, NULL, !cct->_conf->bluestore_fail_eio);
+  int l2cache_policy = _get_l2cache_policy(op_flags, retry_count);
+  L2ReadCache::read_ctx_t l2ctx(cct);
   vector<std::tuple<ready_regions_t, vector<bufferlist>, blobs2read_t>> raw_results;
   raw_results.reserve(m.num_intervals());
   int i = 0;
@@ -13263,23 +14100,37 @@ int BlueStore::_do_readv(
     raw_results.push_back({});
     _read_cache(o, p.get_start(), p.get_len(), read_cache_policy,
                 std::get<0>(raw_results[i]), std::get<2>(raw_results[i]));
-    r = _prepare_read_ioc(std::get<2>(raw_results[i]), &std::get<1>(raw_results[i]), &ioc);
+    r = _prepare_read_ioc(std::get<2>(raw_results[i]), &std::get<1>(raw_results[i]),
+                          &ioc,
+                          (l2cache_policy & L2CACHE_LOOKUP) ? &l2ctx : nullptr);
     // we always issue aio for reading, so errors other than EIO are not allowed
     if (r < 0)
       return r;
   }
 
   auto num_ios = m.size();
-  if (ioc.has_pending_aios()) {
+  bool submitted = ioc.has_pending_aios();
+  if (submitted) {
     num_ios = ioc.get_num_ios();
     bdev->aio_submit(&ioc);
+  }
+  // l2 cache hits are read in parallel
+  if (!l2ctx.hits.empty()) {
+    l2cache->submit(&l2ctx);
+  }
+  if (submitted) {
     dout(20) << __func__ << " waiting for aio" << dendl;
     ioc.aio_wait();
     r = ioc.get_return_value();
-    if (r < 0) {
-      ceph_assert(r == -EIO); // no other errors allowed
-      return -EIO;
-    }
+  }
+  // even on error, as they are reading into our buffers
+  int l2r = _l2cache_wait(l2ctx);
+  if (r < 0) {
+    ceph_assert(r == -EIO); // no other errors allowed
+    return -EIO;
+  }
+  if (l2r < 0) {
+    return l2r;
   }
   log_latency_fn(__func__,
     l_bluestore_read_wait_aio_lat,
@@ -13298,7 +14149,7 @@ int BlueStore::_do_readv(
                                  std::get<0>(raw_results[i]),
                                  std::get<1>(raw_results[i]),
                                  std::get<2>(raw_results[i]),
-                                 buffered, &csum_error, t);
+                                 buffered, &csum_error, t, l2cache_policy);
     if (csum_error) {
       // Handles spurious read errors caused by a kernel bug.
       // We sometimes get all-zero pages as a result of the read under
@@ -13591,10 +14442,12 @@ int BlueStore::_collection_list(
     const KeyValueDB::IteratorBounds bounds = KeyValueDB::IteratorBounds{std::move(kv_low_key), std::move(kv_high_key)};
     if (legacy) {
       it = std::make_unique<SimpleCollectionListIterator>(
-              cct, db->get_iterator(PREFIX_OBJ, 0, std::move(bounds)));
+              cct, db->get_iterator(PREFIX_OBJ, KeyValueDB::ITERATOR_SCAN,
+                              std::move(bounds)));
     } else {
       it = std::make_unique<SortedCollectionListIterator>(
-              db->get_iterator(PREFIX_OBJ, 0, std::move(bounds)));
+              db->get_iterator(PREFIX_OBJ, KeyValueDB::ITERATOR_SCAN,
+                              std::move(bounds)));
     }
     it->lower_bound(low);
     while (it->valid()) {
@@ -13672,7 +14525,8 @@ int BlueStore::_onode_omap_get(
     string head, tail;
     o->get_omap_header(&head);
     o->get_omap_tail(&tail);
-    KeyValueDB::Iterator it = db->get_iterator(prefix, 0, KeyValueDB::IteratorBounds{head, tail});
+    KeyValueDB::Iterator it = db->get_iterator(prefix, KeyValueDB::ITERATOR_SCAN,
+                                               KeyValueDB::IteratorBounds{head, tail});
     it->lower_bound(head);
     while (it->valid()) {
       if (it->key() == head) {
@@ -13757,7 +14611,8 @@ int BlueStore::omap_get_keys(
     string head, tail;
     o->get_omap_key(string(), &head);
     o->get_omap_tail(&tail);
-    KeyValueDB::Iterator it = db->get_iterator(prefix, 0, KeyValueDB::IteratorBounds{head, tail});
+    KeyValueDB::Iterator it = db->get_iterator(prefix, KeyValueDB::ITERATOR_SCAN,
+                                               KeyValueDB::IteratorBounds{head, tail});
     it->lower_bound(head);
     while (it->valid()) {
       if (it->key() >= tail) {
@@ -13811,15 +14666,19 @@ int BlueStore::omap_get_values(
   {
     const string& prefix = o->get_omap_prefix();
     o->get_omap_key(string(), &final_key);
-    size_t base_key_len = final_key.size();
-    for (set<string>::const_iterator p = keys.begin(); p != keys.end(); ++p) {
-      final_key.resize(base_key_len); // keep prefix
-      final_key += *p;
-      bufferlist val;
-      if (db->get(prefix, final_key, &val) >= 0) {
-	dout(30) << __func__ << "  got " << pretty_binary_string(final_key)
+    vector<string> final_keys;
+    final_keys.reserve(keys.size());
+    for (auto& k : keys) {
+      final_keys.emplace_back(final_key + k);
+    }
+    vector<std::optional<bufferlist>> vals;
+    db->get_batch(prefix, final_keys, &vals);
+    auto p = keys.begin();
+    for (size_t n = 0; n < final_keys.size(); ++n, ++p) {
+      if (vals[n]) {
+	dout(30) << __func__ << "  got " << pretty_binary_string(final_keys[n])
 		 << " -> " << *p << dendl;
-	out->insert(make_pair(*p, val));
+	out->emplace_hint(out->end(), *p, std::move(*vals[n]));
       }
     }
   }
@@ -13861,17 +14720,21 @@ int BlueStore::omap_check_keys(
   {
     const string& prefix = o->get_omap_prefix();
     o->get_omap_key(string(), &final_key);
-    size_t base_key_len = final_key.size();
-    for (set<string>::const_iterator p = keys.begin(); p != keys.end(); ++p) {
-      final_key.resize(base_key_len); // keep prefix
-      final_key += *p;
-      bufferlist val;
-      if (db->get(prefix, final_key, &val) >= 0) {
-	dout(30) << __func__ << "  have " << pretty_binary_string(final_key)
+    vector<string> final_keys;
+    final_keys.reserve(keys.size());
+    for (auto& k : keys) {
+      final_keys.emplace_back(final_key + k);
+    }
+    vector<std::optional<bufferlist>> vals;
+    db->get_batch(prefix, final_keys, &vals);
+    auto p = keys.begin();
+    for (size_t n = 0; n < final_keys.size(); ++n, ++p) {
+      if (vals[n]) {
+	dout(30) << __func__ << "  have " << pretty_binary_string(final_keys[n])
 		 << " -> " << *p << dendl;
-	out->insert(*p);
+	out->insert(out->end(), *p);
       } else {
-	dout(30) << __func__ << "  miss " << pretty_binary_string(final_key)
+	dout(30) << __func__ << "  miss " << pretty_binary_string(final_keys[n])
 		 << " -> " << *p << dendl;
       }
     }
@@ -13926,7 +14789,8 @@ int BlueStore::omap_iterate(
       o->get_omap_tail(&upper_bound);
       bounds.lower_bound = std::move(lower_bound);
       bounds.upper_bound = std::move(upper_bound);
-      it = db->get_iterator(o->get_omap_prefix(), 0, std::move(bounds));
+      it = db->get_iterator(o->get_omap_prefix(), KeyValueDB::ITERATOR_SCAN,
+                            std::move(bounds));
     }
   }
 
@@ -14229,7 +15093,8 @@ void BlueStore::get_db_statistics(Formatter *f)
 BlueStore::TransContext *BlueStore::_txc_create(
   Collection *c, OpSequencer *osr,
   list<Context*> *on_commits,
-  TrackedOpRef osd_op)
+  TrackedOpRef osd_op,
+  bool if_prepared)
 {
   TransContext *txc = new TransContext(cct, c, osr, on_commits);
   txc->t = db->get_transaction();
@@ -14244,7 +15109,13 @@ BlueStore::TransContext *BlueStore::_txc_create(
   }
 #endif
 
-  osr->queue_new(txc);
+  if (!if_prepared) {
+    osr->queue_new(txc);
+  } else if (!osr->queue_new_if_prepared(txc)) {
+    dout(20) << __func__ << " osr " << osr << " is preparing a txc" << dendl;
+    delete txc;
+    return nullptr;
+  }
   dout(20) << __func__ << " osr " << osr << " = " << txc
 	  // << " seq " << txc->seq
            << dendl;
@@ -14305,8 +15176,10 @@ void BlueStore::_txc_update_store_statfs(TransContext *txc)
 void BlueStore::_txc_state_proc(TransContext *txc)
 {
   while (true) {
-    dout(10) << __func__ << " txc " << txc
-	     << " " << txc->get_state_name() << dendl;
+    // runs several times per transaction, leave the formatting to the log
+    // thread
+    dout_ring(10, "bluestore({}) {} txc {} {}", path, __func__,
+	      static_cast<const void*>(txc), txc->get_state_name());
     switch (txc->get_state()) {
     case TransContext::STATE_PREPARE:
       throttle.log_state_latency(*txc, logger, l_bluestore_state_prepare_lat);
@@ -14745,6 +15618,9 @@ void BlueStore::_txc_release_alloc(TransContext *txc)
                !alloc)) {
       goto out;
   }
+  if (l2cache) {
+    l2cache->invalidate(txc->released);
+  }
   discard_queued = bdev->try_discard(txc->released);
   // if async discard succeeded, will do alloc->release when discard callback
   // else we should release here
@@ -15420,6 +16296,9 @@ void BlueStore::_deferred_submit_unlock(OpSequencer *osr)
 	dout(20) << __func__ << " write 0x" << std::hex
 		 << start << "~" << bl.length()
 		 << " crc " << bl.crc32c(-1) << std::dec << dendl;
+	if (l2cache) {
+	  l2cache->invalidate(start, bl.length());
+	}
 	if (!g_conf()->bluestore_debug_omit_block_device_write) {
 	  logger->inc(l_bluestore_submitted_deferred_writes);
 	  logger->inc(l_bluestore_submitted_deferred_write_bytes, bl.length());
@@ -15673,17 +16552,7 @@ int BlueStore::queue_transactions(
   _txc_calc_cost(txc);
 
   _txc_write_nodes(txc, txc->t);
-
-  // journal deferred items
-  if (txc->deferred_txn) {
-    txc->deferred_txn->seq = ++deferred_seq;
-    bufferlist bl;
-    encode(*txc->deferred_txn, bl);
-    string key;
-    get_deferred_key(txc->deferred_txn->seq, &key);
-    txc->t->set(PREFIX_DEFERRED, key, bl);
-  }
-
+  _txc_journal_deferred(txc);
   _txc_finalize_kv(txc, txc->t);
 
 #ifdef WITH_BLKIN
@@ -15696,27 +16565,7 @@ int BlueStore::queue_transactions(
     handle->suspend_tp_timeout();
 
   auto tstart = mono_clock::now();
-
-  if (!throttle.try_start_transaction(
-	*db,
-	*txc,
-	tstart)) {
-    // ensure we do not block here because of deferred writes
-    dout(10) << __func__ << " failed get throttle_deferred_bytes, aggressive"
-	     << dendl;
-    ++deferred_aggressive;
-    deferred_try_submit();
-    {
-      // wake up any previously finished deferred events
-      std::lock_guard l(kv_lock);
-      if (!kv_sync_in_progress) {
-	kv_sync_in_progress = true;
-	kv_cond.notify_one();
-      }
-    }
-    throttle.finish_start_transaction(*db, *txc, tstart);
-    --deferred_aggressive;
-  }
+  _txc_throttle_start(txc, tstart);
   auto tend = mono_clock::now();
 
   if (handle)
@@ -15756,6 +16605,43 @@ int BlueStore::queue_transactions(
   return 0;
 }
 
+void BlueStore::_txc_journal_deferred(TransContext *txc)
+{
+  if (txc->deferred_txn) {
+    txc->deferred_txn->seq = ++deferred_seq;
+    bufferlist bl;
+    encode(*txc->deferred_txn, bl);
+    string key;
+    get_deferred_key(txc->deferred_txn->seq, &key);
+    txc->t->set(PREFIX_DEFERRED, key, bl);
+  }
+}
+
+void BlueStore::_txc_throttle_start(TransContext *txc,
+				    mono_clock::time_point tstart)
+{
+  if (!throttle.try_start_transaction(
+	*db,
+	*txc,
+	tstart)) {
+    // ensure we do not block here because of deferred writes
+    dout(10) << __func__ << " failed get throttle_deferred_bytes, aggressive"
+	     << dendl;
+    ++deferred_aggressive;
+    deferred_try_submit();
+    {
+      // wake up any previously finished deferred events
+      std::lock_guard l(kv_lock);
+      if (!kv_sync_in_progress) {
+	kv_sync_in_progress = true;
+	kv_cond.notify_one();
+      }
+    }
+    throttle.finish_start_transaction(*db, *txc, tstart);
+    --deferred_aggressive;
+  }
+}
+
 void BlueStore::_txc_aio_submit(TransContext *txc)
 {
   dout(10) << __func__ << " txc " << txc << dendl;
@@ -15777,6 +16663,12 @@ void BlueStore::_txc_add_transaction(TransContext *txc, Transaction *t)
   
   vector<OnodeRef> ovec(i.objects.size());
 
+  // batch the onode lookups of multi-object ops within a single collection
+  if (cvec.size() == 1 && cvec[0] && i.objects.size() > 1) {
+    std::unique_lock l(cvec[0]->lock);
+    cvec[0]->prefetch_onodes(i.objects);
+  }
+
   for (int pos = 0; i.have_op(); ++pos) {
     Transaction::Op *op = i.decode_op();
     int r = 0;
@@ -16356,6 +17248,9 @@ void BlueStore::_do_write_small(
               b->get_blob().map_bl(
                   b_off, bl,
 		[&](uint64_t offset, bufferlist& t) {
+                    if (l2cache) {
+                      l2cache->invalidate(offset, t.length());
+                    }
                     bdev->aio_write(offset, t,
 				  &txc->ioc, wctx->buffered);
                   });
@@ -16757,7 +17652,7 @@ void BlueStore::_do_write_big(
     uint32_t l = 0;
 
     //attempting to reuse existing blob
-    if (!wctx->compress) {
+    if (!wctx->compress && !wctx->new_blobs) {
       // enforce target blob alignment with max_bsize
       l = max_bsize - p2phase(offset, max_bsize);
       l = std::min(uint64_t(l), length);
@@ -16910,10 +17805,11 @@ void BlueStore::_do_write_big(
 	}
       } while (b == nullptr && any_change);
     } else {
-      // trying to utilize as longer chunk as permitted in case of compression.
+      // trying to utilize as longer chunk as permitted in case of compression
+      // or of a rewrite into new blobs.
       l = std::min(max_bsize, length);
       o->extent_map.punch_hole(c, offset, l, &wctx->old_extents);
-    } // if (!wctx->compress)
+    } // if (!wctx->compress && !wctx->new_blobs)
 
     if (b == nullptr) {
       b = c->new_blob();
@@ -18402,7 +19298,8 @@ int BlueStore::_clone(TransContext *txc,
     string head, tail;
     oldo->get_omap_header(&head);
     oldo->get_omap_tail(&tail);
-    KeyValueDB::Iterator it = db->get_iterator(prefix, 0, KeyValueDB::IteratorBounds{head, tail});
+    KeyValueDB::Iterator it = db->get_iterator(prefix, KeyValueDB::ITERATOR_SCAN,
+                                               KeyValueDB::IteratorBounds{head, tail});
     it->lower_bound(head);
     while (it->valid()) {
       if (it->key() >= tail) {
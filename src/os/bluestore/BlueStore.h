@@ -57,6 +57,7 @@
 #include "bluestore_types.h"
 #include "bluestore_common.h"
 #include "BlueFS.h"
+#include "L2ReadCache.h"
 #include "common/EventTrace.h"
 #include "common/admin_socket.h"
 
@@ -194,6 +195,8 @@ enum {
   l_bluestore_blob_split,
   l_bluestore_extent_compress,
   l_bluestore_gc_merged,
+  l_bluestore_defrag_objects,
+  l_bluestore_defrag_bytes,
   //****************************************
 
   // misc
@@ -1655,6 +1658,8 @@ public:
       return onode_space.cache;
     }
     OnodeRef get_onode(const ghobject_t& oid, bool create, bool is_createop=false);
+    /// load the onodes of not yet cached objects with one batched kv lookup
+    void prefetch_onodes(const std::vector<ghobject_t>& oids);
 
     // the terminology is confusing here, sorry!
     //
@@ -2172,6 +2177,16 @@ public:
       std::lock_guard l(qlock);
       q.push_back(*txc);
     }
+    /// queue txc unless a preceding transaction is still being prepared
+    bool queue_new_if_prepared(TransContext *txc) {
+      std::lock_guard l(qlock);
+      if (!q.empty() &&
+	  q.back().get_state() == TransContext::STATE_PREPARE) {
+	return false;
+      }
+      q.push_back(*txc);
+      return true;
+    }
     void undo_queue(TransContext* txc) {
       std::lock_guard l(qlock);
       ceph_assert(&q.back() == txc);
@@ -2321,6 +2336,8 @@ private:
 
   KeyValueDB *db = nullptr;
   BlockDevice *bdev = nullptr;
+  std::unique_ptr<L2ReadCache> l2cache; ///< optional read cache on a fast device
+  uint64_t l2cache_token = 0;           ///< validates the persisted l2cache index
   std::string freelist_type;
   FreelistManager *fm = nullptr;
 
@@ -2452,6 +2469,8 @@ private:
   double cache_meta_ratio = 0;   ///< cache ratio dedicated to metadata
   double cache_kv_ratio = 0;     ///< cache ratio dedicated to kv (e.g., rocksdb)
   double cache_kv_onode_ratio = 0; ///< cache ratio dedicated to kv onodes (e.g., rocksdb onode CF)
+  bool cache_kv_cf_autotune = false; ///< balance kv column family caches by hits
+  double cache_kv_cf_min_share = 0; ///< min part of the kv share per column family cache
   double cache_data_ratio = 0;   ///< cache ratio dedicated to object data
   bool cache_autotune = false;   ///< cache autotune setting
   double cache_age_bin_interval = 0; ///< time to wait between cache age bin rotations
@@ -2503,6 +2522,10 @@ private:
     bool stop = false;
     std::shared_ptr<PriorityCache::PriCache> binned_kv_cache = nullptr;
     std::shared_ptr<PriorityCache::PriCache> binned_kv_onode_cache = nullptr;
+    /// other column families with a cache of their own, by prefix
+    std::map<std::string, std::shared_ptr<PriorityCache::PriCache>> binned_kv_cf_caches;
+    /// lookup hits and misses at the last balance, by prefix ("" is kv)
+    std::map<std::string, std::pair<uint64_t, uint64_t>> kv_lookup_stats;
     std::shared_ptr<PriorityCache::Manager> pcm = nullptr;
 
     struct MempoolCache : public PriorityCache::PriCache {
@@ -2723,6 +2746,7 @@ private:
 
   private:
     void _update_cache_settings();
+    void _update_kv_cache_ratios();
     void _resize_shards(bool interval_stats);
 
     mono_clock::time_point last_fragmentation_check;
@@ -2761,6 +2785,10 @@ private:
   void _validate_bdev();
   void _close_bdev();
 
+  void _consume_l2cache_token();
+  int _open_l2cache();
+  void _close_l2cache();
+
   int _minimal_open_bluefs(bool create);
   void _minimal_close_bluefs();
   int _open_bluefs(bool create, bool read_only);
@@ -2856,13 +2884,19 @@ private:
   template <int LogLevelV>
   friend void _dump_transaction(CephContext *cct, Transaction *t);
 
+  /// with if_prepared, nullptr if a txc queued on osr is still being
+  /// prepared, as the new one could then be applied before it
   TransContext *_txc_create(Collection *c, OpSequencer *osr,
 			    std::list<Context*> *on_commits,
-			    TrackedOpRef osd_op=TrackedOpRef());
+			    TrackedOpRef osd_op=TrackedOpRef(),
+			    bool if_prepared=false);
   void _txc_update_store_statfs(TransContext *txc);
   void _txc_add_transaction(TransContext *txc, Transaction *t);
   void _txc_calc_cost(TransContext *txc);
   void _txc_write_nodes(TransContext *txc, KeyValueDB::Transaction t);
+  void _txc_journal_deferred(TransContext *txc);
+  void _txc_throttle_start(TransContext *txc,
+			   ceph::mono_clock::time_point tstart);
   void _txc_state_proc(TransContext *txc);
   void _txc_aio_submit(TransContext *txc);
 public:
@@ -3069,6 +3103,22 @@ public:
   static int get_block_device_fsid(CephContext* cct, const std::string& path,
 				   uuid_d *fsid);
 
+  struct kv_cache_share_t {
+    double ratio = 0;    ///< cache ratio, updated by split_kv_cache_ratios()
+    double density = 0;  ///< lookup hits per cached MiB since the last split
+  };
+  /**
+   * Split the kv cache ratios between the kv caches, by prefix ("" is the
+   * default cache, "O" kv_onode if it has a cache of its own).
+   *
+   * Without by_density the other caches share kv_ratio evenly with the
+   * default one.  With it the kv and kv_onode ratios together move half
+   * way towards a split by density, each cache keeping at least min_share.
+   */
+  static void split_kv_cache_ratios(
+    double kv_ratio, double kv_onode_ratio, double min_share, bool by_density,
+    std::map<std::string, kv_cache_share_t>& caches);
+
   bool test_mount_in_use() override;
 
 private:
@@ -3252,10 +3302,18 @@ private:
     blobs2read_t& blobs2read);
 
 
+  enum {
+    L2CACHE_LOOKUP = 1, ///< serve reads from the l2 read cache
+    L2CACHE_FILL = 2,   ///< offer verified reads to the l2 read cache
+  };
+  int _get_l2cache_policy(uint32_t op_flags, uint64_t retry_count) const;
+
+  /// l2 cache hits are queued to l2ctx, if given, rather than to ioc
   int _prepare_read_ioc(
     blobs2read_t& blobs2read,
     std::vector<ceph::buffer::list>* compressed_blob_bls,
-    IOContext* ioc);
+    IOContext* ioc,
+    L2ReadCache::read_ctx_t* l2ctx = nullptr);
 
   int _generate_read_result_bl(
     OnodeRef& o,
@@ -3266,7 +3324,12 @@ private:
     blobs2read_t& blobs2read,
     bool buffered,
     bool* csum_error,
-    ceph::buffer::list& bl);
+    ceph::buffer::list& bl,
+    int l2cache_policy = 0);
+  void _l2cache_fill(const bluestore_blob_t& blob, uint64_t b_off,
+		     const ceph::buffer::list& bl);
+  /// wait for the l2 cache hits, reading those that failed from bdev
+  int _l2cache_wait(L2ReadCache::read_ctx_t& l2ctx);
 
   int _do_read(
     Collection *c,
@@ -3487,6 +3550,57 @@ public:
   bool has_builtin_csum() const override {
     return true;
   }
+
+  struct defrag_stats_t {
+    uint64_t objects = 0;          ///< objects scanned
+    uint64_t extents = 0;          ///< physical extents referenced
+    uint64_t ideal_extents = 0;    ///< extents if every object was contiguous
+    uint64_t rewritten = 0;        ///< objects rewritten
+    uint64_t rewritten_bytes = 0;
+    uint64_t extents_before = 0;   ///< extents of the rewritten objects
+    uint64_t extents_after = 0;    ///< ... and once they were rewritten
+
+    static double score(uint64_t extents, uint64_t ideal) {
+      return extents > ideal ? 1.0 - (double)ideal / extents : 0.0;
+    }
+    double get_score() const {
+      return score(extents, ideal_extents);
+    }
+    double get_score_after() const {
+      return score(extents - extents_before + extents_after, ideal_extents);
+    }
+    void dump(ceph::Formatter *f) const;
+  };
+  /**
+   * Online defragmentation of a collection.
+   *
+   * Scores every object of the collection by the number of physical
+   * extents it references, without caching the onodes it has to load.
+   * If the collection scores at least min_score, objects scoring at least
+   * min_score are rewritten into newly allocated blobs, in pieces of
+   * bluestore_defrag_chunk_size, and their extent map is resharded; at
+   * most max_objects of them and throttled by
+   * bluestore_defrag_max_bytes_per_sec.  Objects referencing shared blobs
+   * (clones) are never rewritten.  Returns -ECANCELED if a background run
+   * is cancelled.
+   */
+  int defrag_collection(CollectionHandle& ch, double min_score,
+			uint64_t max_objects, bool dry_run,
+			defrag_stats_t *stats);
+
+  struct defrag_params_t {
+    std::string collection;        ///< a collection, or every PG if empty
+    double min_score = 0;
+    uint64_t max_objects = 0;      ///< in total, over all collections
+    bool dry_run = false;
+  };
+  /// start defragmenting in the background, the worst scoring collections
+  /// first; -EBUSY if a run is in progress
+  int defrag_start(const defrag_params_t& params, std::ostream& ss);
+  /// ask the run in progress to stop; -ENOENT if there is none
+  int defrag_cancel();
+  /// progress of the run in progress, or results of the last one
+  void defrag_dump_status(ceph::Formatter *f);
   // a debug punch_hole function, to use internals of _wctx_finish
   // to remove old_extents from object
   void debug_punch_hole(
@@ -3560,6 +3674,48 @@ public:
     int idx2 = l_bluestore_first);
 
 private:
+  struct DefragThread : public Thread {
+    BlueStore *store;
+    ceph::mutex lock = ceph::make_mutex("BlueStore::DefragThread::lock");
+    ceph::condition_variable cond;
+    bool running = false;   ///< a run was started and has not ended
+    bool cancel = false;    ///< the run should stop as soon as it can
+    bool stopped = true;    ///< not mounted for writing, no new runs
+    defrag_params_t params;
+    std::vector<CollectionRef> todo;
+    // status of the current or last run
+    const char *state = "idle";
+    int result = 0;
+    utime_t started, ended;
+    std::string current;    ///< collection being scanned or rewritten
+    std::vector<std::pair<coll_t, defrag_stats_t>> collections;
+    explicit DefragThread(BlueStore *s) : store(s) {}
+    void *entry() override {
+      store->_defrag_thread();
+      return NULL;
+    }
+  };
+  DefragThread defrag_thread;
+
+  /// count physical extents of o and the minimum it could be stored in;
+  /// returns false if o can not be rewritten
+  bool _get_onode_fragmentation(OnodeRef& o, uint64_t *extents,
+				uint64_t *ideal,
+				interval_set<uint64_t> *mapped);
+  /// o from the onode cache, or else decoded without caching it
+  OnodeRef _defrag_get_onode(Collection *c, const ghobject_t& oid);
+  int _defrag_object(CollectionRef& c, const ghobject_t& oid,
+		     double min_score, mono_clock::time_point start,
+		     defrag_stats_t *stats);
+  int _defrag_chunk(CollectionRef& c, const ghobject_t& oid,
+		    uint64_t offset, uint64_t length, uint64_t *bytes);
+  /// sleep for as long as bluestore_defrag_max_bytes_per_sec asks for
+  /// having rewritten bytes since start; false if cancelled meanwhile
+  bool _defrag_throttle(mono_clock::time_point start, uint64_t bytes);
+  bool _defrag_wait(ceph::timespan t);
+  void _defrag_thread();
+  void _defrag_stop();
+
   bool _debug_data_eio(const ghobject_t& o) {
     if (!cct->_conf->bluestore_debug_inject_read_err) {
       return false;
@@ -3646,6 +3802,7 @@ private:
     uint8_t csum_type = 0;          ///< checksum type for new blobs
     unsigned csum_order = 0;        ///< target checksum chunk order
     uint64_t target_blob_size = 0;  ///< target (max) blob size
+    bool new_blobs = false;         ///< big writes never reuse blobs
 
     old_extent_map_t old_extents;   ///< must deref these blobs
     interval_set<uint64_t> extents_to_gc; ///< extents for garbage collection
@@ -3693,6 +3850,7 @@ private:
     void fork(const WriteContext& other) {
       buffered = other.buffered;
       compress = other.compress;
+      new_blobs = other.new_blobs;
       target_blob_size = other.target_blob_size;
       csum_type = other.csum_type;
       csum_order = other.csum_order;
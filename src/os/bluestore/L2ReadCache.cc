@@ -0,0 +1,770 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ */
+
+#include <limits>
+
+#include "L2ReadCache.h"
+
+#include "blk/BlockDevice.h"
+#include "common/Clock.h"
+#include "common/debug.h"
+#include "common/errno.h"
+#include "common/Formatter.h"
+#include "include/intarith.h"
+#include "include/random.h"
+
+#ifdef WITH_CRIMSON
+#include "crimson/common/perf_counters_collection.h"
+#else
+#include "common/perf_counters_collection.h"
+#endif
+
+#define dout_context cct
+#define dout_subsys ceph_subsys_bluestore
+#undef dout_prefix
+#define dout_prefix *_dout << "bluestore.l2cache(" << this << ") "
+
+using ceph::bufferlist;
+using ceph::decode;
+using ceph::encode;
+
+static const std::string L2CACHE_MAGIC = "ceph bluestore l2cache v1\n";
+
+static uint32_t block_mask(unsigned first, unsigned count)
+{
+  uint64_t m = (count >= 32 ? 0xffffffffull : ((1ull << count) - 1));
+  return static_cast<uint32_t>(m << first);
+}
+
+L2ReadCache::L2ReadCache(CephContext *cct, uint64_t block_size)
+  : cct(cct),
+    block_size(block_size),
+    writer_thread(this)
+{
+}
+
+L2ReadCache::~L2ReadCache()
+{
+  ceph_assert(bdev == nullptr);
+}
+
+void L2ReadCache::_init_logger()
+{
+  PerfCountersBuilder b(cct, "bluestore-l2cache",
+			l_bluestore_l2cache_first, l_bluestore_l2cache_last);
+  b.add_u64_counter(l_bluestore_l2cache_hit, "hit",
+		    "Reads served from the l2 cache", "l2h",
+		    PerfCountersBuilder::PRIO_USEFUL);
+  b.add_u64_counter(l_bluestore_l2cache_hit_bytes, "hit_bytes",
+		    "Bytes served from the l2 cache", nullptr,
+		    PerfCountersBuilder::PRIO_USEFUL, unit_t(UNIT_BYTES));
+  b.add_u64_counter(l_bluestore_l2cache_miss, "miss",
+		    "Reads not found in the l2 cache", "l2m",
+		    PerfCountersBuilder::PRIO_USEFUL);
+  b.add_u64_counter(l_bluestore_l2cache_admitted, "admitted",
+		    "Units filled into the l2 cache");
+  b.add_u64_counter(l_bluestore_l2cache_rejected, "rejected",
+		    "Units rejected by the admission filter");
+  b.add_u64_counter(l_bluestore_l2cache_dropped, "dropped",
+		    "Fills dropped due to invalidation or backlog");
+  b.add_u64_counter(l_bluestore_l2cache_evicted, "evicted",
+		    "Units evicted from the l2 cache");
+  b.add_u64_counter(l_bluestore_l2cache_invalidated, "invalidated",
+		    "Units invalidated by writes or releases");
+  b.add_u64_counter(l_bluestore_l2cache_csum_err, "csum_err",
+		    "Cached blocks failing checksum on read back");
+  b.add_u64(l_bluestore_l2cache_units, "units",
+	    "Units currently cached");
+  b.add_time_avg(l_bluestore_l2cache_read_lat, "read_lat",
+		 "Average l2 cache hit latency");
+  logger = b.create_perf_counters();
+  cct->get_perfcounters_collection()->add(logger);
+}
+
+void L2ReadCache::_shutdown_logger()
+{
+  if (logger) {
+    cct->get_perfcounters_collection()->remove(logger);
+    delete logger;
+    logger = nullptr;
+  }
+}
+
+int L2ReadCache::open(const std::string& path, const uuid_d& _fsid,
+		      uint64_t token)
+{
+  dout(1) << __func__ << " " << path << dendl;
+  ceph_assert(bdev == nullptr);
+  fsid = _fsid;
+  bdev = BlockDevice::create(cct, path, nullptr, nullptr, nullptr, nullptr,
+			     "l2cache");
+  int r = bdev->open(path);
+  if (r < 0) {
+    derr << __func__ << " failed to open " << path << ": "
+	 << cpp_strerror(r) << dendl;
+    delete bdev;
+    bdev = nullptr;
+    return r;
+  }
+  if (block_size % bdev->get_block_size()) {
+    derr << __func__ << " cache device block size 0x" << std::hex
+	 << bdev->get_block_size() << " incompatible with main block size 0x"
+	 << block_size << std::dec << dendl;
+    r = -EINVAL;
+    goto fail;
+  }
+
+  unit_size = p2roundup<uint64_t>(
+    cct->_conf.get_val<Option::size_t>("bluestore_l2cache_unit_size"),
+    block_size);
+  unit_size = std::min<uint64_t>(unit_size, MAX_BLOCKS_PER_UNIT * block_size);
+  blocks_per_unit = unit_size / block_size;
+  max_pending_bytes =
+    cct->_conf.get_val<Option::size_t>("bluestore_l2cache_max_pending_bytes");
+
+  {
+    uint64_t size = bdev->get_size();
+    uint64_t limit = cct->_conf.get_val<Option::size_t>("bluestore_l2cache_size");
+    if (limit) {
+      size = std::min(size, limit);
+    }
+    // unit, slot, valid mask and one csum per block
+    uint64_t per_slot_index = sizeof(uint64_t) + 2 * sizeof(uint32_t) +
+      blocks_per_unit * sizeof(uint32_t);
+    index_offset = block_size;
+    uint64_t slot_estimate = size > index_offset ?
+      (size - index_offset) / (unit_size + per_slot_index) : 0;
+    index_max = p2roundup(slot_estimate * per_slot_index + block_size,
+			  block_size);
+    data_offset = p2roundup(index_offset + index_max, unit_size);
+    num_slots = size > data_offset ? (size - data_offset) / unit_size : 0;
+  }
+  if (num_slots == 0) {
+    derr << __func__ << " cache device too small" << dendl;
+    r = -ENOSPC;
+    goto fail;
+  }
+
+  slots.resize(num_slots);
+  for (uint32_t i = 0; i < num_slots; ++i) {
+    slots[i].slot = i;
+  }
+  doorkeeper.assign(num_slots * 4, false);
+  _init_logger();
+
+  {
+    super_t super;
+    r = _read_super(&super);
+    if (r == 0 &&
+	super.fsid == fsid &&
+	token != 0 && super.token == token &&
+	super.block_size == block_size &&
+	super.unit_size == unit_size &&
+	super.num_slots == num_slots) {
+      r = _load_index(super);
+      if (r < 0) {
+	derr << __func__ << " failed to load index: " << cpp_strerror(r)
+	     << ", starting empty" << dendl;
+      }
+    } else {
+      dout(1) << __func__ << " no valid index to reload, starting empty"
+	      << dendl;
+    }
+    if (unit_map.empty()) {
+      free_slots.clear();
+      for (uint32_t i = num_slots; i > 0; --i) {
+	free_slots.push_back(i - 1);
+      }
+    }
+
+    // anything we reloaded is only valid until the next clean close()
+    super_t fresh;
+    fresh.fsid = fsid;
+    fresh.block_size = block_size;
+    fresh.unit_size = unit_size;
+    fresh.num_slots = num_slots;
+    r = _write_super(fresh);
+    if (r < 0) {
+      derr << __func__ << " failed to write super: " << cpp_strerror(r)
+	   << dendl;
+      _shutdown_logger();
+      goto fail;
+    }
+  }
+  logger->set(l_bluestore_l2cache_units, unit_map.size());
+  stop = false;
+  writer_thread.create("bstore_l2cache");
+  dout(1) << __func__ << " " << num_slots << " slots of 0x" << std::hex
+	  << unit_size << std::dec << ", " << unit_map.size()
+	  << " units reloaded" << dendl;
+  return 0;
+
+ fail:
+  bdev->close();
+  delete bdev;
+  bdev = nullptr;
+  return r;
+}
+
+void L2ReadCache::close(uint64_t *token)
+{
+  dout(1) << __func__ << dendl;
+  *token = 0;
+  if (!bdev) {
+    return;
+  }
+  {
+    std::lock_guard l(lock);
+    stop = true;
+    cond.notify_all();
+  }
+  writer_thread.join();
+
+  super_t super;
+  super.fsid = fsid;
+  super.block_size = block_size;
+  super.unit_size = unit_size;
+  super.num_slots = num_slots;
+  int r = _save_index(&super);
+  if (r == 0) {
+    super.token = ceph::util::generate_random_number<uint64_t>(
+      1, std::numeric_limits<uint64_t>::max());
+    r = _write_super(super);
+  }
+  if (r == 0) {
+    *token = super.token;
+  } else {
+    derr << __func__ << " failed to persist index: " << cpp_strerror(r)
+	 << dendl;
+  }
+
+  bdev->close();
+  delete bdev;
+  bdev = nullptr;
+  slots.clear();
+  free_slots.clear();
+  unit_map.clear();
+  lru.clear();
+  inflight.clear();
+  _shutdown_logger();
+}
+
+int L2ReadCache::_write_super(const super_t& super)
+{
+  bufferlist bl;
+  bl.append(L2CACHE_MAGIC);
+  encode(super, bl);
+  uint32_t crc = bl.crc32c(-1);
+  encode(crc, bl);
+  ceph_assert(bl.length() <= block_size);
+  bl.append_zero(block_size - bl.length());
+  int r = bdev->write(0, bl, false);
+  if (r == 0) {
+    r = bdev->flush();
+  }
+  return r;
+}
+
+int L2ReadCache::_read_super(super_t *super)
+{
+  bufferlist bl;
+  IOContext ioc(cct, nullptr);
+  int r = bdev->read(0, block_size, &bl, &ioc, false);
+  if (r < 0) {
+    return r;
+  }
+  try {
+    auto p = bl.cbegin();
+    std::string magic;
+    p.copy(L2CACHE_MAGIC.length(), magic);
+    if (magic != L2CACHE_MAGIC) {
+      return -ENOENT;
+    }
+    decode(*super, p);
+    bufferlist t;
+    t.substr_of(bl, 0, p.get_off());
+    uint32_t crc, expected_crc = t.crc32c(-1);
+    decode(crc, p);
+    if (crc != expected_crc) {
+      derr << __func__ << " bad super crc" << dendl;
+      return -EIO;
+    }
+  } catch (ceph::buffer::error& e) {
+    derr << __func__ << " unable to decode super: " << e.what() << dendl;
+    return -EIO;
+  }
+  return 0;
+}
+
+int L2ReadCache::_load_index(const super_t& super)
+{
+  if (super.index_length == 0) {
+    return 0;
+  }
+  if (super.index_length > index_max) {
+    return -EINVAL;
+  }
+  bufferlist bl;
+  IOContext ioc(cct, nullptr);
+  int r = bdev->read(index_offset, p2roundup(super.index_length, block_size),
+		     &bl, &ioc, false);
+  if (r < 0) {
+    return r;
+  }
+  bufferlist index;
+  index.substr_of(bl, 0, super.index_length);
+  if (index.crc32c(-1) != super.index_crc) {
+    return -EIO;
+  }
+  std::vector<bool> used(num_slots, false);
+  try {
+    auto p = index.cbegin();
+    uint64_t n;
+    decode(n, p);
+    while (n--) {
+      uint64_t unit;
+      uint32_t slot, valid;
+      decode(unit, p);
+      decode(slot, p);
+      decode(valid, p);
+      if (slot >= num_slots || used[slot] || unit % unit_size) {
+	throw ceph::buffer::malformed_input("bad index entry");
+      }
+      entry_t& e = slots[slot];
+      e.unit = unit;
+      e.valid = valid & block_mask(0, blocks_per_unit);
+      for (unsigned i = 0; i < blocks_per_unit; ++i) {
+	if (valid & (1u << i)) {
+	  decode(e.csum[i], p);
+	}
+      }
+      used[slot] = true;
+      unit_map[unit] = slot;
+      // entries were saved MRU first
+      lru.push_back(e);
+    }
+  } catch (ceph::buffer::error& e) {
+    derr << __func__ << " unable to decode index: " << e.what() << dendl;
+    lru.clear();
+    unit_map.clear();
+    for (auto& e : slots) {
+      e.valid = 0;
+    }
+    return -EIO;
+  }
+  free_slots.clear();
+  for (uint32_t i = num_slots; i > 0; --i) {
+    if (!used[i - 1]) {
+      free_slots.push_back(i - 1);
+    }
+  }
+  return 0;
+}
+
+int L2ReadCache::_save_index(super_t *super)
+{
+  bufferlist bl;
+  uint64_t n = 0;
+  for (auto& e : lru) {
+    if (e.valid) {
+      ++n;
+    }
+  }
+  encode(n, bl);
+  for (auto& e : lru) {
+    if (!e.valid) {
+      continue;
+    }
+    encode(e.unit, bl);
+    encode(e.slot, bl);
+    encode(e.valid, bl);
+    for (unsigned i = 0; i < blocks_per_unit; ++i) {
+      if (e.valid & (1u << i)) {
+	encode(e.csum[i], bl);
+      }
+    }
+  }
+  if (bl.length() > index_max) {
+    return -ENOSPC;
+  }
+  super->index_length = bl.length();
+  super->index_crc = bl.crc32c(-1);
+  bl.append_zero(p2roundup<uint64_t>(bl.length(), block_size) - bl.length());
+  int r = bdev->write(index_offset, bl, false);
+  if (r == 0) {
+    r = bdev->flush();
+  }
+  return r;
+}
+
+bool L2ReadCache::_admit(uint64_t unit)
+{
+  uint64_t h = (unit / unit_size) * 0x9E3779B97F4A7C15ull;
+  size_t idx = (h >> 17) % doorkeeper.size();
+  if (doorkeeper[idx]) {
+    return true;
+  }
+  doorkeeper[idx] = true;
+  // age the filter so that only recent repeated misses are admitted
+  if (++doorkeeper_count > doorkeeper.size() / 2) {
+    doorkeeper.assign(doorkeeper.size(), false);
+    doorkeeper_count = 0;
+  }
+  return false;
+}
+
+void L2ReadCache::_touch(entry_t& e)
+{
+  lru.erase(lru.iterator_to(e));
+  lru.push_front(e);
+}
+
+void L2ReadCache::_invalidate_unit(uint64_t unit)
+{
+  inflight.erase(unit);
+  auto p = unit_map.find(unit);
+  if (p == unit_map.end()) {
+    return;
+  }
+  entry_t& e = slots[p->second];
+  lru.erase(lru.iterator_to(e));
+  e.valid = 0;
+  free_slots.push_back(e.slot);
+  unit_map.erase(p);
+  logger->inc(l_bluestore_l2cache_invalidated);
+  logger->dec(l_bluestore_l2cache_units);
+}
+
+int L2ReadCache::_get_slot(uint64_t unit, uint32_t *slot)
+{
+  auto p = unit_map.find(unit);
+  if (p != unit_map.end()) {
+    *slot = p->second;
+    return 0;
+  }
+  if (free_slots.empty()) {
+    if (lru.empty()) {
+      return -ENOSPC;
+    }
+    entry_t& victim = lru.back();
+    lru.pop_back();
+    unit_map.erase(victim.unit);
+    victim.valid = 0;
+    free_slots.push_back(victim.slot);
+    logger->inc(l_bluestore_l2cache_evicted);
+    logger->dec(l_bluestore_l2cache_units);
+  }
+  uint32_t s = free_slots.back();
+  free_slots.pop_back();
+  entry_t& e = slots[s];
+  e.unit = unit;
+  e.valid = 0;
+  unit_map[unit] = s;
+  lru.push_front(e);
+  logger->inc(l_bluestore_l2cache_units);
+  *slot = s;
+  return 0;
+}
+
+bool L2ReadCache::read(uint64_t offset, uint64_t length, bufferlist *bl,
+		       read_ctx_t *ctx)
+{
+  if (length == 0 || offset % block_size || length % block_size) {
+    return false;
+  }
+  read_ctx_t::hit_t h{offset, length};
+  {
+    std::lock_guard l(lock);
+    uint64_t pos = offset;
+    uint64_t end = offset + length;
+    while (pos < end) {
+      uint64_t unit = _unit_of(pos);
+      auto p = unit_map.find(unit);
+      if (p == unit_map.end()) {
+	logger->inc(l_bluestore_l2cache_miss);
+	return false;
+      }
+      entry_t& e = slots[p->second];
+      uint64_t l = std::min(end, unit + unit_size) - pos;
+      unsigned first = (pos - unit) / block_size;
+      unsigned count = l / block_size;
+      uint32_t need = block_mask(first, count);
+      if ((e.valid & need) != need) {
+	logger->inc(l_bluestore_l2cache_miss);
+	return false;
+      }
+      h.pieces.emplace_back(
+	read_ctx_t::piece_t{unit, e.slot, first, count, e.csum});
+      _touch(e);
+      pos += l;
+    }
+  }
+
+  // read back outside of the lock; a concurrent eviction is caught by
+  // the per block checksum once the data is there
+  for (auto& p : h.pieces) {
+    int r = bdev->aio_read(_slot_offset(p.slot) + p.first * block_size,
+			   p.count * block_size, &h.data, &ctx->ioc);
+    if (r < 0) {
+      derr << __func__ << " cache device read failed: " << cpp_strerror(r)
+	   << dendl;
+      logger->inc(l_bluestore_l2cache_miss);
+      return false;
+    }
+  }
+  bl->append(h.data);
+  ctx->hits.push_back(std::move(h));
+  return true;
+}
+
+void L2ReadCache::submit(read_ctx_t *ctx)
+{
+  ctx->start = mono_clock::now();
+  if (ctx->ioc.has_pending_aios()) {
+    bdev->aio_submit(&ctx->ioc);
+  }
+}
+
+unsigned L2ReadCache::wait(read_ctx_t *ctx)
+{
+  if (ctx->hits.empty()) {
+    return 0;
+  }
+  ctx->ioc.aio_wait();
+  int r = ctx->ioc.get_return_value();
+  if (r < 0) {
+    derr << __func__ << " cache device read failed: " << cpp_strerror(r)
+	 << dendl;
+  }
+  unsigned failed = 0;
+  for (auto& h : ctx->hits) {
+    uint64_t pos = 0;
+    for (auto p = h.pieces.begin(); r >= 0 && p != h.pieces.end(); ++p) {
+      unsigned i = 0;
+      for (; i < p->count; ++i, pos += block_size) {
+	bufferlist b;
+	b.substr_of(h.data, pos, block_size);
+	if (b.crc32c(-1) != p->csum[p->first + i]) {
+	  break;
+	}
+      }
+      if (i < p->count) {
+	dout(10) << __func__ << " csum mismatch unit 0x" << std::hex << p->unit
+		 << " block " << std::dec << (p->first + i) << dendl;
+	logger->inc(l_bluestore_l2cache_csum_err);
+	std::lock_guard l(lock);
+	auto q = unit_map.find(p->unit);
+	if (q != unit_map.end() && q->second == p->slot) {
+	  _invalidate_unit(p->unit);
+	}
+	h.failed = true;
+	break;
+      }
+    }
+    if (r < 0 || h.failed) {
+      h.failed = true;
+      ++failed;
+      logger->inc(l_bluestore_l2cache_miss);
+    } else {
+      logger->inc(l_bluestore_l2cache_hit);
+      logger->inc(l_bluestore_l2cache_hit_bytes, h.length);
+    }
+  }
+  logger->tinc(l_bluestore_l2cache_read_lat, mono_clock::now() - ctx->start);
+  return failed;
+}
+
+bool L2ReadCache::read(uint64_t offset, uint64_t length, bufferlist *bl)
+{
+  read_ctx_t ctx(cct);
+  bufferlist t;
+  if (!read(offset, length, &t, &ctx)) {
+    return false;
+  }
+  submit(&ctx);
+  if (wait(&ctx)) {
+    return false;
+  }
+  bl->claim_append(t);
+  return true;
+}
+
+void L2ReadCache::insert(uint64_t offset, const bufferlist& bl)
+{
+  uint64_t start = p2roundup(offset, block_size);
+  uint64_t end = p2align<uint64_t>(offset + bl.length(), block_size);
+  if (start >= end) {
+    return;
+  }
+  std::lock_guard l(lock);
+  if (stop) {
+    return;
+  }
+  uint64_t pos = start;
+  while (pos < end) {
+    uint64_t unit = _unit_of(pos);
+    uint64_t unit_end = std::min(end, unit + unit_size);
+    uint32_t mask = block_mask((pos - unit) / block_size,
+			       (unit_end - pos) / block_size);
+    auto p = unit_map.find(unit);
+    if (p != unit_map.end()) {
+      mask &= ~slots[p->second].valid;
+    } else if (!inflight.count(unit) && !_admit(unit)) {
+      logger->inc(l_bluestore_l2cache_rejected);
+      mask = 0;
+    }
+    if (mask) {
+      if (inflight.count(unit) ||
+	  pending_bytes + (unit_end - pos) > max_pending_bytes) {
+	logger->inc(l_bluestore_l2cache_dropped);
+      } else {
+	fill_t f;
+	f.id = ++last_fill_id;
+	f.unit = unit;
+	f.mask = mask;
+	for (unsigned i = 0; i < blocks_per_unit; ++i) {
+	  if (mask & (1u << i)) {
+	    bufferlist b;
+	    b.substr_of(bl, unit + i * block_size - offset, block_size);
+	    f.data.claim_append(b);
+	  }
+	}
+	inflight[unit] = f.id;
+	pending_bytes += f.data.length();
+	pending.emplace_back(std::move(f));
+	cond.notify_one();
+      }
+    }
+    pos = unit_end;
+  }
+}
+
+void L2ReadCache::invalidate(uint64_t offset, uint64_t length)
+{
+  if (length == 0) {
+    return;
+  }
+  std::lock_guard l(lock);
+  if (unit_map.empty() && inflight.empty()) {
+    return;
+  }
+  for (uint64_t unit = _unit_of(offset); unit < offset + length;
+       unit += unit_size) {
+    _invalidate_unit(unit);
+  }
+}
+
+void L2ReadCache::invalidate(const interval_set<uint64_t>& extents)
+{
+  for (auto p = extents.begin(); p != extents.end(); ++p) {
+    invalidate(p.get_start(), p.get_len());
+  }
+}
+
+void L2ReadCache::_writer_entry()
+{
+  std::unique_lock l(lock);
+  while (true) {
+    if (pending.empty()) {
+      if (stop) {
+	break;
+      }
+      cond.wait(l);
+      continue;
+    }
+    fill_t f = std::move(pending.front());
+    pending.pop_front();
+    pending_bytes -= f.data.length();
+
+    auto p = inflight.find(f.unit);
+    if (p == inflight.end() || p->second != f.id) {
+      // invalidated while queued
+      logger->inc(l_bluestore_l2cache_dropped);
+      continue;
+    }
+    uint32_t slot;
+    if (_get_slot(f.unit, &slot) < 0) {
+      inflight.erase(p);
+      logger->inc(l_bluestore_l2cache_dropped);
+      continue;
+    }
+    // only this thread allocates slots, so the slot cannot be handed to
+    // another unit while we write it unlocked
+    uint32_t mask = f.mask;
+    l.unlock();
+    _do_fill(f, slot);
+    l.lock();
+
+    p = inflight.find(f.unit);
+    if (p == inflight.end() || p->second != f.id) {
+      logger->inc(l_bluestore_l2cache_dropped);
+      continue;
+    }
+    inflight.erase(p);
+    if (f.mask == 0) {
+      // write failed
+      logger->inc(l_bluestore_l2cache_dropped);
+      continue;
+    }
+    entry_t& e = slots[slot];
+    ceph_assert(e.unit == f.unit);
+    unsigned k = 0;
+    for (unsigned i = 0; i < blocks_per_unit; ++i) {
+      if (mask & (1u << i)) {
+	bufferlist b;
+	b.substr_of(f.data, k++ * block_size, block_size);
+	e.csum[i] = b.crc32c(-1);
+      }
+    }
+    e.valid |= mask;
+    logger->inc(l_bluestore_l2cache_admitted);
+  }
+}
+
+void L2ReadCache::_do_fill(fill_t& f, uint32_t slot)
+{
+  f.data.rebuild_aligned(block_size);
+  // write each run of consecutive blocks with a single io
+  unsigned k = 0;
+  unsigned i = 0;
+  while (i < blocks_per_unit) {
+    if (!(f.mask & (1u << i))) {
+      ++i;
+      continue;
+    }
+    unsigned run = 0;
+    while (i + run < blocks_per_unit && (f.mask & (1u << (i + run)))) {
+      ++run;
+    }
+    bufferlist t;
+    t.substr_of(f.data, k * block_size, run * block_size);
+    int r = bdev->write(_slot_offset(slot) + i * block_size, t, false);
+    if (r < 0) {
+      derr << __func__ << " cache device write failed: " << cpp_strerror(r)
+	   << dendl;
+      f.mask = 0;
+      return;
+    }
+    k += run;
+    i += run;
+  }
+}
+
+void L2ReadCache::dump(ceph::Formatter *f)
+{
+  std::lock_guard l(lock);
+  f->dump_unsigned("unit_size", unit_size);
+  f->dump_unsigned("num_slots", num_slots);
+  f->dump_unsigned("units", unit_map.size());
+  f->dump_unsigned("free_slots", free_slots.size());
+  f->dump_unsigned("pending_fills", pending.size());
+  f->dump_unsigned("pending_bytes", pending_bytes);
+}
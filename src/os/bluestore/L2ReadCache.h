@@ -0,0 +1,256 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ */
+
+#ifndef CEPH_OS_BLUESTORE_L2READCACHE_H
+#define CEPH_OS_BLUESTORE_L2READCACHE_H
+
+#include <array>
+#include <deque>
+#include <unordered_map>
+#include <vector>
+
+#include <boost/intrusive/list.hpp>
+
+#include "include/buffer.h"
+#include "include/encoding.h"
+#include "include/interval_set.h"
+#include "include/uuid.h"
+#include "blk/BlockDevice.h"
+#include "common/ceph_mutex.h"
+#include "common/Thread.h"
+#include "common/perf_counters.h"
+#include "common/Formatter.h"
+
+enum {
+  l_bluestore_l2cache_first = 732700,
+  l_bluestore_l2cache_hit,
+  l_bluestore_l2cache_hit_bytes,
+  l_bluestore_l2cache_miss,
+  l_bluestore_l2cache_admitted,
+  l_bluestore_l2cache_rejected,
+  l_bluestore_l2cache_dropped,
+  l_bluestore_l2cache_evicted,
+  l_bluestore_l2cache_invalidated,
+  l_bluestore_l2cache_csum_err,
+  l_bluestore_l2cache_units,
+  l_bluestore_l2cache_read_lat,
+  l_bluestore_l2cache_last
+};
+
+/**
+ * L2ReadCache
+ *
+ * A persistent, second level read cache for BlueStore data placed on a
+ * dedicated area of a fast device.
+ *
+ * Cached data is addressed by its location on the main device.  The main
+ * device is split into fixed size units; each cached unit owns a slot on
+ * the cache device and tracks which of its blocks are filled, together
+ * with a crc32c per block so that data read back from the cache device is
+ * always verified.  Units are only ever offered to the cache after the
+ * blob checksum verification succeeded.
+ *
+ * Admission is guarded by a doorkeeper filter: a unit has to be missed
+ * twice within the filter's lifetime before it is admitted, so one-pass
+ * scans (backfill, deep scrub, sequential reads) do not flush the cache.
+ *
+ * Hits are read back asynchronously: read() queues the reads of the cache
+ * device into a read_ctx_t, which the caller submits along with its reads
+ * of the main device and then waits for, to have the cached data verified.
+ *
+ * The caller must invalidate main device ranges before they are
+ * overwritten in place or released to the allocator.
+ *
+ * The index is persisted on close() and reloaded on open() as long as the
+ * token handed out by close() is presented again, so any unclean shutdown
+ * or foreign modification of the store discards the cached content.
+ */
+class L2ReadCache {
+public:
+  static constexpr unsigned MAX_BLOCKS_PER_UNIT = 32;
+
+  struct super_t {
+    uuid_d fsid;           ///< owning BlueStore
+    uint64_t token = 0;    ///< matches the store's token if index is valid
+    uint32_t block_size = 0;
+    uint32_t unit_size = 0;
+    uint64_t num_slots = 0;
+    uint64_t index_length = 0;
+    uint32_t index_crc = 0;
+
+    void encode(ceph::buffer::list& bl) const {
+      ENCODE_START(1, 1, bl);
+      encode(fsid, bl);
+      encode(token, bl);
+      encode(block_size, bl);
+      encode(unit_size, bl);
+      encode(num_slots, bl);
+      encode(index_length, bl);
+      encode(index_crc, bl);
+      ENCODE_FINISH(bl);
+    }
+    void decode(ceph::buffer::list::const_iterator& p) {
+      DECODE_START(1, p);
+      decode(fsid, p);
+      decode(token, p);
+      decode(block_size, p);
+      decode(unit_size, p);
+      decode(num_slots, p);
+      decode(index_length, p);
+      decode(index_crc, p);
+      DECODE_FINISH(p);
+    }
+  };
+
+  /// reads of the cache device for one lookup batch
+  struct read_ctx_t {
+    struct piece_t {
+      uint64_t unit;
+      uint32_t slot;
+      unsigned first;
+      unsigned count;
+      std::array<uint32_t, MAX_BLOCKS_PER_UNIT> csum;
+    };
+    struct hit_t {
+      uint64_t offset;            ///< on the main device
+      uint64_t length;
+      std::vector<piece_t> pieces;
+      ceph::buffer::list data;    ///< shares the buffers handed to the caller
+      bool failed = false;        ///< must be read from the main device
+    };
+    IOContext ioc;
+    std::vector<hit_t> hits;
+    ceph::mono_clock::time_point start;
+
+    explicit read_ctx_t(CephContext *cct) : ioc(cct, nullptr, true) {}
+  };
+
+private:
+  struct entry_t : public boost::intrusive::list_base_hook<> {
+    uint64_t unit = 0;          ///< unit aligned offset on the main device
+    uint32_t slot = 0;
+    uint32_t valid = 0;         ///< bitmap of filled blocks
+    std::array<uint32_t, MAX_BLOCKS_PER_UNIT> csum;
+  };
+  typedef boost::intrusive::list<entry_t> lru_list_t;
+
+  struct fill_t {
+    uint64_t id;
+    uint64_t unit;
+    uint32_t mask;              ///< blocks carried by data
+    ceph::buffer::list data;    ///< one block per bit in mask, ascending
+  };
+
+  CephContext *cct;
+  PerfCounters *logger = nullptr;
+  BlockDevice *bdev = nullptr;
+  uuid_d fsid;
+
+  uint64_t block_size;          ///< main device block size
+  uint64_t unit_size = 0;
+  unsigned blocks_per_unit = 0;
+  uint64_t num_slots = 0;
+  uint64_t index_offset = 0;    ///< index area on the cache device
+  uint64_t index_max = 0;
+  uint64_t data_offset = 0;     ///< first slot on the cache device
+  uint64_t max_pending_bytes = 0;
+
+  ceph::mutex lock = ceph::make_mutex("L2ReadCache::lock");
+  ceph::condition_variable cond;
+  std::vector<entry_t> slots;
+  std::vector<uint32_t> free_slots;
+  std::unordered_map<uint64_t, uint32_t> unit_map;  ///< unit -> slot
+  lru_list_t lru;
+
+  // doorkeeper for admission
+  std::vector<bool> doorkeeper;
+  uint64_t doorkeeper_count = 0;
+
+  // fills queued for the writer thread
+  std::deque<fill_t> pending;
+  uint64_t pending_bytes = 0;
+  uint64_t last_fill_id = 0;
+  std::unordered_map<uint64_t, uint64_t> inflight;  ///< unit -> fill id
+  bool stop = false;
+
+  class WriterThread : public Thread {
+    L2ReadCache *cache;
+  public:
+    explicit WriterThread(L2ReadCache *c) : cache(c) {}
+    void *entry() override {
+      cache->_writer_entry();
+      return nullptr;
+    }
+  } writer_thread;
+
+  uint64_t _unit_of(uint64_t offset) const {
+    return offset - offset % unit_size;
+  }
+  uint64_t _slot_offset(uint32_t slot) const {
+    return data_offset + slot * unit_size;
+  }
+  bool _admit(uint64_t unit);
+  void _touch(entry_t& e);
+  void _invalidate_unit(uint64_t unit);
+  int _get_slot(uint64_t unit, uint32_t *slot);
+  void _writer_entry();
+  void _do_fill(fill_t& f, uint32_t slot);
+
+  void _init_logger();
+  void _shutdown_logger();
+  int _write_super(const super_t& super);
+  int _read_super(super_t *super);
+  int _load_index(const super_t& super);
+  int _save_index(super_t *super);
+
+public:
+  L2ReadCache(CephContext *cct, uint64_t block_size);
+  ~L2ReadCache();
+
+  /// open the cache device at path and reload the index if token matches
+  int open(const std::string& path, const uuid_d& fsid, uint64_t token);
+  /// persist the index; returns the token which validates it on next open
+  void close(uint64_t *token);
+
+  /**
+   * Look up main device range offset~length.
+   *
+   * On a full hit, reading it back is queued to ctx, buffers which will
+   * hold the data once ctx is waited for are appended to bl and true is
+   * returned; otherwise bl is left untouched.  Ranges must be block
+   * aligned.
+   */
+  bool read(uint64_t offset, uint64_t length, ceph::buffer::list *bl,
+	    read_ctx_t *ctx);
+  /// start the reads queued to ctx
+  void submit(read_ctx_t *ctx);
+  /**
+   * Wait for the reads of ctx and verify them.
+   *
+   * Returns the number of hits which failed to read or verify; their
+   * buffers have to be filled from the main device.
+   */
+  unsigned wait(read_ctx_t *ctx);
+  /// read() which waits for the data
+  bool read(uint64_t offset, uint64_t length, ceph::buffer::list *bl);
+
+  /// offer verified data of main device range starting at offset
+  void insert(uint64_t offset, const ceph::buffer::list& bl);
+
+  /// drop any cached data of the given main device range(s)
+  void invalidate(uint64_t offset, uint64_t length);
+  void invalidate(const interval_set<uint64_t>& extents);
+
+  void dump(ceph::Formatter *f);
+};
+WRITE_CLASS_ENCODER(L2ReadCache::super_t)
+
+#endif
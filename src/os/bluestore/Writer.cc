@@ -722,6 +722,9 @@ inline void BlueStore::Writer::_schedule_io_masked(
       bufferlist ddata;
       data.splice(0, chunk_size, &ddata);
       if (chunk_is_unused) {
+        if (bstore->l2cache) {
+          bstore->l2cache->invalidate(disk_position, ddata.length());
+        }
         bstore->bdev->aio_write(disk_position, ddata, &txc->ioc, false);
         bstore->logger->inc(l_bluestore_write_small_unused);
       } else {
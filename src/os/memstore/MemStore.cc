@@ -22,6 +22,7 @@
 #endif
 
 #include "include/types.h"
+#include "include/intarith.h"
 #include "include/stringify.h"
 #include "common/debug.h"
 #include "common/errno.h"
@@ -1074,12 +1075,11 @@ int MemStore::_remove(const coll_t& cid, const ghobject_t& oid)
     return -ENOENT;
   std::lock_guard l{c->lock};
 
-  auto i = c->object_hash.find(oid);
-  if (i == c->object_hash.end())
+  ObjectRef o = c->_find_object(oid);
+  if (!o)
     return -ENOENT;
-  used_bytes -= i->second->get_size();
-  c->object_hash.erase(i);
-  c->object_map.erase(oid);
+  used_bytes -= o->get_size();
+  c->_remove_object(oid);
 
   return 0;
 }
@@ -1339,13 +1339,12 @@ int MemStore::_collection_add(const coll_t& cid, const coll_t& ocid, const ghobj
   std::scoped_lock l{std::min(&(*c), &(*oc))->lock,
 		     std::max(&(*c), &(*oc))->lock};
 
-  if (c->object_hash.count(oid))
+  if (c->_find_object(oid))
     return -EEXIST;
-  if (oc->object_hash.count(oid) == 0)
+  ObjectRef o = oc->_find_object(oid);
+  if (!o)
     return -ENOENT;
-  ObjectRef o = oc->object_hash[oid];
-  c->object_map[oid] = o;
-  c->object_hash[oid] = o;
+  c->_add_object(oid, o);
   return 0;
 }
 
@@ -1365,17 +1364,13 @@ int MemStore::_collection_move_rename(const coll_t& oldcid, const ghobject_t& ol
   ceph_assert(&(*c) == &(*oc));
 
   std::lock_guard l{c->lock};
-  if (c->object_hash.count(oid))
+  if (c->_find_object(oid))
     return -EEXIST;
-  if (oc->object_hash.count(oldoid) == 0)
+  ObjectRef o = oc->_find_object(oldoid);
+  if (!o)
     return -ENOENT;
-  {
-    ObjectRef o = oc->object_hash[oldoid];
-    c->object_map[oid] = o;
-    c->object_hash[oid] = o;
-    oc->object_map.erase(oldoid);
-    oc->object_hash.erase(oldoid);
-  }
+  c->_add_object(oid, o);
+  oc->_remove_object(oldoid);
   return 0;
 }
 
@@ -1398,10 +1393,9 @@ int MemStore::_split_collection(const coll_t& cid, uint32_t bits, uint32_t match
   while (p != sc->object_map.end()) {
     if (p->first.match(bits, match)) {
       dout(20) << " moving " << p->first << dendl;
-      dc->object_map.insert(std::make_pair(p->first, p->second));
-      dc->object_hash.insert(std::make_pair(p->first, p->second));
-      sc->object_hash.erase(p->first);
-      sc->object_map.erase(p++);
+      auto oid = p++->first;
+      dc->_add_object(oid, sc->_find_object(oid));
+      sc->_remove_object(oid);
     } else {
       ++p;
     }
@@ -1430,10 +1424,9 @@ int MemStore::_merge_collection(const coll_t& cid, uint32_t bits, coll_t dest)
     auto p = sc->object_map.begin();
     while (p != sc->object_map.end()) {
       dout(20) << " moving " << p->first << dendl;
-      dc->object_map.insert(std::make_pair(p->first, p->second));
-      dc->object_hash.insert(std::make_pair(p->first, p->second));
-      sc->object_hash.erase(p->first);
-      sc->object_map.erase(p++);
+      auto oid = p++->first;
+      dc->_add_object(oid, sc->_find_object(oid));
+      sc->_remove_object(oid);
     }
 
     dc->bits = bits;
@@ -1555,6 +1548,7 @@ int BufferlistObject::truncate(uint64_t size)
 struct MemStore::PageSetObject : public Object {
   PageSet data;
   uint64_t data_len;
+  const bool zero_copy;
 #if defined(__GLIBCXX__)
   // use a thread-local vector for the pages returned by PageSet, so we
   // can avoid allocations in read/write()
@@ -1586,7 +1580,11 @@ struct MemStore::PageSetObject : public Object {
 
 private:
   FRIEND_MAKE_REF(PageSetObject);
-  explicit PageSetObject(size_t page_size) : data(page_size), data_len(0) {}
+  PageSetObject(size_t page_size, PageArena *arena, bool zero_copy)
+    : data(page_size, arena), data_len(0), zero_copy(zero_copy) {}
+
+  void copy_in(uint64_t offset, uint64_t len,
+	       ceph::buffer::list::const_iterator& p);
 };
 
 #if defined(__GLIBCXX__)
@@ -1647,30 +1645,63 @@ int MemStore::PageSetObject::read(uint64_t offset, uint64_t len, ceph::buffer::l
   return len;
 }
 
-int MemStore::PageSetObject::write(uint64_t offset, const ceph::buffer::list &src)
+void MemStore::PageSetObject::copy_in(uint64_t offset, uint64_t len,
+				      ceph::buffer::list::const_iterator& p)
 {
-  unsigned len = src.length();
+  if (len == 0)
+    return;
 
   DEFINE_PAGE_VECTOR(tls_pages);
   // make sure the page range is allocated
-  data.alloc_range(offset, src.length(), tls_pages);
+  data.alloc_range(offset, len, tls_pages);
 
   auto page = tls_pages.begin();
 
-  auto p = src.begin();
   while (len > 0) {
     unsigned page_offset = offset - (*page)->offset;
     unsigned pageoff = data.get_page_size() - page_offset;
-    unsigned count = std::min(len, pageoff);
+    unsigned count = std::min<uint64_t>(len, pageoff);
     p.copy(count, (*page)->data + page_offset);
     offset += count;
     len -= count;
     if (count == pageoff)
       ++page;
   }
-  if (data_len < offset)
-    data_len = offset;
   tls_pages.clear(); // drop page refs
+}
+
+int MemStore::PageSetObject::write(uint64_t offset, const ceph::buffer::list &src)
+{
+  const uint64_t end = offset + src.length();
+  const auto page_size = data.get_page_size();
+  const uint64_t first = p2roundup<uint64_t>(offset, page_size);
+  const uint64_t last = p2align<uint64_t>(end, page_size);
+
+  auto p = src.begin();
+  if (zero_copy && first < last) {
+    // whole pages take a reference to the source buffer, only the partial
+    // pages at either end are copied.  a page pins all of the buffer it
+    // refers to, so pages are copied from buffers much larger than what
+    // the write keeps of them
+    const uint64_t max_pinned = 2 * (last - first);
+    copy_in(offset, first - offset, p);
+    for (auto o = first; o < last; o += page_size) {
+      ceph::buffer::ptr bp;
+      auto q = p;
+      q.copy_shallow(page_size, bp);
+      if (bp.raw_length() > max_pinned) {
+	copy_in(o, page_size, p);
+      } else {
+	data.share_page(o, std::move(bp));
+	p = q;
+      }
+    }
+    copy_in(last, end - last, p);
+  } else {
+    copy_in(offset, src.length(), p);
+  }
+  if (data_len < end)
+    data_len = end;
   return 0;
 }
 
@@ -1780,6 +1811,11 @@ int MemStore::PageSetObject::truncate(uint64_t size)
   if (tls_pages.empty())
     return 0;
 
+  if (tls_pages.front()->is_shared()) {
+    // don't zero the buffer the page refers to
+    tls_pages.clear();
+    data.alloc_range(size, page_offset + page_size - size, tls_pages);
+  }
   auto page = tls_pages.begin();
   auto data = (*page)->data;
   std::fill(data + (size - page_offset), data + page_size, 0);
@@ -1788,8 +1824,25 @@ int MemStore::PageSetObject::truncate(uint64_t size)
 }
 
 
+MemStore::Collection::Collection(CephContext *cct, coll_t c)
+  : CollectionImpl(cct, c),
+    cct(cct),
+    use_page_set(cct->_conf->memstore_page_set),
+    use_page_arena(cct->_conf.get_val<bool>("memstore_page_arena")),
+    page_zero_copy(cct->_conf.get_val<bool>("memstore_page_zero_copy")),
+    num_shards(std::max<uint64_t>(
+      1, cct->_conf.get_val<uint64_t>("memstore_collection_shards")))
+{
+  shards.reset(new ObjectShard[num_shards]);
+}
+
 MemStore::ObjectRef MemStore::Collection::create_object() const {
-  if (use_page_set)
-    return ceph::make_ref<PageSetObject>(cct->_conf->memstore_page_size);
+  if (use_page_set) {
+    const size_t page_size = cct->_conf->memstore_page_size;
+    return ceph::make_ref<PageSetObject>(
+      page_size,
+      use_page_arena ? PageArena::get(page_size) : nullptr,
+      page_zero_copy);
+  }
   return make_ref<BufferlistObject>();
 }
@@ -17,6 +17,7 @@
 #define CEPH_MEMSTORE_H
 
 #include <atomic>
+#include <memory>
 #include <mutex>
 #include <shared_mutex> // for std::shared_lock
 #include <unordered_map>
@@ -95,13 +96,27 @@ public:
     int bits = 0;
     CephContext *cct;
     bool use_page_set;
-    std::unordered_map<ghobject_t, ObjectRef> object_hash;  ///< for lookup
+    bool use_page_arena;
+    bool page_zero_copy;
     std::map<ghobject_t, ObjectRef> object_map;        ///< for iteration
     std::map<std::string,ceph::buffer::ptr> xattr;
-    /// for object_{map,hash}
+    /// for object_map, and for changes to the object_hash shards
     ceph::shared_mutex lock{
       ceph::make_shared_mutex("MemStore::Collection::lock", true, false)};
 
+    /// object_hash is split in shards with their own lock, so that
+    /// lookups of distinct objects do not contend on the collection lock.
+    /// The shards are only modified with both the collection lock and the
+    /// shard lock held, so holding the collection lock is enough to read.
+    struct ObjectShard {
+      ceph::shared_mutex lock{
+	ceph::make_shared_mutex("MemStore::Collection::ObjectShard::lock",
+				true, false)};
+      std::unordered_map<ghobject_t, ObjectRef> object_hash;  ///< for lookup
+    };
+    std::unique_ptr<ObjectShard[]> shards;
+    unsigned num_shards;
+
     bool exists = true;
     ceph::mutex sequencer_mutex{
       ceph::make_mutex("MemStore::Collection::sequencer_mutex")};
@@ -115,22 +130,57 @@ public:
     // reads and writes, so we will never see them concurrently at this
     // level.
 
+    ObjectShard& get_shard(const ghobject_t& oid) {
+      return shards[std::hash<ghobject_t>()(oid) % num_shards];
+    }
+
     ObjectRef get_object(ghobject_t oid) {
-      std::shared_lock l{lock};
-      auto o = object_hash.find(oid);
-      if (o == object_hash.end())
+      auto& shard = get_shard(oid);
+      std::shared_lock l{shard.lock};
+      auto o = shard.object_hash.find(oid);
+      if (o == shard.object_hash.end())
 	return ObjectRef();
       return o->second;
     }
 
     ObjectRef get_or_create_object(ghobject_t oid) {
+      auto& shard = get_shard(oid);
+      {
+	std::shared_lock l{shard.lock};
+	auto o = shard.object_hash.find(oid);
+	if (o != shard.object_hash.end())
+	  return o->second;
+      }
       std::lock_guard l{lock};
-      auto result = object_hash.emplace(oid, ObjectRef());
+      std::lock_guard l2{shard.lock};
+      auto result = shard.object_hash.emplace(oid, ObjectRef());
       if (result.second)
         object_map[oid] = result.first->second = create_object();
       return result.first->second;
     }
 
+    // the following require the collection lock; _add_object() and
+    // _remove_object() require it exclusively
+    ObjectRef _find_object(const ghobject_t& oid) {
+      auto& shard = get_shard(oid);
+      auto o = shard.object_hash.find(oid);
+      if (o == shard.object_hash.end())
+	return ObjectRef();
+      return o->second;
+    }
+    void _add_object(const ghobject_t& oid, ObjectRef o) {
+      auto& shard = get_shard(oid);
+      std::lock_guard l{shard.lock};
+      shard.object_hash[oid] = o;
+      object_map[oid] = std::move(o);
+    }
+    void _remove_object(const ghobject_t& oid) {
+      auto& shard = get_shard(oid);
+      std::lock_guard l{shard.lock};
+      shard.object_hash.erase(oid);
+      object_map.erase(oid);
+    }
+
     void encode(ceph::buffer::list& bl) const {
       ENCODE_START(1, 1, bl);
       encode(xattr, bl);
@@ -154,8 +204,7 @@ public:
 	decode(k, p);
 	auto o = create_object();
 	o->decode(p);
-	object_map.insert(std::make_pair(k, o));
-	object_hash.insert(std::make_pair(k, o));
+	_add_object(k, std::move(o));
       }
       DECODE_FINISH(p);
     }
@@ -177,10 +226,7 @@ public:
 
   private:
     FRIEND_MAKE_REF(Collection);
-    explicit Collection(CephContext *cct, coll_t c)
-      : CollectionImpl(cct, c),
-	cct(cct),
-	use_page_set(cct->_conf->memstore_page_set) {}
+    explicit Collection(CephContext *cct, coll_t c);
   };
   typedef Collection::Ref CollectionRef;
 
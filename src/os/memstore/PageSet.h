@@ -18,13 +18,186 @@
 #include <algorithm>
 #include <atomic>
 #include <cassert>
+#include <map>
+#include <memory>
 #include <mutex>
+#include <new>
+#include <set>
+#include <shared_mutex>
+#include <thread>
 #include <vector>
+#include <sys/mman.h>
 #include <boost/intrusive/avl_set.hpp>
 #include <boost/intrusive_ptr.hpp>
 
 #include "include/encoding.h"
 
+/// Hands out page data from large mmap()ed chunks, backed by huge pages
+/// where the system allows it, to cut page faults and TLB misses on large
+/// data sets.  A freed page goes back to the chunk it was carved from,
+/// whichever thread frees it, and a chunk is unmapped once all of its
+/// pages are free, except for one spare chunk per shard.  There is one
+/// arena per page size for the whole process, so pages may outlive the
+/// store that allocated them.
+class PageArena {
+  static constexpr size_t HUGE_PAGE_SIZE = 2 << 20;
+  static constexpr unsigned NUM_SHARDS = 16;
+
+  const size_t page_size;
+  const size_t chunk_size;
+
+  struct Shard;
+  struct Chunk {
+    Shard *const shard;
+    char *const base;
+    std::vector<char*> free;  ///< protected by shard->mutex
+    size_t used = 0;          ///< pages handed out
+    Chunk(Shard *shard, char *base) : shard(shard), base(base) {}
+  };
+  struct ChunkLess {
+    bool operator()(const Chunk *a, const Chunk *b) const {
+      return a->base < b->base;
+    }
+  };
+
+  // allocating threads are spread over the shards
+  struct alignas(64) Shard {
+    std::mutex mutex;
+    /// chunks with free pages, the lowest first so that the others drain
+    std::set<Chunk*, ChunkLess> avail;
+    unsigned unused = 0;  ///< chunks with no page handed out
+  } shards[NUM_SHARDS];
+
+  // all chunks by address, to find the one a freed page belongs to
+  std::shared_mutex chunks_lock;
+  std::map<char*, std::unique_ptr<Chunk>> chunks;
+
+  Shard& get_shard() {
+    return shards[std::hash<std::thread::id>()(std::this_thread::get_id()) %
+		  NUM_SHARDS];
+  }
+
+  char *map_chunk() {
+    void *p = MAP_FAILED;
+#ifdef MAP_HUGETLB
+    p = ::mmap(nullptr, chunk_size, PROT_READ | PROT_WRITE,
+	       MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+#endif
+    if (p != MAP_FAILED)
+      return static_cast<char*>(p);
+
+    // no huge pages reserved, ask for transparent huge pages on a huge
+    // page aligned mapping instead
+    const size_t len = chunk_size + HUGE_PAGE_SIZE;
+    p = ::mmap(nullptr, len, PROT_READ | PROT_WRITE,
+	       MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (p == MAP_FAILED)
+      throw std::bad_alloc();
+    auto start = reinterpret_cast<uintptr_t>(p);
+    auto aligned = (start + HUGE_PAGE_SIZE - 1) & ~(HUGE_PAGE_SIZE - 1);
+    if (aligned > start)
+      ::munmap(p, aligned - start);
+    if (aligned + chunk_size < start + len)
+      ::munmap(reinterpret_cast<void*>(aligned + chunk_size),
+	       start + len - aligned - chunk_size);
+#ifdef MADV_HUGEPAGE
+    ::madvise(reinterpret_cast<void*>(aligned), chunk_size, MADV_HUGEPAGE);
+#endif
+    return reinterpret_cast<char*>(aligned);
+  }
+
+  Chunk *add_chunk(Shard &shard) {
+    auto chunk = std::make_unique<Chunk>(&shard, map_chunk());
+    // hand out the pages from the start of the chunk
+    const size_t count = chunk_size / page_size;
+    chunk->free.reserve(count);
+    for (size_t i = count; i > 0; i--)
+      chunk->free.push_back(chunk->base + (i - 1) * page_size);
+    std::unique_lock l(chunks_lock);
+    auto c = chunk.get();
+    chunks.emplace(c->base, std::move(chunk));
+    return c;
+  }
+
+  void remove_chunk(Chunk *chunk) {
+    char *base = chunk->base;
+    {
+      std::unique_lock l(chunks_lock);
+      chunks.erase(base);
+    }
+    ::munmap(base, chunk_size);
+  }
+
+  Chunk *find_chunk(char *p) {
+    std::shared_lock l(chunks_lock);
+    auto i = chunks.upper_bound(p);
+    ceph_assert(i != chunks.begin());
+    --i;
+    ceph_assert(p < i->first + chunk_size);
+    return i->second.get();
+  }
+
+  explicit PageArena(size_t page_size)
+    : page_size(page_size),
+      chunk_size((std::max(page_size, HUGE_PAGE_SIZE) + HUGE_PAGE_SIZE - 1) &
+		 ~(HUGE_PAGE_SIZE - 1)) {}
+
+ public:
+  static PageArena *get(size_t page_size) {
+    static std::mutex lock;
+    // never destroyed, like the arenas themselves
+    static auto arenas = new std::map<size_t, PageArena*>;
+    std::lock_guard<std::mutex> l(lock);
+    auto& arena = (*arenas)[page_size];
+    if (!arena)
+      arena = new PageArena(page_size);
+    return arena;
+  }
+
+  size_t get_page_size() const { return page_size; }
+
+  /// bytes mapped for pages, in use or not
+  size_t get_mapped_bytes() {
+    std::shared_lock l(chunks_lock);
+    return chunks.size() * chunk_size;
+  }
+
+  char *alloc() {
+    auto& shard = get_shard();
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    if (shard.avail.empty()) {
+      shard.avail.insert(add_chunk(shard));
+      shard.unused++;
+    }
+    auto chunk = *shard.avail.begin();
+    auto p = chunk->free.back();
+    chunk->free.pop_back();
+    if (chunk->used++ == 0)
+      shard.unused--;
+    if (chunk->free.empty())
+      shard.avail.erase(shard.avail.begin());
+    return p;
+  }
+  void free(char *p) {
+    auto chunk = find_chunk(p);
+    auto& shard = *chunk->shard;
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    if (chunk->free.empty())
+      shard.avail.insert(chunk);
+    chunk->free.push_back(p);
+    if (--chunk->used > 0)
+      return;
+    // keep a spare so that a shard going back and forth across a chunk
+    // boundary does not map and unmap it every time
+    if (shard.unused == 0) {
+      shard.unused++;
+      return;
+    }
+    shard.avail.erase(chunk);
+    remove_chunk(chunk);
+  }
+};
+
 struct Page {
   char *const data;
   boost::intrusive::avl_set_member_hook<> hook;
@@ -35,6 +208,13 @@ struct Page {
   void get() { ++nrefs; }
   void put() { if (--nrefs == 0) delete this; }
 
+  // where data lives when it is not allocated along with the Page
+  PageArena *const arena = nullptr;
+  ceph::buffer::ptr shared;  ///< a written buffer the page took over
+
+  // the page shares its data with a buffer and must not be modified
+  bool is_shared() const { return shared.have_raw(); }
+
   typedef boost::intrusive_ptr<Page> Ref;
   friend void intrusive_ptr_add_ref(Page *p) { p->get(); }
   friend void intrusive_ptr_release(Page *p) { p->put(); }
@@ -62,7 +242,12 @@ struct Page {
     decode(offset, p);
   }
 
-  static Ref create(size_t page_size, uint64_t offset = 0) {
+  static Ref create(size_t page_size, uint64_t offset = 0,
+		    PageArena *arena = nullptr) {
+    if (arena) {
+      ceph_assert(arena->get_page_size() == page_size);
+      return new (::operator new(sizeof(Page))) Page(arena, offset);
+    }
     // ensure proper alignment of the Page
     const auto align = alignof(Page);
     page_size = (page_size + align - 1) & ~(align - 1);
@@ -71,6 +256,10 @@ struct Page {
     // place the Page structure at the end of the buffer
     return new (buffer + page_size) Page(buffer, offset);
   }
+  // create a page that refers to the given buffer rather than a copy
+  static Ref create(ceph::buffer::ptr&& bp, uint64_t offset) {
+    return new (::operator new(sizeof(Page))) Page(std::move(bp), offset);
+  }
 
   // copy disabled
   Page(const Page&) = delete;
@@ -80,6 +269,10 @@ struct Page {
 
  private: // private constructor, use create() instead
   Page(char *data, uint64_t offset) : data(data), offset(offset), nrefs(1) {}
+  Page(PageArena *arena, uint64_t offset)
+    : data(arena->alloc()), offset(offset), nrefs(1), arena(arena) {}
+  Page(ceph::buffer::ptr&& bp, uint64_t offset)
+    : data(bp.c_str()), offset(offset), nrefs(1), shared(std::move(bp)) {}
 
   // Custom delete operator that uses std::destroying_delete_t to ensure proper cleanup
   // of the buffer-Page layout. Since Page is placed at the end of a larger allocated buffer
@@ -89,10 +282,19 @@ struct Page {
   // 3. Delete the entire buffer containing both data and Page
   // Without std::destroying_delete_t, the compiler would call the destructor
   // before our delete operator, leading to unitialized memory access.
+  // Pages with arena or shared data are allocated on their own.
   static void operator delete(Page *p, std::destroying_delete_t) {
     auto* buffer = p->data;
+    auto* arena = p->arena;
+    const bool separate = arena || p->is_shared();
     p->~Page();
-    delete[] buffer;
+    if (!separate) {
+      delete[] buffer;
+      return;
+    }
+    if (arena)
+      arena->free(buffer);
+    ::operator delete(p);
   }
 };
 
@@ -114,6 +316,7 @@ class PageSet {
 
   page_set pages;
   uint64_t page_size;
+  PageArena *arena;
 
   typedef std::mutex lock_type;
   lock_type mutex;
@@ -141,9 +344,11 @@ class PageSet {
   }
 
  public:
-  explicit PageSet(size_t page_size) : page_size(page_size) {}
+  explicit PageSet(size_t page_size, PageArena *arena = nullptr)
+    : page_size(page_size), arena(arena) {}
   PageSet(PageSet &&rhs)
-    : pages(std::move(rhs.pages)), page_size(rhs.page_size) {}
+    : pages(std::move(rhs.pages)), page_size(rhs.page_size),
+      arena(rhs.arena) {}
   ~PageSet() {
     free_pages(pages.begin(), pages.end());
   }
@@ -173,7 +378,7 @@ class PageSet {
       typename page_set::insert_commit_data commit;
       auto insert = pages.insert_check(cur, page_offset, page_cmp(), commit);
       if (insert.second) {
-        auto page = Page::create(page_size, page_offset);
+        auto page = Page::create(page_size, page_offset, arena);
         cur = pages.insert_commit(*page, commit);
 
         // assume that the caller will write to the range [offset,length),
@@ -186,6 +391,15 @@ class PageSet {
         // zero front of page between page_offset and offset
         if (offset > page->offset)
           std::fill(page->data, page->data + offset - page->offset, 0);
+      } else if (insert.first->is_shared()) {
+        // the caller will write to it, so give it a private copy
+        auto page = Page::create(page_size, page_offset, arena);
+        std::copy(insert.first->data, insert.first->data + page_size,
+                  page->data);
+        Page *old = &*insert.first;
+        pages.replace_node(insert.first, *page);
+        old->put();
+        cur = pages.iterator_to(*page);
       } else { // exists
         cur = insert.first;
       }
@@ -201,6 +415,26 @@ class PageSet {
     ceph_assert(out == range.rend());
   }
 
+  // make the page at offset refer to bp, which must cover the whole page,
+  // instead of copying it.  the page is copied before it is written again
+  // through alloc_range()
+  void share_page(uint64_t offset, ceph::buffer::ptr&& bp) {
+    ceph_assert((offset & (page_size-1)) == 0);
+    ceph_assert(bp.length() == page_size);
+    auto page = Page::create(std::move(bp), offset);
+
+    std::lock_guard<lock_type> lock(mutex);
+    typename page_set::insert_commit_data commit;
+    auto insert = pages.insert_check(offset, page_cmp(), commit);
+    if (insert.second) {
+      pages.insert_commit(*page, commit);
+    } else {
+      Page *old = &*insert.first;
+      pages.replace_node(insert.first, *page);
+      old->put();
+    }
+  }
+
   // return all allocated pages that intersect the range [offset,length)
   void get_range(uint64_t offset, uint64_t length, page_vector &range) {
     auto cur = pages.lower_bound(offset & ~(page_size-1), page_cmp());
@@ -234,7 +468,7 @@ class PageSet {
     decode(count, p);
     auto cur = pages.end();
     for (unsigned i = 0; i < count; i++) {
-      auto page = Page::create(page_size);
+      auto page = Page::create(page_size, 0, arena);
       page->decode(p, page_size);
       cur = pages.insert_before(cur, *page);
     }
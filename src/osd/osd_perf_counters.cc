@@ -2,11 +2,16 @@
 // vim: ts=8 sw=2 smarttab
 
 #include "osd_perf_counters.h"
+#include "common/ceph_context.h"
 #include "include/common_fwd.h"
 
 
 PerfCounters *build_osd_logger(CephContext *cct) {
   PerfCountersBuilder osd_plb(cct, "osd", l_osd_first, l_osd_last);
+#ifndef WITH_CRIMSON
+  // op threads of all shards update these
+  osd_plb.set_sharded(cct->_conf.get_val<bool>("perf_counters_sharded"));
+#endif
 
   // Latency axis configuration for op histograms, values are in nanoseconds
   PerfHistogramCommon::axis_config_d op_hist_x_axis_config{
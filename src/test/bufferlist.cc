@@ -2590,6 +2590,41 @@ TEST(BufferList, crc32c_append) {
   ASSERT_EQ(bl1.crc32c(0), bl2.crc32c(0));
 }
 
+TEST(BufferList, crc32c_fragments) {
+  // uncached fragments are computed in batches and combined
+  const unsigned lens[] = {1, 7, 100, 255, 256, 4096, 300, 65536, 9, 4096,
+			   17, 1000, 2048, 3, 131072, 64, 5, 4096};
+  bufferlist bl;
+  bufferlist flat;
+  for (unsigned len : lens) {
+    bufferptr p(buffer::create(len));
+    for (unsigned i = 0; i < len; i++) {
+      p.c_str()[i] = rand();
+    }
+    bl.append(p);
+    flat.append(p.c_str(), len);
+  }
+  flat.rebuild();
+  const uint32_t expected = ceph_crc32c(42, (unsigned char*)flat.c_str(),
+					flat.length());
+  ASSERT_EQ(expected, bl.crc32c(42));
+  // cached, then adjusted
+  ASSERT_EQ(expected, bl.crc32c(42));
+  ASSERT_EQ(ceph_crc32c(7, (unsigned char*)flat.c_str(), flat.length()),
+	    bl.crc32c(7));
+
+  // a mix of cached and uncached fragments
+  bufferlist mixed;
+  mixed.append(bl);
+  mixed.append(flat);
+  bufferlist twice;
+  twice.append(flat);
+  twice.append(flat);
+  twice.rebuild();
+  ASSERT_EQ(ceph_crc32c(0, (unsigned char*)twice.c_str(), twice.length()),
+	    mixed.crc32c(0));
+}
+
 TEST(BufferList, crc32c_zeros) {
   char buffer[4*1024];
   for (size_t i=0; i < sizeof(buffer); i++)
@@ -0,0 +1,132 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+
+/*
+ * crc32c throughput over fragmented bufferlists
+ *
+ * For each fragment layout this reports the rate of
+ *  - ceph_crc32c() called on every bufferptr in turn, chaining the crc,
+ *  - buffer::list::crc32c() with the per-ptr crc cache invalidated,
+ *    which computes the fragments in batches and combines them, and
+ *  - buffer::list::crc32c() with a different initial value each time,
+ *    which only adjusts the cached values.
+ */
+
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "include/buffer.h"
+#include "include/crc32c.h"
+
+using namespace std;
+using ceph::bufferlist;
+using ceph::bufferptr;
+
+struct layout_t {
+  string name;
+  vector<unsigned> pattern;   ///< fragment sizes, repeated
+};
+
+static const vector<layout_t> layouts = {
+  {"256", {256}},
+  {"4K", {4096}},
+  {"64K", {65536}},
+  {"4M", {4 << 20}},
+  {"4K/64K", {4096, 65536}},
+  {"4K/64K/4M", {4096, 65536, 4096, 4096, 4 << 20, 65536}},
+  {"hdr+4K", {53, 4096, 13}},
+};
+
+static bufferlist make_bl(const layout_t& layout, size_t total)
+{
+  bufferlist bl;
+  size_t i = 0;
+  while (bl.length() < total) {
+    unsigned len = layout.pattern[i++ % layout.pattern.size()];
+    bufferptr p(ceph::buffer::create_aligned(len, 64));
+    for (unsigned j = 0; j < len; j++) {
+      p.c_str()[j] = rand();
+    }
+    bl.append(std::move(p));
+  }
+  return bl;
+}
+
+template <typename F>
+static double rate_mb(size_t bytes, unsigned iterations, F&& f)
+{
+  auto start = std::chrono::steady_clock::now();
+  for (unsigned i = 0; i < iterations; i++) {
+    f(i);
+  }
+  std::chrono::duration<double> elapsed =
+    std::chrono::steady_clock::now() - start;
+  return (double)bytes * iterations / (1024 * 1024) / elapsed.count();
+}
+
+void usage(const char *name) {
+  cout << name << " [total_mb] [iterations]\n"
+       << "\t total_mb: the size of each bufferlist, default 64.\n"
+       << "\t iterations: the number of passes per measurement, default 20.\n";
+}
+
+int main(int argc, const char **argv)
+{
+  if (argc > 3) {
+    usage(argv[0]);
+    return EXIT_FAILURE;
+  }
+  size_t total = (argc > 1 ? atoi(argv[1]) : 64) << 20;
+  unsigned iterations = argc > 2 ? atoi(argv[2]) : 20;
+  if (!total || !iterations) {
+    usage(argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  cout << std::left << std::setw(12) << "layout"
+       << std::right << std::setw(10) << "frags"
+       << std::setw(14) << "per-ptr MB/s"
+       << std::setw(14) << "bl MB/s"
+       << std::setw(16) << "cached MB/s" << std::endl;
+  for (const auto& layout : layouts) {
+    bufferlist bl = make_bl(layout, total);
+    const size_t bytes = bl.length();
+    uint32_t expected = 0;
+    for (const auto& p : bl.buffers()) {
+      expected = ceph_crc32c(expected, (const unsigned char*)p.c_str(),
+			     p.length());
+    }
+
+    uint32_t crc = 0;
+    double per_ptr = rate_mb(bytes, iterations, [&](unsigned) {
+      crc = 0;
+      for (const auto& p : bl.buffers()) {
+	crc = ceph_crc32c(crc, (const unsigned char*)p.c_str(), p.length());
+      }
+    });
+    double uncached = rate_mb(bytes, iterations, [&](unsigned) {
+      bl.invalidate_crc();
+      crc = bl.crc32c(0);
+    });
+    if (crc != expected) {
+      cerr << layout.name << ": crc mismatch " << crc << " != " << expected
+	   << std::endl;
+      return EXIT_FAILURE;
+    }
+    double cached = rate_mb(bytes, iterations, [&](unsigned i) {
+      crc = bl.crc32c(i);
+    });
+
+    cout << std::left << std::setw(12) << layout.name
+	 << std::right << std::setw(10) << bl.get_num_buffers()
+	 << std::fixed << std::setprecision(0)
+	 << std::setw(14) << per_ptr
+	 << std::setw(14) << uncached
+	 << std::setw(16) << cached << std::endl;
+  }
+  return EXIT_SUCCESS;
+}
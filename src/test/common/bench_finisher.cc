@@ -0,0 +1,142 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+
+/*
+ * Finisher completion rate with a growing number of shards
+ *
+ * Producer threads queue contexts for a set of keys, each context
+ * spinning for a while as a completion callback would.  This compares a
+ * Finisher with a ShardedFinisher of 1, 2, 4... shards, and checks that
+ * the contexts of every key complete in the order they were queued.
+ */
+
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+#include "common/Finisher.h"
+#include "common/ceph_argparse.h"
+#include "global/global_context.h"
+#include "global/global_init.h"
+
+using namespace std;
+
+struct key_state_t {
+  alignas(128) uint64_t queued = 0;	///< by the producer of the key
+  alignas(128) uint64_t completed = 0;
+};
+
+static atomic<bool> misordered = false;
+
+class C_Bench : public Context {
+  key_state_t& key;
+  const uint64_t seq;
+  const chrono::nanoseconds work;
+public:
+  C_Bench(key_state_t& key, uint64_t seq, chrono::nanoseconds work)
+    : key(key), seq(seq), work(work) {}
+  void finish(int r) override {
+    if (key.completed++ != seq) {
+      misordered = true;
+    }
+    auto until = chrono::steady_clock::now() + work;
+    while (chrono::steady_clock::now() < until) ;
+  }
+};
+
+// thousand completions per second
+template <typename Queue, typename Wait>
+static double run(unsigned producers, unsigned keys, unsigned per_key,
+		  chrono::nanoseconds work, Queue&& queue, Wait&& wait)
+{
+  vector<key_state_t> state(keys);
+  vector<thread> threads;
+  auto start = chrono::steady_clock::now();
+  for (unsigned p = 0; p < producers; p++) {
+    threads.emplace_back([&, p] {
+      // every key is queued to by a single producer
+      for (unsigned i = 0; i < per_key; i++) {
+	for (unsigned k = p; k < keys; k += producers) {
+	  auto& s = state[k];
+	  queue(k, new C_Bench(s, s.queued++, work));
+	}
+      }
+    });
+  }
+  for (auto& t : threads) {
+    t.join();
+  }
+  wait();
+  chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+  if (misordered) {
+    cerr << "contexts of a key completed out of order" << std::endl;
+    exit(EXIT_FAILURE);
+  }
+  return (double)keys * per_key / elapsed.count() / 1e3;
+}
+
+void usage(const char *name) {
+  cout << name << " [max_shards] [work_ns] [per_key]\n"
+       << "\t max_shards: the largest number of shards, default the number of CPUs.\n"
+       << "\t work_ns: the time each context spins for, default 1000.\n"
+       << "\t per_key: the number of contexts per key, default 1000.\n";
+}
+
+int main(int argc, const char **argv)
+{
+  if (argc > 4) {
+    usage(argv[0]);
+    return EXIT_FAILURE;
+  }
+  unsigned max_shards = argc > 1 ? atoi(argv[1]) :
+    std::max(1u, thread::hardware_concurrency());
+  chrono::nanoseconds work(argc > 2 ? atoi(argv[2]) : 1000);
+  unsigned per_key = argc > 3 ? atoi(argv[3]) : 1000;
+  if (!max_shards || !per_key) {
+    usage(argv[0]);
+    return EXIT_FAILURE;
+  }
+  const unsigned keys = 256;
+  const unsigned producers = 4;
+
+  auto args = argv_to_vec(argc, argv);
+  auto cct = global_init(nullptr, args, CEPH_ENTITY_TYPE_CLIENT,
+			 CODE_ENVIRONMENT_UTILITY,
+			 CINIT_FLAG_NO_DEFAULT_CONFIG_FILE);
+
+  double single;
+  {
+    Finisher f(g_ceph_context);
+    f.start();
+    single = run(producers, keys, per_key, work,
+		 [&](unsigned, Context *c) { f.queue(c); },
+		 [&] { f.wait_for_empty(); });
+    f.stop();
+  }
+  cout << std::right << std::setw(8) << "shards"
+       << std::setw(14) << "Kop/s"
+       << std::setw(10) << "speedup" << std::endl;
+  cout << std::setw(8) << "finisher"
+       << std::fixed << std::setprecision(1)
+       << std::setw(14) << single
+       << std::setw(10) << 1.0 << std::endl;
+  for (unsigned shards = 1; ; shards = std::min(shards * 2, max_shards)) {
+    ShardedFinisher f(g_ceph_context, shards);
+    f.start();
+    double sharded = run(producers, keys, per_key, work,
+			 [&](unsigned k, Context *c) { f.queue(k, c); },
+			 [&] { f.wait_for_empty(); });
+    f.stop();
+    cout << std::setw(8) << shards
+	 << std::setw(14) << sharded
+	 << std::setw(10) << sharded / single << std::endl;
+    if (shards == max_shards) {
+      break;
+    }
+  }
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,111 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+
+/*
+ * PerfCounters update rate with a growing number of threads
+ *
+ * Every thread increments the same counter and time average of one
+ * PerfCounters, once with the counters shared by all threads and once
+ * with them sharded per CPU.  Sharded counters are expected to scale
+ * about linearly with the threads, as long as there are CPUs for them.
+ */
+
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "common/ceph_argparse.h"
+#include "common/perf_counters.h"
+#include "global/global_context.h"
+#include "global/global_init.h"
+
+using namespace std;
+
+enum {
+  l_bench_first = 1000,
+  l_bench_ops,
+  l_bench_lat,
+  l_bench_last,
+};
+
+static unique_ptr<PerfCounters> make_counters(bool sharded)
+{
+  PerfCountersBuilder b(g_ceph_context, "bench", l_bench_first, l_bench_last);
+  b.set_sharded(sharded);
+  b.add_u64_counter(l_bench_ops, "ops");
+  b.add_time_avg(l_bench_lat, "lat");
+  return unique_ptr<PerfCounters>(b.create_perf_counters());
+}
+
+// million updates per second done by all threads together
+static double run(PerfCounters *pc, unsigned threads, unsigned iterations)
+{
+  vector<thread> workers;
+  auto start = chrono::steady_clock::now();
+  for (unsigned t = 0; t < threads; t++) {
+    workers.emplace_back([pc, iterations] {
+      for (unsigned i = 0; i < iterations; i++) {
+	pc->inc(l_bench_ops);
+	pc->tinc(l_bench_lat, chrono::nanoseconds(i));
+      }
+    });
+  }
+  for (auto& w : workers) {
+    w.join();
+  }
+  chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+  if (pc->get(l_bench_ops) != (uint64_t)threads * iterations) {
+    cerr << "lost updates: " << pc->get(l_bench_ops) << " != "
+	 << (uint64_t)threads * iterations << std::endl;
+    exit(EXIT_FAILURE);
+  }
+  return 2.0 * threads * iterations / elapsed.count() / 1e6;
+}
+
+void usage(const char *name) {
+  cout << name << " [max_threads] [iterations]\n"
+       << "\t max_threads: the largest number of threads, default the number of CPUs.\n"
+       << "\t iterations: the number of updates per thread, default 1000000.\n";
+}
+
+int main(int argc, const char **argv)
+{
+  if (argc > 3) {
+    usage(argv[0]);
+    return EXIT_FAILURE;
+  }
+  unsigned max_threads = argc > 1 ? atoi(argv[1]) :
+    std::max(1u, thread::hardware_concurrency());
+  unsigned iterations = argc > 2 ? atoi(argv[2]) : 1000000;
+  if (!max_threads || !iterations) {
+    usage(argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  auto args = argv_to_vec(argc, argv);
+  auto cct = global_init(nullptr, args, CEPH_ENTITY_TYPE_CLIENT,
+			 CODE_ENVIRONMENT_UTILITY,
+			 CINIT_FLAG_NO_DEFAULT_CONFIG_FILE);
+
+  cout << std::right << std::setw(8) << "threads"
+       << std::setw(16) << "shared Mop/s"
+       << std::setw(16) << "sharded Mop/s"
+       << std::setw(10) << "speedup" << std::endl;
+  for (unsigned threads = 1; ; threads = std::min(threads * 2, max_threads)) {
+    double shared = run(make_counters(false).get(), threads, iterations);
+    double sharded = run(make_counters(true).get(), threads, iterations);
+    cout << std::setw(8) << threads
+	 << std::fixed << std::setprecision(1)
+	 << std::setw(16) << shared
+	 << std::setw(16) << sharded
+	 << std::setw(10) << sharded / shared << std::endl;
+    if (threads == max_threads) {
+      break;
+    }
+  }
+  return EXIT_SUCCESS;
+}
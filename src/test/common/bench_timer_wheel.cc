@@ -0,0 +1,179 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+
+/*
+ * SafeTimer schedule throughput with many pending events
+ *
+ * Compares the multimap ordered by expiry plus the map from events to
+ * their position in it, which SafeTimer used to keep, with the timing
+ * wheel it keeps now.  With the given number of events pending, this
+ * reports the cost of
+ *  - adding them, expiring uniformly over a minute,
+ *  - adding and cancelling one, as a timeout armed for every op does,
+ *  - cancelling half of them, and
+ *  - expiring the rest, in order.
+ */
+
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <random>
+#include <vector>
+
+#include "common/ceph_time.h"
+#include "common/timer_wheel.h"
+
+using namespace std;
+using clock_type = ceph::mono_clock;
+using event_t = uint64_t;
+
+/// the schedule of SafeTimer until the timing wheel
+class map_schedule {
+  using scheduled_map_t = std::multimap<clock_type::time_point, event_t>;
+  scheduled_map_t schedule;
+  std::map<event_t, scheduled_map_t::iterator> events;
+public:
+  void add(clock_type::time_point when, event_t e) {
+    auto i = schedule.insert({when, e});
+    events.insert({e, i});
+  }
+  void remove(event_t e) {
+    auto p = events.find(e);
+    schedule.erase(p->second);
+    events.erase(p);
+  }
+  bool pop_expired(clock_type::time_point now, event_t& e) {
+    if (schedule.empty() || schedule.begin()->first > now) {
+      return false;
+    }
+    e = schedule.begin()->second;
+    events.erase(e);
+    schedule.erase(schedule.begin());
+    return true;
+  }
+};
+
+class wheel_schedule {
+  ceph::timer_wheel<clock_type, event_t> schedule;
+public:
+  explicit wheel_schedule(clock_type::time_point origin)
+    : schedule(std::chrono::milliseconds(1), origin) {}
+  void add(clock_type::time_point when, event_t e) {
+    schedule.add(when, e);
+  }
+  void remove(event_t e) {
+    schedule.remove(e);
+  }
+  bool pop_expired(clock_type::time_point now, event_t& e) {
+    auto v = schedule.pop_expired(now);
+    if (v) {
+      e = *v;
+    }
+    return v.has_value();
+  }
+};
+
+struct result_t {
+  double add, churn, cancel, expire;   ///< ns per op
+};
+
+template <typename F>
+static double ns_per_op(size_t ops, F&& f)
+{
+  auto start = std::chrono::steady_clock::now();
+  f();
+  std::chrono::duration<double, std::nano> elapsed =
+    std::chrono::steady_clock::now() - start;
+  return elapsed.count() / ops;
+}
+
+template <typename Schedule>
+static result_t run(Schedule& s, clock_type::time_point origin,
+		    const vector<clock_type::duration>& offsets,
+		    size_t churn)
+{
+  const size_t n = offsets.size();
+  result_t r;
+  r.add = ns_per_op(n, [&] {
+    for (size_t i = 0; i < n; i++) {
+      s.add(origin + offsets[i], i);
+    }
+  });
+  r.churn = ns_per_op(churn, [&] {
+    for (size_t i = 0; i < churn; i++) {
+      s.add(origin + offsets[i % n] + std::chrono::seconds(1), n + i);
+      s.remove(n + i);
+    }
+  });
+  r.cancel = ns_per_op(n / 2, [&] {
+    for (size_t i = 0; i < n; i += 2) {
+      s.remove(i);
+    }
+  });
+  size_t expired = 0;
+  r.expire = ns_per_op(n - n / 2, [&] {
+    // as the timer thread would, a millisecond at a time
+    event_t e;
+    for (auto now = origin; expired < n - n / 2;
+	 now += std::chrono::milliseconds(1)) {
+      while (s.pop_expired(now, e)) {
+	expired++;
+      }
+    }
+  });
+  return r;
+}
+
+void usage(const char *name) {
+  cout << name << " [events] [churn]\n"
+       << "\t events: the number of pending events, default 1000000.\n"
+       << "\t churn: the number of events added and cancelled, default 1000000.\n";
+}
+
+int main(int argc, const char **argv)
+{
+  if (argc > 3) {
+    usage(argv[0]);
+    return EXIT_FAILURE;
+  }
+  size_t n = argc > 1 ? atol(argv[1]) : 1000000;
+  size_t churn = argc > 2 ? atol(argv[2]) : 1000000;
+  if (!n || !churn) {
+    usage(argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  std::mt19937_64 rng(0);
+  vector<clock_type::duration> offsets(n);
+  for (auto& o : offsets) {
+    o = std::chrono::microseconds(rng() % 60000000);
+  }
+
+  const auto origin = clock_type::now();
+  result_t m, w;
+  {
+    map_schedule s;
+    m = run(s, origin, offsets, churn);
+  }
+  {
+    wheel_schedule s(origin);
+    w = run(s, origin, offsets, churn);
+  }
+
+  cout << std::left << std::setw(12) << "ns/op"
+       << std::right << std::setw(10) << "add"
+       << std::setw(10) << "churn"
+       << std::setw(10) << "cancel"
+       << std::setw(10) << "expire" << std::endl;
+  for (auto& [name, r] : {std::pair{"map", m}, std::pair{"wheel", w}}) {
+    cout << std::left << std::setw(12) << name
+	 << std::right << std::fixed << std::setprecision(1)
+	 << std::setw(10) << r.add
+	 << std::setw(10) << r.churn
+	 << std::setw(10) << r.cancel
+	 << std::setw(10) << r.expire << std::endl;
+  }
+  return EXIT_SUCCESS;
+}
@@ -14,6 +14,8 @@
 #include "common/sctp_crc32.h"
 #include "common/crc32c_intel_baseline.h"
 #include "common/crc32c_aarch64.h"
+#include "common/crc32c_intel_vpclmul.h"
+#include "arch/intel.h"
 
 TEST(Crc32c, Small) {
   const char *a = "foo bar baz";
@@ -44,6 +46,44 @@ TEST(Crc32c, Big) {
   free(a);
 }
 
+TEST(Crc32c, Combine) {
+  int len = 70000;
+  unsigned char *a = (unsigned char *)malloc(len);
+  for (int i = 0; i < len; i++)
+    a[i] = rand();
+  for (int split : {0, 1, 15, 16, 255, 256, 4096, 65536, len}) {
+    uint32_t crc_a = ceph_crc32c(1234, a, split);
+    uint32_t crc_b = ceph_crc32c(0, a + split, len - split);
+    ASSERT_EQ(ceph_crc32c_sctp(1234, a, len),
+	      ceph_crc32c_combine(crc_a, crc_b, len - split));
+  }
+  free(a);
+}
+
+TEST(Crc32c, Multi) {
+  int len = 1 << 20;
+  unsigned char *a = (unsigned char *)malloc(len);
+  for (int i = 0; i < len; i++)
+    a[i] = rand();
+  for (int iter = 0; iter < 1000; iter++) {
+    const unsigned n = 1 + rand() % 8;
+    unsigned char const *data[8];
+    unsigned length[8];
+    uint32_t crc[8], init[8];
+    for (unsigned i = 0; i < n; i++) {
+      // mostly short buffers, some of them long or zero-filled
+      length[i] = rand() % 8 ? rand() % 1024 : rand() % 100000;
+      data[i] = rand() % 10 ? a + rand() % (len - length[i]) : nullptr;
+      crc[i] = init[i] = rand();
+    }
+    ceph_crc32c_multi(crc, data, length, n);
+    for (unsigned i = 0; i < n; i++) {
+      ASSERT_EQ(ceph_crc32c_sctp(init[i], data[i], length[i]), crc[i]);
+    }
+  }
+  free(a);
+}
+
 TEST(Crc32c, Performance) {
   int len = 1000 * 1024 * 1024;
   char *a = (char *)malloc(len);
@@ -84,6 +124,17 @@ TEST(Crc32c, Performance) {
     std::cout << "intel baseline = " << rate << " MB/sec" << std::endl;
     ASSERT_EQ(261108528u, val);
   }
+#if defined(__x86_64__) && defined(HAVE_INTEL_VPCLMULQDQ)
+  if (ceph_arch_intel_vpclmul) // Skip if VPCLMULQDQ instructions are not defined.
+  {
+    utime_t start = ceph_clock_now();
+    unsigned val = ceph_crc32c_intel_vpclmul(0, (unsigned char *)a, len);
+    utime_t end = ceph_clock_now();
+    float rate = (float)len / (float)(1024*1024) / (float)(end - start);
+    std::cout << "intel vpclmul = " << rate << " MB/sec" << std::endl;
+    ASSERT_EQ(261108528u, val);
+  }
+#endif
 #if defined(__arm__) || defined(__aarch64__)
   if (ceph_arch_aarch64_crc32) // Skip if CRC32C instructions are not defined.
   {
@@ -0,0 +1,166 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#include <atomic>
+#include <chrono>
+#include <set>
+#include <thread>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "include/Context.h"
+#include "common/ceph_context.h"
+#include "common/ceph_mutex.h"
+#include "common/Cond.h"
+#include "common/Finisher.h"
+
+using namespace std::chrono_literals;
+
+class ShardedFinisherTest : public ::testing::Test {
+protected:
+  boost::intrusive_ptr<CephContext> cct{
+    new CephContext(CEPH_ENTITY_TYPE_CLIENT), false};
+};
+
+TEST_F(ShardedFinisherTest, Shards)
+{
+  {
+    ShardedFinisher f(cct.get(), 1);
+    ASSERT_EQ(1u, f.get_num_shards());
+    EXPECT_EQ(&f.get_shard(0), &f.get_shard(12345));
+  }
+  {
+    ShardedFinisher f(cct.get(), 8, "test_sharded_finisher", "fn_test");
+    ASSERT_EQ(8u, f.get_num_shards());
+    // keys are often aligned pointers, they still spread over all shards
+    std::set<Finisher*> used;
+    for (uint64_t k = 0; k < 1024; k++) {
+      auto& s = f.get_shard(0x7f0000000000ull + k * 4096);
+      EXPECT_EQ(&s, &f.get_shard(0x7f0000000000ull + k * 4096));
+      used.insert(&s);
+    }
+    EXPECT_EQ(8u, used.size());
+  }
+}
+
+TEST_F(ShardedFinisherTest, Order)
+{
+  const unsigned num_keys = 64, per_key = 2000, producers = 4;
+  ShardedFinisher f(cct.get(), 4);
+  f.start();
+
+  // each key is only ever completed by one thread, so its counter is
+  // just checked against the order the contexts were queued in
+  std::vector<unsigned> next(num_keys, 0);
+  std::atomic<unsigned> out_of_order = 0;
+  std::atomic<unsigned> done = 0;
+
+  std::vector<std::thread> threads;
+  for (unsigned p = 0; p < producers; p++) {
+    threads.emplace_back([&, p] {
+      for (unsigned i = 0; i < per_key; i++) {
+	for (unsigned k = p; k < num_keys; k += producers) {
+	  f.queue(k, new LambdaContext([&, k, i](int r) {
+	    if (next[k]++ != i || r != (int)k) {
+	      out_of_order++;
+	    }
+	    done++;
+	  }), k);
+	}
+      }
+    });
+  }
+  for (auto& t : threads) {
+    t.join();
+  }
+  f.wait_for_empty();
+  EXPECT_TRUE(f.is_empty());
+  EXPECT_EQ(num_keys * per_key, done.load());
+  EXPECT_EQ(0u, out_of_order.load());
+  for (unsigned k = 0; k < num_keys; k++) {
+    EXPECT_EQ(per_key, next[k]);
+  }
+  f.stop();
+}
+
+TEST_F(ShardedFinisherTest, Concurrent)
+{
+  // a key held up does not hold up the keys of other shards
+  ShardedFinisher f(cct.get(), 2);
+  f.start();
+  uint64_t blocked = 0, other = 1;
+  while (&f.get_shard(other) == &f.get_shard(blocked)) {
+    other++;
+  }
+
+  ceph::mutex lock = ceph::make_mutex("ShardedFinisherTest::lock");
+  ceph::condition_variable cond;
+  bool release = false;
+  std::atomic<bool> behind_blocked = false;
+  f.queue(blocked, new LambdaContext([&](int) {
+    std::unique_lock l(lock);
+    cond.wait(l, [&] { return release; });
+  }));
+  f.queue(blocked, new LambdaContext([&](int) {
+    behind_blocked = true;
+  }));
+
+  C_SaferCond other_done;
+  f.queue(other, &other_done);
+  ASSERT_EQ(0, other_done.wait_for(60));
+  EXPECT_FALSE(behind_blocked);
+
+  {
+    std::lock_guard l(lock);
+    release = true;
+    cond.notify_all();
+  }
+  f.wait_for_empty();
+  EXPECT_TRUE(behind_blocked);
+  f.stop();
+}
+
+TEST_F(ShardedFinisherTest, Shutdown)
+{
+  // shutting down as users do, everything queued before is completed
+  const unsigned num_keys = 16, per_key = 100;
+  ShardedFinisher f(cct.get(), 4);
+  f.start();
+
+  ceph::mutex lock = ceph::make_mutex("ShardedFinisherTest::lock");
+  ceph::condition_variable cond;
+  bool release = false;
+  std::atomic<unsigned> done = 0;
+  for (unsigned k = 0; k < num_keys; k++) {
+    f.queue(k, new LambdaContext([&](int) {
+      std::unique_lock l(lock);
+      cond.wait(l, [&] { return release; });
+    }));
+    for (unsigned i = 0; i < per_key; i++) {
+      f.queue(k, new LambdaContext([&](int) {
+	done++;
+      }));
+    }
+  }
+
+  std::thread releaser([&] {
+    std::this_thread::sleep_for(100ms);
+    std::lock_guard l(lock);
+    release = true;
+    cond.notify_all();
+  });
+  f.wait_for_empty();
+  EXPECT_EQ(num_keys * per_key, done.load());
+  EXPECT_TRUE(f.is_empty());
+  f.stop();
+  releaser.join();
+}
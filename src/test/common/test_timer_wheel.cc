@@ -0,0 +1,130 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+
+#include <chrono>
+#include <map>
+#include <random>
+#include <set>
+#include <gtest/gtest.h>
+
+#include "common/timer_wheel.h"
+
+using clock_type = std::chrono::steady_clock;
+using namespace std::chrono_literals;
+using wheel_t = ceph::timer_wheel<clock_type, unsigned>;
+
+TEST(TimerWheel, AddRemove)
+{
+  const auto origin = clock_type::now();
+  wheel_t w(1ms, origin);
+  EXPECT_TRUE(w.empty());
+  EXPECT_EQ(clock_type::time_point::max(), w.next_expiry());
+
+  EXPECT_TRUE(w.add(origin + 10ms, 1));
+  EXPECT_FALSE(w.add(origin + 20ms, 1));
+  EXPECT_TRUE(w.add(origin + 1h, 2));
+  EXPECT_TRUE(w.add(origin + 24h * 100, 3));   // beyond the last level
+  EXPECT_EQ(3u, w.size());
+  ASSERT_TRUE(w.get(1));
+  EXPECT_EQ(origin + 10ms, *w.get(1));
+  EXPECT_FALSE(w.get(4));
+
+  EXPECT_TRUE(w.remove(2));
+  EXPECT_FALSE(w.remove(2));
+  EXPECT_EQ(2u, w.size());
+
+  EXPECT_FALSE(w.pop_expired(origin + 9ms));
+  EXPECT_LE(w.next_expiry(), origin + 10ms);
+  EXPECT_EQ(1u, w.pop_expired(origin + 10ms));
+  EXPECT_FALSE(w.pop_expired(origin + 24h * 100 - 1ns));
+  EXPECT_EQ(3u, w.pop_expired(origin + 24h * 100));
+  EXPECT_TRUE(w.empty());
+}
+
+TEST(TimerWheel, SameExpiry)
+{
+  const auto origin = clock_type::now();
+  wheel_t w(1ms, origin);
+  for (unsigned i = 0; i < 10; i++) {
+    w.add(origin + 5s, i);
+  }
+  for (unsigned i = 0; i < 10; i++) {
+    auto v = w.pop_expired(origin + 5s);
+    ASSERT_TRUE(v);
+    EXPECT_EQ(i, *v);
+  }
+  EXPECT_FALSE(w.pop_expired(origin + 5s));
+}
+
+TEST(TimerWheel, Clear)
+{
+  const auto origin = clock_type::now();
+  wheel_t w(1ms, origin);
+  for (unsigned i = 0; i < 1000; i++) {
+    w.add(origin + std::chrono::seconds(i * i), i);
+  }
+  while (w.pop_expired(origin + 1h)) ;
+  std::set<unsigned> cleared;
+  w.clear([&](clock_type::time_point, unsigned v) {
+    cleared.insert(v);
+  });
+  EXPECT_TRUE(w.empty());
+  EXPECT_EQ(1000u - 61u, cleared.size());
+  EXPECT_FALSE(w.pop_expired(origin + 24h * 365));
+}
+
+// compare the wheel with a multimap ordered by expiry, then insertion
+TEST(TimerWheel, Random)
+{
+  std::mt19937 rng(42);
+  const auto origin = clock_type::now();
+  wheel_t w(1ms, origin);
+  std::multimap<clock_type::time_point, unsigned> ref;
+  std::map<unsigned, decltype(ref)::iterator> lookup;
+
+  auto now = origin;
+  unsigned next = 0;
+  // spans from below a tick up to beyond the last level
+  const std::vector<clock_type::duration> spans = {
+    100us, 10ms, 1s, 1min, 1h, 24h, 24h * 60
+  };
+  for (unsigned round = 0; round < 2000; round++) {
+    for (unsigned i = rng() % 50; i > 0; i--) {
+      auto span = spans[rng() % spans.size()];
+      auto when = now + clock_type::duration(rng() % span.count());
+      if (rng() % 8 == 0 && !ref.empty()) {
+	// the same expiry as another event
+	when = std::next(ref.begin(), rng() % ref.size())->first;
+      }
+      ASSERT_TRUE(w.add(when, next));
+      lookup[next] = ref.emplace(when, next);
+      next++;
+    }
+    for (unsigned i = rng() % 10; i > 0 && !lookup.empty(); i--) {
+      auto p = std::next(lookup.begin(), rng() % lookup.size());
+      ASSERT_TRUE(w.remove(p->first));
+      ref.erase(p->second);
+      lookup.erase(p);
+    }
+
+    ASSERT_EQ(ref.size(), w.size());
+    if (!ref.empty()) {
+      ASSERT_LE(w.next_expiry(), ref.begin()->first);
+    }
+    // move on to the next expiry, at most a day later
+    auto step = clock_type::duration(rng() % (rng() % 4 ? 10ms : 24h).count());
+    if (!ref.empty() && rng() % 2) {
+      step = std::max(ref.begin()->first - now, clock_type::duration(0));
+    }
+    now += step;
+
+    while (auto v = w.pop_expired(now)) {
+      ASSERT_FALSE(ref.empty());
+      ASSERT_LE(ref.begin()->first, now);
+      ASSERT_EQ(ref.begin()->second, *v);
+      lookup.erase(*v);
+      ref.erase(ref.begin());
+    }
+    ASSERT_TRUE(ref.empty() || ref.begin()->first > now);
+  }
+}
@@ -0,0 +1,151 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#include <map>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "mds/ClientDispatchQueue.h"
+
+#include "gtest/gtest.h"
+
+// (client, sequence number within the client)
+using item_t = std::pair<int, int>;
+using queue_t = ClientDispatchQueue<int, item_t, 4>;
+
+TEST(ClientDispatchQueue, Order)
+{
+  queue_t q;
+  EXPECT_TRUE(q.empty());
+  EXPECT_TRUE(q.push(1, {1, 0}));
+  EXPECT_FALSE(q.push(1, {1, 1}));
+  EXPECT_FALSE(q.push(1, {1, 2}));
+  EXPECT_EQ(3u, q.size());
+
+  std::vector<item_t> out;
+  q.take(out, 100);
+  ASSERT_EQ(3u, out.size());
+  for (int i = 0; i < 3; i++) {
+    EXPECT_EQ(item_t(1, i), out[i]);
+  }
+  EXPECT_TRUE(q.empty());
+  EXPECT_TRUE(q.push(1, {1, 3}));
+}
+
+TEST(ClientDispatchQueue, Turns)
+{
+  queue_t q;
+  // a busy client queued first, then a few quiet ones
+  for (int i = 0; i < 100; i++) {
+    q.push(0, {0, i});
+  }
+  for (int c = 1; c <= 10; c++) {
+    q.push(c, {c, 0});
+  }
+
+  std::vector<item_t> out;
+  q.take(out, 22);
+  ASSERT_EQ(22u, out.size());
+  // every quiet client got its turn among the first ones taken
+  std::map<int, int> taken;
+  for (auto& [c, seq] : out) {
+    EXPECT_EQ(taken[c]++, seq);
+  }
+  EXPECT_EQ(11u, taken.size());
+  EXPECT_EQ(12, taken[0]);
+  EXPECT_EQ(100u - 12u, q.size());
+
+  // the busy client is left alone and keeps its order
+  out.clear();
+  q.take(out, 1000);
+  ASSERT_EQ(88u, out.size());
+  for (int i = 0; i < 88; i++) {
+    EXPECT_EQ(item_t(0, 12 + i), out[i]);
+  }
+  EXPECT_TRUE(q.empty());
+}
+
+TEST(ClientDispatchQueue, Batch)
+{
+  queue_t q;
+  for (int c = 0; c < 10; c++) {
+    for (int i = 0; i < 10; i++) {
+      q.push(c, {c, i});
+    }
+  }
+  std::map<int, int> next;
+  std::vector<item_t> out;
+  while (!q.empty()) {
+    out.clear();
+    q.take(out, 7);
+    ASSERT_LE(out.size(), 7u);
+    ASSERT_FALSE(out.empty());
+    for (auto& [c, seq] : out) {
+      ASSERT_EQ(next[c]++, seq);
+    }
+  }
+  EXPECT_EQ(10u, next.size());
+}
+
+TEST(ClientDispatchQueue, Clear)
+{
+  queue_t q;
+  for (int c = 0; c < 10; c++) {
+    for (int i = 0; i < 3; i++) {
+      q.push(c, {c, i});
+    }
+  }
+  std::vector<item_t> out;
+  q.take(out, 5);
+  unsigned cleared = 0;
+  q.clear([&cleared](item_t&) { cleared++; });
+  EXPECT_EQ(25u, cleared);
+  EXPECT_TRUE(q.empty());
+  out.clear();
+  q.take(out, 100);
+  EXPECT_TRUE(out.empty());
+  EXPECT_TRUE(q.push(3, {3, 0}));
+}
+
+TEST(ClientDispatchQueue, Concurrent)
+{
+  queue_t q;
+  const int clients = 16, per_client = 10000;
+  std::vector<std::thread> producers;
+  for (int p = 0; p < 4; p++) {
+    producers.emplace_back([&q, p] {
+      // a client is pushed to by a single thread, as a connection is
+      for (int i = 0; i < per_client; i++) {
+	for (int c = p; c < clients; c += 4) {
+	  q.push(c, {c, i});
+	}
+      }
+    });
+  }
+
+  std::map<int, int> next;
+  std::vector<item_t> out;
+  int total = 0;
+  while (total < clients * per_client) {
+    out.clear();
+    q.take(out, 64);
+    for (auto& [c, seq] : out) {
+      ASSERT_EQ(next[c]++, seq);
+    }
+    total += out.size();
+  }
+  for (auto& t : producers) {
+    t.join();
+  }
+  EXPECT_TRUE(q.empty());
+}
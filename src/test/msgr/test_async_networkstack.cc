@@ -21,14 +21,17 @@
 #include <random>
 #include <string>
 #include <set>
+#include <thread>
 #include <vector>
 #include <gtest/gtest.h>
 
 #include "acconfig.h"
 #include "common/config_obs.h"
 #include "include/Context.h"
+#include "include/scope_guard.h"
 #include "msg/async/Event.h"
 #include "msg/async/Stack.h"
+#include "msg/async/net_handler.h"
 
 using namespace std;
 using namespace std::literals;
@@ -62,7 +65,7 @@ class NetworkWorkerTest : public ::testing::TestWithParam<const char*> {
   void SetUp() override {
     cerr << __func__ << " start set up " << GetParam() << std::endl;
     if (strncmp(GetParam(), "dpdk", 4)) {
-      g_ceph_context->_conf.set_val("ms_type", "async+posix");
+      g_ceph_context->_conf.set_val("ms_type", string("async+") + GetParam());
       addr = "127.0.0.1:15000";
       port_addr = "127.0.0.1:15001";
     } else {
@@ -1041,6 +1044,300 @@ TEST_P(NetworkWorkerTest, StressTest) {
   ASSERT_EQ(0, factory.message_left);
 }
 
+TEST(NetworkStackTest, LoadAwarePlacement) {
+  g_ceph_context->_conf.set_val("ms_async_migrate_load_gap", "20");
+  // the workers are not started, so their loads are left as we set them
+  auto stack = NetworkStack::create(g_ceph_context, "posix");
+  g_ceph_context->_conf.rm_val("ms_async_migrate_load_gap");
+  unsigned n = stack->get_num_worker();
+  ASSERT_GE(n, 2u);
+  Worker *hot = stack->get_worker(0u);
+
+  // the busy worker gets no new connections despite having the fewest
+  hot->load = 900;
+  for (unsigned i = 1; i < n; ++i) {
+    stack->get_worker(i)->load = 50;
+  }
+  for (unsigned i = 0; i < 2 * (n - 1); ++i) {
+    Worker *w = stack->get_worker();
+    ASSERT_NE(w, hot);
+  }
+  ASSERT_EQ(0u, hot->references.load());
+  // workers of similar load are balanced by connections
+  for (unsigned i = 1; i < n; ++i) {
+    ASSERT_EQ(2u, stack->get_worker(i)->references.load());
+  }
+
+  // one idle connection moves off the hot worker per sample
+  Worker *target = stack->get_migration_target(hot);
+  ASSERT_NE(nullptr, target);
+  ASSERT_NE(hot, target);
+  ASSERT_EQ(3u, target->references.load());
+  ASSERT_EQ(nullptr, stack->get_migration_target(hot));
+  // and never off a worker that is not busier by the gap
+  ASSERT_EQ(nullptr, stack->get_migration_target(target));
+}
+
+
+TEST(NetworkStackTest, RxBufferPool) {
+  g_ceph_context->_conf.set_val("ms_rx_buffer_pool_size", "8192");
+  auto stack = NetworkStack::create(g_ceph_context, "posix");
+  g_ceph_context->_conf.rm_val("ms_rx_buffer_pool_size");
+  Worker *worker = stack->get_worker(0u);
+  ASSERT_TRUE(worker->rx_buffer_pool);
+  RxBufferPool *pool = worker->rx_buffer_pool.get();
+  PerfCounters *logger = worker->get_perf_counter();
+  const uint64_t misses = logger->get(l_msgr_rx_pool_miss);
+  const uint64_t hits = logger->get(l_msgr_rx_pool_hit);
+
+  // segments are rounded up to the next quarter power of two and come
+  // back to their size class
+  const char *data;
+  {
+    bufferptr p(pool->get(3000, 8, logger));
+    ASSERT_TRUE(p.have_raw());
+    ASSERT_EQ(3072u, p.raw_length());
+    data = p.c_str();
+  }
+  ASSERT_EQ(3072u, pool->get_cached_bytes());
+  {
+    bufferptr p(pool->get(2600, 1024, logger));
+    ASSERT_EQ(data, p.c_str());
+    ASSERT_EQ(0u, pool->get_cached_bytes());
+  }
+  ASSERT_EQ(misses + 1, logger->get(l_msgr_rx_pool_miss));
+  ASSERT_EQ(hits + 1, logger->get(l_msgr_rx_pool_hit));
+
+  // what does not fit in ms_rx_buffer_pool_size is released
+  {
+    bufferptr a(pool->get(4096, 8, logger));
+    bufferptr b(pool->get(4096, 8, logger));
+    bufferptr c(pool->get(4096, 8, logger));
+  }
+  ASSERT_EQ(8192u, pool->get_cached_bytes());
+
+  // puts to different classes cannot overshoot the limit together
+  {
+    std::vector<bufferptr> bufs;
+    for (unsigned len = 512; len <= 8192; len += 512) {
+      bufs.emplace_back(pool->get(len, 8, logger));
+      bufs.emplace_back(pool->get(len, 8, logger));
+    }
+    std::vector<std::thread> threads;
+    for (unsigned t = 0; t < 4; t++) {
+      threads.emplace_back([&bufs, t] {
+	for (size_t i = t; i < bufs.size(); i += 4) {
+	  bufs[i] = bufferptr();
+	}
+      });
+    }
+    for (auto &t : threads) {
+      t.join();
+    }
+  }
+  ASSERT_LE(pool->get_cached_bytes(), 8192u);
+
+  // a segment just over 2MB does not take a 4MB buffer
+  {
+    bufferptr p(pool->get((2 << 20) + 1, 8, logger));
+    ASSERT_TRUE(p.have_raw());
+    ASSERT_EQ(5u << 19, p.raw_length());
+  }
+
+  // too large or too strictly aligned segments are not pooled
+  ASSERT_FALSE(pool->get(8 << 20, 8, logger));
+  ASSERT_FALSE(pool->get(512, 4096, logger));
+  ASSERT_FALSE(pool->get(640, 256, logger));
+}
+
+static void connect_pair(Worker *worker, ServerSocket &bind_socket,
+			 const entity_addr_t &bind_addr,
+			 ConnectedSocket *cli, ConnectedSocket *srv)
+{
+  SocketOptions options;
+  ASSERT_EQ(0, worker->connect(bind_addr, options, cli));
+  entity_addr_t cli_addr;
+  int r = -EAGAIN;
+  for (int i = 0; i < 1000; ++i) {
+    r = bind_socket.accept(srv, options, &cli_addr, worker);
+    if (r != -EAGAIN)
+      break;
+    usleep(1000);
+  }
+  ASSERT_EQ(0, r);
+  for (int i = 0; i < 1000; ++i) {
+    r = cli->is_connected();
+    if (r != 0)
+      break;
+    usleep(1000);
+  }
+  ASSERT_EQ(1, r);
+}
+
+static bufferlist make_zerocopy_payload(unsigned len, char c, bufferptr *keep)
+{
+  bufferptr p = buffer::create_page_aligned(len);
+  memset(p.c_str(), c, len);
+  *keep = p;
+  bufferlist bl;
+  bl.append(p);
+  return bl;
+}
+
+// read len bytes, all of them have to be c
+static void read_all(ConnectedSocket &srv, uint64_t len, char c)
+{
+  char buf[65536];
+  uint64_t got = 0;
+  for (int i = 0; got < len && i < 5000; ) {
+    ssize_t r = srv.read(buf, sizeof(buf));
+    if (r == -EAGAIN) {
+      usleep(1000);
+      ++i;
+      continue;
+    }
+    if (r <= 0)
+      break;
+    for (ssize_t j = 0; j < r; ++j) {
+      ASSERT_EQ(c, buf[j]) << "at offset " << got + j;
+    }
+    got += r;
+  }
+  ASSERT_EQ(len, got);
+}
+
+// the peer closed its side once its data was read
+static void wait_for_eof(ConnectedSocket &srv)
+{
+  char buf[4096];
+  ssize_t r = -EAGAIN;
+  for (int i = 0; r == -EAGAIN && i < 5000; ++i) {
+    r = srv.read(buf, sizeof(buf));
+    if (r == -EAGAIN) {
+      usleep(1000);
+    }
+  }
+  ASSERT_EQ(0, r);
+}
+
+static void wait_for_release(const std::vector<bufferptr>& bufs)
+{
+  for (int i = 0; i < 5000; ++i) {
+    if (std::all_of(bufs.begin(), bufs.end(),
+		    [](auto& p) { return p.raw_nref() == 1; })) {
+      break;
+    }
+    usleep(1000);
+  }
+  for (auto& p : bufs) {
+    ASSERT_EQ(1, p.raw_nref());
+  }
+}
+
+TEST(NetworkStackTest, ZeroCopySend) {
+  {
+    ceph::NetHandler net(g_ceph_context);
+    int fd = net.create_socket(AF_INET);
+    ASSERT_LE(0, fd);
+    int r = net.set_zerocopy(fd);
+    ::close(fd);
+    if (r < 0) {
+      GTEST_SKIP() << "no SO_ZEROCOPY support";
+    }
+  }
+  g_ceph_context->_conf.set_val("ms_tcp_zerocopy", "true");
+  g_ceph_context->_conf.set_val("ms_tcp_zerocopy_min_size", "64K");
+  auto restore = make_scope_guard([] {
+    g_ceph_context->_conf.rm_val("ms_tcp_zerocopy");
+    g_ceph_context->_conf.rm_val("ms_tcp_zerocopy_min_size");
+  });
+  auto stack = NetworkStack::create(g_ceph_context, "posix");
+  // sockets closed with sends outstanding are kept by the worker threads
+  stack->start();
+  auto stop = make_scope_guard([&stack] {
+    stack->stop();
+  });
+  Worker *worker = stack->get_worker(0u);
+  entity_addr_t bind_addr;
+  ASSERT_TRUE(bind_addr.parse("127.0.0.1:15002"));
+  SocketOptions options;
+  ServerSocket bind_socket;
+  ASSERT_EQ(0, worker->listen(bind_addr, 0, options, &bind_socket));
+  const unsigned len = 256 << 10;
+
+  {
+    ConnectedSocket cli, srv;
+    ASSERT_NO_FATAL_FAILURE(
+      connect_pair(worker, bind_socket, bind_addr, &cli, &srv));
+
+    // the sent buffer stays referenced by the socket until the kernel
+    // reports the send complete, on loopback once the peer read it
+    bufferptr p;
+    bufferlist bl = make_zerocopy_payload(len, 'a', &p);
+    ASSERT_EQ((ssize_t)len, cli.send(bl, false));
+    ASSERT_EQ(0u, bl.length());
+    ASSERT_EQ(2, p.raw_nref());
+    cli.reap_completions();
+    ASSERT_EQ(2, p.raw_nref());
+
+    ASSERT_NO_FATAL_FAILURE(read_all(srv, len, 'a'));
+    for (int i = 0; i < 1000 && p.raw_nref() > 1; ++i) {
+      usleep(1000);
+      cli.reap_completions();
+    }
+    ASSERT_EQ(1, p.raw_nref());
+
+    // loopback reported SO_EE_CODE_ZEROCOPY_COPIED, so the connection went
+    // back to copying sends, which keep nothing
+    bufferptr q;
+    bl = make_zerocopy_payload(len, 'b', &q);
+    ASSERT_EQ((ssize_t)len, cli.send(bl, false));
+    ASSERT_EQ(1, q.raw_nref());
+    ASSERT_NO_FATAL_FAILURE(read_all(srv, len, 'b'));
+    cli.close();
+    srv.close();
+  }
+
+  {
+    ConnectedSocket cli, srv;
+    ASSERT_NO_FATAL_FAILURE(
+      connect_pair(worker, bind_socket, bind_addr, &cli, &srv));
+
+    // fill the socket while the peer does not read
+    std::vector<bufferptr> sent;
+    uint64_t sent_bytes = 0;
+    for (int i = 0; i < 256; ++i) {
+      bufferptr p;
+      bufferlist bl = make_zerocopy_payload(len, 'c', &p);
+      ssize_t r = cli.send(bl, false);
+      ASSERT_LE(0, r);
+      if (r > 0) {
+	sent.push_back(p);
+	sent_bytes += r;
+      }
+      if (r < (ssize_t)len) {
+	break;
+      }
+    }
+    ASSERT_FALSE(sent.empty());
+    cli.reap_completions();
+    for (auto& p : sent) {
+      ASSERT_LT(1, p.raw_nref());
+    }
+
+    // closing does not drop what was queued, and the worker keeps the
+    // buffers until the kernel let go of them
+    cli.close();
+    for (auto& p : sent) {
+      ASSERT_LT(1, p.raw_nref());
+    }
+    ASSERT_NO_FATAL_FAILURE(read_all(srv, sent_bytes, 'c'));
+    ASSERT_NO_FATAL_FAILURE(wait_for_eof(srv));
+    ASSERT_NO_FATAL_FAILURE(wait_for_release(sent));
+    srv.close();
+  }
+  bind_socket.abort_accept();
+}
 
 INSTANTIATE_TEST_SUITE_P(
   NetworkStack,
@@ -1048,6 +1345,9 @@ INSTANTIATE_TEST_SUITE_P(
   ::testing::Values(
 #ifdef HAVE_DPDK
     "dpdk",
+#endif
+#ifdef HAVE_LIBURING
+    "uring",
 #endif
     "posix"
   )
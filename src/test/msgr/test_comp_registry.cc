@@ -4,11 +4,13 @@
 #include "include/types.h"
 #include "include/stringify.h"
 #include "compressor/Compressor.h"
+#include "msg/Message.h"
 #include "msg/compressor_registry.h"
 #include "gtest/gtest.h"
 #include "common/ceph_context.h"
 #include "global/global_context.h"
 
+#include <cerrno>
 #include <sstream>
 
 TEST(CompressorRegistry, con_modes)
@@ -96,3 +98,158 @@ TEST(CompressorRegistry, con_modes)
   // back to normalish, for the benefit of the next test(s)
   cct->_set_module_type(CEPH_ENTITY_TYPE_CLIENT);  
 }
+
+TEST(CompressorRegistry, type_policy)
+{
+  auto cct = g_ceph_context;
+  CompressorRegistry reg(cct);
+  using ceph::compression::onwire::TxPolicy;
+
+  cct->_conf.set_val("ms_osd_compress_min_size", "1024");
+  cct->_conf.set_val("ms_osd_compress_types",
+		     "MOSDOp=64K, 0x46=never bogus 0=1 MOSDBogus=1 113=4K");
+  cct->_conf.set_val("ms_compress_min_ratio", "1.5");
+  cct->_conf.set_val("ms_compress_backoff_frames", "16");
+  cct->_conf.apply_changes(NULL);
+
+  TxPolicy policy = reg.get_tx_policy(CEPH_ENTITY_TYPE_OSD);
+  ASSERT_EQ(policy.type_min_size.size(), 3);
+  ASSERT_EQ(policy.get_min_size(CEPH_MSG_OSD_OP), 64u << 10);
+  ASSERT_EQ(policy.get_min_size(MSG_OSD_PING), TxPolicy::NEVER);
+  ASSERT_EQ(policy.get_min_size(MSG_OSD_REPOPREPLY), 4u << 10);
+  ASSERT_EQ(policy.get_min_size(0), 1024);
+  ASSERT_EQ(policy.get_min_size(112), 1024);
+  ASSERT_EQ(policy.min_ratio, 1.5);
+  ASSERT_EQ(policy.backoff_frames, 16);
+
+  // nothing is compressed when talking to other daemons
+  policy = reg.get_tx_policy(CEPH_ENTITY_TYPE_MON);
+  ASSERT_TRUE(policy.type_min_size.empty());
+  ASSERT_EQ(policy.min_ratio, 0);
+
+  cct->_conf.rm_val("ms_osd_compress_min_size");
+  cct->_conf.rm_val("ms_osd_compress_types");
+  cct->_conf.rm_val("ms_compress_min_ratio");
+  cct->_conf.rm_val("ms_compress_backoff_frames");
+  cct->_conf.apply_changes(NULL);
+
+  policy = reg.get_tx_policy(CEPH_ENTITY_TYPE_OSD);
+  ASSERT_EQ(policy.get_min_size(CEPH_MSG_PING), TxPolicy::NEVER);
+  ASSERT_EQ(policy.get_min_size(MSG_OSD_PING), TxPolicy::NEVER);
+  ASSERT_EQ(policy.get_min_size(CEPH_MSG_OSD_OP), policy.min_size);
+}
+
+namespace {
+
+using ceph::compression::onwire::TxHandler;
+using ceph::compression::onwire::TxPolicy;
+
+/// shrinks its input by a set ratio
+class FakeCompressor : public Compressor {
+public:
+  double ratio = 4;
+
+  FakeCompressor() : Compressor(COMP_ALG_NONE, "fake") {}
+  int compress(const ceph::bufferlist &in, ceph::bufferlist &out,
+	       std::optional<int32_t> &compressor_message) override {
+    out.append_zero(std::max<unsigned>(1, in.length() / ratio));
+    return 0;
+  }
+  int decompress(const ceph::bufferlist &in, ceph::bufferlist &out,
+		 std::optional<int32_t> compressor_message) override {
+    return -EOPNOTSUPP;
+  }
+  int decompress(ceph::bufferlist::const_iterator &p, size_t compressed_len,
+		 ceph::bufferlist &out,
+		 std::optional<int32_t> compressor_message) override {
+    return -EOPNOTSUPP;
+  }
+};
+
+/// as FrameAssembler::asm_compress() does, for a single segment frame
+bool send_frame(TxHandler& tx, std::uint16_t msg_type, unsigned len)
+{
+  ceph::bufferlist bl;
+  bl.append_zero(len);
+  tx.reset_handler(1, len, msg_type);
+  if (!tx.compress(bl)) {
+    return false;
+  }
+  tx.done();
+  return true;
+}
+
+} // anonymous namespace
+
+TEST(TxHandler, type_min_size)
+{
+  auto compressor = std::make_shared<FakeCompressor>();
+  TxPolicy policy;
+  policy.min_size = 1024;
+  policy.type_min_size[42] = 64 << 10;
+  policy.type_min_size[70] = TxPolicy::NEVER;
+  TxHandler tx(g_ceph_context, compressor, Compressor::COMP_FORCE, policy);
+
+  ASSERT_FALSE(send_frame(tx, 0, 1000));
+  ASSERT_TRUE(send_frame(tx, 0, 1024));
+  ASSERT_TRUE(send_frame(tx, 112, 4096));
+  ASSERT_FALSE(send_frame(tx, 42, 4096));
+  ASSERT_TRUE(send_frame(tx, 42, 64 << 10));
+  ASSERT_FALSE(send_frame(tx, 70, 1024));
+  ASSERT_FALSE(send_frame(tx, 70, 16 << 20));
+}
+
+TEST(TxHandler, ratio_backoff)
+{
+  auto compressor = std::make_shared<FakeCompressor>();
+  TxPolicy policy;
+  policy.min_size = 1024;
+  policy.min_ratio = 2;
+  policy.backoff_frames = 3;
+  TxHandler tx(g_ceph_context, compressor, Compressor::COMP_FORCE, policy);
+
+  // compressing well, never backs off
+  for (int i = 0; i < 10; i++) {
+    ASSERT_TRUE(send_frame(tx, 42, 4096));
+  }
+
+  // the average ratio drops below min_ratio after a few frames
+  compressor->ratio = 1.1;
+  int compressed = 0;
+  while (send_frame(tx, 42, 4096)) {
+    ASSERT_LT(++compressed, 100);
+  }
+  ASSERT_GT(compressed, 1);
+  // the frame refused above was the first of the back off
+  ASSERT_FALSE(send_frame(tx, 42, 4096));
+  ASSERT_FALSE(send_frame(tx, 42, 4096));
+  // other types are not backed off
+  ASSERT_TRUE(send_frame(tx, 43, 4096));
+  // frames below the threshold do not count towards the back off
+  ASSERT_FALSE(send_frame(tx, 42, 100));
+  // probed again afterwards, with a fresh average
+  ASSERT_TRUE(send_frame(tx, 42, 4096));
+  ASSERT_FALSE(send_frame(tx, 42, 4096));
+
+  // and compressed again once it compresses well
+  for (int i = 0; i < 2; i++) {
+    ASSERT_FALSE(send_frame(tx, 42, 4096));
+  }
+  compressor->ratio = 4;
+  for (int i = 0; i < 10; i++) {
+    ASSERT_TRUE(send_frame(tx, 42, 4096));
+  }
+}
+
+TEST(TxHandler, no_min_ratio)
+{
+  auto compressor = std::make_shared<FakeCompressor>();
+  compressor->ratio = 1.01;
+  TxPolicy policy;
+  policy.min_size = 1024;
+  policy.backoff_frames = 3;
+  TxHandler tx(g_ceph_context, compressor, Compressor::COMP_FORCE, policy);
+  for (int i = 0; i < 10; i++) {
+    ASSERT_TRUE(send_frame(tx, 42, 4096));
+  }
+}
@@ -14,6 +14,7 @@
 
 #include "msg/async/frames_v2.h"
 
+#include <algorithm>
 #include <numeric>
 #include <ostream>
 #include <string>
@@ -147,6 +148,22 @@ static bufferlist make_bufferlist(size_t len, char c) {
   return bl;
 }
 
+// split bl into many small buffers with a few large ones in between, the
+// way an encoded message front usually looks
+static bufferlist fragment(const bufferlist& bl) {
+  static const unsigned sizes[] = {1, 15, 64, 700, 1100, 4000};
+  bufferlist out;
+  for (unsigned off = 0, i = 0; off < bl.length(); i++) {
+    unsigned len = std::min<unsigned>(sizes[i % std::size(sizes)],
+                                      bl.length() - off);
+    bufferlist piece;
+    piece.substr_of(bl, off, len);
+    out.push_back(ceph::bufferptr(piece.c_str(), len));
+    off += len;
+  }
+  return out;
+}
+
 bool disassemble_frame(FrameAssembler& frame_asm, bufferlist& frame_bl,
                        Tag& tag, segment_bls_t& segment_bls) {
   bufferlist preamble_bl;
@@ -205,10 +222,12 @@ protected:
       comp_meta.con_mode = Compressor::COMP_FORCE;
       comp_meta.con_method = Compressor::COMP_ALG_SNAPPY;
       m_tx_comp = ceph::compression::onwire::rxtx_t::create_handler_pair(
-        g_ceph_context, comp_meta, /*min_compress_size=*/COMP_THRESHOLD
+        g_ceph_context, comp_meta,
+        ceph::compression::onwire::TxPolicy{/*min_size=*/COMP_THRESHOLD}
       );
       m_rx_comp = ceph::compression::onwire::rxtx_t::create_handler_pair(
-        g_ceph_context, comp_meta, /*min_compress_size=*/COMP_THRESHOLD
+        g_ceph_context, comp_meta,
+        ceph::compression::onwire::TxPolicy{/*min_size=*/COMP_THRESHOLD}
       );
     }
   }
@@ -233,7 +252,12 @@ protected:
   }
 
   void test_round_trip() {
-    auto tx_frame = TestFrame::Encode(m_header, m_front, m_middle, m_data);
+    test_round_trip(m_header, m_front, m_middle, m_data);
+  }
+
+  void test_round_trip(const bufferlist& header, const bufferlist& front,
+                       const bufferlist& middle, const bufferlist& data) {
+    auto tx_frame = TestFrame::Encode(header, front, middle, data);
     auto onwire_bl = tx_frame.get_buffer(m_tx_frame_asm);
     check_frame_assembler(m_tx_frame_asm);
     EXPECT_EQ(m_tx_frame_asm.get_frame_onwire_len(), onwire_bl.length());
@@ -248,10 +272,10 @@ protected:
     EXPECT_EQ(m_rx_frame_asm.get_num_segments(), rx_segment_bls.size());
 
     auto rx_frame = TestFrame::Decode(rx_segment_bls);
-    EXPECT_TRUE(m_header.contents_equal(rx_frame.header()));
-    EXPECT_TRUE(m_front.contents_equal(rx_frame.front()));
-    EXPECT_TRUE(m_middle.contents_equal(rx_frame.middle()));
-    EXPECT_TRUE(m_data.contents_equal(rx_frame.data()));
+    EXPECT_TRUE(header.contents_equal(rx_frame.header()));
+    EXPECT_TRUE(front.contents_equal(rx_frame.front()));
+    EXPECT_TRUE(middle.contents_equal(rx_frame.middle()));
+    EXPECT_TRUE(data.contents_equal(rx_frame.data()));
   }
 
   ceph::crypto::onwire::rxtx_t m_tx_crypto;
@@ -279,6 +303,13 @@ TEST_P(RoundTripTest, Reuse) {
   }
 }
 
+TEST_P(RoundTripTest, Fragmented) {
+  for (int i = 0; i < 3; i++) {
+    test_round_trip(fragment(m_header), fragment(m_front),
+                    fragment(m_middle), fragment(m_data));
+  }
+}
+
 static const round_trip_instance_t round_trip_instances[] = {
   // first segment is empty
   { 0,   0,   0,   0, 1, {{32,  0,  17,   0,   0,  0},
@@ -436,6 +467,20 @@ TEST_P(RoundTripPerfTest, DISABLED_Basic) {
   }
 }
 
+TEST_P(RoundTripPerfTest, DISABLED_Fragmented) {
+  const auto front = fragment(m_front);
+  const auto data = fragment(m_data);
+  for (int i = 0; i < 100000; i++) {
+    auto tx_frame = TestFrame::Encode(m_header, front, m_middle, data);
+    auto onwire_bl = tx_frame.get_buffer(m_tx_frame_asm);
+
+    Tag rx_tag;
+    segment_bls_t rx_segment_bls;
+    ASSERT_TRUE(disassemble_frame(m_rx_frame_asm, onwire_bl, rx_tag,
+                                  rx_segment_bls));
+  }
+}
+
 static const round_trip_instance_t round_trip_perf_instances[] = {
   {41, 250, 0,       0, 2, {{32, 41, 250, 17,       0,  0},
                             {32, 48, 256, 32,       0,  0},
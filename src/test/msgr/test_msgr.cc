@@ -19,10 +19,13 @@
 #include <list>
 #include <memory>
 #include <set>
+#include <thread>
 #include <gmock/gmock-matchers.h>
 #include <stdlib.h>
 #include <time.h>
 #include <unistd.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
 
 #include <boost/random/binomial_distribution.hpp>
 #include <boost/random/mersenne_twister.hpp>
@@ -44,11 +47,13 @@
 #include "msg/Messenger.h"
 #include "msg/msg_types.h"
 #include "msg/async/AsyncMessenger.h"
+#include "msg/async/net_handler.h"
 
 typedef boost::mt11213b gen_type;
 
 #include "common/dout.h"
 #include "include/ceph_assert.h"
+#include "include/scope_guard.h"
 
 #include "auth/DummyAuth.h"
 
@@ -1703,6 +1708,245 @@ TEST_P(MessengerTest, MessageTest) {
   client_msgr->wait();
 }
 
+// DummyAuth with a fixed connection secret, so that the connections can
+// run in secure mode without cephx
+class SecureDummyAuthClientServer : public DummyAuthClientServer {
+  const std::string secret = std::string(64, 'k');
+public:
+  SecureDummyAuthClientServer(CephContext *cct)
+    : DummyAuthClientServer(cct) {}
+
+  int get_auth_request(
+    Connection *con,
+    AuthConnectionMeta *auth_meta,
+    uint32_t *method,
+    std::vector<uint32_t> *preferred_modes,
+    bufferlist *out) override {
+    *method = CEPH_AUTH_NONE;
+    *preferred_modes = { CEPH_CON_MODE_SECURE };
+    return 0;
+  }
+
+  int handle_auth_done(
+    Connection *con,
+    AuthConnectionMeta *auth_meta,
+    uint64_t global_id,
+    uint32_t con_mode,
+    const bufferlist& bl,
+    CryptoKey *session_key,
+    std::string *connection_secret) override {
+    *connection_secret = secret;
+    return 0;
+  }
+
+  uint32_t pick_con_mode(
+    int peer_type,
+    uint32_t auth_method,
+    const std::vector<uint32_t>& preferred_modes) override {
+    return CEPH_CON_MODE_SECURE;
+  }
+
+  int handle_auth_request(
+    Connection *con,
+    AuthConnectionMeta *auth_meta,
+    bool more,
+    uint32_t auth_method,
+    const bufferlist& bl,
+    bufferlist *reply) override {
+    auth_meta->connection_secret = secret;
+    return 1;
+  }
+};
+
+// whether the kernel takes kernel TLS keys on a loopback TCP connection
+static bool ktls_supported()
+{
+  ceph::NetHandler handler(g_ceph_context);
+  int listen_fd = ::socket(AF_INET, SOCK_STREAM, 0);
+  int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+  auto close_fds = make_scope_guard([&] {
+    ::close(fd);
+    ::close(listen_fd);
+  });
+  sockaddr_in sa = {};
+  sa.sin_family = AF_INET;
+  sa.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  socklen_t len = sizeof(sa);
+  if (listen_fd < 0 || fd < 0 ||
+      ::bind(listen_fd, (sockaddr*)&sa, sizeof(sa)) < 0 ||
+      ::listen(listen_fd, 1) < 0 ||
+      ::getsockname(listen_fd, (sockaddr*)&sa, &len) < 0 ||
+      ::connect(fd, (sockaddr*)&sa, sizeof(sa)) < 0) {
+    return false;
+  }
+  const unsigned char key[16] = {}, iv[12] = {};
+  return handler.enable_ktls(fd) == 0 &&
+    handler.set_ktls_key(fd, true, key, iv) == 0 &&
+    handler.set_ktls_key(fd, false, key, iv) == 0;
+}
+
+TEST_P(MessengerTest, KernelTLSTest) {
+  if (string(GetParam()) != "async+posix") {
+    GTEST_SKIP() << "kernel TLS is only offered by the posix stack";
+  }
+  if (!ktls_supported()) {
+    GTEST_SKIP() << "kernel has no TCP_ULP \"tls\" support";
+  }
+  g_ceph_context->_conf.set_val("ms_ktls", "true");
+  auto restore_ktls = make_scope_guard([] {
+    g_ceph_context->_conf.rm_val("ms_ktls");
+  });
+  SecureDummyAuthClientServer secure_auth(g_ceph_context);
+  secure_auth.auth_registry.refresh_config();
+  server_msgr->set_auth_client(&secure_auth);
+  server_msgr->set_auth_server(&secure_auth);
+  client_msgr->set_auth_client(&secure_auth);
+  client_msgr->set_auth_server(&secure_auth);
+
+  FakeDispatcher cli_dispatcher(false), srv_dispatcher(true);
+  entity_addr_t bind_addr;
+  bind_addr.parse("v2:127.0.0.1");
+  server_msgr->bind(bind_addr);
+  server_msgr->add_dispatcher_head(&srv_dispatcher);
+  server_msgr->start();
+  client_msgr->add_dispatcher_head(&cli_dispatcher);
+  client_msgr->start();
+
+  // 1. small messages right after the handshake
+  ConnectionRef conn = client_msgr->connect_to(server_msgr->get_mytype(),
+					       server_msgr->get_myaddrs());
+  for (int i = 0; i < 10; i++) {
+    ASSERT_EQ(conn->send_message(new MPing()), 0);
+    std::unique_lock l{cli_dispatcher.lock};
+    cli_dispatcher.cond.wait(l, [&] { return cli_dispatcher.got_new; });
+    cli_dispatcher.got_new = false;
+  }
+  ASSERT_TRUE(conn->is_connected());
+  ASSERT_EQ(10U, static_cast<Session*>(conn->get_priv().get())->get_count());
+
+  // the records are protected by the kernel, not by the stream handlers
+  {
+    auto f = Formatter::create_unique("json");
+    static_cast<AsyncConnection*>(conn.get())->dump(f.get(), false);
+    std::ostringstream os;
+    f->flush(os);
+    ASSERT_THAT(os.str(), ::testing::HasSubstr(
+      "\"crypto\":{\"rx\":\"kTLS AES-128-GCM\",\"tx\":\"kTLS AES-128-GCM\"}"))
+      << os.str();
+  }
+
+  // 2. a large "front" and "data"
+  {
+    uuid_d uuid;
+    uuid.generate_random();
+    vector<string> cmds;
+    bufferlist bl;
+    string s("abcdefghijklmnopqrstuvwxyz");
+    for (int i = 0; i < 1024*30; i++) {
+      cmds.push_back(s);
+      bl.append(s);
+    }
+    MCommand *m = new MCommand(uuid);
+    m->cmd = cmds;
+    m->set_data(bl);
+    ASSERT_EQ(conn->send_message(m), 0);
+    std::unique_lock l{cli_dispatcher.lock};
+    cli_dispatcher.cond.wait_for(l, 500s, [&] { return cli_dispatcher.got_new; });
+    ASSERT_TRUE(cli_dispatcher.got_new);
+    cli_dispatcher.got_new = false;
+  }
+  ASSERT_TRUE(conn->is_connected());
+
+  server_msgr->shutdown();
+  client_msgr->shutdown();
+  server_msgr->wait();
+  client_msgr->wait();
+}
+
+
+static int get_worker_id(AsyncConnection *conn)
+{
+  auto f = Formatter::create_unique("json");
+  conn->dump(f.get(), false);
+  std::ostringstream os;
+  f->flush(os);
+  auto s = os.str();
+  auto p = s.find("\"worker_id\":");
+  ceph_assert(p != std::string::npos);
+  return atoi(s.c_str() + p + strlen("\"worker_id\":"));
+}
+
+TEST_P(MessengerTest, MigrationTest) {
+  if (string(GetParam()) != "async+posix") {
+    GTEST_SKIP() << "connections only migrate between posix workers";
+  }
+  // connections may move on every wake up, as soon as a worker looks busy
+  g_ceph_context->_conf.set_val("ms_async_migrate_load_gap", "20");
+  g_ceph_context->_conf.set_val("ms_async_migrate_idle_time", "0");
+  auto restore = make_scope_guard([] {
+    g_ceph_context->_conf.rm_val("ms_async_migrate_load_gap");
+    g_ceph_context->_conf.rm_val("ms_async_migrate_idle_time");
+  });
+  FakeDispatcher cli_dispatcher(false), srv_dispatcher(true);
+  entity_addr_t bind_addr;
+  bind_addr.parse("v2:127.0.0.1");
+  server_msgr->bind(bind_addr);
+  server_msgr->add_dispatcher_head(&srv_dispatcher);
+  server_msgr->start();
+  client_msgr->add_dispatcher_head(&cli_dispatcher);
+  client_msgr->start();
+
+  ConnectionRef conn = client_msgr->connect_to(server_msgr->get_mytype(),
+					       server_msgr->get_myaddrs());
+  auto async_conn = static_cast<AsyncConnection*>(conn.get());
+  auto stack = static_cast<AsyncMessenger*>(client_msgr)->get_stack();
+  ASSERT_LE(2u, stack->get_num_worker());
+
+  // pings keep flowing while the connection moves, each is answered
+  std::atomic<bool> stop = false;
+  std::atomic<uint64_t> sent = 0;
+  std::thread sender([&] {
+    while (!stop) {
+      ASSERT_EQ(0, conn->send_message(new MPing()));
+      ++sent;
+      usleep(200);
+    }
+  });
+
+  // make the worker of the connection look busy until it left it
+  for (int moves = 0; moves < 4; moves++) {
+    int from = get_worker_id(async_conn);
+    int to = from;
+    for (int i = 0; i < 10000 && to == from; i++) {
+      for (unsigned w = 0; w < stack->get_num_worker(); w++) {
+	stack->get_worker(w)->load = (int)w == from ? 1000 : 0;
+      }
+      usleep(1000);
+      to = get_worker_id(async_conn);
+    }
+    ASSERT_NE(from, to) << "connection did not leave worker " << from;
+  }
+  stop = true;
+  sender.join();
+  for (unsigned w = 0; w < stack->get_num_worker(); w++) {
+    stack->get_worker(w)->load = 0;
+  }
+
+  // nothing was lost or reset on the way
+  auto session = static_cast<Session*>(conn->get_priv().get());
+  CHECK_AND_WAIT_TRUE(session && session->get_count() == sent);
+  session = static_cast<Session*>(conn->get_priv().get());
+  ASSERT_TRUE(session);
+  ASSERT_EQ(sent.load(), session->get_count());
+  ASSERT_TRUE(conn->is_connected());
+  ASSERT_FALSE(cli_dispatcher.got_remote_reset);
+  ASSERT_FALSE(srv_dispatcher.got_remote_reset);
+
+  server_msgr->shutdown();
+  client_msgr->shutdown();
+  server_msgr->wait();
+  client_msgr->wait();
+}
 
 class SyntheticWorkload;
 
@@ -0,0 +1,135 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * RocksDB block cache lookup throughput, BinnedLRUCache vs BinnedClockCache.
+ */
+#include <atomic>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "common/ceph_time.h"
+#include "global/global_context.h"
+#include "kv/rocksdb_cache/BinnedClockCache.h"
+#include "kv/rocksdb_cache/BinnedLRUCache.h"
+
+using namespace std;
+
+static void delete_value(const rocksdb::Slice& key, void* value)
+{
+  delete static_cast<uint64_t*>(value);
+}
+
+class RocksDBCacheBench
+  : public ::testing::TestWithParam<std::tuple<const char*, int>> {
+public:
+  static constexpr size_t CHARGE = 4096;
+  std::shared_ptr<rocksdb::Cache> cache;
+
+  void create(size_t capacity) {
+    auto type = string(std::get<0>(GetParam()));
+    // default shard bits, like RocksDBStore does
+    if (type == "binned_lru") {
+      cache = rocksdb_cache::NewBinnedLRUCache(
+	g_ceph_context, capacity, -1, false, 0.0);
+    } else {
+      cache = rocksdb_cache::NewBinnedClockCache(
+	g_ceph_context, capacity, -1, false, 0.0, CHARGE);
+    }
+    ASSERT_TRUE(cache);
+  }
+
+  static string make_key(uint64_t k) {
+    // sized like a block cache key
+    string key(24, '\0');
+    memcpy(key.data(), &k, sizeof(k));
+    return key;
+  }
+
+  // run lookups of keys drawn from [0, key_space) on all threads and
+  // report the aggregate rate
+  void run(uint64_t key_space, uint64_t ops_per_thread) {
+    int num_threads = std::get<1>(GetParam());
+    vector<string> keys(key_space);
+    for (uint64_t k = 0; k < key_space; k++) {
+      keys[k] = make_key(k);
+    }
+    std::atomic<uint64_t> hits{0};
+    std::atomic<bool> go{false};
+    vector<std::thread> threads;
+    for (int t = 0; t < num_threads; t++) {
+      threads.emplace_back([&, t] {
+	std::mt19937_64 rng(t);
+	uint64_t h = 0;
+	while (!go) {
+	  std::this_thread::yield();
+	}
+	for (uint64_t i = 0; i < ops_per_thread; i++) {
+	  const string& key = keys[rng() % key_space];
+	  auto handle = cache->Lookup(key);
+	  if (handle) {
+	    ++h;
+	    cache->Release(handle);
+	  } else {
+	    cache->Insert(key, new uint64_t(i), CHARGE, delete_value);
+	  }
+	}
+	hits += h;
+      });
+    }
+    auto start = ceph::mono_clock::now();
+    go = true;
+    for (auto& t : threads) {
+      t.join();
+    }
+    double secs = std::chrono::duration<double>(
+      ceph::mono_clock::now() - start).count();
+    uint64_t ops = ops_per_thread * num_threads;
+    cout << cache->Name() << " threads " << num_threads
+	 << " keys " << key_space
+	 << " lookups " << ops
+	 << " hit ratio " << (double)hits / ops
+	 << " rate " << (uint64_t)(ops / secs) << " lookups/s"
+	 << std::endl;
+  }
+};
+
+TEST_P(RocksDBCacheBench, LookupHot)
+{
+  // everything fits, a few keys are very hot
+  create(1ull << 30);
+  for (uint64_t k = 0; k < 1024; k++) {
+    cache->Insert(make_key(k), new uint64_t(k), CHARGE, delete_value);
+  }
+  run(1024, 1000000);
+}
+
+TEST_P(RocksDBCacheBench, LookupWorkingSet)
+{
+  // everything fits, uniform over a large working set
+  create(1ull << 30);
+  uint64_t keys = (1ull << 30) / CHARGE / 2;
+  for (uint64_t k = 0; k < keys; k++) {
+    cache->Insert(make_key(k), new uint64_t(k), CHARGE, delete_value);
+  }
+  run(keys, 1000000);
+}
+
+TEST_P(RocksDBCacheBench, LookupEvicting)
+{
+  // the working set is twice the cache, misses insert and evict
+  create(256ull << 20);
+  run((512ull << 20) / CHARGE, 500000);
+}
+
+INSTANTIATE_TEST_SUITE_P(
+  RocksDBCache,
+  RocksDBCacheBench,
+  ::testing::Combine(
+    ::testing::Values("binned_lru", "binned_clock"),
+    ::testing::Values(1, 32, 64)));
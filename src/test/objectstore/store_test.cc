@@ -2987,6 +2987,105 @@ TEST_P(StoreTest, ZeroLengthWrite) {
   ASSERT_EQ(0, r);
 }
 
+TEST_P(StoreTest, MemStorePageArenaZeroCopy) {
+  if (string(GetParam()) != "memstore")
+    return;
+  SetVal(g_conf(), "memstore_page_set", "true");
+  SetVal(g_conf(), "memstore_page_size", "4096");
+  SetVal(g_conf(), "memstore_page_arena", "true");
+  SetVal(g_conf(), "memstore_page_zero_copy", "true");
+  g_conf().apply_changes(nullptr);
+
+  int r;
+  coll_t cid;
+  ghobject_t hoid(hobject_t(sobject_t("foo", CEPH_NOSNAP)));
+  ghobject_t hoid2(hobject_t(sobject_t("bar", CEPH_NOSNAP)));
+  auto ch = store->create_new_collection(cid);
+  {
+    ObjectStore::Transaction t;
+    t.create_collection(cid, 0);
+    r = queue_transaction(store, ch, std::move(t));
+    ASSERT_EQ(r, 0);
+  }
+
+  // whole pages of the write are shared with its buffer
+  bufferptr src(16384);
+  memset(src.c_str(), 'a', src.length());
+  bufferlist expected;
+  expected.append(src.c_str(), src.length());
+  {
+    ObjectStore::Transaction t;
+    bufferlist bl;
+    bl.append(src);
+    t.write(cid, hoid, 0, bl.length(), bl);
+    r = queue_transaction(store, ch, std::move(t));
+    ASSERT_EQ(r, 0);
+  }
+  // overwriting part of a shared page leaves the buffer alone
+  {
+    ObjectStore::Transaction t;
+    bufferlist bl;
+    bl.append(std::string(100, 'b'));
+    t.write(cid, hoid, 4096 + 10, bl.length(), bl);
+    r = queue_transaction(store, ch, std::move(t));
+    ASSERT_EQ(r, 0);
+    expected.begin(4096 + 10).copy_in(bl.length(), bl);
+  }
+  ASSERT_EQ(std::string(src.length(), 'a'),
+	    std::string(src.c_str(), src.length()));
+  {
+    bufferlist in;
+    r = store->read(ch, hoid, 0, expected.length(), in);
+    ASSERT_EQ((int)expected.length(), r);
+    ASSERT_TRUE(bl_eq(expected, in));
+  }
+
+  // a page taken from a much larger buffer is copied
+  {
+    bufferptr big(1 << 20);
+    memset(big.c_str(), 'c', big.length());
+    ObjectStore::Transaction t;
+    bufferlist bl;
+    bl.append(bufferptr(big, 8192, 4096));
+    t.write(cid, hoid, 8192, bl.length(), bl);
+    r = queue_transaction(store, ch, std::move(t));
+    ASSERT_EQ(r, 0);
+    expected.begin(8192).copy_in(bl.length(), bl);
+    memset(big.c_str(), 'd', big.length());
+  }
+  {
+    bufferlist in;
+    r = store->read(ch, hoid, 0, expected.length(), in);
+    ASSERT_EQ((int)expected.length(), r);
+    ASSERT_TRUE(bl_eq(expected, in));
+  }
+
+  // clones and truncates see the same data
+  {
+    ObjectStore::Transaction t;
+    t.clone(cid, hoid, hoid2);
+    t.truncate(cid, hoid2, 6000);
+    t.remove(cid, hoid);
+    r = queue_transaction(store, ch, std::move(t));
+    ASSERT_EQ(r, 0);
+  }
+  {
+    bufferlist in;
+    r = store->read(ch, hoid2, 0, 16384, in);
+    ASSERT_EQ(6000, r);
+    bufferlist head;
+    head.substr_of(expected, 0, 6000);
+    ASSERT_TRUE(bl_eq(head, in));
+  }
+  {
+    ObjectStore::Transaction t;
+    t.remove(cid, hoid2);
+    t.remove_collection(cid);
+    r = queue_transaction(store, ch, std::move(t));
+    ASSERT_EQ(r, 0);
+  }
+}
+
 TEST_P(StoreTest, ZeroLengthZero) {
   int r;
   coll_t cid;
@@ -5445,6 +5544,17 @@ TEST_P(StoreTest, Synthetic) {
   doSyntheticTest(1000, 10000, 400*1024, 40*1024, 0);
 }
 
+TEST_P(StoreTest, SyntheticMemStorePageArenaZeroCopy) {
+  if (string(GetParam()) != "memstore")
+    return;
+  SetVal(g_conf(), "memstore_page_set", "true");
+  SetVal(g_conf(), "memstore_page_size", "4096");
+  SetVal(g_conf(), "memstore_page_arena", "true");
+  SetVal(g_conf(), "memstore_page_zero_copy", "true");
+  g_conf().apply_changes(nullptr);
+  doSyntheticTest(1000, 10000, 400*1024, 40*1024, 0);
+}
+
 class SyntheticMatrixSharding: public MatrixTest {};
 TEST_P(SyntheticMatrixSharding, Test)
 {
@@ -9518,6 +9628,124 @@ TEST_P(StoreTestSpecificAUSize, BlobReuseOnOverwriteReverse) {
   }
 }
 
+TEST_P(StoreTestSpecificAUSize, OnlineDefrag) {
+
+  if (string(GetParam()) != "bluestore")
+    return;
+
+  size_t block_size = 4096;
+  StartDeferred(block_size);
+  SetVal(g_conf(), "bluestore_max_blob_size", "65536");
+  g_conf().apply_changes(nullptr);
+
+  int r;
+  coll_t cid;
+  ghobject_t hoid1(hobject_t("defrag1", "", CEPH_NOSNAP, 0, -1, ""));
+  ghobject_t hoid2(hobject_t("defrag2", "", CEPH_NOSNAP, 0, -1, ""));
+  BlueStore* bstore = dynamic_cast<BlueStore*> (store.get());
+
+  auto ch = store->create_new_collection(cid);
+  {
+    ObjectStore::Transaction t;
+    t.create_collection(cid, 0);
+    r = queue_transaction(store, ch, std::move(t));
+    ASSERT_EQ(r, 0);
+  }
+  // interleave backwards block writes of two objects so that neither
+  // of them can be allocated contiguously
+  bufferlist expected1, expected2;
+  for (int i = 15; i >= 0; --i) {
+    for (auto& [hoid, c] : { std::make_pair(hoid1, 'a'),
+			     std::make_pair(hoid2, 'b') }) {
+      ObjectStore::Transaction t;
+      bufferlist bl;
+      bl.append(std::string(block_size, c + i));
+      t.write(cid, hoid, block_size * i, bl.length(), bl);
+      r = queue_transaction(store, ch, std::move(t));
+      ASSERT_EQ(r, 0);
+    }
+  }
+  for (int i = 0; i < 16; ++i) {
+    expected1.append(std::string(block_size, 'a' + i));
+    expected2.append(std::string(block_size, 'b' + i));
+  }
+
+  BlueStore::defrag_stats_t before;
+  r = bstore->defrag_collection(ch, 0.5, 0, true, &before);
+  ASSERT_EQ(r, 0);
+  ASSERT_EQ(before.objects, 2u);
+  ASSERT_EQ(before.ideal_extents, 2u);
+  ASSERT_GT(before.get_score(), 0.5);
+  ASSERT_EQ(before.rewritten, 0u);
+
+  BlueStore::defrag_stats_t stats;
+  r = bstore->defrag_collection(ch, 0.5, 1, false, &stats);
+  ASSERT_EQ(r, 0);
+  ASSERT_EQ(stats.rewritten, 1u);
+  ASSERT_EQ(stats.rewritten_bytes, block_size * 16);
+  ASSERT_LT(stats.extents_after, stats.extents_before);
+  ASSERT_LT(stats.get_score_after(), stats.get_score());
+
+  // the rest in the background, as the admin socket command does
+  ASSERT_EQ(-ENOENT, bstore->defrag_cancel());
+  {
+    BlueStore::defrag_params_t params;
+    params.collection = stringify(cid);
+    params.min_score = 0.5;
+    params.max_objects = 10;
+    std::stringstream ss;
+    r = bstore->defrag_start(params, ss);
+    ASSERT_EQ(r, 0);
+    std::string status;
+    for (int i = 0; i < 600; ++i) {
+      JSONFormatter f;
+      bstore->defrag_dump_status(&f);
+      std::stringstream out;
+      f.flush(out);
+      status = out.str();
+      if (status.find("\"done\"") != std::string::npos) {
+	break;
+      }
+      usleep(100000);
+    }
+    ASSERT_NE(std::string::npos, status.find("\"done\"")) << status;
+    ASSERT_NE(std::string::npos, status.find("\"rewritten\":1")) << status;
+  }
+  for (auto& [hoid, expected] : { std::make_pair(hoid1, expected1),
+				  std::make_pair(hoid2, expected2) }) {
+    bufferlist bl;
+    r = store->read(ch, hoid, 0, block_size * 16, bl);
+    ASSERT_EQ(r, (int)block_size * 16);
+    ASSERT_TRUE(bl_eq(expected, bl));
+  }
+
+  ch.reset();
+  r = store->umount();
+  ASSERT_EQ(0, r);
+  r = store->mount();
+  ASSERT_EQ(0, r);
+  ch = store->open_collection(cid);
+  {
+    BlueStore::defrag_stats_t after;
+    r = bstore->defrag_collection(ch, 0.5, 0, true, &after);
+    ASSERT_EQ(r, 0);
+    ASSERT_EQ(after.objects, 2u);
+    ASSERT_LT(after.get_score(), before.get_score());
+    bufferlist bl;
+    r = store->read(ch, hoid2, 0, block_size * 16, bl);
+    ASSERT_EQ(r, (int)block_size * 16);
+    ASSERT_TRUE(bl_eq(expected2, bl));
+  }
+  {
+    ObjectStore::Transaction t;
+    t.remove(cid, hoid1);
+    t.remove(cid, hoid2);
+    t.remove_collection(cid);
+    r = queue_transaction(store, ch, std::move(t));
+    ASSERT_EQ(r, 0);
+  }
+}
+
 TEST_P(StoreTestSpecificAUSize, BlobReuseOnSmallOverwrite) {
 
   if (string(GetParam()) != "bluestore")
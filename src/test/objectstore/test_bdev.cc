@@ -91,6 +91,92 @@ TEST(KernelDevice, Ticket45337) {
   b->close();
 }
 
+class EmulatedDeviceTest : public ::testing::TestWithParam<const char*> {
+public:
+  void SetUp() override {
+    g_ceph_context->_conf.set_val("bdev_type", "emulated");
+    g_ceph_context->_conf.set_val("bdev_emulated_backend", GetParam());
+  }
+  void TearDown() override {
+    for (auto k : {"bdev_type", "bdev_emulated_backend",
+		   "bdev_emulated_write_latency_us",
+		   "bdev_emulated_queue_depth",
+		   "bdev_emulated_bandwidth"}) {
+      g_ceph_context->_conf.rm_val(k);
+    }
+  }
+  static double elapsed(ceph::mono_clock::time_point start) {
+    return std::chrono::duration<double>(ceph::mono_clock::now() - start).count();
+  }
+};
+
+TEST_P(EmulatedDeviceTest, Latency) {
+  g_ceph_context->_conf.set_val("bdev_emulated_write_latency_us", "2000");
+  g_ceph_context->_conf.set_val("bdev_emulated_queue_depth", "4");
+  TempBdev bdev{ 64 << 20 };
+  std::unique_ptr<BlockDevice> b(
+    BlockDevice::create(g_ceph_context, bdev.path, NULL, NULL,
+      [](void* handle, void* aio) {}, NULL));
+  ASSERT_EQ(0, b->open(bdev.path));
+  ASSERT_EQ(64u << 20, b->get_size());
+
+  bufferlist bl;
+  bl.append(string(4096, 'x'));
+  auto start = ceph::mono_clock::now();
+  ASSERT_EQ(0, b->write(0, bl, false));
+  ASSERT_GE(elapsed(start), 0.002);
+
+  // 16 ios at queue depth 4 take at least 4 latencies
+  std::unique_ptr<IOContext> ioc(new IOContext(g_ceph_context, NULL));
+  start = ceph::mono_clock::now();
+  for (int i = 0; i < 16; i++) {
+    bufferlist t;
+    t.append(string(4096, 'a' + i));
+    ASSERT_EQ(0, b->aio_write(i * 8192, t, ioc.get(), false));
+  }
+  ASSERT_TRUE(ioc->has_pending_aios());
+  b->aio_submit(ioc.get());
+  ioc->aio_wait();
+  ASSERT_GE(elapsed(start), 0.008);
+
+  char buf[4096];
+  ASSERT_EQ(0, b->read_random(3 * 8192, sizeof(buf), buf, false));
+  ASSERT_EQ('d', buf[0]);
+  b->close();
+
+  // data survives reopening
+  ASSERT_EQ(0, b->open(bdev.path));
+  bufferlist r;
+  ASSERT_EQ(0, b->read(5 * 8192, 4096, &r, ioc.get(), false));
+  ASSERT_EQ(string(4096, 'f'), r.to_str());
+  b->close();
+}
+
+TEST_P(EmulatedDeviceTest, Bandwidth) {
+  g_ceph_context->_conf.set_val("bdev_emulated_bandwidth", "100M");
+  TempBdev bdev{ 64 << 20 };
+  std::unique_ptr<BlockDevice> b(
+    BlockDevice::create(g_ceph_context, bdev.path, NULL, NULL,
+      [](void* handle, void* aio) {}, NULL));
+  ASSERT_EQ(0, b->open(bdev.path));
+  std::unique_ptr<IOContext> ioc(new IOContext(g_ceph_context, NULL));
+  auto start = ceph::mono_clock::now();
+  for (int i = 0; i < 10; i++) {
+    bufferlist t;
+    t.append(string(1 << 20, 'a'));
+    ASSERT_EQ(0, b->aio_write(i << 20, t, ioc.get(), false));
+  }
+  b->aio_submit(ioc.get());
+  ioc->aio_wait();
+  ASSERT_GE(elapsed(start), 0.095);
+  b->close();
+}
+
+INSTANTIATE_TEST_SUITE_P(
+  BlockDevice,
+  EmulatedDeviceTest,
+  ::testing::Values("file", "ram"));
+
 int main(int argc, char **argv) {
   auto args = argv_to_vec(argc, argv);
   map<string,string> defaults = {
@@ -189,6 +189,68 @@ TEST(BlueFS, small_appends) {
   fs.umount();
 }
 
+TEST(BlueFS, read_random_multi) {
+  uint64_t size = 1048576 * 128;
+  TempBdev bdev{size};
+
+  ConfSaver conf(g_ceph_context->_conf);
+  conf.SetVal("bluefs_alloc_size", "65536");
+  conf.SetVal("bluefs_buffered_io", "false");
+  conf.ApplyChanges();
+
+  BlueFS fs(g_ceph_context);
+  ASSERT_EQ(0, fs.add_block_device(BlueFS::BDEV_DB, bdev.path, false));
+  uuid_d fsid;
+  ASSERT_EQ(0, fs.mkfs(fsid, { BlueFS::BDEV_DB, false, false }));
+  ASSERT_EQ(0, fs.mount());
+  ASSERT_EQ(0, fs.mkdir("dir"));
+  const uint64_t file_size = 1048576 * 3 + 1000;
+  {
+    // interleave two files so that extents are not contiguous
+    BlueFS::FileWriter *h, *h2;
+    ASSERT_EQ(0, fs.open_for_write("dir", "file", &h, false));
+    ASSERT_EQ(0, fs.open_for_write("dir", "other", &h2, false));
+    std::string data;
+    for (uint64_t i = 0; i < file_size; ++i) {
+      data.push_back('a' + (i * 7 + i / 4096) % 26);
+    }
+    for (uint64_t pos = 0; pos < file_size; pos += 65536) {
+      uint64_t l = std::min<uint64_t>(65536, file_size - pos);
+      h->append(data.data() + pos, l);
+      fs.fsync(h);
+      h2->append(data.data() + pos, l);
+      fs.fsync(h2);
+    }
+    fs.close_writer(h);
+    fs.close_writer(h2);
+  }
+  {
+    BlueFS::FileReader *h;
+    ASSERT_EQ(0, fs.open_for_read("dir", "file", &h, true));
+    // unaligned, spanning extents, and past eof
+    std::vector<std::pair<uint64_t, uint64_t>> ranges = {
+      {0, 4096}, {1, 100}, {65530, 20}, {100000, 300000},
+      {file_size - 10, 10}, {file_size - 10, 100}, {777777, 1}};
+    std::vector<std::string> bufs(ranges.size());
+    std::vector<BlueFS::read_random_req_t> reqs;
+    for (size_t i = 0; i < ranges.size(); ++i) {
+      bufs[i].resize(ranges[i].second);
+      reqs.push_back({ranges[i].first, ranges[i].second, bufs[i].data()});
+    }
+    fs.read_random_multi(h, reqs);
+    for (size_t i = 0; i < ranges.size(); ++i) {
+      std::string expected(ranges[i].second, 0);
+      int64_t r = fs.read_random(h, ranges[i].first, ranges[i].second,
+				 expected.data());
+      ASSERT_EQ(r, reqs[i].result);
+      ASSERT_EQ(0, memcmp(expected.data(), bufs[i].data(), r));
+    }
+    ASSERT_EQ(10, reqs[5].result);
+    delete h;
+  }
+  fs.umount();
+}
+
 TEST(BlueFS, very_large_write) {
   SKIP_JENKINS();
   // we'll write a ~5G file, so allocate more than that for the whole fs
@@ -836,6 +898,69 @@ TEST(BlueFS, test_replay_growth) {
   fs.umount();
 }
 
+TEST(BlueFS, test_replay_readahead) {
+  uint64_t size = 1048576LL * 256;
+  TempBdev bdev{size};
+
+  ConfSaver conf(g_ceph_context->_conf);
+  conf.SetVal("bluefs_alloc_size", "4096");
+  conf.SetVal("bluefs_shared_alloc_size", "4096");
+  conf.SetVal("bluefs_compact_log_sync", "false");
+  conf.SetVal("bluefs_min_log_runway", "32768");
+  conf.SetVal("bluefs_max_log_runway", "65536");
+  conf.SetVal("bluefs_max_prefetch", "16384");
+  conf.SetVal("bluefs_replay_readahead", "131072");
+  conf.ApplyChanges();
+
+  BlueFS fs(g_ceph_context);
+  ASSERT_EQ(0, fs.add_block_device(BlueFS::BDEV_DB, bdev.path, false));
+  uuid_d fsid;
+  ASSERT_EQ(0, fs.mkfs(fsid, { BlueFS::BDEV_DB, false, false }));
+  ASSERT_EQ(0, fs.mount());
+  ASSERT_EQ(0, fs.mkdir("dir"));
+
+  // lots of small fsyncs spread the log over many extents
+  char data[1000];
+  BlueFS::FileWriter *h;
+  ASSERT_EQ(0, fs.open_for_write("dir", "file", &h, false));
+  for (size_t i = 0; i < 5000; i++) {
+    memset(data, 'a' + i % 26, sizeof(data));
+    h->append(data, sizeof(data));
+    fs.fsync(h);
+  }
+  fs.close_writer(h);
+  fs.umount(true); //do not compact on exit!
+
+  for (auto readahead : { "131072", "0" }) {
+    conf.SetVal("bluefs_replay_readahead", readahead);
+    conf.ApplyChanges();
+    ASSERT_EQ(0, fs.mount());
+    // the log chunks are only taken from the readahead when they match
+    // the reads replay does
+    uint64_t readahead_bytes =
+      fs.get_perf_counters()->get(l_bluefs_read_readahead_bytes);
+    if (strcmp(readahead, "0") == 0) {
+      ASSERT_EQ(0u, readahead_bytes);
+    } else {
+      ASSERT_LT(0u, readahead_bytes);
+    }
+    ASSERT_EQ(0, fs.maybe_verify_layout({ BlueFS::BDEV_DB, false, false }));
+    uint64_t file_size = 0;
+    ASSERT_EQ(0, fs.stat("dir", "file", &file_size, nullptr));
+    ASSERT_EQ(file_size, 5000u * sizeof(data));
+    BlueFS::FileReader *r;
+    ASSERT_EQ(0, fs.open_for_read("dir", "file", &r));
+    for (size_t i = 0; i < 5000; i += 499) {
+      bufferlist bl;
+      ASSERT_EQ((int)sizeof(data),
+		fs.read(r, i * sizeof(data), sizeof(data), &bl, NULL));
+      ASSERT_EQ(std::string(sizeof(data), 'a' + i % 26), bl.to_str());
+    }
+    delete r;
+    fs.umount(true);
+  }
+}
+
 TEST(BlueFS, test_tracker_50965) {
   uint64_t size_wal = 1048576 * 64;
   TempBdev bdev_wal{size_wal};
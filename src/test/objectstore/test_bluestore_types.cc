@@ -4010,6 +4010,82 @@ TEST(bluestore_blob_use_tracker_t, mempool_stats_test) {
   }
 }
 
+TEST(BlueStore, split_kv_cache_ratios) {
+  using shares_t = std::map<std::string, BlueStore::kv_cache_share_t>;
+  auto sum = [](const shares_t& caches) {
+    double r = 0;
+    for (auto& [prefix, s] : caches) {
+      r += s.ratio;
+    }
+    return r;
+  };
+
+  // without autotune the column family caches split the kv ratio evenly
+  // with the default one, kv_onode keeps its own
+  {
+    shares_t caches{{"", {}}, {"L", {}}, {"P", {}}};
+    BlueStore::split_kv_cache_ratios(0.45, 0.04, 0.1, false, caches);
+    for (auto& [prefix, s] : caches) {
+      EXPECT_DOUBLE_EQ(0.15, s.ratio) << prefix;
+    }
+    caches["O"] = {};
+    BlueStore::split_kv_cache_ratios(0.45, 0.04, 0.1, false, caches);
+    EXPECT_DOUBLE_EQ(0.04, caches["O"].ratio);
+    EXPECT_DOUBLE_EQ(0.15, caches[""].ratio);
+    EXPECT_DOUBLE_EQ(0.15, caches["P"].ratio);
+    // densities do not matter then
+    caches["P"].density = 100;
+    BlueStore::split_kv_cache_ratios(0.45, 0.04, 0.1, false, caches);
+    EXPECT_DOUBLE_EQ(0.15, caches["P"].ratio);
+  }
+
+  // with autotune, the kv and kv_onode shares together follow hit density
+  {
+    shares_t caches{{"", {0.15, 0}}, {"P", {0.15, 0}}, {"O", {0.04, 0}}};
+    const double share = 0.34;
+    // no lookups, nothing moves
+    BlueStore::split_kv_cache_ratios(0.3, 0.04, 0.1, true, caches);
+    EXPECT_DOUBLE_EQ(0.15, caches[""].ratio);
+    EXPECT_DOUBLE_EQ(0.15, caches["P"].ratio);
+    EXPECT_DOUBLE_EQ(0.04, caches["O"].ratio);
+
+    // half way towards the target per split; the total stays the share
+    caches["O"].density = 10;
+    BlueStore::split_kv_cache_ratios(0.3, 0.04, 0.1, true, caches);
+    EXPECT_DOUBLE_EQ((0.04 + share * 0.8) / 2, caches["O"].ratio);
+    EXPECT_DOUBLE_EQ((0.15 + share * 0.1) / 2, caches["P"].ratio);
+    EXPECT_NEAR(share, sum(caches), 1e-9);
+
+    // the caches without hits keep min_share of it
+    for (int i = 0; i < 50; i++) {
+      BlueStore::split_kv_cache_ratios(0.3, 0.04, 0.1, true, caches);
+    }
+    EXPECT_NEAR(share * 0.1, caches[""].ratio, 1e-9);
+    EXPECT_NEAR(share * 0.1, caches["P"].ratio, 1e-9);
+    EXPECT_NEAR(share * 0.8, caches["O"].ratio, 1e-9);
+
+    // and hits elsewhere shift it back
+    caches["O"].density = 1;
+    caches["P"].density = 3;
+    for (int i = 0; i < 50; i++) {
+      BlueStore::split_kv_cache_ratios(0.3, 0.04, 0.1, true, caches);
+    }
+    EXPECT_NEAR(share * 0.1, caches[""].ratio, 1e-9);
+    EXPECT_NEAR(share * (0.1 + 0.7 * 0.75), caches["P"].ratio, 1e-9);
+    EXPECT_NEAR(share * (0.1 + 0.7 * 0.25), caches["O"].ratio, 1e-9);
+  }
+
+  // min_share is capped at an even split
+  {
+    shares_t caches{{"", {0.2, 0}}, {"P", {0.2, 50}}};
+    for (int i = 0; i < 50; i++) {
+      BlueStore::split_kv_cache_ratios(0.4, 0, 0.9, true, caches);
+    }
+    EXPECT_NEAR(0.2, caches[""].ratio, 1e-9);
+    EXPECT_NEAR(0.2, caches["P"].ratio, 1e-9);
+  }
+}
+
 int main(int argc, char **argv) {
   auto args = argv_to_vec(argc, argv);
   auto cct =
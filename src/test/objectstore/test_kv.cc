@@ -359,6 +359,46 @@ TEST_P(KVTest, ShardingRMRange) {
   fini();
 }
 
+TEST_P(KVTest, GetBatch) {
+  std::string cfs;
+  if (string(GetParam()) == "rocksdb")
+    cfs = "O(3)=";
+  ASSERT_EQ(0, db->create_and_open(cout, cfs));
+  {
+    KeyValueDB::Transaction t = db->get_transaction();
+    for (size_t i = 0; i < 100; i += 2) {
+      bufferlist value;
+      value.append(stringify(i));
+      t->set("O", "key" + stringify(i), value);
+      t->set("prefix", "key" + stringify(i), value);
+    }
+    db->submit_transaction_sync(t);
+  }
+  for (auto prefix : {"O", "prefix"}) {
+    vector<string> keys;
+    for (size_t i = 0; i < 100; i++) {
+      keys.push_back("key" + stringify(i));
+    }
+    vector<std::optional<bufferlist>> values;
+    ASSERT_EQ(0, db->get_batch(prefix, keys, &values));
+    ASSERT_EQ(keys.size(), values.size());
+    for (size_t i = 0; i < 100; i++) {
+      if (i % 2) {
+	ASSERT_FALSE(values[i]);
+      } else {
+	ASSERT_TRUE(values[i]);
+	ASSERT_EQ(stringify(i), _bl_to_str(*values[i]));
+      }
+    }
+
+    set<string> key_set(keys.begin(), keys.end());
+    map<string, bufferlist> out;
+    ASSERT_EQ(0, db->get(prefix, key_set, &out));
+    ASSERT_EQ(50u, out.size());
+    ASSERT_EQ("42", _bl_to_str(out["key42"]));
+  }
+  fini();
+}
 
 TEST_P(KVTest, RocksDBColumnFamilyTest) {
   if(string(GetParam()) != "rocksdb")
@@ -619,6 +659,141 @@ TEST_P(KVTest, RocksDB_estimate_size_column_family) {
   fini();
 }
 
+TEST_P(KVTest, ScanIteratorBounds) {
+  ASSERT_EQ(0, db->create_and_open(cout));
+  {
+    KeyValueDB::Transaction t = db->get_transaction();
+    bufferlist v;
+    v.append("v");
+    for (auto prefix : {"a", "b", "c"}) {
+      for (auto key : {"1", "2", "3", "4"}) {
+	t->set(prefix, key, v);
+      }
+    }
+    db->submit_transaction_sync(t);
+  }
+  {
+    KeyValueDB::Iterator it = db->get_iterator("b", KeyValueDB::ITERATOR_SCAN);
+    vector<string> keys;
+    for (it->seek_to_first(); it->valid(); it->next()) {
+      ASSERT_EQ("b", it->raw_key().first);
+      keys.push_back(it->key());
+    }
+    ASSERT_EQ(vector<string>({"1", "2", "3", "4"}), keys);
+    ASSERT_EQ(0, it->seek_to_last());
+    ASSERT_TRUE(it->valid());
+    ASSERT_EQ("4", it->key());
+  }
+  if (string(GetParam()) == "rocksdb") {
+    // only rocksdb honours the bounds
+    KeyValueDB::Iterator it = db->get_iterator(
+      "b", KeyValueDB::ITERATOR_SCAN,
+      KeyValueDB::IteratorBounds{string("2"), string("4")});
+    vector<string> keys;
+    for (it->lower_bound("2"); it->valid(); it->next()) {
+      keys.push_back(it->key());
+    }
+    ASSERT_EQ(vector<string>({"2", "3"}), keys);
+  }
+  fini();
+}
+
+TEST_P(KVTest, RocksDB_blob_files_column_family) {
+  if(string(GetParam()) != "rocksdb")
+    GTEST_SKIP();
+
+  std::string cfs("cf1=blob_files={min_size=1K;compression=none}");
+  ASSERT_EQ(0, db->init(g_conf()->bluestore_rocksdb_options));
+  cout << "creating column family with blob files and opening it" << std::endl;
+  ASSERT_EQ(0, db->create_and_open(cout, cfs));
+
+  map<string, string> expected;
+  for (int i = 0; i < 100; i++) {
+    KeyValueDB::Transaction t = db->get_transaction();
+    // a mix of values stored inline and in blob files
+    string v = gen_random_string(i % 2 ? 4000 : 100);
+    bufferlist bl;
+    bl.append(v);
+    t->set("cf1", to_string(i), bl);
+    expected[to_string(i)] = v;
+    db->submit_transaction_sync(t);
+  }
+  db->compact();
+  for (auto& [k, v] : expected) {
+    bufferlist bl;
+    ASSERT_EQ(0, db->get("cf1", k, &bl));
+    ASSERT_EQ(v, bl.to_str());
+  }
+  fini();
+}
+
+TEST_P(KVTest, RocksDB_blob_files_invalid) {
+  if(string(GetParam()) != "rocksdb")
+    GTEST_SKIP();
+
+  ASSERT_EQ(0, db->init(g_conf()->bluestore_rocksdb_options));
+  ASSERT_NE(0, db->create_and_open(cout, "cf1=blob_files={min_size=1K;foo=1}"));
+  fini();
+}
+
+TEST_P(KVTest, RocksDB_priority_caches) {
+  if(string(GetParam()) != "rocksdb")
+    GTEST_SKIP();
+
+  // cf1 has a cache of its own, cf2 shares the default one
+  std::string cfs("cf1=block_cache={type=binned_lru;size=16M} cf2");
+  ASSERT_EQ(0, db->init(g_conf()->bluestore_rocksdb_options));
+  ASSERT_EQ(0, db->create_and_open(cout, cfs));
+
+  auto caches = db->get_priority_caches();
+  ASSERT_EQ(1u, caches.size());
+  ASSERT_EQ(1u, caches.count("cf1"));
+  ASSERT_TRUE(caches["cf1"]);
+  ASSERT_NE(caches["cf1"], db->get_priority_cache());
+
+  for (int i = 0; i < 100; i++) {
+    KeyValueDB::Transaction t = db->get_transaction();
+    bufferlist bl;
+    bl.append(gen_random_string(1000));
+    t->set("cf1", to_string(i), bl);
+    t->set("cf2", to_string(i), bl);
+    db->submit_transaction_sync(t);
+  }
+  db->compact();
+  db->enable_cache_lookup_stats();
+
+  uint64_t hits, misses;
+  ASSERT_EQ(-ENOENT, db->get_cache_lookup_stats("cf2", &hits, &misses));
+  uint64_t cf1_hits, cf1_misses, def_hits, def_misses;
+  ASSERT_EQ(0, db->get_cache_lookup_stats("cf1", &cf1_hits, &cf1_misses));
+  ASSERT_EQ(0, db->get_cache_lookup_stats("", &def_hits, &def_misses));
+
+  // reading cf1 twice looks blocks up in its cache, and hits the second time
+  for (int pass = 0; pass < 2; pass++) {
+    for (int i = 0; i < 100; i++) {
+      bufferlist bl;
+      ASSERT_EQ(0, db->get("cf1", to_string(i), &bl));
+    }
+  }
+  ASSERT_EQ(0, db->get_cache_lookup_stats("cf1", &hits, &misses));
+  ASSERT_LT(cf1_misses, misses);
+  ASSERT_LT(cf1_hits, hits);
+  cf1_hits = hits;
+  cf1_misses = misses;
+
+  // while reading cf2 counts in the default cache only
+  for (int i = 0; i < 100; i++) {
+    bufferlist bl;
+    ASSERT_EQ(0, db->get("cf2", to_string(i), &bl));
+  }
+  ASSERT_EQ(0, db->get_cache_lookup_stats("cf1", &hits, &misses));
+  ASSERT_EQ(cf1_hits, hits);
+  ASSERT_EQ(cf1_misses, misses);
+  ASSERT_EQ(0, db->get_cache_lookup_stats("", &hits, &misses));
+  ASSERT_LT(def_hits + def_misses, hits + misses);
+  fini();
+}
+
 TEST_P(KVTest, RocksDB_parse_sharding_def) {
   if(string(GetParam()) != "rocksdb")
     GTEST_SKIP();
@@ -0,0 +1,204 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+
+#include <chrono>
+#include <fcntl.h>
+#include <thread>
+#include <unistd.h>
+#include <gtest/gtest.h>
+#include "global/global_init.h"
+#include "global/global_context.h"
+#include "common/ceph_argparse.h"
+#include "include/stringify.h"
+
+#include "os/bluestore/L2ReadCache.h"
+
+using namespace std;
+
+class TempBdev {
+public:
+  TempBdev(uint64_t size)
+    : path{get_temp_bdev(size)}
+  {}
+  ~TempBdev() {
+    ::unlink(path.c_str());
+  }
+  const std::string path;
+private:
+  static string get_temp_bdev(uint64_t size)
+  {
+    static int n = 0;
+    string fn = "ceph_test_l2readcache.tmp.block." + stringify(getpid())
+      + "." + stringify(++n);
+    int fd = ::open(fn.c_str(), O_CREAT|O_RDWR|O_TRUNC, 0644);
+    ceph_assert(fd >= 0);
+    int r = ::ftruncate(fd, size);
+    ceph_assert(r >= 0);
+    ::close(fd);
+    return fn;
+  }
+};
+
+static const uint64_t block_size = 4096;
+
+static bufferlist make_data(uint64_t len, char seed)
+{
+  bufferlist bl;
+  bufferptr p(len);
+  for (uint64_t i = 0; i < len; ++i) {
+    p.c_str()[i] = seed + (i / block_size);
+  }
+  bl.append(p);
+  return bl;
+}
+
+// fills are written asynchronously; poll until the range shows up
+static bool wait_for_hit(L2ReadCache& cache, uint64_t off, uint64_t len,
+			 bufferlist *out)
+{
+  for (int i = 0; i < 500; ++i) {
+    if (cache.read(off, len, out)) {
+      return true;
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  return false;
+}
+
+TEST(L2ReadCache, AdmitAfterSecondMiss) {
+  TempBdev dev{64 << 20};
+  uuid_d fsid;
+  fsid.generate_random();
+  L2ReadCache cache(g_ceph_context, block_size);
+  ASSERT_EQ(0, cache.open(dev.path, fsid, 0));
+
+  bufferlist data = make_data(65536, 'a');
+  bufferlist out;
+  cache.insert(1 << 20, data);
+  std::this_thread::sleep_for(std::chrono::milliseconds(100));
+  ASSERT_FALSE(cache.read(1 << 20, 65536, &out));
+
+  cache.insert(1 << 20, data);
+  ASSERT_TRUE(wait_for_hit(cache, 1 << 20, 65536, &out));
+  ASSERT_TRUE(out.contents_equal(data));
+
+  // partial, block aligned lookups are served as well
+  bufferlist part;
+  ASSERT_TRUE(cache.read((1 << 20) + 8192, 8192, &part));
+  bufferlist expected;
+  expected.substr_of(data, 8192, 8192);
+  ASSERT_TRUE(part.contents_equal(expected));
+
+  // unaligned lookups are never served
+  bufferlist unaligned;
+  ASSERT_FALSE(cache.read((1 << 20) + 512, 4096, &unaligned));
+  ASSERT_EQ(0u, unaligned.length());
+
+  uint64_t token;
+  cache.close(&token);
+}
+
+TEST(L2ReadCache, AsyncRead) {
+  TempBdev dev{64 << 20};
+  uuid_d fsid;
+  fsid.generate_random();
+  L2ReadCache cache(g_ceph_context, block_size);
+  ASSERT_EQ(0, cache.open(dev.path, fsid, 0));
+
+  bufferlist data = make_data(131072, 'f');
+  bufferlist out;
+  cache.insert(2 << 20, data);
+  cache.insert(2 << 20, data);
+  ASSERT_TRUE(wait_for_hit(cache, 2 << 20, 131072, &out));
+
+  // hits of one batch are read together, into the caller's buffers
+  L2ReadCache::read_ctx_t ctx(g_ceph_context);
+  bufferlist bl;
+  ASSERT_TRUE(cache.read(2 << 20, 65536, &bl, &ctx));
+  ASSERT_TRUE(cache.read((2 << 20) + 65536, 65536, &bl, &ctx));
+  ASSERT_FALSE(cache.read(8 << 20, 65536, &bl, &ctx));
+  ASSERT_EQ(131072u, bl.length());
+  ASSERT_EQ(2u, ctx.hits.size());
+  cache.submit(&ctx);
+  ASSERT_EQ(0u, cache.wait(&ctx));
+  ASSERT_TRUE(bl.contents_equal(data));
+
+  JSONFormatter f;
+  f.open_object_section("l2cache");
+  cache.dump(&f);
+  f.close_section();
+  std::stringstream ss;
+  f.flush(ss);
+  ASSERT_NE(std::string::npos, ss.str().find("\"units\":")) << ss.str();
+  ASSERT_EQ(std::string::npos, ss.str().find("\"units\":0")) << ss.str();
+
+  uint64_t token;
+  cache.close(&token);
+}
+
+TEST(L2ReadCache, Invalidate) {
+  TempBdev dev{64 << 20};
+  uuid_d fsid;
+  fsid.generate_random();
+  L2ReadCache cache(g_ceph_context, block_size);
+  ASSERT_EQ(0, cache.open(dev.path, fsid, 0));
+
+  bufferlist data = make_data(131072, 'k');
+  bufferlist out;
+  cache.insert(0, data);
+  cache.insert(0, data);
+  ASSERT_TRUE(wait_for_hit(cache, 0, 131072, &out));
+
+  cache.invalidate(70000, 10);
+  out.clear();
+  ASSERT_TRUE(cache.read(0, 65536, &out));
+  out.clear();
+  ASSERT_FALSE(cache.read(65536, 65536, &out));
+
+  uint64_t token;
+  cache.close(&token);
+}
+
+TEST(L2ReadCache, PersistIndex) {
+  TempBdev dev{64 << 20};
+  uuid_d fsid;
+  fsid.generate_random();
+  bufferlist data = make_data(65536, 'x');
+  uint64_t token = 0;
+  {
+    L2ReadCache cache(g_ceph_context, block_size);
+    ASSERT_EQ(0, cache.open(dev.path, fsid, 0));
+    cache.insert(4 << 20, data);
+    cache.insert(4 << 20, data);
+    bufferlist out;
+    ASSERT_TRUE(wait_for_hit(cache, 4 << 20, 65536, &out));
+    cache.close(&token);
+    ASSERT_NE(0u, token);
+  }
+  {
+    L2ReadCache cache(g_ceph_context, block_size);
+    ASSERT_EQ(0, cache.open(dev.path, fsid, token));
+    bufferlist out;
+    ASSERT_TRUE(cache.read(4 << 20, 65536, &out));
+    ASSERT_TRUE(out.contents_equal(data));
+    cache.close(&token);
+  }
+  {
+    // a stale token discards the index
+    L2ReadCache cache(g_ceph_context, block_size);
+    ASSERT_EQ(0, cache.open(dev.path, fsid, token + 1));
+    bufferlist out;
+    ASSERT_FALSE(cache.read(4 << 20, 65536, &out));
+    cache.close(&token);
+  }
+}
+
+int main(int argc, char **argv) {
+  auto args = argv_to_vec(argc, argv);
+  auto cct = global_init(nullptr, args, CEPH_ENTITY_TYPE_CLIENT,
+			 CODE_ENVIRONMENT_UTILITY,
+			 CINIT_FLAG_NO_DEFAULT_CONFIG_FILE);
+  common_init_finish(g_ceph_context);
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,308 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+
+#include <atomic>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "global/global_context.h"
+#include "kv/rocksdb_cache/BinnedClockCache.h"
+#include "kv/rocksdb_cache/BinnedLRUCache.h"
+
+using namespace std;
+
+static std::atomic<int64_t> live_values{0};
+
+static void delete_value(const rocksdb::Slice& key, void* value)
+{
+  --live_values;
+  delete static_cast<int*>(value);
+}
+
+class RocksDBCacheTest : public ::testing::TestWithParam<const char*> {
+public:
+  std::shared_ptr<rocksdb::Cache> cache;
+
+  void create(size_t capacity, bool strict = false, double high_ratio = 0.0,
+	      int shard_bits = 0) {
+    if (string(GetParam()) == "binned_lru") {
+      cache = rocksdb_cache::NewBinnedLRUCache(
+	g_ceph_context, capacity, shard_bits, strict, high_ratio);
+    } else {
+      cache = rocksdb_cache::NewBinnedClockCache(
+	g_ceph_context, capacity, shard_bits, strict, high_ratio, 4096);
+    }
+    ASSERT_TRUE(cache);
+  }
+  rocksdb_cache::ShardedCache* sharded() {
+    return dynamic_cast<rocksdb_cache::ShardedCache*>(cache.get());
+  }
+  uint64_t sum_bins(uint32_t start, uint32_t end) {
+    if (auto c = dynamic_cast<rocksdb_cache::BinnedLRUCache*>(cache.get())) {
+      return c->sum_bins(start, end);
+    }
+    return static_cast<rocksdb_cache::BinnedClockCache*>(cache.get())->
+      sum_bins(start, end);
+  }
+  rocksdb::Status insert(int k, size_t charge = 4096,
+			 rocksdb::Cache::Handle** handle = nullptr,
+			 rocksdb::Cache::Priority pri = rocksdb::Cache::Priority::LOW) {
+    ++live_values;
+    return cache->Insert(to_string(k), new int(k), charge, delete_value,
+			 handle, pri);
+  }
+  int lookup(int k) {
+    auto h = cache->Lookup(to_string(k));
+    if (!h) {
+      return -1;
+    }
+    int v = *static_cast<int*>(cache->Value(h));
+    cache->Release(h);
+    return v;
+  }
+  void SetUp() override {
+    live_values = 0;
+  }
+  void TearDown() override {
+    cache.reset();
+    ASSERT_EQ(0, live_values);
+  }
+};
+
+TEST_P(RocksDBCacheTest, InsertLookupErase)
+{
+  create(1 << 20);
+  for (int i = 0; i < 100; i++) {
+    ASSERT_TRUE(insert(i).ok());
+  }
+  ASSERT_EQ(100u * 4096, cache->GetUsage());
+  for (int i = 0; i < 100; i++) {
+    ASSERT_EQ(i, lookup(i));
+  }
+  ASSERT_EQ(-1, lookup(100));
+  cache->Erase(to_string(7));
+  ASSERT_EQ(-1, lookup(7));
+  ASSERT_EQ(99, live_values);
+  ASSERT_EQ(99u * 4096, cache->GetUsage());
+  ASSERT_EQ(0u, cache->GetPinnedUsage());
+}
+
+TEST_P(RocksDBCacheTest, ReferencedEntries)
+{
+  create(1 << 20);
+  rocksdb::Cache::Handle* h = nullptr;
+  ASSERT_TRUE(insert(1, 4096, &h).ok());
+  ASSERT_TRUE(h);
+  ASSERT_EQ(4096u, cache->GetPinnedUsage());
+
+  // erased entries stay valid until their last reference is gone
+  cache->Erase(to_string(1));
+  ASSERT_EQ(-1, lookup(1));
+  ASSERT_EQ(1, *static_cast<int*>(cache->Value(h)));
+  ASSERT_EQ(1, live_values);
+  ASSERT_TRUE(cache->Release(h));
+  ASSERT_EQ(0, live_values);
+  ASSERT_EQ(0u, cache->GetUsage());
+
+  // replacing a key hides the old entry
+  ASSERT_TRUE(insert(2, 4096, &h).ok());
+  ++live_values;
+  ASSERT_TRUE(cache->Insert(to_string(2), new int(3), 4096, delete_value).ok());
+  ASSERT_EQ(3, lookup(2));
+  ASSERT_EQ(2, *static_cast<int*>(cache->Value(h)));
+  ASSERT_TRUE(cache->Release(h));
+  ASSERT_EQ(1, live_values);
+  ASSERT_EQ(4096u, cache->GetUsage());
+}
+
+TEST_P(RocksDBCacheTest, Capacity)
+{
+  const size_t capacity = 64 * 4096;
+  create(capacity);
+  for (int i = 0; i < 1000; i++) {
+    ASSERT_TRUE(insert(i).ok());
+    ASSERT_LE(cache->GetUsage(), capacity);
+  }
+  // recently inserted entries survive
+  ASSERT_EQ(999, lookup(999));
+
+  cache->SetCapacity(capacity / 2);
+  ASSERT_LE(cache->GetUsage(), capacity / 2);
+  cache->EraseUnRefEntries();
+  ASSERT_EQ(0u, cache->GetUsage());
+  ASSERT_EQ(0, live_values);
+}
+
+TEST_P(RocksDBCacheTest, StrictCapacity)
+{
+  create(4 * 4096, true);
+  vector<rocksdb::Cache::Handle*> handles(4);
+  for (int i = 0; i < 4; i++) {
+    ASSERT_TRUE(insert(i, 4096, &handles[i]).ok());
+  }
+  rocksdb::Cache::Handle* h = nullptr;
+  ++live_values;
+  int *v = new int(4);
+  ASSERT_TRUE(cache->Insert(to_string(4), v, 4096, delete_value, &h)
+	      .IsIncomplete());
+  ASSERT_FALSE(h);
+  delete_value(to_string(4), v);
+  // without a handle the insert silently drops the value
+  ASSERT_TRUE(insert(5).ok());
+  ASSERT_EQ(-1, lookup(5));
+  for (auto h : handles) {
+    cache->Release(h);
+  }
+  ASSERT_TRUE(insert(6).ok());
+  ASSERT_EQ(6, lookup(6));
+}
+
+TEST_P(RocksDBCacheTest, AgeBins)
+{
+  create(1 << 20, false, 0.5);
+  auto c = sharded();
+  c->set_bin_count(4);
+  ASSERT_TRUE(insert(1).ok());
+  ASSERT_TRUE(insert(2, 8192, nullptr, rocksdb::Cache::Priority::HIGH).ok());
+  ASSERT_EQ(4096u, sum_bins(0, 1));
+
+  c->shift_bins();
+  ASSERT_EQ(0u, sum_bins(0, 1));
+  ASSERT_EQ(4096u, sum_bins(1, 2));
+  ASSERT_EQ(1, lookup(1));
+  ASSERT_EQ(4096u, sum_bins(0, 1));
+  ASSERT_EQ(0u, sum_bins(1, 4));
+
+  // entries older than the bin count fall off the bins
+  for (int i = 0; i < 4; i++) {
+    c->shift_bins();
+  }
+  ASSERT_EQ(0u, sum_bins(0, 4));
+
+  // the high priority entry is left to PRI0, the aged out one to LAST
+  ASSERT_EQ(4096, c->request_cache_bytes(PriorityCache::Priority::LAST, 1 << 30));
+}
+
+TEST_P(RocksDBCacheTest, ConcurrentAccess)
+{
+  create(256 * 4096, false, 0.1, 2);
+  const int keys = 2048;
+  vector<std::thread> threads;
+  std::atomic<bool> failed{false};
+  for (int t = 0; t < 16; t++) {
+    threads.emplace_back([&, t] {
+      std::mt19937 rng(t);
+      for (int i = 0; i < 20000; i++) {
+	int k = rng() % keys;
+	unsigned op = rng() % 100;
+	if (op < 80) {
+	  auto h = cache->Lookup(to_string(k));
+	  if (h) {
+	    if (*static_cast<int*>(cache->Value(h)) != k) {
+	      failed = true;
+	    }
+	    cache->Release(h);
+	  }
+	} else if (op < 95) {
+	  rocksdb::Cache::Handle* h = nullptr;
+	  insert(k, 4096, (op & 1) ? &h : nullptr,
+		 (op % 10) ? rocksdb::Cache::Priority::LOW :
+		 rocksdb::Cache::Priority::HIGH);
+	  if (h) {
+	    if (*static_cast<int*>(cache->Value(h)) != k) {
+	      failed = true;
+	    }
+	    cache->Release(h);
+	  }
+	} else {
+	  cache->Erase(to_string(k));
+	}
+      }
+    });
+  }
+  for (auto& t : threads) {
+    t.join();
+  }
+  ASSERT_FALSE(failed);
+  ASSERT_EQ(0u, cache->GetPinnedUsage());
+  cache->EraseUnRefEntries();
+  ASSERT_EQ(0u, cache->GetUsage());
+  ASSERT_EQ(0, live_values);
+}
+
+TEST_P(RocksDBCacheTest, LookupStats)
+{
+  create(4 << 20, false, 0.0, 2);
+  uint64_t hits, misses;
+  for (int i = 0; i < 100; i++) {
+    ASSERT_TRUE(insert(i).ok());
+  }
+  // nothing is counted unless asked for
+  for (int i = 0; i < 150; i++) {
+    lookup(i);
+  }
+  sharded()->get_lookup_stats(&hits, &misses);
+  ASSERT_EQ(0u, hits);
+  ASSERT_EQ(0u, misses);
+
+  // inserting does not count, every lookup does, over all shards
+  sharded()->set_count_lookups(true);
+  ASSERT_TRUE(insert(100).ok());
+  for (int i = 0; i < 150; i++) {
+    lookup(i);
+  }
+  sharded()->get_lookup_stats(&hits, &misses);
+  ASSERT_EQ(101u, hits);
+  ASSERT_EQ(49u, misses);
+
+  cache->Erase(to_string(0));
+  ASSERT_EQ(-1, lookup(0));
+  ASSERT_EQ(1, lookup(1));
+  sharded()->get_lookup_stats(&hits, &misses);
+  ASSERT_EQ(102u, hits);
+  ASSERT_EQ(50u, misses);
+
+  sharded()->set_count_lookups(false);
+  lookup(1);
+  lookup(0);
+  sharded()->get_lookup_stats(&hits, &misses);
+  ASSERT_EQ(102u, hits);
+  ASSERT_EQ(50u, misses);
+}
+
+INSTANTIATE_TEST_SUITE_P(
+  RocksDBCache,
+  RocksDBCacheTest,
+  ::testing::Values("binned_lru", "binned_clock"));
+
+TEST(BinnedClockCache, TableGrowth)
+{
+  live_values = 0;
+  // sized for 16 entries of 64k, filled with 4k ones
+  std::shared_ptr<rocksdb::Cache> cache = rocksdb_cache::NewBinnedClockCache(
+    g_ceph_context, 1 << 20, 0, false, 0.0, 1 << 16);
+  auto clock = static_cast<rocksdb_cache::BinnedClockCache*>(cache.get());
+  auto shard = static_cast<rocksdb_cache::BinnedClockCacheShard*>(
+    clock->GetShard(0));
+  ASSERT_EQ(1, shard->TEST_GetNumTables());
+  for (int i = 0; i < 256; i++) {
+    ++live_values;
+    ASSERT_TRUE(cache->Insert(to_string(i), new int(i), 4096,
+			      delete_value).ok());
+  }
+  ASSERT_LT(1, shard->TEST_GetNumTables());
+  ASSERT_EQ(256u, clock->TEST_GetOccupancy());
+  for (int i = 0; i < 256; i++) {
+    auto h = cache->Lookup(to_string(i));
+    ASSERT_TRUE(h);
+    ASSERT_EQ(i, *static_cast<int*>(cache->Value(h)));
+    cache->Release(h);
+  }
+  cache->EraseUnRefEntries();
+  ASSERT_EQ(0u, clock->TEST_GetOccupancy());
+  ASSERT_EQ(0, live_values);
+}
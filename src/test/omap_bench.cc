@@ -21,6 +21,7 @@
 #include "common/ceph_argparse.h"
 #include "test/omap_bench.h"
 
+#include <algorithm>
 #include <string>
 #include <iostream>
 #include <cassert>
@@ -190,6 +191,7 @@ void OmapBench::aio_is_complete(rados_completion_t c, void *arg) {
     data.max_latency = time;
   }
   data.total_latency += time;
+  data.latencies.push_back(time);
   ++(data.freq_map[time / INCREMENT]);
   if(data.freq_map[time/INCREMENT] > data.mode.second) {
     data.mode.first = time/INCREMENT;
@@ -273,6 +275,15 @@ void OmapBench::print_results() {
   cout << " and " <<data.mode.first * increment + increment;
   cout << "ms\nTotal latency:\t\t" << data.total_latency;
   cout << "ms"<<std::endl;
+  if (!data.latencies.empty()) {
+    std::sort(data.latencies.begin(), data.latencies.end());
+    for (double p : {50.0, 95.0, 99.0, 99.9}) {
+      size_t i = std::min(data.latencies.size() - 1,
+			  (size_t)(p / 100 * data.latencies.size()));
+      cout << "p" << p << " latency:\t\t" << data.latencies[i] << "ms"
+	   << std::endl;
+    }
+  }
   cout << std::endl;
   cout << "Histogram:" << std::endl;
   for(int i = floor(data.min_latency / increment); i <
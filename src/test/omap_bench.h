@@ -19,6 +19,7 @@
 #include "include/rados/librados.hpp"
 #include <string>
 #include <map>
+#include <vector>
 #include <cfloat>
 
 using ceph::bufferlist;
@@ -32,6 +33,7 @@ struct o_bench_data {
   int completed_ops;
   std::map<int,int> freq_map;
   std::pair<int,int> mode;
+  std::vector<double> latencies;
   o_bench_data()
   : avg_latency(0.0), min_latency(DBL_MAX), max_latency(0.0),
     total_latency(0.0),
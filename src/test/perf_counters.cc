@@ -267,6 +267,50 @@ TEST(PerfCounters, read_avg) {
   t1.join();
 }
 
+TEST(PerfCounters, Sharded) {
+  PerfCountersBuilder bld(g_ceph_context, "test_perfcounter_sharded",
+	  TEST_PERFCOUNTERS1_ELEMENT_FIRST, TEST_PERFCOUNTERS1_ELEMENT_LAST);
+  bld.set_sharded(true);
+  bld.add_u64_counter(TEST_PERFCOUNTERS1_ELEMENT_1, "element1");
+  bld.add_time(TEST_PERFCOUNTERS1_ELEMENT_2, "element2");
+  bld.add_time_avg(TEST_PERFCOUNTERS1_ELEMENT_3, "element3");
+  std::unique_ptr<PerfCounters> pf(bld.create_perf_counters());
+
+  // the increments of all threads are summed up on reads
+  std::vector<std::thread> threads;
+  for (int t = 0; t < 8; t++) {
+    threads.emplace_back([&pf] {
+      for (int i = 0; i < 10000; i++) {
+	pf->inc(TEST_PERFCOUNTERS1_ELEMENT_1);
+	pf->tinc(TEST_PERFCOUNTERS1_ELEMENT_3, std::chrono::nanoseconds(1));
+      }
+    });
+  }
+  for (auto& t : threads) {
+    t.join();
+  }
+  ASSERT_EQ(80000u, pf->get(TEST_PERFCOUNTERS1_ELEMENT_1));
+  auto [sum, count] = pf->get_tavg_ns(TEST_PERFCOUNTERS1_ELEMENT_3);
+  ASSERT_EQ(80000u, sum);
+  ASSERT_EQ(80000u, count);
+
+  // set overrides what the shards hold
+  pf->set(TEST_PERFCOUNTERS1_ELEMENT_1, 5);
+  ASSERT_EQ(5u, pf->get(TEST_PERFCOUNTERS1_ELEMENT_1));
+  pf->inc(TEST_PERFCOUNTERS1_ELEMENT_1, 2);
+  ASSERT_EQ(7u, pf->get(TEST_PERFCOUNTERS1_ELEMENT_1));
+  pf->dec(TEST_PERFCOUNTERS1_ELEMENT_1, 3);
+  ASSERT_EQ(4u, pf->get(TEST_PERFCOUNTERS1_ELEMENT_1));
+  pf->tset(TEST_PERFCOUNTERS1_ELEMENT_2, utime_t(1, 0));
+  pf->tinc(TEST_PERFCOUNTERS1_ELEMENT_2, utime_t(2, 0));
+  ASSERT_EQ(utime_t(3, 0), pf->tget(TEST_PERFCOUNTERS1_ELEMENT_2));
+
+  pf->reset();
+  ASSERT_EQ(0u, pf->get(TEST_PERFCOUNTERS1_ELEMENT_1));
+  ASSERT_EQ(std::make_pair<uint64_t, uint64_t>(0, 0),
+	    pf->get_tavg_ns(TEST_PERFCOUNTERS1_ELEMENT_3));
+}
+
 static PerfCounters* setup_test_perfcounter4(std::string name, CephContext *cct)
 {
   PerfCountersBuilder bld(cct, name,
@@ -1,5 +1,7 @@
 // -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
 // vim: ts=8 sw=2 smarttab
+#include <thread>
+
 #include "gtest/gtest.h"
 
 #include "os/memstore/PageSet.h"
@@ -281,3 +283,76 @@ TEST(PageSet, FreeHoles)
   pages.get_range(0, 8, range);
   ASSERT_EQ(0u, range.size());
 }
+
+TEST(PageSet, Arena)
+{
+  PageArena *arena = PageArena::get(4096);
+  ASSERT_EQ(arena, PageArena::get(4096));
+  ASSERT_NE(arena, PageArena::get(8192));
+
+  PageSet pages(4096, arena);
+  PageSet::page_vector range;
+  pages.alloc_range(0, 4096 * 4, range);
+  ASSERT_EQ(4u, range.size());
+  for (auto& page : range) {
+    ASSERT_EQ(0u, reinterpret_cast<uintptr_t>(page->data) % 4096);
+    std::fill(page->data, page->data + 4096, 'a');
+  }
+  range.clear();
+
+  // freed pages are reused
+  pages.get_range(4096 * 3, 4096, range);
+  char *data = range[0]->data;
+  range.clear();
+  pages.free_pages_after(4096 * 3);
+  pages.alloc_range(4096 * 8, 4096, range);
+  ASSERT_EQ(data, range[0]->data);
+}
+
+TEST(PageSet, ArenaTrim)
+{
+  // two pages per chunk
+  const size_t page_size = 1 << 20;
+  PageArena *arena = PageArena::get(page_size);
+  ASSERT_EQ(0u, arena->get_mapped_bytes());
+  {
+    PageSet pages(page_size, arena);
+    PageSet::page_vector range;
+    pages.alloc_range(0, page_size * 8, range);
+    ASSERT_EQ(8 * page_size, arena->get_mapped_bytes());
+    // pages freed by another thread go back to their chunks
+    std::thread([&] {
+      range.clear();
+      pages.free_pages_after(0);
+    }).join();
+    ASSERT_TRUE(pages.empty());
+  }
+  // all but one spare chunk are unmapped
+  ASSERT_EQ(2 * page_size, arena->get_mapped_bytes());
+}
+
+TEST(PageSet, SharePage)
+{
+  PageSet pages(4);
+  PageSet::page_vector range;
+  pages.alloc_range(0, 8, range);
+  range.clear();
+
+  ceph::buffer::ptr bp = ceph::buffer::copy("abcd", 4);
+  pages.share_page(4, ceph::buffer::ptr(bp));
+  pages.get_range(0, 8, range);
+  ASSERT_EQ(2u, range.size());
+  ASSERT_FALSE(range[0]->is_shared());
+  ASSERT_TRUE(range[1]->is_shared());
+  ASSERT_EQ(bp.c_str(), range[1]->data);
+  range.clear();
+
+  // writing to a shared page leaves the buffer alone
+  pages.alloc_range(5, 1, range);
+  ASSERT_EQ(1u, range.size());
+  ASSERT_FALSE(range[0]->is_shared());
+  ASSERT_NE(bp.c_str(), range[0]->data);
+  ASSERT_EQ(0, memcmp("abcd", range[0]->data, 4));
+  range[0]->data[1] = 'x';
+  ASSERT_EQ(0, memcmp("abcd", bp.c_str(), 4));
+}